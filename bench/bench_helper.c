@@ -0,0 +1,382 @@
+#include "bench_helper.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Every benchmark is calibrated by doubling its iterations until one run
+ * takes at least the minimum run time, and it is then run RUNS times. We
+ * report both the fastest run, which is the one least disturbed by the rest
+ * of the machine, and the median. The minimum run time can be raised with
+ * MMDB_BENCH_MIN_TIME, in seconds, for steadier numbers. */
+
+#define RUNS (5)
+#define DEFAULT_MIN_TIME (0.01)
+#define MAX_ITERATIONS ((size_t)1 << 40)
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL double now(void);
+LOCAL int compare_doubles(const void *a, const void *b);
+LOCAL void write_big_endian(bench_buffer_s *buffer, uint64_t value,
+                            int bytes);
+LOCAL void write_record_pair(bench_buffer_s *buffer, int record_size,
+                             uint32_t left, uint32_t right);
+LOCAL void write_metadata(bench_buffer_s *buffer, int record_size,
+                          uint32_t node_count);
+LOCAL void write_key_uint(bench_buffer_s *buffer, const char *key, int type,
+                          uint64_t value);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+void bench_run(const char *benchmark, const char *name, bench_fn fn,
+               void *ctx)
+{
+    static volatile uint64_t sink;
+
+    double min_time = DEFAULT_MIN_TIME;
+    const char *env = getenv("MMDB_BENCH_MIN_TIME");
+    if (NULL != env && atof(env) > 0) {
+        min_time = atof(env);
+    }
+
+    size_t iterations = 1;
+    for (;; ) {
+        double start = now();
+        sink += fn(ctx, iterations);
+        if (now() - start >= min_time || iterations >= MAX_ITERATIONS) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    double ns_per_op[RUNS];
+    for (int run = 0; run < RUNS; run++) {
+        double start = now();
+        sink += fn(ctx, iterations);
+        ns_per_op[run] = (now() - start) / iterations * 1e9;
+    }
+    qsort(ns_per_op, RUNS, sizeof(double), compare_doubles);
+
+    fprintf(stdout, "{\"benchmark\":\"%s\",\"case\":\"%s\","
+            "\"version\":\"%s\",\"ns_per_op\":%.2f,"
+            "\"median_ns_per_op\":%.2f,\"iterations\":%zu,\"runs\":%d}\n",
+            benchmark, name, VERSION, ns_per_op[0],
+            ns_per_op[RUNS / 2], iterations, RUNS);
+    fflush(stdout);
+}
+
+LOCAL double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+LOCAL int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* This returns the path to a file in the test data directory, or NULL if it
+ * isn't there, in which case the benchmarks that need it are skipped */
+const char *bench_fixture(const char *data_dir, const char *file)
+{
+    size_t size = strlen(data_dir) + strlen(file) + 2;
+    char *path = malloc(size);
+    if (NULL == path) {
+        return NULL;
+    }
+    snprintf(path, size, "%s/%s", data_dir, file);
+    if (0 != access(path, R_OK)) {
+        fprintf(stderr, "Skipping the benchmarks for %s, which can't be read\n",
+                path);
+        free(path);
+        return NULL;
+    }
+    return path;
+}
+
+void bench_append(bench_buffer_s *buffer, const void *data, size_t size)
+{
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+        while (buffer->size + size > capacity) {
+            capacity *= 2;
+        }
+        buffer->data = realloc(buffer->data, capacity);
+        if (NULL == buffer->data) {
+            fprintf(stderr, "Can't allocate memory\n");
+            exit(2);
+        }
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+LOCAL void write_big_endian(bench_buffer_s *buffer, uint64_t value,
+                            int bytes)
+{
+    uint8_t data[8];
+    for (int i = bytes - 1; i >= 0; i--) {
+        data[i] = value & 0xff;
+        value >>= 8;
+    }
+    bench_append(buffer, data, bytes);
+}
+
+/* This writes a control byte, the extended type byte for the types above 7
+ * and then however many bytes the size needs */
+void bench_write_control(bench_buffer_s *buffer, int type, uint32_t size)
+{
+    uint8_t control = (type > 7 ? 0 : type) << 5;
+    int size_bytes = 0;
+    if (size < 29) {
+        control |= size;
+    } else if (size < 285) {
+        control |= 29;
+        size -= 29;
+        size_bytes = 1;
+    } else if (size < 65821) {
+        control |= 30;
+        size -= 285;
+        size_bytes = 2;
+    } else {
+        control |= 31;
+        size -= 65821;
+        size_bytes = 3;
+    }
+
+    bench_append(buffer, &control, 1);
+    if (type > 7) {
+        uint8_t extended = type - 7;
+        bench_append(buffer, &extended, 1);
+    }
+    write_big_endian(buffer, size, size_bytes);
+}
+
+/* This works for all of the unsigned types and for non-negative int32s */
+void bench_write_uint(bench_buffer_s *buffer, int type, uint64_t value)
+{
+    int bytes = 0;
+    for (uint64_t v = value; v > 0; v >>= 8) {
+        bytes++;
+    }
+    bench_write_control(buffer, type, bytes);
+    write_big_endian(buffer, value, bytes);
+}
+
+void bench_write_string(bench_buffer_s *buffer, const char *string)
+{
+    size_t length = strlen(string);
+    bench_write_control(buffer, MMDB_DATA_TYPE_UTF8_STRING, length);
+    bench_append(buffer, string, length);
+}
+
+void bench_write_pointer(bench_buffer_s *buffer, uint32_t pointer)
+{
+    uint8_t control = MMDB_DATA_TYPE_POINTER << 5;
+    if (pointer < 2048) {
+        control |= pointer >> 8;
+        bench_append(buffer, &control, 1);
+        write_big_endian(buffer, pointer, 1);
+    } else if (pointer < 526336) {
+        pointer -= 2048;
+        control |= 1 << 3 | pointer >> 16;
+        bench_append(buffer, &control, 1);
+        write_big_endian(buffer, pointer, 2);
+    } else if (pointer < 134744064) {
+        pointer -= 526336;
+        control |= 2 << 3 | pointer >> 24;
+        bench_append(buffer, &control, 1);
+        write_big_endian(buffer, pointer, 3);
+    } else {
+        control |= 3 << 3;
+        bench_append(buffer, &control, 1);
+        write_big_endian(buffer, pointer, 4);
+    }
+}
+
+/* This is enough of an MMDB_s to decode a data section with, the same as
+ * the decoder tests use */
+MMDB_s bench_fake_mmdb(bench_buffer_s *data_section)
+{
+    MMDB_s mmdb;
+    memset(&mmdb, 0, sizeof(mmdb));
+    mmdb.data_section = data_section->data;
+    mmdb.data_section_size = data_section->size;
+    return mmdb;
+}
+
+/* This writes an IPv4 database whose search tree is complete to the given
+ * depth, so every lookup reads exactly depth nodes. The records in the last
+ * row of nodes point to record_count small maps in turn. It returns the path
+ * of a temporary file, which the caller should unlink and free. */
+char *bench_make_database(int record_size, int depth, int record_count)
+{
+    bench_buffer_s data = { 0 };
+    uint32_t *offsets = malloc(record_count * sizeof(uint32_t));
+    if (NULL == offsets) {
+        fprintf(stderr, "Can't allocate memory\n");
+        exit(2);
+    }
+    for (int i = 0; i < record_count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "record %d", i);
+        offsets[i] = data.size;
+        bench_write_control(&data, MMDB_DATA_TYPE_MAP, 2);
+        bench_write_string(&data, "id");
+        bench_write_uint(&data, MMDB_DATA_TYPE_UINT32, i);
+        bench_write_string(&data, "name");
+        bench_write_string(&data, name);
+    }
+
+    uint32_t node_count = ((uint32_t)1 << depth) - 1;
+    uint32_t first_leaf = ((uint32_t)1 << (depth - 1)) - 1;
+    bench_buffer_s database = { 0 };
+    for (uint32_t node = 0; node < node_count; node++) {
+        if (node < first_leaf) {
+            write_record_pair(&database, record_size, 2 * node + 1,
+                              2 * node + 2);
+        } else {
+            uint32_t record = 2 * (node - first_leaf);
+            write_record_pair(
+                &database, record_size,
+                node_count + 16 + offsets[record % record_count],
+                node_count + 16 + offsets[(record + 1) % record_count]);
+        }
+    }
+    static const uint8_t separator[16] = { 0 };
+    bench_append(&database, separator, sizeof(separator));
+    bench_append(&database, data.data, data.size);
+    write_metadata(&database, record_size, node_count);
+    free(data.data);
+    free(offsets);
+
+    const char *tmpdir = getenv("TMPDIR");
+    size_t size = strlen(tmpdir ? tmpdir : "/tmp") + 32;
+    char *path = malloc(size);
+    snprintf(path, size, "%s/mmdb-bench-XXXXXX", tmpdir ? tmpdir : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0 || (ssize_t)database.size
+        != write(fd, database.data, database.size)) {
+        fprintf(stderr, "Can't write %s\n", path);
+        exit(2);
+    }
+    close(fd);
+    free(database.data);
+    return path;
+}
+
+LOCAL void write_record_pair(bench_buffer_s *buffer, int record_size,
+                             uint32_t left, uint32_t right)
+{
+    if (24 == record_size) {
+        write_big_endian(buffer, left, 3);
+        write_big_endian(buffer, right, 3);
+    } else if (28 == record_size) {
+        write_big_endian(buffer, left & 0xffffff, 3);
+        write_big_endian(buffer, (left >> 24) << 4 | right >> 24, 1);
+        write_big_endian(buffer, right & 0xffffff, 3);
+    } else {
+        write_big_endian(buffer, left, 4);
+        write_big_endian(buffer, right, 4);
+    }
+}
+
+LOCAL void write_metadata(bench_buffer_s *buffer, int record_size,
+                          uint32_t node_count)
+{
+    bench_append(buffer, "\xab\xcd\xefMaxMind.com", 14);
+    bench_write_control(buffer, MMDB_DATA_TYPE_MAP, 9);
+    write_key_uint(buffer, "binary_format_major_version",
+                   MMDB_DATA_TYPE_UINT16, 2);
+    write_key_uint(buffer, "binary_format_minor_version",
+                   MMDB_DATA_TYPE_UINT16, 0);
+    write_key_uint(buffer, "build_epoch", MMDB_DATA_TYPE_UINT64,
+                   (uint64_t)time(NULL));
+    bench_write_string(buffer, "database_type");
+    bench_write_string(buffer, "Bench-Synthetic");
+    bench_write_string(buffer, "description");
+    bench_write_control(buffer, MMDB_DATA_TYPE_MAP, 1);
+    bench_write_string(buffer, "en");
+    bench_write_string(buffer, "A generated database for benchmarks");
+    write_key_uint(buffer, "ip_version", MMDB_DATA_TYPE_UINT16, 4);
+    bench_write_string(buffer, "languages");
+    bench_write_control(buffer, MMDB_DATA_TYPE_ARRAY, 1);
+    bench_write_string(buffer, "en");
+    write_key_uint(buffer, "node_count", MMDB_DATA_TYPE_UINT32, node_count);
+    write_key_uint(buffer, "record_size", MMDB_DATA_TYPE_UINT16, record_size);
+}
+
+LOCAL void write_key_uint(bench_buffer_s *buffer, const char *key, int type,
+                          uint64_t value)
+{
+    bench_write_string(buffer, key);
+    bench_write_uint(buffer, type, value);
+}
+
+void bench_open(const char *path, MMDB_s *mmdb)
+{
+    int status = MMDB_open(path, MMDB_MODE_MMAP, mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "Can't open %s - %s\n", path, MMDB_strerror(status));
+        exit(2);
+    }
+}
+
+/* This is used to fold the results of each operation into a checksum */
+uint64_t bench_mix(uint64_t hash, uint64_t value)
+{
+    hash ^= value;
+    hash *= 0x9e3779b97f4a7c15ULL;
+    return hash ^ (hash >> 29);
+}
+
+/* This fills in up to max entries with the distinct records in the database,
+ * in the order of their first network, and returns how many it found */
+int bench_collect_entries(MMDB_s *mmdb, MMDB_entry_s *entries, int max)
+{
+    MMDB_network_iterator_s iterator;
+    int status = MMDB_network_iterator_init(mmdb, 0, &iterator);
+    MMDB_network_s network;
+    bool found;
+    int count = 0;
+    while (MMDB_SUCCESS == status && count < max
+           && MMDB_SUCCESS == (status = MMDB_network_iterator_next(
+                                   &iterator, &network, &found))
+           && found) {
+        if (MMDB_RECORD_TYPE_DATA != network.record_type) {
+            continue;
+        }
+        int i = 0;
+        for (; i < count && entries[i].offset != network.entry.offset; i++) {
+        }
+        if (i == count) {
+            entries[count++] = network.entry;
+        }
+    }
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "Can't iterate over the networks - %s\n",
+                MMDB_strerror(status));
+        exit(2);
+    }
+    if (0 == count) {
+        fprintf(stderr, "No records found\n");
+        exit(2);
+    }
+    return count;
+}
+
+void bench_ipv4_sockaddr(uint32_t ip, struct sockaddr_in *sin)
+{
+    memset(sin, 0, sizeof(struct sockaddr_in));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(ip);
+}
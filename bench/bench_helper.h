@@ -0,0 +1,45 @@
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdint.h>
+#include "maxminddb.h"
+
+#ifndef MMDB_BENCH_HELPER_H
+#define MMDB_BENCH_HELPER_H (1)
+
+/* A growable byte buffer for building data sections and databases */
+typedef struct bench_buffer_s {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} bench_buffer_s;
+
+/* This runs the given number of operations and returns something computed
+ * from their results, so that the compiler can't drop any of the work */
+typedef uint64_t (*bench_fn)(void *ctx, size_t iterations);
+
+    /* *INDENT-OFF* */
+    /* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+    extern void bench_run(const char *benchmark, const char *name, bench_fn fn,
+                          void *ctx);
+    extern const char *bench_fixture(const char *data_dir, const char *file);
+    extern void bench_append(bench_buffer_s *buffer, const void *data,
+                             size_t size);
+    extern void bench_write_control(bench_buffer_s *buffer, int type,
+                                    uint32_t size);
+    extern void bench_write_uint(bench_buffer_s *buffer, int type,
+                                 uint64_t value);
+    extern void bench_write_string(bench_buffer_s *buffer, const char *string);
+    extern void bench_write_pointer(bench_buffer_s *buffer, uint32_t pointer);
+    extern MMDB_s bench_fake_mmdb(bench_buffer_s *data_section);
+    extern char *bench_make_database(int record_size, int depth,
+                                     int record_count);
+    extern void bench_open(const char *path, MMDB_s *mmdb);
+    extern uint64_t bench_mix(uint64_t hash, uint64_t value);
+    extern int bench_collect_entries(MMDB_s *mmdb, MMDB_entry_s *entries,
+                                     int max);
+    extern void bench_ipv4_sockaddr(uint32_t ip, struct sockaddr_in *sin);
+    /* --prototypes end - don't remove this comment-- */
+    /* *INDENT-ON* */
+
+#endif
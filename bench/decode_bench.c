@@ -0,0 +1,168 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This measures decoding whole records from the City test database, once by
+ * walking each one with MMDB_walk_entry() and once with
+ * MMDB_get_entry_data_list(). It then calls MMDB_verify() and does the same
+ * again with the unchecked decoder. Each operation decodes one record, and
+ * the records are taken in turn from every distinct record in the database.
+ *
+ * The checksum covers the type, offset and value of every decoded entry, so
+ * that the compiler can't skip any of the decoding. */
+
+#define MAX_ENTRIES (1024)
+
+typedef struct decode_ctx_s {
+    MMDB_entry_s *entries;
+    int count;
+} decode_ctx_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void run_benchmarks(decode_ctx_s *decode, const char *suffix);
+LOCAL uint64_t entry_data_checksum(uint64_t hash,
+                                   const MMDB_entry_data_s *entry_data);
+LOCAL int checksum_scalar(void *ctx, const MMDB_entry_data_s *entry_data);
+LOCAL int checksum_key(void *ctx, const char *key, uint32_t key_size);
+LOCAL uint64_t walk(void *ctx, size_t iterations);
+LOCAL uint64_t entry_data_list(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    const char *data_dir = argc > 1 ? argv[1] : "../t/maxmind-db/test-data";
+
+    const char *path = bench_fixture(data_dir, "GeoIP2-City-Test.mmdb");
+    if (NULL == path) {
+        exit(0);
+    }
+    MMDB_s mmdb;
+    bench_open(path, &mmdb);
+    free((void *)path);
+
+    static MMDB_entry_s entries[MAX_ENTRIES];
+    decode_ctx_s decode = {
+        entries, bench_collect_entries(&mmdb, entries, MAX_ENTRIES)
+    };
+    run_benchmarks(&decode, "");
+
+    /* The same records can then be decoded without any bounds checks */
+    int status = MMDB_verify(&mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "MMDB_verify failed - %s\n", MMDB_strerror(status));
+        exit(2);
+    }
+    run_benchmarks(&decode, "_verified");
+
+    MMDB_close(&mmdb);
+    exit(0);
+}
+
+LOCAL void run_benchmarks(decode_ctx_s *decode, const char *suffix)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "city_records%s", suffix);
+    bench_run("MMDB_walk_entry", name, walk, decode);
+    bench_run("MMDB_get_entry_data_list", name, entry_data_list, decode);
+}
+
+LOCAL uint64_t entry_data_checksum(uint64_t hash,
+                                   const MMDB_entry_data_s *entry_data)
+{
+    hash = bench_mix(hash, entry_data->type);
+    hash = bench_mix(hash, entry_data->offset);
+
+    switch (entry_data->type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+    case MMDB_DATA_TYPE_BYTES:
+    case MMDB_DATA_TYPE_MAP:
+    case MMDB_DATA_TYPE_ARRAY:
+        hash = bench_mix(hash, entry_data->data_size);
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+    case MMDB_DATA_TYPE_UINT64:
+        hash = bench_mix(hash, entry_data->uint64);
+        break;
+    case MMDB_DATA_TYPE_UINT16:
+        hash = bench_mix(hash, entry_data->uint16);
+        break;
+    case MMDB_DATA_TYPE_UINT32:
+    case MMDB_DATA_TYPE_INT32:
+    case MMDB_DATA_TYPE_FLOAT:
+        hash = bench_mix(hash, entry_data->uint32);
+        break;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        hash = bench_mix(hash, entry_data->boolean);
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+        for (int i = 0; i < 16; i++) {
+            hash = bench_mix(hash,
+                             ((const uint8_t *)&entry_data->uint128)[i]);
+        }
+        break;
+    }
+
+    return hash;
+}
+
+LOCAL int checksum_scalar(void *ctx, const MMDB_entry_data_s *entry_data)
+{
+    uint64_t *checksum = ctx;
+    *checksum = entry_data_checksum(*checksum, entry_data);
+    return MMDB_VISIT_CONTINUE;
+}
+
+LOCAL int checksum_key(void *ctx, const char *key, uint32_t key_size)
+{
+    (void)key;
+    uint64_t *checksum = ctx;
+    *checksum = bench_mix(*checksum, key_size);
+    return MMDB_VISIT_CONTINUE;
+}
+
+LOCAL uint64_t walk(void *ctx, size_t iterations)
+{
+    decode_ctx_s *decode = ctx;
+    MMDB_visitor_s visitor = {
+        .key    = checksum_key,
+        .scalar = checksum_scalar,
+    };
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        int status = MMDB_walk_entry(&decode->entries[i % decode->count],
+                                     &visitor, &checksum);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "MMDB_walk_entry failed - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+    }
+    return checksum;
+}
+
+LOCAL uint64_t entry_data_list(void *ctx, size_t iterations)
+{
+    decode_ctx_s *decode = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_entry_data_list_s *entry_data_list, *list;
+        int status = MMDB_get_entry_data_list(
+            &decode->entries[i % decode->count], &entry_data_list);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "MMDB_get_entry_data_list failed - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+        for (list = entry_data_list; list; list = list->next) {
+            checksum = entry_data_checksum(checksum, &list->entry_data);
+        }
+        MMDB_free_entry_data_list(entry_data_list);
+    }
+    return checksum;
+}
@@ -0,0 +1,139 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This measures decoding a single value of each type. The values are in a
+ * hand built data section and are decoded with MMDB_aget_value() and an
+ * empty path, which decodes the value at the entry's offset and nothing
+ * else. The pointer case includes decoding the string it points to. */
+
+typedef struct decode_case_s {
+    const char *name;
+    uint32_t offset;
+} decode_case_s;
+
+typedef struct decode_ctx_s {
+    MMDB_s *mmdb;
+    uint32_t offset;
+} decode_ctx_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL int add_case(decode_case_s *cases, int count, const char *name,
+                   uint32_t offset);
+LOCAL void write_big_endian_bytes(bench_buffer_s *buffer, uint64_t bits,
+                                  int bytes);
+LOCAL uint64_t decode_one(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(void)
+{
+    bench_buffer_s data = { 0 };
+    decode_case_s cases[16];
+    int count = 0;
+
+    count = add_case(cases, count, "utf8_string", data.size);
+    bench_write_string(&data, "Saint-Jean-sur-Richelieu");
+
+    count = add_case(cases, count, "pointer", data.size);
+    bench_write_pointer(&data, cases[0].offset);
+
+    count = add_case(cases, count, "double", data.size);
+    double d = 45.3099;
+    uint64_t double_bits;
+    memcpy(&double_bits, &d, sizeof(double_bits));
+    bench_write_control(&data, MMDB_DATA_TYPE_DOUBLE, 8);
+    write_big_endian_bytes(&data, double_bits, 8);
+
+    count = add_case(cases, count, "bytes", data.size);
+    bench_write_control(&data, MMDB_DATA_TYPE_BYTES, 16);
+    bench_append(&data, "\x00\x01\x02\x03\x04\x05\x06\x07"
+                 "\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f", 16);
+
+    count = add_case(cases, count, "uint16", data.size);
+    bench_write_uint(&data, MMDB_DATA_TYPE_UINT16, 443);
+
+    count = add_case(cases, count, "uint32", data.size);
+    bench_write_uint(&data, MMDB_DATA_TYPE_UINT32, 6077243);
+
+    count = add_case(cases, count, "map", data.size);
+    bench_write_control(&data, MMDB_DATA_TYPE_MAP, 1);
+    bench_write_string(&data, "en");
+    bench_write_string(&data, "Canada");
+
+    count = add_case(cases, count, "int32", data.size);
+    bench_write_uint(&data, MMDB_DATA_TYPE_INT32, 100000);
+
+    count = add_case(cases, count, "uint64", data.size);
+    bench_write_uint(&data, MMDB_DATA_TYPE_UINT64, 1ULL << 40);
+
+    count = add_case(cases, count, "uint128", data.size);
+    bench_write_control(&data, MMDB_DATA_TYPE_UINT128, 16);
+    write_big_endian_bytes(&data, 1ULL << 63, 8);
+    write_big_endian_bytes(&data, 1, 8);
+
+    count = add_case(cases, count, "array", data.size);
+    bench_write_control(&data, MMDB_DATA_TYPE_ARRAY, 1);
+    bench_write_string(&data, "en");
+
+    count = add_case(cases, count, "boolean", data.size);
+    bench_write_control(&data, MMDB_DATA_TYPE_BOOLEAN, 1);
+
+    count = add_case(cases, count, "float", data.size);
+    float f = 1.1f;
+    uint32_t float_bits;
+    memcpy(&float_bits, &f, sizeof(float_bits));
+    bench_write_control(&data, MMDB_DATA_TYPE_FLOAT, 4);
+    write_big_endian_bytes(&data, float_bits, 4);
+
+    MMDB_s mmdb = bench_fake_mmdb(&data);
+    for (int i = 0; i < count; i++) {
+        decode_ctx_s ctx = { .mmdb = &mmdb, .offset = cases[i].offset };
+        bench_run("decode_one", cases[i].name, decode_one, &ctx);
+    }
+
+    free(data.data);
+    exit(0);
+}
+
+LOCAL int add_case(decode_case_s *cases, int count, const char *name,
+                   uint32_t offset)
+{
+    cases[count].name = name;
+    cases[count].offset = offset;
+    return count + 1;
+}
+
+LOCAL void write_big_endian_bytes(bench_buffer_s *buffer, uint64_t bits,
+                                  int bytes)
+{
+    uint8_t be[8];
+    for (int i = bytes - 1; i >= 0; i--) {
+        be[i] = bits & 0xff;
+        bits >>= 8;
+    }
+    bench_append(buffer, be, bytes);
+}
+
+LOCAL uint64_t decode_one(void *ctx, size_t iterations)
+{
+    decode_ctx_s *decode = ctx;
+    MMDB_entry_s entry = { .mmdb = decode->mmdb, .offset = decode->offset };
+    static const char *const path[] = { NULL };
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_entry_data_s entry_data;
+        if (MMDB_SUCCESS != MMDB_aget_value(&entry, &entry_data, path)) {
+            fprintf(stderr, "Can't decode the value at %u\n", decode->offset);
+            exit(3);
+        }
+        checksum += entry_data.type + entry_data.data_size
+                    + entry_data.offset_to_next;
+    }
+    return checksum;
+}
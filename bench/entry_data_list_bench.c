@@ -0,0 +1,89 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This measures MMDB_get_entry_data_list() and MMDB_free_entry_data_list()
+ * on a small generated record and on records from the test databases: a
+ * typical city record and the decoder test record, which has a value of
+ * every type. */
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void bench_fixture_record(const char *data_dir, const char *file,
+                                const char *ip, const char *name);
+LOCAL uint64_t get_entry_data_list(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    const char *data_dir = argc > 1 ? argv[1] : "../t/maxmind-db/test-data";
+
+    bench_buffer_s data = { 0 };
+    bench_write_control(&data, MMDB_DATA_TYPE_MAP, 2);
+    bench_write_string(&data, "id");
+    bench_write_uint(&data, MMDB_DATA_TYPE_UINT32, 1);
+    bench_write_string(&data, "name");
+    bench_write_string(&data, "record 1");
+    MMDB_s mmdb = bench_fake_mmdb(&data);
+    MMDB_entry_s entry = { .mmdb = &mmdb, .offset = 0 };
+    bench_run("get_entry_data_list", "small_map", get_entry_data_list, &entry);
+    free(data.data);
+
+    bench_fixture_record(data_dir, "GeoIP2-City-Test.mmdb", "81.2.69.160",
+                         "city");
+    bench_fixture_record(data_dir, "MaxMind-DB-test-decoder.mmdb", "1.1.1.1",
+                         "all_types");
+
+    exit(0);
+}
+
+LOCAL void bench_fixture_record(const char *data_dir, const char *file,
+                                const char *ip, const char *name)
+{
+    const char *path = bench_fixture(data_dir, file);
+    if (NULL == path) {
+        return;
+    }
+
+    MMDB_s mmdb;
+    int status = MMDB_open(path, MMDB_MODE_MMAP, &mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "Can't open %s - %s\n", path, MMDB_strerror(status));
+        exit(2);
+    }
+
+    int gai_error, mmdb_error;
+    MMDB_lookup_result_s result =
+        MMDB_lookup_string(&mmdb, ip, &gai_error, &mmdb_error);
+    if (0 != gai_error || MMDB_SUCCESS != mmdb_error || !result.found_entry) {
+        fprintf(stderr, "Can't find %s in %s\n", ip, path);
+        exit(3);
+    }
+    bench_run("get_entry_data_list", name, get_entry_data_list,
+              &result.entry);
+
+    MMDB_close(&mmdb);
+    free((void *)path);
+}
+
+LOCAL uint64_t get_entry_data_list(void *ctx, size_t iterations)
+{
+    MMDB_entry_s *entry = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_entry_data_list_s *entry_data_list = NULL;
+        int status = MMDB_get_entry_data_list(entry, &entry_data_list);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "Can't decode the record - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+        checksum += entry_data_list->entry_data.data_size;
+        MMDB_free_entry_data_list(entry_data_list);
+    }
+    return checksum;
+}
@@ -0,0 +1,97 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This compares MMDB_entry_to_json() to the usual way of turning a record
+ * into text, which is to build an entry data list and dump it. Each
+ * operation converts one record, and the records are taken in turn from
+ * every distinct record in the City test database. */
+
+#define MAX_ENTRIES (1024)
+
+typedef struct json_ctx_s {
+    MMDB_entry_s *entries;
+    int count;
+    FILE *devnull;
+} json_ctx_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL uint64_t dump(void *ctx, size_t iterations);
+LOCAL uint64_t to_json(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    const char *data_dir = argc > 1 ? argv[1] : "../t/maxmind-db/test-data";
+
+    const char *path = bench_fixture(data_dir, "GeoIP2-City-Test.mmdb");
+    if (NULL == path) {
+        exit(0);
+    }
+    MMDB_s mmdb;
+    bench_open(path, &mmdb);
+    free((void *)path);
+
+    static MMDB_entry_s entries[MAX_ENTRIES];
+    json_ctx_s json = {
+        entries, bench_collect_entries(&mmdb, entries, MAX_ENTRIES), NULL
+    };
+    json.devnull = fopen("/dev/null", "w");
+    if (NULL == json.devnull) {
+        fprintf(stderr, "Can't open /dev/null\n");
+        exit(2);
+    }
+
+    bench_run("MMDB_dump_entry_data_list", "city_records", dump, &json);
+    bench_run("MMDB_entry_to_json", "city_records", to_json, &json);
+
+    fclose(json.devnull);
+    MMDB_close(&mmdb);
+    exit(0);
+}
+
+/* This includes building and freeing the entry data list */
+LOCAL uint64_t dump(void *ctx, size_t iterations)
+{
+    json_ctx_s *json = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_entry_data_list_s *entry_data_list;
+        int status = MMDB_get_entry_data_list(
+            &json->entries[i % json->count], &entry_data_list);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "MMDB_get_entry_data_list failed - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+        MMDB_dump_entry_data_list(json->devnull, entry_data_list, 0);
+        checksum += entry_data_list->entry_data.data_size;
+        MMDB_free_entry_data_list(entry_data_list);
+    }
+    return checksum;
+}
+
+LOCAL uint64_t to_json(void *ctx, size_t iterations)
+{
+    static char buffer[65536];
+    json_ctx_s *json = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        size_t needed;
+        int status = MMDB_entry_to_json(&json->entries[i % json->count],
+                                        buffer, sizeof(buffer), &needed);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "MMDB_entry_to_json failed - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+        checksum += needed;
+    }
+    return checksum;
+}
@@ -0,0 +1,118 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* This measures looking up a sorted list of random IPv4 addresses, once with
+ * MMDB_join_sockaddr() and once with MMDB_lookup_sockaddr(). The database is
+ * a generated one with 2^20 networks and the list has 2^22 addresses, so
+ * there are several addresses in most networks. Each operation looks up the
+ * next address in the list, and a join starts again from the root once the
+ * list wraps around.
+ *
+ * Both find the same records, so they must return the same checksum. This
+ * is checked once before they are timed. */
+
+#define ADDRESSES ((size_t)1 << 22)
+
+typedef struct join_ctx_s {
+    MMDB_s *mmdb;
+    uint32_t *ips;
+} join_ctx_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL int compare_ips(const void *a, const void *b);
+LOCAL uint64_t join_lookups(void *ctx, size_t iterations);
+LOCAL uint64_t lookups(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(void)
+{
+    char *path = bench_make_database(28, 20, 256);
+    MMDB_s mmdb;
+    bench_open(path, &mmdb);
+
+    join_ctx_s join = { &mmdb, malloc(ADDRESSES * sizeof(uint32_t)) };
+    if (NULL == join.ips) {
+        fprintf(stderr, "Can't allocate memory\n");
+        exit(2);
+    }
+    uint64_t state = 1;
+    for (size_t i = 0; i < ADDRESSES; i++) {
+        state = bench_mix(state, i);
+        join.ips[i] = (uint32_t)(state >> 32);
+    }
+    qsort(join.ips, ADDRESSES, sizeof(uint32_t), compare_ips);
+
+    if (join_lookups(&join, ADDRESSES) != lookups(&join, ADDRESSES)) {
+        fprintf(stderr, "MMDB_join_sockaddr found different records\n");
+        exit(3);
+    }
+
+    bench_run("MMDB_join_sockaddr", "sorted_ipv4", join_lookups, &join);
+    bench_run("MMDB_lookup_sockaddr", "sorted_ipv4", lookups, &join);
+
+    free(join.ips);
+    MMDB_close(&mmdb);
+    unlink(path);
+    free(path);
+    exit(0);
+}
+
+LOCAL int compare_ips(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+LOCAL uint64_t join_lookups(void *ctx, size_t iterations)
+{
+    join_ctx_s *join_ctx = ctx;
+    uint64_t checksum = 0;
+
+    MMDB_join_s join;
+    int status = MMDB_join_init(join_ctx->mmdb, &join);
+    for (size_t i = 0; MMDB_SUCCESS == status && i < iterations; i++) {
+        struct sockaddr_in sin;
+        bench_ipv4_sockaddr(join_ctx->ips[i % ADDRESSES], &sin);
+        MMDB_lookup_result_s result =
+            MMDB_join_sockaddr(&join, (struct sockaddr *)&sin, &status);
+        if (result.found_entry) {
+            checksum = bench_mix(checksum, result.entry.offset);
+        }
+    }
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "MMDB_join_sockaddr failed - %s\n",
+                MMDB_strerror(status));
+        exit(3);
+    }
+    return checksum;
+}
+
+LOCAL uint64_t lookups(void *ctx, size_t iterations)
+{
+    join_ctx_s *join = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        struct sockaddr_in sin;
+        bench_ipv4_sockaddr(join->ips[i % ADDRESSES], &sin);
+        int mmdb_error;
+        MMDB_lookup_result_s result =
+            MMDB_lookup_sockaddr(join->mmdb, (struct sockaddr *)&sin,
+                                 &mmdb_error);
+        if (MMDB_SUCCESS != mmdb_error) {
+            fprintf(stderr, "MMDB_lookup_sockaddr failed - %s\n",
+                    MMDB_strerror(mmdb_error));
+            exit(3);
+        }
+        if (result.found_entry) {
+            checksum = bench_mix(checksum, result.entry.offset);
+        }
+    }
+    return checksum;
+}
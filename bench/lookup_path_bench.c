@@ -0,0 +1,134 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This measures looking up one key with MMDB_aget_value() in hand built
+ * maps. The lookup_path_in_map cases look for the first key, the last key
+ * and a key that isn't there in a map of 16 keys with small values, so they
+ * mostly compare keys. The skip_map_or_array cases look for the key after a
+ * large value, so they mostly skip over that value. */
+
+#define MAP_KEYS (16)
+
+typedef struct lookup_ctx_s {
+    MMDB_s *mmdb;
+    uint32_t offset;
+    const char *key;
+} lookup_ctx_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void write_string_map(bench_buffer_s *data, int keys);
+LOCAL void write_uint32_array(bench_buffer_s *data, int count);
+LOCAL void write_nested_map(bench_buffer_s *data, int depth);
+LOCAL uint64_t lookup_key(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(void)
+{
+    bench_buffer_s data = { 0 };
+
+    uint32_t map_offset = data.size;
+    bench_write_control(&data, MMDB_DATA_TYPE_MAP, MAP_KEYS);
+    for (int i = 0; i < MAP_KEYS; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%02d", i);
+        bench_write_string(&data, key);
+        bench_write_uint(&data, MMDB_DATA_TYPE_UINT32, i);
+    }
+
+    /* Each of these is a map whose first value is skipped to find "last" */
+    uint32_t skip_offsets[3];
+    const char *skip_names[3] = { "map", "array", "nested" };
+    for (int i = 0; i < 3; i++) {
+        skip_offsets[i] = data.size;
+        bench_write_control(&data, MMDB_DATA_TYPE_MAP, 2);
+        bench_write_string(&data, "skipped");
+        if (0 == i) {
+            write_string_map(&data, MAP_KEYS);
+        } else if (1 == i) {
+            write_uint32_array(&data, 64);
+        } else {
+            write_nested_map(&data, 3);
+        }
+        bench_write_string(&data, "last");
+        bench_write_uint(&data, MMDB_DATA_TYPE_UINT32, 1);
+    }
+
+    MMDB_s mmdb = bench_fake_mmdb(&data);
+
+    lookup_ctx_s first = { &mmdb, map_offset, "key00" };
+    bench_run("lookup_path_in_map", "hit_first", lookup_key, &first);
+    lookup_ctx_s last = { &mmdb, map_offset, "key15" };
+    bench_run("lookup_path_in_map", "hit_last", lookup_key, &last);
+    lookup_ctx_s miss = { &mmdb, map_offset, "missing" };
+    bench_run("lookup_path_in_map", "miss", lookup_key, &miss);
+
+    for (int i = 0; i < 3; i++) {
+        lookup_ctx_s skip = { &mmdb, skip_offsets[i], "last" };
+        bench_run("skip_map_or_array", skip_names[i], lookup_key, &skip);
+    }
+
+    free(data.data);
+    exit(0);
+}
+
+LOCAL void write_string_map(bench_buffer_s *data, int keys)
+{
+    bench_write_control(data, MMDB_DATA_TYPE_MAP, keys);
+    for (int i = 0; i < keys; i++) {
+        char key[16], value[32];
+        snprintf(key, sizeof(key), "k%d", i);
+        snprintf(value, sizeof(value), "value number %d", i);
+        bench_write_string(data, key);
+        bench_write_string(data, value);
+    }
+}
+
+LOCAL void write_uint32_array(bench_buffer_s *data, int count)
+{
+    bench_write_control(data, MMDB_DATA_TYPE_ARRAY, count);
+    for (int i = 0; i < count; i++) {
+        bench_write_uint(data, MMDB_DATA_TYPE_UINT32, i * 1000003);
+    }
+}
+
+/* Four keys at each level, with an array of four numbers at the bottom */
+LOCAL void write_nested_map(bench_buffer_s *data, int depth)
+{
+    if (0 == depth) {
+        write_uint32_array(data, 4);
+        return;
+    }
+    bench_write_control(data, MMDB_DATA_TYPE_MAP, 4);
+    for (int i = 0; i < 4; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "level%d_%d", depth, i);
+        bench_write_string(data, key);
+        write_nested_map(data, depth - 1);
+    }
+}
+
+LOCAL uint64_t lookup_key(void *ctx, size_t iterations)
+{
+    lookup_ctx_s *lookup = ctx;
+    MMDB_entry_s entry = { .mmdb = lookup->mmdb, .offset = lookup->offset };
+    const char *const path[] = { lookup->key, NULL };
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_entry_data_s entry_data;
+        int status = MMDB_aget_value(&entry, &entry_data, path);
+        if (MMDB_SUCCESS != status
+            && MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR != status) {
+            fprintf(stderr, "Can't look up %s - %s\n", lookup->key,
+                    MMDB_strerror(status));
+            exit(3);
+        }
+        checksum += entry_data.has_data + entry_data.uint32;
+    }
+    return checksum;
+}
@@ -0,0 +1,123 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* This measures finding every network inside an IPv4 /12, once with
+ * MMDB_lookup_range() and once with MMDB_lookup_sockaddr(), looking up an
+ * address and then skipping to the end of the network it is in until the
+ * whole range is covered, which is what callers had to do before. The
+ * database is a generated one with a /20 for every address, so each /12 has
+ * 256 networks. Each operation covers the next /12 in turn.
+ *
+ * Both find the same networks, so they must return the same checksum. This
+ * is checked once before they are timed. */
+
+#define PREFIX_LENGTH (12)
+#define RANGES (1 << PREFIX_LENGTH)
+
+typedef struct totals_s {
+    uint64_t count;
+    uint64_t checksum;
+} totals_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL int count_network(void *ctx, const MMDB_network_s *network);
+LOCAL uint64_t lookup_range(void *ctx, size_t iterations);
+LOCAL uint64_t lookups(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(void)
+{
+    char *path = bench_make_database(28, 20, 256);
+    MMDB_s mmdb;
+    bench_open(path, &mmdb);
+
+    if (lookup_range(&mmdb, RANGES) != lookups(&mmdb, RANGES)) {
+        fprintf(stderr, "MMDB_lookup_range found different networks\n");
+        exit(3);
+    }
+
+    bench_run("MMDB_lookup_range", "ipv4_12", lookup_range, &mmdb);
+    bench_run("MMDB_lookup_sockaddr", "ipv4_12", lookups, &mmdb);
+
+    MMDB_close(&mmdb);
+    unlink(path);
+    free(path);
+    exit(0);
+}
+
+LOCAL int count_network(void *ctx, const MMDB_network_s *network)
+{
+    totals_s *totals = ctx;
+    totals->count++;
+    totals->checksum = bench_mix(totals->checksum, network->entry.offset);
+    return MMDB_VISIT_CONTINUE;
+}
+
+LOCAL uint64_t lookup_range(void *ctx, size_t iterations)
+{
+    MMDB_s *mmdb = ctx;
+    totals_s totals = { 0, 0 };
+
+    for (size_t i = 0; i < iterations; i++) {
+        struct sockaddr_in sin;
+        bench_ipv4_sockaddr((uint32_t)(i % RANGES) << (32 - PREFIX_LENGTH),
+                            &sin);
+        int status = MMDB_lookup_range(mmdb, (struct sockaddr *)&sin,
+                                       PREFIX_LENGTH, 0, count_network,
+                                       &totals);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "MMDB_lookup_range failed - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+    }
+    return bench_mix(totals.checksum, totals.count);
+}
+
+/* A lookup tells us the netmask of the network the address is in, whether or
+ * not it has data, so we skip to the end of that network. That is the best
+ * a caller can do without walking the search tree. */
+LOCAL uint64_t lookups(void *ctx, size_t iterations)
+{
+    MMDB_s *mmdb = ctx;
+    totals_s totals = { 0, 0 };
+    int ipv4_offset = 6 == mmdb->metadata.ip_version ? 96 : 0;
+    uint64_t size = (uint64_t)1 << (32 - PREFIX_LENGTH);
+
+    for (size_t i = 0; i < iterations; i++) {
+        uint64_t ip = (i % RANGES) * size;
+        uint64_t end = ip + size;
+        while (ip < end) {
+            struct sockaddr_in sin;
+            bench_ipv4_sockaddr((uint32_t)ip, &sin);
+            int mmdb_error;
+            MMDB_lookup_result_s result =
+                MMDB_lookup_sockaddr(mmdb, (struct sockaddr *)&sin,
+                                     &mmdb_error);
+            if (MMDB_SUCCESS != mmdb_error) {
+                fprintf(stderr, "MMDB_lookup_sockaddr failed - %s\n",
+                        MMDB_strerror(mmdb_error));
+                exit(3);
+            }
+            if (result.found_entry) {
+                totals.count++;
+                totals.checksum = bench_mix(totals.checksum,
+                                            result.entry.offset);
+            }
+            int netmask = result.netmask - ipv4_offset;
+            netmask = netmask < 0 ? 0 : netmask;
+            /* The network the address is in starts at or before ip */
+            uint64_t network_end =
+                (ip & ~(((uint64_t)1 << (32 - netmask)) - 1))
+                + ((uint64_t)1 << (32 - netmask));
+            ip = network_end > ip ? network_end : ip + 1;
+        }
+    }
+    return bench_mix(totals.checksum, totals.count);
+}
@@ -0,0 +1,158 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This measures visiting every network in a database, once with the network
+ * iterator and once with a recursive walker built on MMDB_read_node(), the
+ * way callers had to do it before there was an iterator. The walker doesn't
+ * skip IPv4 aliases, so the iterator is run with
+ * MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES to do the same work. Each operation
+ * walks the whole tree of the City test database or of a generated database
+ * with 2^17 networks.
+ *
+ * Both find the same networks, so they must return the same checksum. This
+ * is checked once before they are timed. */
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void run_benchmarks(const char *path, const char *name);
+LOCAL uint64_t network_checksum(uint64_t hash, const uint8_t *address,
+                                uint16_t prefix_length, uint32_t offset);
+LOCAL uint64_t iterate(void *ctx, size_t iterations);
+LOCAL uint64_t read_node(void *ctx, size_t iterations);
+LOCAL uint64_t walk_node(MMDB_s *mmdb, uint32_t node, uint8_t *address,
+                         uint16_t prefix_length, uint64_t checksum);
+LOCAL uint64_t walk_record(MMDB_s *mmdb, uint64_t record, uint8_t type,
+                           uint32_t offset, uint8_t *address,
+                           uint16_t prefix_length, uint64_t checksum);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    const char *data_dir = argc > 1 ? argv[1] : "../t/maxmind-db/test-data";
+
+    const char *path = bench_fixture(data_dir, "GeoIP2-City-Test.mmdb");
+    if (NULL != path) {
+        run_benchmarks(path, "GeoIP2-City-Test.mmdb");
+        free((void *)path);
+    }
+
+    char *generated = bench_make_database(28, 17, 256);
+    run_benchmarks(generated, "generated_17_bit");
+    unlink(generated);
+    free(generated);
+
+    exit(0);
+}
+
+LOCAL void run_benchmarks(const char *path, const char *name)
+{
+    MMDB_s mmdb;
+    bench_open(path, &mmdb);
+
+    if (iterate(&mmdb, 1) != read_node(&mmdb, 1)) {
+        fprintf(stderr, "The iterator found different networks in %s\n",
+                name);
+        exit(3);
+    }
+
+    bench_run("MMDB_network_iterator_next", name, iterate, &mmdb);
+    bench_run("MMDB_read_node_walk", name, read_node, &mmdb);
+
+    MMDB_close(&mmdb);
+}
+
+LOCAL uint64_t network_checksum(uint64_t hash, const uint8_t *address,
+                                uint16_t prefix_length, uint32_t offset)
+{
+    uint64_t high, low;
+    memcpy(&high, address, 8);
+    memcpy(&low, address + 8, 8);
+    hash = bench_mix(hash, high);
+    hash = bench_mix(hash, low);
+    hash = bench_mix(hash, prefix_length);
+    return bench_mix(hash, offset);
+}
+
+LOCAL uint64_t iterate(void *ctx, size_t iterations)
+{
+    MMDB_s *mmdb = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_network_iterator_s iterator;
+        int status = MMDB_network_iterator_init(
+            mmdb, MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES, &iterator);
+        MMDB_network_s network;
+        bool found;
+        while (MMDB_SUCCESS == status
+               && MMDB_SUCCESS == (status = MMDB_network_iterator_next(
+                                       &iterator, &network, &found))
+               && found) {
+            checksum = network_checksum(checksum, network.address,
+                                        network.prefix_length,
+                                        network.entry.offset);
+        }
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "Iterating failed - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+    }
+    return checksum;
+}
+
+LOCAL uint64_t read_node(void *ctx, size_t iterations)
+{
+    MMDB_s *mmdb = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        uint8_t address[16] = { 0 };
+        checksum = walk_node(mmdb, 0, address, 0, checksum);
+    }
+    return checksum;
+}
+
+LOCAL uint64_t walk_node(MMDB_s *mmdb, uint32_t node, uint8_t *address,
+                         uint16_t prefix_length, uint64_t checksum)
+{
+    MMDB_search_node_s search_node;
+    int status = MMDB_read_node(mmdb, node, &search_node);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "MMDB_read_node failed - %s\n",
+                MMDB_strerror(status));
+        exit(3);
+    }
+
+    checksum = walk_record(mmdb, search_node.left_record,
+                           search_node.left_record_type,
+                           search_node.left_record_entry.offset, address,
+                           prefix_length + 1, checksum);
+    address[prefix_length / 8] |= 0x80 >> (prefix_length % 8);
+    checksum = walk_record(mmdb, search_node.right_record,
+                           search_node.right_record_type,
+                           search_node.right_record_entry.offset, address,
+                           prefix_length + 1, checksum);
+    address[prefix_length / 8] &= ~(0x80 >> (prefix_length % 8));
+    return checksum;
+}
+
+LOCAL uint64_t walk_record(MMDB_s *mmdb, uint64_t record, uint8_t type,
+                           uint32_t offset, uint8_t *address,
+                           uint16_t prefix_length, uint64_t checksum)
+{
+    if (MMDB_RECORD_TYPE_SEARCH_NODE == type) {
+        return walk_node(mmdb, (uint32_t)record, address, prefix_length,
+                         checksum);
+    }
+    if (MMDB_RECORD_TYPE_DATA == type) {
+        return network_checksum(checksum, address, prefix_length, offset);
+    }
+    return checksum;
+}
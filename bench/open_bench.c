@@ -0,0 +1,60 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* This measures MMDB_open() followed by MMDB_close() on the test databases
+ * and on a generated database with about a million nodes. Opening maps the
+ * file, finds and decodes the metadata and sets up the search tree, so this
+ * is the fixed cost a program pays for each database it opens. */
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL uint64_t open_and_close(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    const char *data_dir = argc > 1 ? argv[1] : "../t/maxmind-db/test-data";
+
+    const char *files[] = {
+        "MaxMind-DB-test-ipv4-24.mmdb", "MaxMind-DB-test-decoder.mmdb",
+        "GeoIP2-City-Test.mmdb"
+    };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        const char *path = bench_fixture(data_dir, files[i]);
+        if (NULL != path) {
+            bench_run("MMDB_open", files[i], open_and_close, (void *)path);
+            free((void *)path);
+        }
+    }
+
+    char *path = bench_make_database(28, 20, 256);
+    bench_run("MMDB_open", "generated_28_bit", open_and_close, path);
+    unlink(path);
+    free(path);
+
+    exit(0);
+}
+
+LOCAL uint64_t open_and_close(void *ctx, size_t iterations)
+{
+    const char *path = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_s mmdb;
+        int status = MMDB_open(path, MMDB_MODE_MMAP, &mmdb);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "Can't open %s - %s\n", path,
+                    MMDB_strerror(status));
+            exit(2);
+        }
+        checksum += mmdb.metadata.node_count;
+        MMDB_close(&mmdb);
+    }
+    return checksum;
+}
@@ -0,0 +1,157 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This measures what a projection table costs and what it saves. It times
+ * building and freeing a projection of a few City fields, and then reading
+ * the same fields for a record, once with MMDB_aget_value() and once by
+ * finding the record's row in the projection. The records are taken in turn
+ * from every distinct record in the City test database.
+ *
+ * Both read the same values, so they must return the same checksum. This is
+ * checked once before they are timed. */
+
+#define MAX_ENTRIES (1024)
+
+static const char *const city_names_en[] = { "city", "names", "en", NULL };
+static const char *const country_iso_code[] = { "country", "iso_code", NULL };
+static const char *const city_geoname_id[] = { "city", "geoname_id", NULL };
+static const char *const latitude[] = { "location", "latitude", NULL };
+static const char *const longitude[] = { "location", "longitude", NULL };
+static const char *const time_zone[] = { "location", "time_zone", NULL };
+
+static const char *const *const paths[] = {
+    city_names_en, country_iso_code, city_geoname_id, latitude, longitude,
+    time_zone
+};
+#define PATH_COUNT (sizeof(paths) / sizeof(paths[0]))
+
+typedef struct projection_ctx_s {
+    MMDB_s *mmdb;
+    MMDB_entry_s *entries;
+    int count;
+    MMDB_projection_s projection;
+} projection_ctx_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL uint64_t value_checksum(uint64_t hash,
+                              const MMDB_entry_data_s *entry_data);
+LOCAL uint64_t build_projection(void *ctx, size_t iterations);
+LOCAL uint64_t aget_value(void *ctx, size_t iterations);
+LOCAL uint64_t projection_row(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    const char *data_dir = argc > 1 ? argv[1] : "../t/maxmind-db/test-data";
+
+    const char *path = bench_fixture(data_dir, "GeoIP2-City-Test.mmdb");
+    if (NULL == path) {
+        exit(0);
+    }
+    MMDB_s mmdb;
+    bench_open(path, &mmdb);
+    free((void *)path);
+
+    static MMDB_entry_s entries[MAX_ENTRIES];
+    projection_ctx_s projection = {
+        .mmdb    = &mmdb,
+        .entries = entries,
+        .count   = bench_collect_entries(&mmdb, entries, MAX_ENTRIES)
+    };
+
+    bench_run("MMDB_build_projection", "city_fields", build_projection,
+              &projection);
+
+    int status = MMDB_build_projection(&mmdb, paths, PATH_COUNT,
+                                       &projection.projection);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "MMDB_build_projection failed - %s\n",
+                MMDB_strerror(status));
+        exit(2);
+    }
+    if (aget_value(&projection, projection.count)
+        != projection_row(&projection, projection.count)) {
+        fprintf(stderr, "The projection has different values\n");
+        exit(3);
+    }
+
+    bench_run("MMDB_aget_value", "city_fields", aget_value, &projection);
+    bench_run("MMDB_get_projection_row", "city_fields", projection_row,
+              &projection);
+
+    MMDB_free_projection(&projection.projection);
+    MMDB_close(&mmdb);
+    exit(0);
+}
+
+LOCAL uint64_t value_checksum(uint64_t hash,
+                              const MMDB_entry_data_s *entry_data)
+{
+    hash = bench_mix(hash, entry_data->has_data);
+    hash = bench_mix(hash, entry_data->type);
+    return bench_mix(hash, entry_data->offset);
+}
+
+LOCAL uint64_t build_projection(void *ctx, size_t iterations)
+{
+    projection_ctx_s *projection = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_projection_s built;
+        int status = MMDB_build_projection(projection->mmdb, paths,
+                                           PATH_COUNT, &built);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "MMDB_build_projection failed - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+        checksum += built.memory_size;
+        MMDB_free_projection(&built);
+    }
+    return checksum;
+}
+
+LOCAL uint64_t aget_value(void *ctx, size_t iterations)
+{
+    projection_ctx_s *projection = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_entry_s *entry = &projection->entries[i % projection->count];
+        for (size_t j = 0; j < PATH_COUNT; j++) {
+            MMDB_entry_data_s entry_data;
+            MMDB_aget_value(entry, &entry_data, paths[j]);
+            checksum = value_checksum(checksum, &entry_data);
+        }
+    }
+    return checksum;
+}
+
+LOCAL uint64_t projection_row(void *ctx, size_t iterations)
+{
+    projection_ctx_s *projection = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        uint32_t row;
+        if (MMDB_SUCCESS != MMDB_get_projection_row(
+                &projection->projection,
+                &projection->entries[i % projection->count], &row)) {
+            fprintf(stderr, "A record isn't in the projection\n");
+            exit(3);
+        }
+        for (size_t j = 0; j < PATH_COUNT; j++) {
+            MMDB_entry_data_s entry_data;
+            MMDB_get_projection_value(&projection->projection, row, j,
+                                      &entry_data);
+            checksum = value_checksum(checksum, &entry_data);
+        }
+    }
+    return checksum;
+}
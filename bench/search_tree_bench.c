@@ -0,0 +1,107 @@
+#include "bench_helper.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This measures MMDB_lookup_sockaddr(), which is mostly the search tree
+ * walk, for each record size. The generated databases have a complete tree
+ * 20 nodes deep, which at about a million nodes is larger than most CPU
+ * caches, so every lookup reads 20 nodes from all over the tree. The IPv4
+ * test databases are also measured, and since their trees are tiny they
+ * show the cost of the walk when it is all in cache. */
+
+#define DEPTH (20)
+#define RECORDS (256)
+#define ADDRESSES (4096)
+
+typedef struct search_ctx_s {
+    MMDB_s *mmdb;
+    struct sockaddr_in *addresses;
+} search_ctx_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void bench_database(const char *path, const char *name,
+                          struct sockaddr_in *addresses);
+LOCAL uint64_t lookup_addresses(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    const char *data_dir = argc > 1 ? argv[1] : "../t/maxmind-db/test-data";
+
+    /* A fixed sequence of addresses makes runs comparable */
+    static struct sockaddr_in addresses[ADDRESSES];
+    uint32_t ip = 0;
+    for (int i = 0; i < ADDRESSES; i++) {
+        ip += 2654435761U;
+        addresses[i].sin_family = AF_INET;
+        addresses[i].sin_addr.s_addr = htonl(ip);
+    }
+
+    int record_sizes[] = { 24, 28, 32 };
+    for (int i = 0; i < 3; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "generated_%d_bit", record_sizes[i]);
+        char *path = bench_make_database(record_sizes[i], DEPTH, RECORDS);
+        bench_database(path, name, addresses);
+        unlink(path);
+        free(path);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        char file[64], name[32];
+        snprintf(file, sizeof(file), "MaxMind-DB-test-ipv4-%d.mmdb",
+                 record_sizes[i]);
+        snprintf(name, sizeof(name), "test_ipv4_%d_bit", record_sizes[i]);
+        const char *path = bench_fixture(data_dir, file);
+        if (NULL != path) {
+            bench_database(path, name, addresses);
+            free((void *)path);
+        }
+    }
+
+    exit(0);
+}
+
+LOCAL void bench_database(const char *path, const char *name,
+                          struct sockaddr_in *addresses)
+{
+    MMDB_s mmdb;
+    int status = MMDB_open(path, MMDB_MODE_MMAP, &mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "Can't open %s - %s\n", path, MMDB_strerror(status));
+        exit(2);
+    }
+
+    search_ctx_s ctx = { .mmdb = &mmdb, .addresses = addresses };
+    bench_run("find_address_in_search_tree", name, lookup_addresses, &ctx);
+
+    MMDB_close(&mmdb);
+}
+
+LOCAL uint64_t lookup_addresses(void *ctx, size_t iterations)
+{
+    search_ctx_s *search = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        int mmdb_error;
+        MMDB_lookup_result_s result = MMDB_lookup_sockaddr(
+            search->mmdb,
+            (struct sockaddr *)&search->addresses[i % ADDRESSES],
+            &mmdb_error);
+        if (MMDB_SUCCESS != mmdb_error) {
+            fprintf(stderr, "Can't look up an address - %s\n",
+                    MMDB_strerror(mmdb_error));
+            exit(3);
+        }
+        checksum += result.netmask + result.entry.offset;
+    }
+    return checksum;
+}
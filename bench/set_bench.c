@@ -0,0 +1,135 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* This measures looking up one address in several databases, once by
+ * calling MMDB_lookup_sockaddr() for each database and once with
+ * MMDB_set_lookup_sockaddr(). The set is the IPv4 test databases for each
+ * record size and three generated databases with deeper trees. Each
+ * operation looks up one address in all of them, and the addresses are a
+ * fixed sequence that steps through the IPv4 space.
+ *
+ * Both find the same records, so they must return the same checksum. This
+ * is checked once before they are timed. */
+
+#define MAX_DATABASES (8)
+#define CHECK_LOOKUPS (4096)
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL uint64_t result_checksum(uint64_t hash,
+                               const MMDB_lookup_result_s *result,
+                               int mmdb_error);
+LOCAL uint64_t one_at_a_time(void *ctx, size_t iterations);
+LOCAL uint64_t set_lookup(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    const char *data_dir = argc > 1 ? argv[1] : "../t/maxmind-db/test-data";
+
+    static MMDB_s databases[MAX_DATABASES];
+    static MMDB_s *mmdbs[MAX_DATABASES];
+    MMDB_set_s set = { .mmdbs = mmdbs, .count = 0 };
+
+    const char *files[] = {
+        "MaxMind-DB-test-ipv4-24.mmdb", "MaxMind-DB-test-ipv4-28.mmdb",
+        "MaxMind-DB-test-ipv4-32.mmdb"
+    };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        const char *path = bench_fixture(data_dir, files[i]);
+        if (NULL != path) {
+            bench_open(path, &databases[set.count]);
+            mmdbs[set.count] = &databases[set.count];
+            set.count++;
+            free((void *)path);
+        }
+    }
+
+    int record_sizes[] = { 24, 28, 32 };
+    for (size_t i = 0; i < sizeof(record_sizes) / sizeof(int); i++) {
+        char *path = bench_make_database(record_sizes[i], 16, 256);
+        bench_open(path, &databases[set.count]);
+        mmdbs[set.count] = &databases[set.count];
+        set.count++;
+        unlink(path);
+        free(path);
+    }
+
+    if (one_at_a_time(&set, CHECK_LOOKUPS)
+        != set_lookup(&set, CHECK_LOOKUPS)) {
+        fprintf(stderr, "The set lookup found different records\n");
+        exit(3);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%zu_databases", set.count);
+    bench_run("MMDB_lookup_sockaddr", name, one_at_a_time, &set);
+    bench_run("MMDB_set_lookup_sockaddr", name, set_lookup, &set);
+
+    for (size_t i = 0; i < set.count; i++) {
+        MMDB_close(mmdbs[i]);
+    }
+    exit(0);
+}
+
+LOCAL uint64_t result_checksum(uint64_t hash,
+                               const MMDB_lookup_result_s *result,
+                               int mmdb_error)
+{
+    hash = bench_mix(hash, mmdb_error);
+    hash = bench_mix(hash, result->found_entry);
+    hash = bench_mix(hash, result->netmask);
+    return bench_mix(hash, result->entry.offset);
+}
+
+LOCAL uint64_t one_at_a_time(void *ctx, size_t iterations)
+{
+    MMDB_set_s *set = ctx;
+    uint64_t checksum = 0;
+
+    /* Stepping by a large odd number visits every address eventually, and a
+     * fixed sequence makes runs comparable with each other. */
+    uint32_t ip = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        ip += 2654435761U;
+        struct sockaddr_in sin;
+        bench_ipv4_sockaddr(ip, &sin);
+
+        for (size_t j = 0; j < set->count; j++) {
+            int mmdb_error;
+            MMDB_lookup_result_s result =
+                MMDB_lookup_sockaddr(set->mmdbs[j], (struct sockaddr *)&sin,
+                                     &mmdb_error);
+            checksum = result_checksum(checksum, &result, mmdb_error);
+        }
+    }
+    return checksum;
+}
+
+LOCAL uint64_t set_lookup(void *ctx, size_t iterations)
+{
+    MMDB_set_s *set = ctx;
+    MMDB_lookup_result_s results[MAX_DATABASES];
+    int mmdb_errors[MAX_DATABASES];
+    uint64_t checksum = 0;
+
+    uint32_t ip = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        ip += 2654435761U;
+        struct sockaddr_in sin;
+        bench_ipv4_sockaddr(ip, &sin);
+
+        MMDB_set_lookup_sockaddr(set, (struct sockaddr *)&sin, results,
+                                 mmdb_errors);
+        for (size_t j = 0; j < set->count; j++) {
+            checksum = result_checksum(checksum, &results[j],
+                                       mmdb_errors[j]);
+        }
+    }
+    return checksum;
+}
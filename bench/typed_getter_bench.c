@@ -0,0 +1,158 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This measures reading a handful of fields from a record, the way a typical
+ * application reads a City record, once with MMDB_aget_value() and once with
+ * the typed getters such as MMDB_get_utf8(). Fields a record doesn't have
+ * are skipped. Each operation reads every field from one record, and the
+ * records are taken in turn from every distinct record in the City test
+ * database.
+ *
+ * Both read the same values, so they must return the same checksum. This is
+ * checked once before they are timed. */
+
+#define MAX_ENTRIES (1024)
+
+static const char *const string_paths[][5] = {
+    { "city", "names", "en", NULL },
+    { "country", "iso_code", NULL },
+    { "country", "names", "en", NULL },
+    { "subdivisions", "0", "iso_code", NULL },
+    { "location", "time_zone", NULL },
+    { "postal", "code", NULL },
+};
+
+static const char *const uint32_paths[][3] = {
+    { "city", "geoname_id", NULL },
+};
+
+static const char *const double_paths[][3] = {
+    { "location", "latitude", NULL },
+    { "location", "longitude", NULL },
+};
+
+#define COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+typedef struct getter_ctx_s {
+    MMDB_entry_s *entries;
+    int count;
+} getter_ctx_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL uint64_t mix_string(uint64_t hash, const char *string, uint32_t size);
+LOCAL uint64_t aget_value(void *ctx, size_t iterations);
+LOCAL uint64_t typed_getters(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    const char *data_dir = argc > 1 ? argv[1] : "../t/maxmind-db/test-data";
+
+    const char *path = bench_fixture(data_dir, "GeoIP2-City-Test.mmdb");
+    if (NULL == path) {
+        exit(0);
+    }
+    MMDB_s mmdb;
+    bench_open(path, &mmdb);
+    free((void *)path);
+
+    static MMDB_entry_s entries[MAX_ENTRIES];
+    getter_ctx_s getter = {
+        entries, bench_collect_entries(&mmdb, entries, MAX_ENTRIES)
+    };
+
+    if (aget_value(&getter, getter.count)
+        != typed_getters(&getter, getter.count)) {
+        fprintf(stderr, "The typed getters read different values\n");
+        exit(3);
+    }
+
+    bench_run("MMDB_aget_value", "city_fields", aget_value, &getter);
+    bench_run("typed_getters", "city_fields", typed_getters, &getter);
+
+    MMDB_close(&mmdb);
+    exit(0);
+}
+
+LOCAL uint64_t mix_string(uint64_t hash, const char *string, uint32_t size)
+{
+    hash = bench_mix(hash, size);
+    for (uint32_t i = 0; i < size; i++) {
+        hash = bench_mix(hash, (uint8_t)string[i]);
+    }
+    return hash;
+}
+
+LOCAL uint64_t aget_value(void *ctx, size_t iterations)
+{
+    getter_ctx_s *getter = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_entry_s *entry = &getter->entries[i % getter->count];
+        MMDB_entry_data_s entry_data;
+        for (size_t k = 0; k < COUNT(string_paths); k++) {
+            if (MMDB_SUCCESS == MMDB_aget_value(entry, &entry_data,
+                                                string_paths[k])
+                && MMDB_DATA_TYPE_UTF8_STRING == entry_data.type) {
+                checksum = mix_string(checksum, entry_data.utf8_string,
+                                      entry_data.data_size);
+            }
+        }
+        for (size_t k = 0; k < COUNT(uint32_paths); k++) {
+            if (MMDB_SUCCESS == MMDB_aget_value(entry, &entry_data,
+                                                uint32_paths[k])
+                && MMDB_DATA_TYPE_UINT32 == entry_data.type) {
+                checksum = bench_mix(checksum, entry_data.uint32);
+            }
+        }
+        for (size_t k = 0; k < COUNT(double_paths); k++) {
+            if (MMDB_SUCCESS == MMDB_aget_value(entry, &entry_data,
+                                                double_paths[k])
+                && MMDB_DATA_TYPE_DOUBLE == entry_data.type) {
+                checksum = bench_mix(checksum,
+                                     (uint64_t)(entry_data.double_value
+                                                * 1e6));
+            }
+        }
+    }
+    return checksum;
+}
+
+LOCAL uint64_t typed_getters(void *ctx, size_t iterations)
+{
+    getter_ctx_s *getter = ctx;
+    uint64_t checksum = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        MMDB_entry_s *entry = &getter->entries[i % getter->count];
+        for (size_t k = 0; k < COUNT(string_paths); k++) {
+            const char *string;
+            uint32_t size;
+            if (MMDB_SUCCESS == MMDB_get_utf8(entry, string_paths[k],
+                                              &string, &size)) {
+                checksum = mix_string(checksum, string, size);
+            }
+        }
+        for (size_t k = 0; k < COUNT(uint32_paths); k++) {
+            uint32_t value;
+            if (MMDB_SUCCESS == MMDB_get_uint32(entry, uint32_paths[k],
+                                                &value)) {
+                checksum = bench_mix(checksum, value);
+            }
+        }
+        for (size_t k = 0; k < COUNT(double_paths); k++) {
+            double value;
+            if (MMDB_SUCCESS == MMDB_get_double(entry, double_paths[k],
+                                                &value)) {
+                checksum = bench_mix(checksum, (uint64_t)(value * 1e6));
+            }
+        }
+    }
+    return checksum;
+}
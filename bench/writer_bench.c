@@ -0,0 +1,113 @@
+#include "bench_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This measures building a database with the writer. The insert cases put
+ * /24 networks into a new IPv4 tree, one in ascending order of address and
+ * one in a random order, which shows how much of an insert is waiting for
+ * nodes that aren't in the cache. The add_record cases add a small record
+ * that is different each time, and one that is the same each time and so
+ * is only hashed and compared. */
+
+typedef struct insert_ctx_s {
+    bool random;
+} insert_ctx_s;
+
+#define LOCAL static
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void init_writer(MMDB_writer_s *writer);
+LOCAL uint64_t insert_networks(void *ctx, size_t iterations);
+LOCAL uint64_t add_records(void *ctx, size_t iterations);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(void)
+{
+    insert_ctx_s in_order = { .random = false };
+    bench_run("MMDB_writer_insert", "in_order_24", insert_networks,
+              &in_order);
+    insert_ctx_s random = { .random = true };
+    bench_run("MMDB_writer_insert", "random_24", insert_networks, &random);
+
+    bool distinct = true;
+    bench_run("MMDB_writer_add_record", "distinct", add_records, &distinct);
+    bool same = false;
+    bench_run("MMDB_writer_add_record", "duplicate", add_records, &same);
+
+    exit(0);
+}
+
+LOCAL void init_writer(MMDB_writer_s *writer)
+{
+    int status = MMDB_writer_init(writer, 4, 28);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "Can't set up the writer - %s\n",
+                MMDB_strerror(status));
+        exit(2);
+    }
+}
+
+LOCAL uint64_t insert_networks(void *ctx, size_t iterations)
+{
+    insert_ctx_s *insert = ctx;
+    MMDB_writer_s writer;
+    init_writer(&writer);
+
+    MMDB_entry_data_s value = { .type = MMDB_DATA_TYPE_UINT32, .uint32 = 1 };
+    uint32_t record;
+    MMDB_writer_add_record(&writer, &value, 1, &record);
+
+    /* The random order is a fixed sequence so that runs are comparable */
+    uint32_t ip = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        ip = insert->random ? ip * 1664525 + 1013904223 : ip + 256;
+        uint8_t address[4] = {
+            (uint8_t)(ip >> 24), (uint8_t)(ip >> 16), (uint8_t)(ip >> 8), 0
+        };
+        int status = MMDB_writer_insert(&writer, address, 24, record);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "Can't insert a network - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+    }
+
+    uint64_t checksum = writer.node_count;
+    MMDB_writer_free(&writer);
+    return checksum;
+}
+
+LOCAL uint64_t add_records(void *ctx, size_t iterations)
+{
+    bool distinct = *(bool *)ctx;
+    MMDB_writer_s writer;
+    init_writer(&writer);
+
+    MMDB_entry_data_s values[] = {
+        { .type = MMDB_DATA_TYPE_MAP, .data_size = 2 },
+        { .type = MMDB_DATA_TYPE_UTF8_STRING, .utf8_string = "city",
+          .data_size = 4 },
+        { .type = MMDB_DATA_TYPE_UTF8_STRING,
+          .utf8_string = "Saint-Jean-sur-Richelieu", .data_size = 24 },
+        { .type = MMDB_DATA_TYPE_UTF8_STRING, .utf8_string = "id",
+          .data_size = 2 },
+        { .type = MMDB_DATA_TYPE_UINT32, .uint32 = 0 },
+    };
+    uint64_t checksum = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        values[4].uint32 = distinct ? (uint32_t)i : 0;
+        uint32_t record;
+        int status = MMDB_writer_add_record(&writer, values, 5, &record);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "Can't add a record - %s\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+        checksum += record;
+    }
+
+    MMDB_writer_free(&writer);
+    return checksum;
+}
@@ -0,0 +1,860 @@
+/* maxminddb.h defines _POSIX_C_SOURCE, which hides syscall(). We need that
+ * for perf_event_open(), which has no libc wrapper. */
+#define _DEFAULT_SOURCE
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "maxminddb.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/* This benchmarks a database in three stages:
+ *
+ *     tree        MMDB_lookup_sockaddr(), which walks the search tree
+ *     decode      MMDB_get_entry_data_list() on records that were found
+ *     end-to-end  both of them, the way most callers use the library
+ *
+ * The addresses are all generated, or read from a file, before anything is
+ * timed, so the timed loops only call the library. Each stage is run twice
+ * by every thread: once untimed apart from its start and end, which gives the
+ * throughput and the perf counters, and once with every operation timed,
+ * which gives the latency percentiles. */
+
+#define MAX_THREADS (256)
+#define MAX_ADDRESSES (1 << 20)
+#define MAX_SAMPLES (1 << 22)
+#define ZIPF_ADDRESSES (1 << 16)
+#define CLOCK_READS (1000)
+
+#define UNIFORM_IPV4 (0)
+#define UNIFORM_IPV6 (1)
+#define ZIPF (2)
+#define REPLAY (3)
+
+#define TREE_STAGE (0)
+#define DECODE_STAGE (1)
+#define END_TO_END_STAGE (2)
+#define STAGE_COUNT (3)
+
+#define CYCLES (0)
+#define INSTRUCTIONS (1)
+#define CACHE_MISSES (2)
+#define COUNTER_COUNT (3)
+
+static const char *distribution_names[] = {
+    "uniform4", "uniform6", "zipf", "replay"
+};
+
+static const char *stage_names[STAGE_COUNT] = {
+    "tree", "decode", "end-to-end"
+};
+
+typedef union address_u {
+    struct sockaddr sa;
+    struct sockaddr_in sin;
+    struct sockaddr_in6 sin6;
+} address_u;
+
+typedef struct options_s {
+    char *mmdb_file;
+    char *input_file;
+    int distribution;
+    double zipf_exponent;
+    size_t count;
+    int thread_count;
+    uint64_t seed;
+} options_s;
+
+/* The state shared by all of the threads. The lock and condition variable
+ * are a barrier that starts every thread on a stage at the same time. */
+typedef struct bench_s {
+    MMDB_s *mmdb;
+    address_u *addresses;
+    size_t address_count;
+    MMDB_entry_s *entries;
+    size_t entry_count;
+    size_t count;
+    size_t sample_count;
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int waiting;
+    unsigned int generation;
+} bench_s;
+
+typedef struct worker_s {
+    bench_s *bench;
+    pthread_t thread;
+    size_t first_address;
+    size_t first_entry;
+    uint64_t start[STAGE_COUNT];
+    uint64_t end[STAGE_COUNT];
+    uint32_t *latencies[STAGE_COUNT];
+    uint64_t counters[STAGE_COUNT][COUNTER_COUNT];
+    int counter_error;
+    uint64_t checksum;
+    int status;
+} worker_s;
+
+#define LOCAL
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void usage(char *program, int exit_code, const char *error);
+LOCAL void get_options(int argc, char **argv, options_s *options);
+LOCAL uint64_t random_next(uint64_t *state);
+LOCAL void make_addresses(MMDB_s *mmdb, options_s *options, bench_s *bench);
+LOCAL void random_address(uint64_t *state, bool ipv6, address_u *address);
+LOCAL void read_addresses(MMDB_s *mmdb, const char *file, bench_s *bench);
+LOCAL void find_entries(bench_s *bench);
+LOCAL void *run_worker(void *arg);
+LOCAL void wait_for_workers(bench_s *bench);
+LOCAL int run_stage(worker_s *worker, int stage, uint32_t *latencies,
+                    size_t count);
+LOCAL int run_operation(bench_s *bench, int stage, size_t address,
+                        size_t entry, uint64_t *checksum);
+LOCAL uint64_t now(void);
+LOCAL uint32_t clock_overhead(void);
+LOCAL int open_counters(int *fds);
+LOCAL void start_counters(int *fds);
+LOCAL void read_counters(int *fds, uint64_t *counters);
+LOCAL void close_counters(int *fds);
+LOCAL void print_report(bench_s *bench, options_s *options,
+                        worker_s *workers, uint32_t overhead);
+LOCAL uint32_t percentile(const uint32_t *latencies, size_t count,
+                          double fraction);
+LOCAL int compare_latencies(const void *a, const void *b);
+LOCAL void *xcalloc(size_t count, size_t size);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    options_s options = {
+        .distribution  = UNIFORM_IPV4,
+        .zipf_exponent = 1.0,
+        .count         = 1000000,
+        .seed          = 1
+    };
+    get_options(argc, argv, &options);
+
+    MMDB_s mmdb;
+    int status = MMDB_open(options.mmdb_file, MMDB_MODE_MMAP, &mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", options.mmdb_file,
+                MMDB_strerror(status));
+        exit(2);
+    }
+
+    bench_s bench = {
+        .mmdb         = &mmdb,
+        .count        = options.count,
+        .thread_count = options.thread_count
+    };
+    make_addresses(&mmdb, &options, &bench);
+    find_entries(&bench);
+
+    /* The latencies for every thread are kept until the end, so we limit
+     * how many of them are recorded */
+    bench.sample_count = MAX_SAMPLES / options.thread_count;
+    if (bench.sample_count > options.count) {
+        bench.sample_count = options.count;
+    }
+
+    uint32_t overhead = clock_overhead();
+
+    pthread_mutex_init(&bench.lock, NULL);
+    pthread_cond_init(&bench.changed, NULL);
+
+    worker_s *workers = xcalloc(options.thread_count, sizeof(worker_s));
+    for (int i = 0; i < options.thread_count; i++) {
+        workers[i].bench = &bench;
+        workers[i].first_address =
+            bench.address_count * i / options.thread_count;
+        workers[i].first_entry =
+            bench.entry_count * i / options.thread_count;
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            workers[i].latencies[stage] =
+                xcalloc(bench.sample_count, sizeof(uint32_t));
+        }
+        if (pthread_create(&workers[i].thread, NULL, run_worker,
+                           &workers[i])) {
+            fprintf(stderr, "\n  Can't create a thread\n\n");
+            exit(2);
+        }
+    }
+
+    status = MMDB_SUCCESS;
+    for (int i = 0; i < options.thread_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (MMDB_SUCCESS != workers[i].status) {
+            status = workers[i].status;
+        }
+    }
+
+    if (MMDB_SUCCESS == status) {
+        print_report(&bench, &options, workers, overhead);
+    } else {
+        fprintf(stderr, "\n  Got an error during the benchmark - %s\n\n",
+                MMDB_strerror(status));
+    }
+
+    for (int i = 0; i < options.thread_count; i++) {
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            free(workers[i].latencies[stage]);
+        }
+    }
+    free(workers);
+    free(bench.addresses);
+    free(bench.entries);
+    pthread_mutex_destroy(&bench.lock);
+    pthread_cond_destroy(&bench.changed);
+    MMDB_close(&mmdb);
+
+    exit(MMDB_SUCCESS == status ? 0 : 3);
+}
+
+LOCAL void usage(char *program, int exit_code, const char *error)
+{
+    if (NULL != error) {
+        fprintf(stderr, "\n  *ERROR: %s\n", error);
+    }
+
+    char *usage = "\n"
+                  "  %s --file /path/to/file.mmdb [--distribution NAME]\n"
+                  "\n"
+                  "  This application accepts the following options:\n"
+                  "\n"
+                  "      --file (-f)           The path to the MMDB file. Required.\n"
+                  "\n"
+                  "      --count (-c)          The number of operations each thread runs in\n"
+                  "                            each stage. This defaults to 1000000.\n"
+                  "\n"
+                  "      --threads (-t)        The number of threads to use. This defaults\n"
+                  "                            to 1.\n"
+                  "\n"
+                  "      --distribution (-d)   How the addresses are chosen: \"uniform4\"\n"
+                  "                            (the default), \"uniform6\", \"zipf\" or\n"
+                  "                            \"replay\".\n"
+                  "\n"
+                  "      --input (-i)          The file of addresses to replay, one per line.\n"
+                  "                            This implies --distribution replay.\n"
+                  "\n"
+                  "      --zipf-exponent (-z)  The exponent for --distribution zipf. This\n"
+                  "                            defaults to 1.0.\n"
+                  "\n"
+                  "      --seed (-s)           The seed for the generated addresses.\n"
+                  "\n"
+                  "      --version             Print the program's version number and exit.\n"
+                  "\n"
+                  "      --help (-h -?)        Show usage information.\n"
+                  "\n"
+                  "  This times looking up addresses in the search tree, decoding the\n"
+                  "  records that were found and both together. For each of them it prints\n"
+                  "  the nanoseconds per operation, the throughput of all of the threads,\n"
+                  "  the p50, p99 and p99.9 latencies in nanoseconds and, where perf\n"
+                  "  counters are available, the cycles, instructions and cache misses per\n"
+                  "  operation.\n"
+                  "\n";
+
+    fprintf(stdout, usage, program);
+    exit(exit_code);
+}
+
+LOCAL void get_options(int argc, char **argv, options_s *options)
+{
+    static int help = 0;
+    static int version = 0;
+    const char *distribution = NULL;
+    long thread_count = 1;
+    long long count = (long long)options->count;
+
+    while (1) {
+        static struct option long_options[] = {
+            { "file",          required_argument, 0, 'f' },
+            { "count",         required_argument, 0, 'c' },
+            { "threads",       required_argument, 0, 't' },
+            { "distribution",  required_argument, 0, 'd' },
+            { "input",         required_argument, 0, 'i' },
+            { "zipf-exponent", required_argument, 0, 'z' },
+            { "seed",          required_argument, 0, 's' },
+            { "version",       no_argument,       0, 'n' },
+            { "help",          no_argument,       0, 'h' },
+            { "?",             no_argument,       0, 1   },
+            { 0,               0,                 0, 0   }
+        };
+
+        int opt_index;
+        int opt_char = getopt_long(argc, argv, "f:c:t:d:i:z:s:nh?",
+                                   long_options, &opt_index);
+
+        if (-1 == opt_char) {
+            break;
+        }
+
+        if ('f' == opt_char) {
+            options->mmdb_file = optarg;
+        } else if ('c' == opt_char) {
+            count = strtoll(optarg, NULL, 10);
+        } else if ('t' == opt_char) {
+            thread_count = strtol(optarg, NULL, 10);
+        } else if ('d' == opt_char) {
+            distribution = optarg;
+        } else if ('i' == opt_char) {
+            options->input_file = optarg;
+        } else if ('z' == opt_char) {
+            options->zipf_exponent = strtod(optarg, NULL);
+        } else if ('s' == opt_char) {
+            options->seed = strtoull(optarg, NULL, 10);
+        } else if ('n' == opt_char) {
+            version = 1;
+        } else if ('h' == opt_char || '?' == opt_char) {
+            help = 1;
+        }
+    }
+
+    char *program = basename(argv[0]);
+
+    if (help) {
+        usage(program, 0, NULL);
+    }
+
+    if (version) {
+        fprintf(stdout, "\n  %s version %s\n\n", program, VERSION);
+        exit(0);
+    }
+
+    if (NULL == options->mmdb_file) {
+        usage(program, 1, "You must provide a filename with --file");
+    }
+
+    if (NULL != options->input_file) {
+        options->distribution = REPLAY;
+    }
+    if (NULL != distribution) {
+        int i;
+        for (i = 0; i <= REPLAY; i++) {
+            if (0 == strcmp(distribution, distribution_names[i])) {
+                break;
+            }
+        }
+        if (i > REPLAY) {
+            usage(program, 1, "The distribution must be uniform4, uniform6, "
+                  "zipf or replay");
+        }
+        if (NULL != options->input_file && REPLAY != i) {
+            usage(program, 1, "--input can only be used with "
+                  "--distribution replay");
+        }
+        options->distribution = i;
+    }
+    if (REPLAY == options->distribution && NULL == options->input_file) {
+        usage(program, 1, "You must provide a file to replay with --input");
+    }
+
+    if (count < 1) {
+        usage(program, 1, "The count must be at least 1");
+    }
+    options->count = (size_t)count;
+
+    if (thread_count < 1 || thread_count > MAX_THREADS) {
+        usage(program, 1, "The number of threads must be from 1 to 256");
+    }
+    options->thread_count = (int)thread_count;
+
+    if (!(options->zipf_exponent > 0)) {
+        usage(program, 1, "The Zipf exponent must be greater than 0");
+    }
+}
+
+/* This is splitmix64, which is plenty random for picking addresses and
+ * gives the same addresses for the same seed everywhere */
+LOCAL uint64_t random_next(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* The threads share one list of addresses, each starting at a different
+ * place in it and wrapping around at the end. For the Zipf distribution the
+ * list is drawn from a smaller set of addresses, where the address of rank k
+ * is picked with a probability proportional to 1 / k^s. */
+LOCAL void make_addresses(MMDB_s *mmdb, options_s *options, bench_s *bench)
+{
+    if (REPLAY == options->distribution) {
+        read_addresses(mmdb, options->input_file, bench);
+        return;
+    }
+
+    if (UNIFORM_IPV6 == options->distribution
+        && 4 == mmdb->metadata.ip_version) {
+        fprintf(stderr, "\n  Can't use IPv6 addresses with an IPv4 database"
+                "\n\n");
+        exit(1);
+    }
+
+    size_t count = options->count * options->thread_count;
+    bench->address_count = count < MAX_ADDRESSES ? count : MAX_ADDRESSES;
+    bench->addresses = xcalloc(bench->address_count, sizeof(address_u));
+
+    uint64_t state = options->seed;
+    if (ZIPF != options->distribution) {
+        for (size_t i = 0; i < bench->address_count; i++) {
+            random_address(&state, UNIFORM_IPV6 == options->distribution,
+                           &bench->addresses[i]);
+        }
+        return;
+    }
+
+    address_u *ranked = xcalloc(ZIPF_ADDRESSES, sizeof(address_u));
+    double *cumulative = xcalloc(ZIPF_ADDRESSES, sizeof(double));
+    double total = 0;
+    for (int i = 0; i < ZIPF_ADDRESSES; i++) {
+        random_address(&state, false, &ranked[i]);
+        total += 1 / pow(i + 1, options->zipf_exponent);
+        cumulative[i] = total;
+    }
+    for (size_t i = 0; i < bench->address_count; i++) {
+        double r = (random_next(&state) >> 11) * 0x1.0p-53 * total;
+        size_t low = 0, high = ZIPF_ADDRESSES - 1;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (cumulative[middle] < r) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        bench->addresses[i] = ranked[low];
+    }
+    free(ranked);
+    free(cumulative);
+}
+
+LOCAL void random_address(uint64_t *state, bool ipv6, address_u *address)
+{
+    memset(address, 0, sizeof(address_u));
+    if (ipv6) {
+        address->sin6.sin6_family = AF_INET6;
+        uint64_t bits[2] = { random_next(state), random_next(state) };
+        memcpy(&address->sin6.sin6_addr, bits, 16);
+    } else {
+        address->sin.sin_family = AF_INET;
+        address->sin.sin_addr.s_addr = (uint32_t)random_next(state);
+    }
+}
+
+/* Lines that aren't IP addresses, and IPv6 addresses when the database is
+ * IPv4, are skipped so that a log can be replayed as it is */
+LOCAL void read_addresses(MMDB_s *mmdb, const char *file, bench_s *bench)
+{
+    FILE *fh = fopen(file, "r");
+    if (NULL == fh) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", file, strerror(errno));
+        exit(2);
+    }
+
+    size_t capacity = 0, skipped = 0;
+    char line[1024];
+    while (NULL != fgets(line, sizeof(line), fh)) {
+        char *ip = line + strspn(line, " \t");
+        ip[strcspn(ip, " \t\r\n")] = '\0';
+        if ('\0' == *ip) {
+            continue;
+        }
+
+        address_u address;
+        memset(&address, 0, sizeof(address));
+        if (1 == inet_pton(AF_INET, ip, &address.sin.sin_addr)) {
+            address.sin.sin_family = AF_INET;
+        } else if (6 == mmdb->metadata.ip_version
+                   && 1 == inet_pton(AF_INET6, ip, &address.sin6.sin6_addr)) {
+            address.sin6.sin6_family = AF_INET6;
+        } else {
+            skipped++;
+            continue;
+        }
+
+        if (bench->address_count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            bench->addresses = realloc(bench->addresses,
+                                       capacity * sizeof(address_u));
+            if (NULL == bench->addresses) {
+                fprintf(stderr, "\n  Can't allocate memory\n\n");
+                exit(2);
+            }
+        }
+        bench->addresses[bench->address_count++] = address;
+    }
+    fclose(fh);
+
+    if (skipped) {
+        fprintf(stderr, "  Skipped %zu line%s of %s that can't be looked up\n",
+                skipped, 1 == skipped ? "" : "s", file);
+    }
+    if (0 == bench->address_count) {
+        fprintf(stderr, "\n  There are no addresses to replay in %s\n\n",
+                file);
+        exit(2);
+    }
+}
+
+/* The decode stage decodes the records that the addresses find, so it is
+ * weighted the same way as the lookups are */
+LOCAL void find_entries(bench_s *bench)
+{
+    bench->entries = xcalloc(bench->address_count, sizeof(MMDB_entry_s));
+    for (size_t i = 0; i < bench->address_count; i++) {
+        int mmdb_error;
+        MMDB_lookup_result_s result =
+            MMDB_lookup_sockaddr(bench->mmdb, &bench->addresses[i].sa,
+                                 &mmdb_error);
+        if (MMDB_SUCCESS != mmdb_error) {
+            fprintf(stderr, "\n  Got an error looking up an address - %s\n\n",
+                    MMDB_strerror(mmdb_error));
+            exit(3);
+        }
+        if (result.found_entry) {
+            bench->entries[bench->entry_count++] = result.entry;
+        }
+    }
+}
+
+LOCAL void *run_worker(void *arg)
+{
+    worker_s *worker = arg;
+    bench_s *bench = worker->bench;
+
+    int fds[COUNTER_COUNT];
+    worker->counter_error = open_counters(fds);
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        if (DECODE_STAGE == stage && 0 == bench->entry_count) {
+            continue;
+        }
+
+        wait_for_workers(bench);
+        if (0 == worker->counter_error) {
+            start_counters(fds);
+        }
+        worker->start[stage] = now();
+        int status = run_stage(worker, stage, NULL, bench->count);
+        worker->end[stage] = now();
+        if (0 == worker->counter_error) {
+            read_counters(fds, worker->counters[stage]);
+        }
+
+        wait_for_workers(bench);
+        if (MMDB_SUCCESS == status) {
+            status = run_stage(worker, stage, worker->latencies[stage],
+                               bench->sample_count);
+        }
+        if (MMDB_SUCCESS != status) {
+            worker->status = status;
+        }
+    }
+
+    if (0 == worker->counter_error) {
+        close_counters(fds);
+    }
+    return NULL;
+}
+
+LOCAL void wait_for_workers(bench_s *bench)
+{
+    pthread_mutex_lock(&bench->lock);
+    unsigned int generation = bench->generation;
+    if (++bench->waiting == bench->thread_count) {
+        bench->waiting = 0;
+        bench->generation++;
+        pthread_cond_broadcast(&bench->changed);
+    } else {
+        while (generation == bench->generation) {
+            pthread_cond_wait(&bench->changed, &bench->lock);
+        }
+    }
+    pthread_mutex_unlock(&bench->lock);
+}
+
+/* When latencies is not NULL, every operation is timed on its own */
+LOCAL int run_stage(worker_s *worker, int stage, uint32_t *latencies,
+                    size_t count)
+{
+    bench_s *bench = worker->bench;
+    size_t address = worker->first_address, entry = worker->first_entry;
+    int status = MMDB_SUCCESS;
+
+    for (size_t i = 0; MMDB_SUCCESS == status && i < count; i++) {
+        if (NULL == latencies) {
+            status = run_operation(bench, stage, address, entry,
+                                   &worker->checksum);
+        } else {
+            uint64_t start = now();
+            status = run_operation(bench, stage, address, entry,
+                                   &worker->checksum);
+            uint64_t elapsed = now() - start;
+            latencies[i] = elapsed > UINT32_MAX ? UINT32_MAX
+                           : (uint32_t)elapsed;
+        }
+        if (++address == bench->address_count) {
+            address = 0;
+        }
+        if (++entry == bench->entry_count) {
+            entry = 0;
+        }
+    }
+    return status;
+}
+
+/* The checksum uses something from every result so that none of the work
+ * can be optimized away */
+LOCAL int run_operation(bench_s *bench, int stage, size_t address,
+                        size_t entry, uint64_t *checksum)
+{
+    MMDB_entry_s found;
+    int status = MMDB_SUCCESS;
+
+    if (DECODE_STAGE == stage) {
+        found = bench->entries[entry];
+    } else {
+        MMDB_lookup_result_s result =
+            MMDB_lookup_sockaddr(bench->mmdb, &bench->addresses[address].sa,
+                                 &status);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+        *checksum += result.netmask;
+        if (!result.found_entry || TREE_STAGE == stage) {
+            *checksum += result.entry.offset;
+            return MMDB_SUCCESS;
+        }
+        found = result.entry;
+    }
+
+    MMDB_entry_data_list_s *entry_data_list = NULL;
+    status = MMDB_get_entry_data_list(&found, &entry_data_list);
+    if (NULL != entry_data_list) {
+        *checksum += entry_data_list->entry_data.data_size;
+    }
+    MMDB_free_entry_data_list(entry_data_list);
+    return status;
+}
+
+LOCAL uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Reading the clock takes time too. We take the median of many back to back
+ * reads and subtract it from each latency. */
+LOCAL uint32_t clock_overhead(void)
+{
+    uint32_t reads[CLOCK_READS];
+    for (int i = 0; i < CLOCK_READS; i++) {
+        uint64_t start = now();
+        reads[i] = (uint32_t)(now() - start);
+    }
+    qsort(reads, CLOCK_READS, sizeof(uint32_t), compare_latencies);
+    return reads[CLOCK_READS / 2];
+}
+
+/* The counters are opened by each thread for itself and only count user
+ * space, which an unprivileged process is usually allowed to do. This
+ * returns 0 or the errno for why they aren't available. */
+LOCAL int open_counters(int *fds)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+    static const uint64_t configs[COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = 0 == i;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+
+        fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1,
+                              0 == i ? -1 : fds[0], 0);
+        if (fds[i] < 0) {
+            int error = errno;
+            while (i-- > 0) {
+                close(fds[i]);
+            }
+            return error;
+        }
+    }
+    return 0;
+#else
+    return ENOSYS;
+#endif
+}
+
+LOCAL void start_counters(int *fds)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+LOCAL void read_counters(int *fds, uint64_t *counters)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+    ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t values[1 + COUNTER_COUNT];
+    if (read(fds[0], values, sizeof(values)) == (ssize_t)sizeof(values)) {
+        memcpy(counters, values + 1, sizeof(uint64_t) * COUNTER_COUNT);
+    }
+#endif
+}
+
+LOCAL void close_counters(int *fds)
+{
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        close(fds[i]);
+    }
+}
+
+LOCAL void print_report(bench_s *bench, options_s *options,
+                        worker_s *workers, uint32_t overhead)
+{
+    MMDB_s *mmdb = bench->mmdb;
+    int counter_error = 0;
+    for (int i = 0; i < options->thread_count; i++) {
+        if (workers[i].counter_error) {
+            counter_error = workers[i].counter_error;
+        }
+    }
+
+    fprintf(stdout, "\n  Database      %s, %u nodes, %u bit records, IPv%u\n",
+            mmdb->metadata.database_type, mmdb->metadata.node_count,
+            mmdb->metadata.record_size, mmdb->metadata.ip_version);
+    if (ZIPF == options->distribution) {
+        fprintf(stdout, "  Addresses     zipf over %d addresses, exponent %g, "
+                "%.1f%% with data\n", ZIPF_ADDRESSES, options->zipf_exponent,
+                100.0 * bench->entry_count / bench->address_count);
+    } else if (REPLAY == options->distribution) {
+        fprintf(stdout, "  Addresses     %zu from %s, %.1f%% with data\n",
+                bench->address_count, options->input_file,
+                100.0 * bench->entry_count / bench->address_count);
+    } else {
+        fprintf(stdout, "  Addresses     %s, %zu generated, %.1f%% with data\n",
+                distribution_names[options->distribution],
+                bench->address_count,
+                100.0 * bench->entry_count / bench->address_count);
+    }
+    fprintf(stdout, "  Operations    %zu per thread for each stage, %d "
+            "thread%s\n", bench->count, options->thread_count,
+            1 == options->thread_count ? "" : "s");
+    fprintf(stdout, "  Latencies     %zu per thread, %u ns of clock overhead "
+            "subtracted\n", bench->sample_count, overhead);
+    if (counter_error) {
+        fprintf(stdout, "  Counters      not available - %s\n",
+                strerror(counter_error));
+    } else {
+        fprintf(stdout, "  Counters      per operation, user space only\n");
+    }
+
+    fprintf(stdout, "\n  %-12s %9s %9s %9s %9s %9s %9s %9s %9s\n", "stage",
+            "ns/op", "Mops/s", "p50", "p99", "p99.9", "cycles", "instrs",
+            "misses");
+
+    size_t sample_count = bench->sample_count * options->thread_count;
+    uint32_t *latencies = xcalloc(sample_count, sizeof(uint32_t));
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        if (DECODE_STAGE == stage && 0 == bench->entry_count) {
+            fprintf(stdout, "  %-12s no records were found\n",
+                    stage_names[stage]);
+            continue;
+        }
+
+        uint64_t first_start = UINT64_MAX, last_end = 0, thread_time = 0;
+        uint64_t counters[COUNTER_COUNT] = { 0 };
+        for (int i = 0; i < options->thread_count; i++) {
+            worker_s *worker = &workers[i];
+            if (worker->start[stage] < first_start) {
+                first_start = worker->start[stage];
+            }
+            if (worker->end[stage] > last_end) {
+                last_end = worker->end[stage];
+            }
+            thread_time += worker->end[stage] - worker->start[stage];
+            for (int c = 0; c < COUNTER_COUNT; c++) {
+                counters[c] += worker->counters[stage][c];
+            }
+            for (size_t j = 0; j < bench->sample_count; j++) {
+                uint32_t latency = worker->latencies[stage][j];
+                latencies[i * bench->sample_count + j] =
+                    latency > overhead ? latency - overhead : 0;
+            }
+        }
+        qsort(latencies, sample_count, sizeof(uint32_t), compare_latencies);
+
+        double operations = (double)bench->count * options->thread_count;
+        fprintf(stdout, "  %-12s %9.1f %9.2f %9u %9u %9u", stage_names[stage],
+                thread_time / operations,
+                operations / (last_end - first_start) * 1000,
+                percentile(latencies, sample_count, 0.5),
+                percentile(latencies, sample_count, 0.99),
+                percentile(latencies, sample_count, 0.999));
+        if (counter_error) {
+            fprintf(stdout, " %9s %9s %9s\n", "-", "-", "-");
+        } else {
+            fprintf(stdout, " %9.1f %9.1f %9.2f\n",
+                    counters[CYCLES] / operations,
+                    counters[INSTRUCTIONS] / operations,
+                    counters[CACHE_MISSES] / operations);
+        }
+    }
+    fprintf(stdout, "\n");
+    free(latencies);
+}
+
+LOCAL uint32_t percentile(const uint32_t *latencies, size_t count,
+                          double fraction)
+{
+    size_t i = (size_t)ceil(fraction * count);
+    return latencies[i > 0 ? i - 1 : 0];
+}
+
+LOCAL int compare_latencies(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+LOCAL void *xcalloc(size_t count, size_t size)
+{
+    void *p = calloc(count, size);
+    if (NULL == p) {
+        fprintf(stderr, "\n  Can't allocate memory\n\n");
+        exit(2);
+    }
+    return p;
+}
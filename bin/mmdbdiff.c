@@ -0,0 +1,254 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "maxminddb.h"
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This prints every network whose data is different in two databases, using
+ * MMDB_diff(). Each line is tab separated, starting with what happened to
+ * the network and then the network in CIDR form:
+ *
+ *     added    NETWORK  NEW-JSON
+ *     removed  NETWORK  OLD-JSON
+ *     changed  NETWORK  OLD-JSON  NEW-JSON
+ *
+ * Like diff(1), it exits with 0 when the databases have the same data, 1
+ * when they don't and 2 if something went wrong. */
+
+typedef struct diff_output_s {
+    MMDB_s *old_mmdb;
+    bool summary;
+    uint64_t counts[4];
+    char *json;
+    size_t json_capacity;
+    int status;
+} diff_output_s;
+
+#define LOCAL
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void usage(char *program, int exit_code, const char *error);
+LOCAL void get_options(int argc, char **argv, char **old_file,
+                       char **new_file, bool *summary);
+LOCAL void open_or_exit(const char *file, MMDB_s *mmdb);
+LOCAL int print_difference(void *ctx, const MMDB_diff_s *diff);
+LOCAL void format_network(MMDB_s *mmdb, const uint8_t *address,
+                          uint16_t prefix_length, char *network);
+LOCAL int print_json(diff_output_s *output, MMDB_entry_s *entry);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    char *old_file = NULL, *new_file = NULL;
+    bool summary = false;
+
+    get_options(argc, argv, &old_file, &new_file, &summary);
+
+    MMDB_s old_mmdb, new_mmdb;
+    open_or_exit(old_file, &old_mmdb);
+    open_or_exit(new_file, &new_mmdb);
+
+    diff_output_s output = {
+        .old_mmdb = &old_mmdb,
+        .summary  = summary,
+        .status   = MMDB_SUCCESS
+    };
+    int status = MMDB_diff(&old_mmdb, &new_mmdb, 0, print_difference,
+                           &output);
+    if (MMDB_SUCCESS == status) {
+        status = output.status;
+    }
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't compare %s and %s - %s\n\n", old_file,
+                new_file, MMDB_strerror(status));
+    }
+
+    if (summary && MMDB_SUCCESS == status) {
+        fprintf(stdout, "added\t%llu\nremoved\t%llu\nchanged\t%llu\n",
+                (unsigned long long)output.counts[MMDB_DIFF_ADDED],
+                (unsigned long long)output.counts[MMDB_DIFF_REMOVED],
+                (unsigned long long)output.counts[MMDB_DIFF_CHANGED]);
+    }
+
+    free(output.json);
+    MMDB_close(&old_mmdb);
+    MMDB_close(&new_mmdb);
+
+    if (MMDB_SUCCESS != status) {
+        exit(2);
+    }
+    exit(output.counts[MMDB_DIFF_ADDED] || output.counts[MMDB_DIFF_REMOVED]
+         || output.counts[MMDB_DIFF_CHANGED] ? 1 : 0);
+}
+
+LOCAL void usage(char *program, int exit_code, const char *error)
+{
+    if (NULL != error) {
+        fprintf(stderr, "\n  *ERROR: %s\n", error);
+    }
+
+    char *usage = "\n"
+                  "  %s --old /path/to/old.mmdb --new /path/to/new.mmdb\n"
+                  "\n"
+                  "  This application accepts the following options:\n"
+                  "\n"
+                  "      --old (-o)      The path to the older MMDB file. Required.\n"
+                  "\n"
+                  "      --new (-n)      The path to the newer MMDB file. Required.\n"
+                  "\n"
+                  "      --summary (-s)  Only print the number of networks that were added,\n"
+                  "                      removed and changed.\n"
+                  "\n"
+                  "      --version       Print the program's version number and exit.\n"
+                  "\n"
+                  "      --help (-h -?)  Show usage information.\n"
+                  "\n"
+                  "  This prints one tab separated line for each network whose data is\n"
+                  "  different in the two databases, starting with \"added\", \"removed\" or\n"
+                  "  \"changed\", then the network and then its old and new records as JSON.\n"
+                  "  The exit status is 0 if there are no differences, 1 if there are and 2\n"
+                  "  if the databases could not be compared.\n"
+                  "\n";
+
+    fprintf(stdout, usage, program);
+    exit(exit_code);
+}
+
+LOCAL void get_options(int argc, char **argv, char **old_file,
+                       char **new_file, bool *summary)
+{
+    static int help = 0;
+    static int version = 0;
+
+    while (1) {
+        static struct option options[] = {
+            { "old",     required_argument, 0, 'o' },
+            { "new",     required_argument, 0, 'n' },
+            { "summary", no_argument,       0, 's' },
+            { "version", no_argument,       0, 'v' },
+            { "help",    no_argument,       0, 'h' },
+            { "?",       no_argument,       0, 1   },
+            { 0,         0,                 0, 0   }
+        };
+
+        int opt_index;
+        int opt_char = getopt_long(argc, argv, "o:n:sh?", options,
+                                   &opt_index);
+
+        if (-1 == opt_char) {
+            break;
+        }
+
+        if ('o' == opt_char) {
+            *old_file = optarg;
+        } else if ('n' == opt_char) {
+            *new_file = optarg;
+        } else if ('s' == opt_char) {
+            *summary = true;
+        } else if ('v' == opt_char) {
+            version = 1;
+        } else if ('h' == opt_char || '?' == opt_char) {
+            help = 1;
+        }
+    }
+
+    char *program = basename(argv[0]);
+
+    if (help) {
+        usage(program, 0, NULL);
+    }
+
+    if (version) {
+        fprintf(stdout, "\n  %s version %s\n\n", program, VERSION);
+        exit(0);
+    }
+
+    if (NULL == *old_file || NULL == *new_file) {
+        usage(program, 2, "You must provide both files with --old and --new");
+    }
+}
+
+LOCAL void open_or_exit(const char *file, MMDB_s *mmdb)
+{
+    int status = MMDB_open(file, MMDB_MODE_MMAP, mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", file,
+                MMDB_strerror(status));
+        exit(2);
+    }
+}
+
+LOCAL int print_difference(void *ctx, const MMDB_diff_s *diff)
+{
+    diff_output_s *output = ctx;
+    output->counts[diff->change]++;
+    if (output->summary) {
+        return MMDB_VISIT_CONTINUE;
+    }
+
+    char network[INET6_ADDRSTRLEN + 8];
+    format_network(output->old_mmdb, diff->address, diff->prefix_length,
+                   network);
+    fprintf(stdout, "%s\t%s",
+            MMDB_DIFF_ADDED == diff->change ? "added"
+            : MMDB_DIFF_REMOVED == diff->change ? "removed" : "changed",
+            network);
+
+    MMDB_entry_s old_entry = diff->old_entry, new_entry = diff->new_entry;
+    if (MMDB_DIFF_ADDED != diff->change
+        && MMDB_SUCCESS != (output->status = print_json(output, &old_entry))) {
+        return MMDB_VISIT_STOP;
+    }
+    if (MMDB_DIFF_REMOVED != diff->change
+        && MMDB_SUCCESS != (output->status = print_json(output, &new_entry))) {
+        return MMDB_VISIT_STOP;
+    }
+    fputc('\n', stdout);
+
+    return MMDB_VISIT_CONTINUE;
+}
+
+/* An IPv4 network in an IPv6 database is printed as IPv4 */
+LOCAL void format_network(MMDB_s *mmdb, const uint8_t *address,
+                          uint16_t prefix_length, char *network)
+{
+    char ip[INET6_ADDRSTRLEN];
+    static const uint8_t ipv4_prefix[12] = { 0 };
+    if (4 == mmdb->metadata.ip_version) {
+        inet_ntop(AF_INET, address, ip, sizeof(ip));
+    } else if (prefix_length >= 96 && 0 == memcmp(address, ipv4_prefix, 12)) {
+        inet_ntop(AF_INET, address + 12, ip, sizeof(ip));
+        prefix_length -= 96;
+    } else {
+        inet_ntop(AF_INET6, address, ip, sizeof(ip));
+    }
+    sprintf(network, "%s/%u", ip, prefix_length);
+}
+
+LOCAL int print_json(diff_output_s *output, MMDB_entry_s *entry)
+{
+    size_t needed;
+    int status = MMDB_entry_to_json(entry, output->json,
+                                    output->json_capacity, &needed);
+    if (MMDB_BUFFER_TOO_SMALL_ERROR == status) {
+        char *bigger = realloc(output->json, needed * 2);
+        if (NULL == bigger) {
+            return MMDB_OUT_OF_MEMORY_ERROR;
+        }
+        output->json = bigger;
+        output->json_capacity = needed * 2;
+        status = MMDB_entry_to_json(entry, output->json,
+                                    output->json_capacity, &needed);
+    }
+    if (MMDB_SUCCESS == status) {
+        fprintf(stdout, "\t%s", output->json);
+    }
+    return status;
+}
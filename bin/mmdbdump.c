@@ -0,0 +1,474 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "maxminddb.h"
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This writes every network in a database, along with its record as JSON,
+ * using a pool of threads. The search tree is split near its root into
+ * subtrees, which are listed in address order. The threads take subtrees
+ * from a shared queue and each one walks its subtree with a network
+ * iterator, writing its lines into a buffer. A buffer is written out once
+ * every subtree before it has been written, so the output is sorted by
+ * address no matter how many threads there are. */
+
+#define MAX_THREADS (256)
+/* The search tree is split into about this many subtrees per thread so
+ * that a thread that gets a small subtree can take another one */
+#define SUBTREES_PER_THREAD (64)
+
+typedef struct subtree_s {
+    uint8_t address[16];
+    uint16_t prefix_length;
+    uint32_t node;
+    bool is_search_node;
+    /* This is filled in by the thread that walks the subtree */
+    char *output;
+    size_t output_size;
+    bool done;
+} subtree_s;
+
+typedef struct subtree_list_s {
+    subtree_s *subtrees;
+    size_t count;
+    size_t capacity;
+} subtree_list_s;
+
+typedef struct shared_state_s {
+    MMDB_s *mmdb;
+    subtree_list_s list;
+    /* This is the next subtree to hand out */
+    size_t next_item;
+    /* This is the next subtree to write out */
+    size_t next_output;
+    pthread_mutex_t output_lock;
+    int status;
+} shared_state_s;
+
+typedef struct worker_s {
+    shared_state_s *shared;
+    pthread_t thread;
+    char *json;
+    size_t json_capacity;
+} worker_s;
+
+typedef struct buffer_s {
+    char *data;
+    size_t size;
+    size_t capacity;
+} buffer_s;
+
+#define LOCAL
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void usage(char *program, int exit_code, const char *error);
+LOCAL void get_options(int argc, char **argv, char **mmdb_file,
+                       int *thread_count);
+LOCAL void split_search_tree(shared_state_s *shared, int thread_count);
+LOCAL void add_subtree(subtree_list_s *list, const uint8_t *address,
+                       uint16_t prefix_length, uint64_t record,
+                       bool is_search_node);
+LOCAL void add_child(MMDB_s *mmdb, subtree_list_s *list,
+                     const uint8_t *address, uint16_t prefix_length,
+                     bool right, uint64_t record, uint8_t type);
+LOCAL void *dump_subtrees(void *arg);
+LOCAL int dump_subtree(worker_s *worker, subtree_s *subtree,
+                       buffer_s *buffer);
+LOCAL int append_network(worker_s *worker, MMDB_network_s *network,
+                         buffer_s *buffer);
+LOCAL void write_finished_subtrees(shared_state_s *shared);
+LOCAL void append(buffer_s *buffer, const char *data, size_t size);
+LOCAL void *xrealloc(void *p, size_t size);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    char *mmdb_file = NULL;
+    int thread_count = 0;
+
+    get_options(argc, argv, &mmdb_file, &thread_count);
+
+    MMDB_s mmdb;
+    int status = MMDB_open(mmdb_file, MMDB_MODE_MMAP, &mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", mmdb_file,
+                MMDB_strerror(status));
+        exit(2);
+    }
+
+    shared_state_s shared = {
+        .mmdb   = &mmdb,
+        .status = MMDB_SUCCESS
+    };
+    pthread_mutex_init(&shared.output_lock, NULL);
+    worker_s *workers = calloc(thread_count, sizeof(worker_s));
+    if (NULL == workers) {
+        fprintf(stderr, "\n  Out of memory\n\n");
+        exit(2);
+    }
+
+    split_search_tree(&shared, thread_count);
+
+    fprintf(stdout, "network,data\n");
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].shared = &shared;
+    }
+    for (int i = 1; i < thread_count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, dump_subtrees,
+                           &workers[i])) {
+            fprintf(stderr, "\n  Can't create a thread\n\n");
+            exit(2);
+        }
+    }
+    /* The main thread does its share of the work too */
+    dump_subtrees(&workers[0]);
+    for (int i = 1; i < thread_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    if (MMDB_SUCCESS != shared.status) {
+        fprintf(stderr, "\n  Can't read the search tree - %s\n\n",
+                MMDB_strerror(shared.status));
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        free(workers[i].json);
+    }
+    free(workers);
+    free(shared.list.subtrees);
+    pthread_mutex_destroy(&shared.output_lock);
+    MMDB_close(&mmdb);
+
+    exit(MMDB_SUCCESS == shared.status ? 0 : 1);
+}
+
+LOCAL void usage(char *program, int exit_code, const char *error)
+{
+    if (NULL != error) {
+        fprintf(stderr, "\n  *ERROR: %s\n", error);
+    }
+
+    char *usage = "\n"
+                  "  %s --file /path/to/file.mmdb\n"
+                  "\n"
+                  "  This application accepts the following options:\n"
+                  "\n"
+                  "      --file (-f)     The path to the MMDB file. Required.\n"
+                  "\n"
+                  "      --threads (-t)  The number of threads to use. This defaults to the\n"
+                  "                      number of online CPUs.\n"
+                  "\n"
+                  "      --version       Print the program's version number and exit.\n"
+                  "\n"
+                  "      --help (-h -?)  Show usage information.\n"
+                  "\n"
+                  "  This writes every network in the database as CSV, one line per network,\n"
+                  "  with the network in CIDR form and its record as JSON. The lines are\n"
+                  "  sorted by address.\n"
+                  "\n";
+
+    fprintf(stdout, usage, program);
+    exit(exit_code);
+}
+
+LOCAL void get_options(int argc, char **argv, char **mmdb_file,
+                       int *thread_count)
+{
+    static int help = 0;
+    static int version = 0;
+
+    while (1) {
+        static struct option options[] = {
+            { "file",    required_argument, 0, 'f' },
+            { "threads", required_argument, 0, 't' },
+            { "version", no_argument,       0, 'n' },
+            { "help",    no_argument,       0, 'h' },
+            { "?",       no_argument,       0, 1   },
+            { 0,         0,                 0, 0   }
+        };
+
+        int opt_index;
+        int opt_char = getopt_long(argc, argv, "f:t:nh?", options,
+                                   &opt_index);
+
+        if (-1 == opt_char) {
+            break;
+        }
+
+        if ('f' == opt_char) {
+            *mmdb_file = optarg;
+        } else if ('t' == opt_char) {
+            *thread_count = strtol(optarg, NULL, 10);
+        } else if ('n' == opt_char) {
+            version = 1;
+        } else if ('h' == opt_char || '?' == opt_char) {
+            help = 1;
+        }
+    }
+
+    char *program = basename(argv[0]);
+
+    if (help) {
+        usage(program, 0, NULL);
+    }
+
+    if (version) {
+        fprintf(stdout, "\n  %s version %s\n\n", program, VERSION);
+        exit(0);
+    }
+
+    if (NULL == *mmdb_file) {
+        usage(program, 1, "You must provide a filename with --file");
+    }
+
+    if (0 == *thread_count) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        *thread_count = cpus > 0 ? (int)cpus : 1;
+    }
+    if (*thread_count < 1 || *thread_count > MAX_THREADS) {
+        usage(program, 1, "The number of threads must be from 1 to 256");
+    }
+}
+
+/* This splits the top of the search tree one level at a time until there
+ * are enough subtrees to keep all of the threads busy. Each round replaces
+ * every subtree that starts at a search node with its two children, so the
+ * list stays in address order. Records with no data, or with a single
+ * network, stay in the list as they are, since they are cheap to walk. */
+LOCAL void split_search_tree(shared_state_s *shared, int thread_count)
+{
+    MMDB_s *mmdb = shared->mmdb;
+    size_t wanted = (size_t)thread_count * SUBTREES_PER_THREAD;
+    static const uint8_t root_address[16] = { 0 };
+
+    subtree_list_s list = { 0 };
+    add_subtree(&list, root_address, 0, 0, true);
+
+    size_t search_nodes = 1, split = 1;
+    while (split > 0 && search_nodes < wanted) {
+        subtree_list_s next = { 0 };
+        search_nodes = split = 0;
+        for (size_t i = 0; i < list.count; i++) {
+            subtree_s *subtree = &list.subtrees[i];
+            /* If the node can't be read, the iterator reports the error
+             * when it gets to it */
+            MMDB_search_node_s node;
+            if (!subtree->is_search_node
+                || subtree->prefix_length + 1 >= mmdb->depth
+                || MMDB_SUCCESS != MMDB_read_node(mmdb, subtree->node,
+                                                  &node)) {
+                add_subtree(&next, subtree->address, subtree->prefix_length,
+                            subtree->node, subtree->is_search_node);
+                continue;
+            }
+
+            add_child(mmdb, &next, subtree->address, subtree->prefix_length,
+                      false, node.left_record, node.left_record_type);
+            add_child(mmdb, &next, subtree->address, subtree->prefix_length,
+                      true, node.right_record, node.right_record_type);
+            split++;
+        }
+        for (size_t i = 0; i < next.count; i++) {
+            search_nodes += next.subtrees[i].is_search_node;
+        }
+        free(list.subtrees);
+        list = next;
+    }
+
+    shared->list = list;
+}
+
+LOCAL void add_subtree(subtree_list_s *list, const uint8_t *address,
+                       uint16_t prefix_length, uint64_t record,
+                       bool is_search_node)
+{
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity * 2 + 64;
+        list->subtrees = xrealloc(list->subtrees,
+                                  list->capacity * sizeof(subtree_s));
+    }
+
+    subtree_s *subtree = &list->subtrees[list->count++];
+    memset(subtree, 0, sizeof(subtree_s));
+    memcpy(subtree->address, address, 16);
+    subtree->prefix_length = prefix_length;
+    subtree->node = (uint32_t)record;
+    subtree->is_search_node = is_search_node;
+}
+
+/* A lot of the tree is a chain of nodes where one record is empty, like the
+ * path down to the IPv4 part of an IPv6 database. Splitting those one level
+ * at a time would leave almost all of the work in one subtree, so we follow
+ * such a chain down to the next node with two subtrees. */
+LOCAL void add_child(MMDB_s *mmdb, subtree_list_s *list,
+                     const uint8_t *address, uint16_t prefix_length,
+                     bool right, uint64_t record, uint8_t type)
+{
+    uint8_t child_address[16];
+    memcpy(child_address, address, 16);
+    if (right) {
+        child_address[prefix_length / 8] |= 0x80 >> (prefix_length % 8);
+    }
+    prefix_length++;
+
+    MMDB_search_node_s node;
+    if (MMDB_RECORD_TYPE_SEARCH_NODE != type
+        || prefix_length + 1 >= mmdb->depth
+        || MMDB_SUCCESS != MMDB_read_node(mmdb, (uint32_t)record, &node)) {
+        add_subtree(list, child_address, prefix_length, record,
+                    MMDB_RECORD_TYPE_SEARCH_NODE == type);
+        return;
+    }
+
+    bool left_is_node = MMDB_RECORD_TYPE_SEARCH_NODE == node.left_record_type;
+    bool right_is_node =
+        MMDB_RECORD_TYPE_SEARCH_NODE == node.right_record_type;
+    if (left_is_node == right_is_node) {
+        add_subtree(list, child_address, prefix_length, record,
+                    MMDB_RECORD_TYPE_SEARCH_NODE == type);
+        return;
+    }
+
+    add_child(mmdb, list, child_address, prefix_length, false,
+              node.left_record, node.left_record_type);
+    add_child(mmdb, list, child_address, prefix_length, true,
+              node.right_record, node.right_record_type);
+}
+
+LOCAL void *dump_subtrees(void *arg)
+{
+    worker_s *worker = arg;
+    shared_state_s *shared = worker->shared;
+
+    size_t i;
+    while ((i = __sync_fetch_and_add(&shared->next_item, 1)) <
+           shared->list.count) {
+        subtree_s *subtree = &shared->list.subtrees[i];
+        buffer_s buffer = { 0 };
+        int status = dump_subtree(worker, subtree, &buffer);
+
+        pthread_mutex_lock(&shared->output_lock);
+        if (MMDB_SUCCESS != status && MMDB_SUCCESS == shared->status) {
+            shared->status = status;
+        }
+        subtree->output = buffer.data;
+        subtree->output_size = buffer.size;
+        subtree->done = true;
+        write_finished_subtrees(shared);
+        pthread_mutex_unlock(&shared->output_lock);
+    }
+
+    return NULL;
+}
+
+LOCAL int dump_subtree(worker_s *worker, subtree_s *subtree,
+                       buffer_s *buffer)
+{
+    MMDB_network_iterator_s iterator;
+    int status = MMDB_network_iterator_init_subtree(
+        worker->shared->mmdb, 0, subtree->address, subtree->prefix_length,
+        &iterator);
+
+    MMDB_network_s network;
+    bool found_network;
+    while (MMDB_SUCCESS == status
+           && MMDB_SUCCESS == (status = MMDB_network_iterator_next(
+                                   &iterator, &network, &found_network))
+           && found_network) {
+        status = append_network(worker, &network, buffer);
+    }
+
+    return status;
+}
+
+/* This writes one line of CSV. The JSON is quoted the CSV way, by doubling
+ * each double quote in it. An IPv4 network in an IPv6 database is written
+ * as IPv4. */
+LOCAL int append_network(worker_s *worker, MMDB_network_s *network,
+                         buffer_s *buffer)
+{
+    char address[INET6_ADDRSTRLEN];
+    char line[INET6_ADDRSTRLEN + 8];
+    static const uint8_t ipv4_prefix[12] = { 0 };
+    if (4 == worker->shared->mmdb->metadata.ip_version) {
+        inet_ntop(AF_INET, network->address, address, sizeof(address));
+        sprintf(line, "%s/%u,\"", address, network->prefix_length);
+    } else if (network->prefix_length >= 96
+               && 0 == memcmp(network->address, ipv4_prefix, 12)) {
+        inet_ntop(AF_INET, network->address + 12, address, sizeof(address));
+        sprintf(line, "%s/%u,\"", address, network->prefix_length - 96);
+    } else {
+        inet_ntop(AF_INET6, network->address, address, sizeof(address));
+        sprintf(line, "%s/%u,\"", address, network->prefix_length);
+    }
+    append(buffer, line, strlen(line));
+
+    size_t needed;
+    int status = MMDB_entry_to_json(&network->entry, worker->json,
+                                    worker->json_capacity, &needed);
+    if (MMDB_BUFFER_TOO_SMALL_ERROR == status) {
+        worker->json_capacity = needed * 2;
+        worker->json = xrealloc(worker->json, worker->json_capacity);
+        status = MMDB_entry_to_json(&network->entry, worker->json,
+                                    worker->json_capacity, &needed);
+    }
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+
+    /* needed includes the terminating NUL */
+    const char *start = worker->json;
+    const char *end = worker->json + needed - 1;
+    for (const char *quote; (quote = memchr(start, '"', end - start));
+         start = quote + 1) {
+        append(buffer, start, quote + 1 - start);
+        append(buffer, "\"", 1);
+    }
+    append(buffer, start, end - start);
+    append(buffer, "\"\n", 2);
+
+    return MMDB_SUCCESS;
+}
+
+/* The caller must hold the output lock */
+LOCAL void write_finished_subtrees(shared_state_s *shared)
+{
+    while (shared->next_output < shared->list.count
+           && shared->list.subtrees[shared->next_output].done) {
+        subtree_s *subtree = &shared->list.subtrees[shared->next_output++];
+        if (subtree->output_size > 0) {
+            fwrite(subtree->output, 1, subtree->output_size, stdout);
+        }
+        free(subtree->output);
+        subtree->output = NULL;
+    }
+}
+
+LOCAL void append(buffer_s *buffer, const char *data, size_t size)
+{
+    if (buffer->size + size > buffer->capacity) {
+        buffer->capacity = (buffer->size + size) * 2 + 4096;
+        buffer->data = xrealloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+LOCAL void *xrealloc(void *p, size_t size)
+{
+    void *new = realloc(p, size);
+    if (NULL == new) {
+        fprintf(stderr, "\n  Out of memory\n\n");
+        exit(2);
+    }
+    return new;
+}
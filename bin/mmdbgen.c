@@ -0,0 +1,740 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "maxminddb.h"
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This generates a database of a given size and shape with the writer, for
+ * testing the library on trees and records larger than any real database.
+ * Everything comes from one seeded random number generator, so the same
+ * options and seed always give the same database.
+ *
+ * The networks are generated in ascending order of address, which is much
+ * faster to insert than random order. Before each network, a random gap is
+ * left after the previous one. The gaps are sized from the nodes each
+ * network has needed so far, so that the networks are spread over the whole
+ * address space by the time the tree reaches the requested node count. In
+ * an IPv6 database, half of the nodes are used for IPv4 networks in ::/96
+ * and the rest for IPv6 networks in 2000::/3.
+ *
+ * Each record is a map with an "id" key, so that every record is distinct,
+ * and then the requested number of keys. Above the requested depth, every
+ * other key is a nested map. The nested maps also have a "names" map with a
+ * name in each language, like the maps in the GeoIP2 databases. */
+
+#define MAX_PREFIX_LENGTHS (129)
+#define MAX_LANGUAGES (64)
+#define MAX_RECORD_VALUES (1 << 20)
+#define WORD_COUNT (65536)
+#define WORD_SIZE (12)
+
+typedef struct prefix_lengths_s {
+    uint32_t count;
+    uint16_t lengths[MAX_PREFIX_LENGTHS];
+    uint32_t weights[MAX_PREFIX_LENGTHS];
+    uint64_t total_weight;
+    uint64_t mean_length;
+} prefix_lengths_s;
+
+typedef struct options_s {
+    char *output_file;
+    uint32_t nodes;
+    uint16_t ip_version;
+    uint16_t record_size;
+    prefix_lengths_s ipv4_lengths;
+    prefix_lengths_s ipv6_lengths;
+    uint32_t records;
+    uint32_t keys;
+    uint32_t depth;
+    uint32_t languages;
+    uint64_t seed;
+    char *database_type;
+} options_s;
+
+typedef struct generator_s {
+    options_s *options;
+    MMDB_writer_s writer;
+    uint64_t random;
+    char *words;
+    uint8_t *word_sizes;
+    char (*key_names)[24];
+    const char *languages[MAX_LANGUAGES];
+    char language_codes[MAX_LANGUAGES][8];
+    MMDB_entry_data_s *values;
+    uint32_t value_count;
+    uint32_t *records;
+    uint64_t networks;
+} generator_s;
+
+/* The default lengths are roughly those of the networks in a commercial
+ * database */
+static const char *default_ipv4_lengths = "16:2,20:8,22:15,24:65,28:5,32:5";
+static const char *default_ipv6_lengths = "32:10,40:15,48:50,56:10,64:15";
+
+static const char *real_languages[] = {
+    "en", "de", "es", "fr", "ja", "pt-BR", "ru", "zh-CN"
+};
+
+static const uint32_t scalar_types[] = {
+    MMDB_DATA_TYPE_UTF8_STRING, MMDB_DATA_TYPE_UINT32,
+    MMDB_DATA_TYPE_DOUBLE,      MMDB_DATA_TYPE_UTF8_STRING,
+    MMDB_DATA_TYPE_BOOLEAN,     MMDB_DATA_TYPE_UINT16,
+    MMDB_DATA_TYPE_UTF8_STRING, MMDB_DATA_TYPE_UINT64,
+    MMDB_DATA_TYPE_INT32,       MMDB_DATA_TYPE_FLOAT
+};
+
+#define LOCAL
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void usage(char *program, int exit_code, const char *error);
+LOCAL void get_options(int argc, char **argv, options_s *options);
+LOCAL bool parse_number(const char *string, uint64_t min, uint64_t max,
+                        uint64_t *number);
+LOCAL bool parse_prefix_lengths(const char *list, uint16_t max_length,
+                                prefix_lengths_s *lengths);
+LOCAL uint64_t record_value_count(options_s *options, uint32_t level);
+LOCAL void set_up_generator(generator_s *gen, options_s *options);
+LOCAL uint64_t random_next(uint64_t *state);
+LOCAL void add_records(generator_s *gen);
+LOCAL MMDB_entry_data_s *add_value(generator_s *gen, uint32_t type);
+LOCAL void add_string(generator_s *gen, const char *string);
+LOCAL void add_word(generator_s *gen);
+LOCAL void add_map(generator_s *gen, uint32_t level, uint32_t id);
+LOCAL void add_scalar(generator_s *gen, uint32_t type);
+LOCAL void add_networks(generator_s *gen, prefix_lengths_s *lengths,
+                        bool ipv6, uint32_t node_target);
+LOCAL uint16_t random_length(generator_s *gen, prefix_lengths_s *lengths);
+LOCAL void insert_network(generator_s *gen, bool ipv6, uint64_t position,
+                          uint16_t length);
+LOCAL void write_database(generator_s *gen);
+LOCAL void free_generator(generator_s *gen);
+LOCAL void *xcalloc(size_t count, size_t size);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    options_s options = {
+        .nodes         = 1000000,
+        .ip_version    = 6,
+        .record_size   = 28,
+        .records       = 10000,
+        .keys          = 8,
+        .depth         = 2,
+        .languages     = 8,
+        .seed          = 1,
+        .database_type = "mmdbgen"
+    };
+
+    get_options(argc, argv, &options);
+
+    generator_s gen;
+    set_up_generator(&gen, &options);
+    add_records(&gen);
+
+    if (4 == options.ip_version) {
+        add_networks(&gen, &options.ipv4_lengths, false, options.nodes);
+    } else {
+        add_networks(&gen, &options.ipv4_lengths, false, options.nodes / 2);
+        add_networks(&gen, &options.ipv6_lengths, true, options.nodes);
+    }
+
+    write_database(&gen);
+
+    fprintf(stdout, "networks\t%llu\nnodes\t%u\nrecords\t%u\ndata_size\t%u\n",
+            (unsigned long long)gen.networks, gen.writer.node_count,
+            options.records, gen.writer.data_size);
+
+    free_generator(&gen);
+    exit(0);
+}
+
+LOCAL void usage(char *program, int exit_code, const char *error)
+{
+    if (NULL != error) {
+        fprintf(stderr, "\n  *ERROR: %s\n", error);
+    }
+
+    char *usage = "\n"
+                  "  %s --output /path/to/file.mmdb [--nodes N] [--seed N]\n"
+                  "\n"
+                  "  This application accepts the following options:\n"
+                  "\n"
+                  "      --output (-o)               The path to write the MMDB file to.\n"
+                  "                                  Required.\n"
+                  "\n"
+                  "      --nodes (-n)                The number of nodes in the search tree.\n"
+                  "                                  This defaults to 1000000.\n"
+                  "\n"
+                  "      --ip-version (-i)           4 or 6. This defaults to 6.\n"
+                  "\n"
+                  "      --record-size (-r)          24, 28 or 32. This defaults to 28.\n"
+                  "\n"
+                  "      --ipv4-prefix-lengths (-4)  The IPv4 prefix lengths to use, as a\n"
+                  "                                  comma separated list of LENGTH:WEIGHT.\n"
+                  "                                  This defaults to\n"
+                  "                                  16:2,20:8,22:15,24:65,28:5,32:5.\n"
+                  "\n"
+                  "      --ipv6-prefix-lengths (-6)  The IPv6 prefix lengths to use. This\n"
+                  "                                  defaults to 32:10,40:15,48:50,56:10,64:15.\n"
+                  "\n"
+                  "      --records (-R)              The number of distinct records. This\n"
+                  "                                  defaults to 10000.\n"
+                  "\n"
+                  "      --keys (-k)                 The number of keys in each map of a\n"
+                  "                                  record. This defaults to 8.\n"
+                  "\n"
+                  "      --depth (-d)                How deeply maps are nested in a record.\n"
+                  "                                  This defaults to 2.\n"
+                  "\n"
+                  "      --languages (-l)            The number of languages in each names\n"
+                  "                                  map. This defaults to 8.\n"
+                  "\n"
+                  "      --seed (-s)                 The seed for the random numbers. This\n"
+                  "                                  defaults to 1.\n"
+                  "\n"
+                  "      --database-type (-t)        The database_type in the metadata. This\n"
+                  "                                  defaults to \"mmdbgen\".\n"
+                  "\n"
+                  "      --version                   Print the program's version number and\n"
+                  "                                  exit.\n"
+                  "\n"
+                  "      --help (-h -?)              Show usage information.\n"
+                  "\n"
+                  "  This generates a database with the given number of nodes and shape of\n"
+                  "  record. The same options and seed always give the same database. When\n"
+                  "  it is done, it prints the number of networks, nodes and records and the\n"
+                  "  size of the data section.\n"
+                  "\n";
+
+    fprintf(stdout, usage, program);
+    exit(exit_code);
+}
+
+LOCAL void get_options(int argc, char **argv, options_s *options)
+{
+    static int help = 0;
+    static int version = 0;
+    const char *ipv4_lengths = default_ipv4_lengths;
+    const char *ipv6_lengths = default_ipv6_lengths;
+    char *program = basename(argv[0]);
+    uint64_t number;
+
+    while (1) {
+        static struct option long_options[] = {
+            { "output",              required_argument, 0, 'o' },
+            { "nodes",               required_argument, 0, 'n' },
+            { "ip-version",          required_argument, 0, 'i' },
+            { "record-size",         required_argument, 0, 'r' },
+            { "ipv4-prefix-lengths", required_argument, 0, '4' },
+            { "ipv6-prefix-lengths", required_argument, 0, '6' },
+            { "records",             required_argument, 0, 'R' },
+            { "keys",                required_argument, 0, 'k' },
+            { "depth",               required_argument, 0, 'd' },
+            { "languages",           required_argument, 0, 'l' },
+            { "seed",                required_argument, 0, 's' },
+            { "database-type",       required_argument, 0, 't' },
+            { "version",             no_argument,       0, 'v' },
+            { "help",                no_argument,       0, 'h' },
+            { "?",                   no_argument,       0, 1   },
+            { 0,                     0,                 0, 0   }
+        };
+
+        int opt_index;
+        int opt_char = getopt_long(argc, argv, "o:n:i:r:4:6:R:k:d:l:s:t:h?",
+                                   long_options, &opt_index);
+
+        if (-1 == opt_char) {
+            break;
+        }
+
+        if ('o' == opt_char) {
+            options->output_file = optarg;
+        } else if ('n' == opt_char) {
+            if (!parse_number(optarg, 1, MMDB_WRITER_DATA_RECORD - 1,
+                              &number)) {
+                usage(program, 1, "The number of nodes must be from 1 to "
+                      "2147483647");
+            }
+            options->nodes = (uint32_t)number;
+        } else if ('i' == opt_char) {
+            if (!parse_number(optarg, 4, 6, &number) || 5 == number) {
+                usage(program, 1, "The IP version must be 4 or 6");
+            }
+            options->ip_version = (uint16_t)number;
+        } else if ('r' == opt_char) {
+            if (!parse_number(optarg, 24, 32, &number)
+                || (24 != number && 28 != number && 32 != number)) {
+                usage(program, 1, "The record size must be 24, 28 or 32");
+            }
+            options->record_size = (uint16_t)number;
+        } else if ('4' == opt_char) {
+            ipv4_lengths = optarg;
+        } else if ('6' == opt_char) {
+            ipv6_lengths = optarg;
+        } else if ('R' == opt_char) {
+            if (!parse_number(optarg, 1, 100000000, &number)) {
+                usage(program, 1, "The number of records must be from 1 to "
+                      "100000000");
+            }
+            options->records = (uint32_t)number;
+        } else if ('k' == opt_char) {
+            if (!parse_number(optarg, 1, 256, &number)) {
+                usage(program, 1, "The number of keys must be from 1 to 256");
+            }
+            options->keys = (uint32_t)number;
+        } else if ('d' == opt_char) {
+            if (!parse_number(optarg, 1, 8, &number)) {
+                usage(program, 1, "The depth must be from 1 to 8");
+            }
+            options->depth = (uint32_t)number;
+        } else if ('l' == opt_char) {
+            if (!parse_number(optarg, 0, MAX_LANGUAGES, &number)) {
+                usage(program, 1, "The number of languages must be from 0 to "
+                      "64");
+            }
+            options->languages = (uint32_t)number;
+        } else if ('s' == opt_char) {
+            if (!parse_number(optarg, 0, UINT64_MAX, &number)) {
+                usage(program, 1, "The seed must be a number");
+            }
+            options->seed = number;
+        } else if ('t' == opt_char) {
+            options->database_type = optarg;
+        } else if ('v' == opt_char) {
+            version = 1;
+        } else if ('h' == opt_char || '?' == opt_char) {
+            help = 1;
+        }
+    }
+
+    if (help) {
+        usage(program, 0, NULL);
+    }
+
+    if (version) {
+        fprintf(stdout, "\n  %s version %s\n\n", program, VERSION);
+        exit(0);
+    }
+
+    if (NULL == options->output_file) {
+        usage(program, 1, "You must provide a filename with --output");
+    }
+
+    if (!parse_prefix_lengths(ipv4_lengths, 32, &options->ipv4_lengths)) {
+        usage(program, 1, "The IPv4 prefix lengths must be a list of "
+              "LENGTH:WEIGHT with lengths from 8 to 32");
+    }
+    if (!parse_prefix_lengths(ipv6_lengths, 128, &options->ipv6_lengths)) {
+        usage(program, 1, "The IPv6 prefix lengths must be a list of "
+              "LENGTH:WEIGHT with lengths from 8 to 128");
+    }
+
+    if (record_value_count(options, 1) > MAX_RECORD_VALUES) {
+        usage(program, 1, "The keys and depth give records with more than "
+              "1048576 values");
+    }
+}
+
+LOCAL bool parse_number(const char *string, uint64_t min, uint64_t max,
+                        uint64_t *number)
+{
+    char *end;
+    if (*string < '0' || *string > '9') {
+        return false;
+    }
+    *number = strtoull(string, &end, 10);
+    return '\0' == *end && *number >= min && *number <= max;
+}
+
+/* The list is LENGTH[:WEIGHT][,LENGTH[:WEIGHT]]..., where a missing weight
+ * is 1 */
+LOCAL bool parse_prefix_lengths(const char *list, uint16_t max_length,
+                                prefix_lengths_s *lengths)
+{
+    memset(lengths, 0, sizeof(prefix_lengths_s));
+    uint64_t weighted_lengths = 0;
+    const char *p = list;
+
+    while (1) {
+        char *end;
+        if (*p < '0' || *p > '9'
+            || MAX_PREFIX_LENGTHS == lengths->count) {
+            return false;
+        }
+        unsigned long length = strtoul(p, &end, 10);
+        unsigned long weight = 1;
+        if (':' == *end) {
+            p = end + 1;
+            if (*p < '0' || *p > '9') {
+                return false;
+            }
+            weight = strtoul(p, &end, 10);
+        }
+        if (length < 8 || length > max_length || weight < 1
+            || weight > 1000000) {
+            return false;
+        }
+
+        lengths->lengths[lengths->count] = (uint16_t)length;
+        lengths->weights[lengths->count++] = (uint32_t)weight;
+        lengths->total_weight += weight;
+        weighted_lengths += (uint64_t)length * weight;
+
+        if ('\0' == *end) {
+            break;
+        }
+        if (',' != *end) {
+            return false;
+        }
+        p = end + 1;
+    }
+
+    lengths->mean_length = weighted_lengths / lengths->total_weight;
+    return true;
+}
+
+/* This counts the entry data values in the map at the given level of a
+ * record. It stops counting once there are too many. */
+LOCAL uint64_t record_value_count(options_s *options, uint32_t level)
+{
+    uint64_t count = 1 + options->keys;
+    if (1 == level) {
+        count += 2;
+    }
+    if (options->languages > 0 && (level > 1 || 1 == options->depth)) {
+        count += 2 + 2 * options->languages;
+    }
+    for (uint32_t k = 0; k < options->keys; k++) {
+        if (level < options->depth && 0 == k % 2) {
+            count += record_value_count(options, level + 1);
+        } else {
+            count++;
+        }
+        if (count > MAX_RECORD_VALUES) {
+            break;
+        }
+    }
+    return count;
+}
+
+LOCAL void set_up_generator(generator_s *gen, options_s *options)
+{
+    memset(gen, 0, sizeof(generator_s));
+    gen->options = options;
+    gen->random = options->seed;
+
+    int status = MMDB_writer_init(&gen->writer, options->ip_version,
+                                  options->record_size);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't set up the writer - %s\n\n",
+                MMDB_strerror(status));
+        exit(2);
+    }
+
+    /* SOURCE_DATE_EPOCH is the usual way to ask for a reproducible build */
+    const char *epoch = getenv("SOURCE_DATE_EPOCH");
+    uint64_t number;
+    if (NULL != epoch && parse_number(epoch, 0, UINT64_MAX, &number)) {
+        gen->writer.metadata.build_epoch = number;
+    }
+
+    gen->words = xcalloc(WORD_COUNT, WORD_SIZE);
+    gen->word_sizes = xcalloc(WORD_COUNT, 1);
+    for (uint32_t i = 0; i < WORD_COUNT; i++) {
+        uint8_t size = 3 + random_next(&gen->random) % (WORD_SIZE - 2);
+        for (uint8_t j = 0; j < size; j++) {
+            gen->words[i * WORD_SIZE + j] =
+                'a' + random_next(&gen->random) % 26;
+        }
+        gen->word_sizes[i] = size;
+    }
+
+    gen->key_names = xcalloc(options->keys, sizeof(gen->key_names[0]));
+    for (uint32_t k = 0; k < options->keys; k++) {
+        snprintf(gen->key_names[k], sizeof(gen->key_names[0]), "field_%u", k);
+    }
+
+    for (uint32_t i = 0; i < options->languages; i++) {
+        if (i < sizeof(real_languages) / sizeof(real_languages[0])) {
+            gen->languages[i] = real_languages[i];
+        } else {
+            snprintf(gen->language_codes[i], sizeof(gen->language_codes[0]),
+                     "x-%u", i);
+            gen->languages[i] = gen->language_codes[i];
+        }
+    }
+
+    gen->writer.metadata.database_type = options->database_type;
+    gen->writer.metadata.languages.count = options->languages;
+    gen->writer.metadata.languages.names = gen->languages;
+
+    gen->values = xcalloc(record_value_count(options, 1),
+                          sizeof(MMDB_entry_data_s));
+    gen->records = xcalloc(options->records, sizeof(uint32_t));
+}
+
+/* This is splitmix64, which gives the same numbers for the same seed
+ * everywhere */
+LOCAL uint64_t random_next(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+LOCAL void add_records(generator_s *gen)
+{
+    for (uint32_t i = 0; i < gen->options->records; i++) {
+        gen->value_count = 0;
+        add_map(gen, 1, i);
+        int status = MMDB_writer_add_record(&gen->writer, gen->values,
+                                            gen->value_count,
+                                            &gen->records[i]);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "\n  Can't add record %u - %s\n\n", i,
+                    MMDB_strerror(status));
+            exit(3);
+        }
+    }
+}
+
+LOCAL MMDB_entry_data_s *add_value(generator_s *gen, uint32_t type)
+{
+    MMDB_entry_data_s *value = &gen->values[gen->value_count++];
+    memset(value, 0, sizeof(MMDB_entry_data_s));
+    value->type = type;
+    return value;
+}
+
+LOCAL void add_string(generator_s *gen, const char *string)
+{
+    MMDB_entry_data_s *value = add_value(gen, MMDB_DATA_TYPE_UTF8_STRING);
+    value->utf8_string = string;
+    value->data_size = (uint32_t)strlen(string);
+}
+
+LOCAL void add_word(generator_s *gen)
+{
+    uint32_t word = random_next(&gen->random) % WORD_COUNT;
+    MMDB_entry_data_s *value = add_value(gen, MMDB_DATA_TYPE_UTF8_STRING);
+    value->utf8_string = &gen->words[word * WORD_SIZE];
+    value->data_size = gen->word_sizes[word];
+}
+
+LOCAL void add_map(generator_s *gen, uint32_t level, uint32_t id)
+{
+    options_s *options = gen->options;
+    bool has_names = options->languages > 0
+                     && (level > 1 || 1 == options->depth);
+
+    MMDB_entry_data_s *map = add_value(gen, MMDB_DATA_TYPE_MAP);
+    map->data_size = options->keys + (1 == level) + has_names;
+
+    if (1 == level) {
+        add_string(gen, "id");
+        add_value(gen, MMDB_DATA_TYPE_UINT32)->uint32 = id;
+    }
+    if (has_names) {
+        add_string(gen, "names");
+        add_value(gen, MMDB_DATA_TYPE_MAP)->data_size = options->languages;
+        for (uint32_t i = 0; i < options->languages; i++) {
+            add_string(gen, gen->languages[i]);
+            add_word(gen);
+        }
+    }
+    for (uint32_t k = 0; k < options->keys; k++) {
+        add_string(gen, gen->key_names[k]);
+        if (level < options->depth && 0 == k % 2) {
+            add_map(gen, level + 1, id);
+        } else {
+            uint32_t types = sizeof(scalar_types) / sizeof(scalar_types[0]);
+            add_scalar(gen, scalar_types[k % types]);
+        }
+    }
+}
+
+/* The doubles and floats are made from the top bits of a random number, so
+ * they are the same everywhere */
+LOCAL void add_scalar(generator_s *gen, uint32_t type)
+{
+    uint64_t r = random_next(&gen->random);
+    MMDB_entry_data_s *value;
+
+    switch (type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        add_word(gen);
+        return;
+    case MMDB_DATA_TYPE_DOUBLE:
+        value = add_value(gen, type);
+        value->double_value = (double)(r >> 11) / 9007199254740992.0 * 360.0
+                              - 180.0;
+        return;
+    case MMDB_DATA_TYPE_FLOAT:
+        value = add_value(gen, type);
+        value->float_value = (float)(r >> 40) / 16777216.0f * 100.0f;
+        return;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        add_value(gen, type)->boolean = r & 1;
+        return;
+    case MMDB_DATA_TYPE_UINT16:
+        add_value(gen, type)->uint16 = (uint16_t)r;
+        return;
+    case MMDB_DATA_TYPE_UINT32:
+        add_value(gen, type)->uint32 = (uint32_t)r;
+        return;
+    case MMDB_DATA_TYPE_INT32:
+        add_value(gen, type)->int32 = (int32_t)(uint32_t)r;
+        return;
+    case MMDB_DATA_TYPE_UINT64:
+        add_value(gen, type)->uint64 = r;
+        return;
+    }
+}
+
+/* This adds networks in ascending order until the tree has node_target
+ * nodes or the address space runs out. The position is in units of the
+ * smallest network that is placed on its own: a single address for IPv4
+ * and a /64 in 2000::/3 for IPv6. Longer IPv6 networks are placed one to a
+ * /64. */
+LOCAL void add_networks(generator_s *gen, prefix_lengths_s *lengths,
+                        bool ipv6, uint32_t node_target)
+{
+    MMDB_writer_s *writer = &gen->writer;
+    uint64_t space = ipv6 ? 1ULL << 61 : 1ULL << 32;
+    uint64_t position = 0;
+    uint32_t first_node = writer->node_count;
+    uint64_t networks = 0;
+
+    while (writer->node_count < node_target) {
+        uint16_t length = random_length(gen, lengths);
+        uint16_t bits = ipv6 ? 64 : 32;
+        uint64_t size = length < bits ? 1ULL << (bits - length) : 1;
+
+        /* The nodes per network so far start at a guess of the mean prefix
+         * length, which is about right for a sparse tree */
+        uint64_t used = writer->node_count - first_node;
+        uint64_t per_network = (used + lengths->mean_length) / (networks + 1);
+        uint64_t remaining = (node_target - writer->node_count)
+                             / (per_network ? per_network : 1);
+        uint64_t slot = (space - position) / (remaining ? remaining : 1);
+        uint64_t start = position;
+        if (slot > size) {
+            start += random_next(&gen->random) % (2 * (slot - size) + 1);
+        }
+
+        /* A gap that runs past the end is cut short, so that the last few
+         * networks still fit */
+        start = (start + size - 1) & ~(size - 1);
+        if (start >= space || space - start < size) {
+            if (space - position < size) {
+                break;
+            }
+            start = space - size;
+        }
+
+        insert_network(gen, ipv6, start, length);
+        position = start + size;
+        networks++;
+    }
+
+    gen->networks += networks;
+}
+
+LOCAL uint16_t random_length(generator_s *gen, prefix_lengths_s *lengths)
+{
+    uint64_t r = random_next(&gen->random) % lengths->total_weight;
+    uint32_t i = 0;
+    while (r >= lengths->weights[i]) {
+        r -= lengths->weights[i++];
+    }
+    return lengths->lengths[i];
+}
+
+LOCAL void insert_network(generator_s *gen, bool ipv6, uint64_t position,
+                          uint16_t length)
+{
+    uint8_t address[16] = { 0 };
+    uint16_t prefix_length = length;
+
+    if (ipv6) {
+        uint64_t high = 1ULL << 61 | position;
+        uint64_t low = 0;
+        if (128 == length) {
+            low = random_next(&gen->random);
+        } else if (length > 64) {
+            low = random_next(&gen->random) & ~(~0ULL >> (length - 64));
+        }
+        for (int i = 0; i < 8; i++) {
+            address[i] = (uint8_t)(high >> (56 - 8 * i));
+            address[8 + i] = (uint8_t)(low >> (56 - 8 * i));
+        }
+    } else {
+        uint8_t *ipv4 = address;
+        if (6 == gen->options->ip_version) {
+            ipv4 = address + 12;
+            prefix_length += 96;
+        }
+        for (int i = 0; i < 4; i++) {
+            ipv4[i] = (uint8_t)(position >> (24 - 8 * i));
+        }
+    }
+
+    uint32_t record =
+        gen->records[random_next(&gen->random) % gen->options->records];
+    int status = MMDB_writer_insert(&gen->writer, address, prefix_length,
+                                    record);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't insert a network - %s\n\n",
+                MMDB_strerror(status));
+        exit(3);
+    }
+}
+
+LOCAL void write_database(generator_s *gen)
+{
+    char *file = gen->options->output_file;
+    FILE *stream = fopen(file, "wb");
+    if (NULL == stream) {
+        fprintf(stderr, "\n  Can't open %s for writing\n\n", file);
+        exit(2);
+    }
+
+    int status = MMDB_writer_write(&gen->writer, stream);
+    if (0 != fclose(stream) && MMDB_SUCCESS == status) {
+        status = MMDB_IO_ERROR;
+    }
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't write %s - %s\n\n", file,
+                MMDB_strerror(status));
+        unlink(file);
+        exit(3);
+    }
+}
+
+LOCAL void free_generator(generator_s *gen)
+{
+    MMDB_writer_free(&gen->writer);
+    free(gen->words);
+    free(gen->word_sizes);
+    free(gen->key_names);
+    free(gen->values);
+    free(gen->records);
+}
+
+LOCAL void *xcalloc(size_t count, size_t size)
+{
+    void *p = calloc(count, size);
+    if (NULL == p) {
+        fprintf(stderr, "\n  Can't allocate memory\n\n");
+        exit(2);
+    }
+    return p;
+}
@@ -14,26 +14,106 @@
 #define snprintf _snprintf
 #undef UNICODE /* Use the non-UTF16 version of the gai_strerror */
 #else
+#include <arpa/inet.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <unistd.h>
 #endif
 
+#define MAX_THREADS (256)
+/* The input is handed to the threads in blocks of about this many bytes.
+ * There are this many blocks per thread, so that the threads have work
+ * while a slow block holds up the output of the ones after it. */
+#define BLOCK_SIZE (256 * 1024)
+#define BLOCKS_PER_THREAD (4)
+
+typedef struct buffer_s {
+    char *data;
+    size_t size;
+    size_t capacity;
+} buffer_s;
+
+/* This is a block of whole lines of input and, once a thread has looked
+ * them up, the output and the errors for them */
+typedef struct block_s {
+    buffer_s input;
+    buffer_s output;
+    buffer_s errors;
+    bool done;
+} block_s;
+
+typedef struct bulk_s bulk_s;
+typedef struct worker_s worker_s;
+
+/* --bulk needs threads, which are only there on POSIX systems */
+#ifndef _WIN32
+/* The blocks are used as a ring. next_read is the next block to fill with
+ * input, next_work the next one to look up and next_write the next one to
+ * write out, and next_write <= next_work <= next_read. */
+struct bulk_s {
+    MMDB_s *mmdb;
+    bool has_projection;
+    MMDB_projection_s projection;
+    char **row_json;
+    block_s *blocks;
+    size_t block_count;
+    uint64_t next_read;
+    uint64_t next_work;
+    uint64_t next_write;
+    bool eof;
+    bool bad_input;
+    int status;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+struct worker_s {
+    bulk_s *bulk;
+    pthread_t thread;
+    MMDB_join_s join;
+};
+#endif
+
 #define LOCAL
 
 /* *INDENT-OFF* */
 /* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
 LOCAL void usage(char *program, int exit_code, const char *error);
 LOCAL const char **get_options(int argc, char **argv, char **mmdb_file,
-                               char **ip_address, int *verbose, int *iterations,
+                               char **ip_address, int *verbose,
+                               char **bulk_file, int *thread_count,
+                               const char ***paths, int *path_count,
                                int *lookup_path_length);
 LOCAL MMDB_s open_or_die(const char *fname);
 LOCAL void dump_meta(MMDB_s *mmdb);
 LOCAL int lookup_and_print(MMDB_s *mmdb, const char *ip_address,
                            const char **lookup_path,
                            int lookup_path_length);
-LOCAL int benchmark(MMDB_s *mmdb, int iterations);
+LOCAL int bulk_lookup(MMDB_s *mmdb, const char *input_file, int thread_count,
+                      const char **paths, int path_count,
+                      const char **lookup_path, int lookup_path_length);
+LOCAL int build_row_json(bulk_s *bulk, const char **paths, int path_count,
+                         const char **lookup_path);
+LOCAL const char **split_path(const char *path);
+LOCAL void free_row_json(bulk_s *bulk);
+LOCAL bool read_block(FILE *input, buffer_s *carry, buffer_s *block);
+LOCAL void *lookup_blocks(void *arg);
+LOCAL int lookup_block(worker_s *worker, block_s *block, bool *bad_input);
+LOCAL int lookup_line(worker_s *worker, block_s *block, const char *line,
+                      bool *bad_input);
+LOCAL void write_finished_blocks(bulk_s *bulk);
+LOCAL bool parse_address(const char *ip_address,
+                         struct sockaddr_storage *sockaddr);
+LOCAL void format_network(MMDB_s *mmdb, const MMDB_network_s *network,
+                          char *cidr);
+LOCAL int append_json(buffer_s *buffer, MMDB_entry_s *entry);
+LOCAL void append_json_string(buffer_s *buffer, const char *string);
+LOCAL void append(buffer_s *buffer, const char *data, size_t size);
+LOCAL void reserve(buffer_s *buffer, size_t size);
+LOCAL void *xcalloc(size_t count, size_t size);
+LOCAL void *xrealloc(void *p, size_t size);
+LOCAL char *xstrdup(const char *string);
 LOCAL MMDB_lookup_result_s lookup_or_die(MMDB_s *mmdb, const char *ipstr);
-LOCAL void random_ipv4(char *ip);
 /* --prototypes end - don't remove this comment-- */
 /* *INDENT-ON* */
 
@@ -42,12 +122,15 @@ int main(int argc, char **argv)
     char *mmdb_file = NULL;
     char *ip_address = NULL;
     int verbose = 0;
-    int iterations = 0;
+    char *bulk_file = NULL;
+    int thread_count = 0;
+    const char **paths = NULL;
+    int path_count = 0;
     int lookup_path_length = 0;
 
     const char **lookup_path =
-        get_options(argc, argv, &mmdb_file, &ip_address, &verbose, &iterations,
-                    &lookup_path_length);
+        get_options(argc, argv, &mmdb_file, &ip_address, &verbose, &bulk_file,
+                    &thread_count, &paths, &path_count, &lookup_path_length);
 
     MMDB_s mmdb = open_or_die(mmdb_file);
 
@@ -55,12 +138,18 @@ int main(int argc, char **argv)
         dump_meta(&mmdb);
     }
 
-    if (0 == iterations) {
-        exit(lookup_and_print(&mmdb, ip_address, lookup_path,
-                              lookup_path_length));
-    } else {
-        exit(benchmark(&mmdb, iterations));
+#ifndef _WIN32
+    if (NULL != bulk_file) {
+        int exit_code = bulk_lookup(&mmdb, bulk_file, thread_count, paths,
+                                    path_count, lookup_path,
+                                    lookup_path_length);
+        free(paths);
+        exit(exit_code);
     }
+#endif
+
+    exit(lookup_and_print(&mmdb, ip_address, lookup_path,
+                          lookup_path_length));
 }
 
 LOCAL void usage(char *program, int exit_code, const char *error)
@@ -76,7 +165,22 @@ LOCAL void usage(char *program, int exit_code, const char *error)
                   "\n"
                   "      --file (-f)     The path to the MMDB file. Required.\n"
                   "\n"
-                  "      --ip (-i)       The IP address to look up. Required.\n"
+                  "      --ip (-i)       The IP address to look up. Required unless --bulk\n"
+                  "                      or --join is given.\n"
+                  "\n"
+                  "      --bulk (-B)     Look up each IP address in a file, one per line, and\n"
+                  "                      print one JSON object per line, in the same order.\n"
+                  "                      Use - to read from standard input. This is fastest\n"
+                  "                      when the addresses are sorted.\n"
+                  "\n"
+                  "      --join (-j)     The same as --bulk -.\n"
+                  "\n"
+                  "      --threads (-t)  The number of threads to use for --bulk. This\n"
+                  "                      defaults to the number of online CPUs.\n"
+                  "\n"
+                  "      --path (-p)     A path such as city.names.en to print for each\n"
+                  "                      address with --bulk. This can be given more than\n"
+                  "                      once.\n"
                   "\n"
                   "      --verbose (-v)  Turns on verbose output. Specifically, this causes this\n"
                   "                      application to output the database metadata.\n"
@@ -117,7 +221,9 @@ LOCAL void usage(char *program, int exit_code, const char *error)
 }
 
 LOCAL const char **get_options(int argc, char **argv, char **mmdb_file,
-                               char **ip_address, int *verbose, int *iterations,
+                               char **ip_address, int *verbose,
+                               char **bulk_file, int *thread_count,
+                               const char ***paths, int *path_count,
                                int *lookup_path_length)
 {
     static int help = 0;
@@ -125,18 +231,21 @@ LOCAL const char **get_options(int argc, char **argv, char **mmdb_file,
 
     while (1) {
         static struct option options[] = {
-            { "file",      required_argument, 0, 'f' },
-            { "ip",        required_argument, 0, 'i' },
-            { "verbose",   no_argument,       0, 'v' },
-            { "version",   no_argument,       0, 'n' },
-            { "benchmark", required_argument, 0, 'b' },
-            { "help",      no_argument,       0, 'h' },
-            { "?",         no_argument,       0, 1   },
-            { 0,           0,                 0, 0   }
+            { "file",    required_argument, 0, 'f' },
+            { "ip",      required_argument, 0, 'i' },
+            { "bulk",    required_argument, 0, 'B' },
+            { "join",    no_argument,       0, 'j' },
+            { "threads", required_argument, 0, 't' },
+            { "path",    required_argument, 0, 'p' },
+            { "verbose", no_argument,       0, 'v' },
+            { "version", no_argument,       0, 'n' },
+            { "help",    no_argument,       0, 'h' },
+            { "?",       no_argument,       0, 1   },
+            { 0,         0,                 0, 0   }
         };
 
         int opt_index;
-        int opt_char = getopt_long(argc, argv, "f:i:b:vnh?", options,
+        int opt_char = getopt_long(argc, argv, "f:i:B:jt:p:vnh?", options,
                                    &opt_index);
 
         if (-1 == opt_char) {
@@ -147,12 +256,19 @@ LOCAL const char **get_options(int argc, char **argv, char **mmdb_file,
             *mmdb_file = optarg;
         } else if ('i' == opt_char) {
             *ip_address = optarg;
+        } else if ('B' == opt_char) {
+            *bulk_file = optarg;
+        } else if ('j' == opt_char) {
+            *bulk_file = "-";
+        } else if ('t' == opt_char) {
+            *thread_count = strtol(optarg, NULL, 10);
+        } else if ('p' == opt_char) {
+            *paths = xrealloc(*paths, sizeof(char *) * (*path_count + 1));
+            (*paths)[(*path_count)++] = optarg;
         } else if ('v' == opt_char) {
             *verbose = 1;
         } else if ('n' == opt_char) {
             version = 1;
-        } else if ('b' == opt_char) {
-            *iterations = strtol(optarg, NULL, 10);
         } else if ('h' == opt_char || '?' == opt_char) {
             help = 1;
         }
@@ -179,10 +295,31 @@ LOCAL const char **get_options(int argc, char **argv, char **mmdb_file,
         usage(program, 1, "You must provide a filename with --file");
     }
 
-    if (NULL == *ip_address && *iterations == 0) {
+    if (NULL == *ip_address && NULL == *bulk_file) {
         usage(program, 1, "You must provide an IP address with --ip");
     }
 
+    if (NULL == *bulk_file && (*path_count || *thread_count)) {
+        usage(program, 1, "--path and --threads can only be used with --bulk");
+    }
+    if (*path_count && optind < argc) {
+        usage(program, 1, "You can't use --path and a lookup path together");
+    }
+
+#ifdef _WIN32
+    if (NULL != *bulk_file) {
+        usage(program, 1, "--bulk and --join aren't supported on Windows");
+    }
+#else
+    if (0 == *thread_count) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        *thread_count = cpus > 0 ? (int)cpus : 1;
+    }
+    if (*thread_count < 1 || *thread_count > MAX_THREADS) {
+        usage(program, 1, "The number of threads must be from 1 to 256");
+    }
+#endif
+
     const char **lookup_path =
         malloc(sizeof(const char *) * ((argc - optind) + 1));
     int i;
@@ -318,49 +455,514 @@ LOCAL int lookup_and_print(MMDB_s *mmdb, const char *ip_address,
 
     return exit_code;
 }
+#ifndef _WIN32
+/* This reads addresses, one per line, and writes a JSON object for each one
+ * with the address, the network it is in and its data, if it has any:
+ *
+ *   {"ip":"1.2.3.4","network":"1.2.3.0/24","data":{...}}
+ *
+ * The main thread reads the input in blocks of whole lines, which a pool of
+ * threads looks up. Each block's output is written once every block before
+ * it has been written, so the output is in the same order as the input. The
+ * threads use MMDB_join_sockaddr(), which is as fast as a lookup for
+ * addresses in any order and much faster for sorted ones.
+ *
+ * A line that isn't an address, or is an IPv6 address in an IPv4 database,
+ * is reported on stderr and skipped. */
+LOCAL int bulk_lookup(MMDB_s *mmdb, const char *input_file, int thread_count,
+                      const char **paths, int path_count,
+                      const char **lookup_path, int lookup_path_length)
+{
+    FILE *input = stdin;
+    if (0 != strcmp(input_file, "-")
+        && NULL == (input = fopen(input_file, "r"))) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", input_file,
+                strerror(errno));
+        MMDB_close(mmdb);
+        free(lookup_path);
+        return 2;
+    }
+
+    bulk_s bulk = {
+        .mmdb        = mmdb,
+        .block_count = (size_t)thread_count * BLOCKS_PER_THREAD,
+        .status      = MMDB_SUCCESS
+    };
+    if (path_count || lookup_path_length) {
+        bulk.status = build_row_json(&bulk, paths, path_count, lookup_path);
+    }
+    bulk.blocks = xcalloc(bulk.block_count, sizeof(block_s));
+    worker_s *workers = xcalloc(thread_count, sizeof(worker_s));
+    pthread_mutex_init(&bulk.lock, NULL);
+    pthread_cond_init(&bulk.changed, NULL);
+
+    for (int i = 0; MMDB_SUCCESS == bulk.status && i < thread_count; i++) {
+        workers[i].bulk = &bulk;
+        MMDB_join_init(mmdb, &workers[i].join);
+        if (pthread_create(&workers[i].thread, NULL, lookup_blocks,
+                           &workers[i])) {
+            fprintf(stderr, "\n  Can't create a thread\n\n");
+            exit(2);
+        }
+    }
+
+    buffer_s carry = { 0 };
+    bool more = MMDB_SUCCESS == bulk.status;
+    while (more) {
+        pthread_mutex_lock(&bulk.lock);
+        while (bulk.next_read - bulk.next_write == bulk.block_count
+               && MMDB_SUCCESS == bulk.status) {
+            pthread_cond_wait(&bulk.changed, &bulk.lock);
+        }
+        if (MMDB_SUCCESS != bulk.status) {
+            bulk.eof = true;
+            pthread_cond_broadcast(&bulk.changed);
+            pthread_mutex_unlock(&bulk.lock);
+            break;
+        }
+        pthread_mutex_unlock(&bulk.lock);
+
+        /* No thread touches this block until next_read moves past it */
+        block_s *block = &bulk.blocks[bulk.next_read % bulk.block_count];
+        more = read_block(input, &carry, &block->input);
+
+        pthread_mutex_lock(&bulk.lock);
+        bulk.next_read++;
+        bulk.eof = !more;
+        pthread_cond_broadcast(&bulk.changed);
+        pthread_mutex_unlock(&bulk.lock);
+    }
+
+    for (int i = 0; i < thread_count && NULL != workers[i].bulk; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    int exit_code = bulk.bad_input ? 3 : 0;
+    if (MMDB_SUCCESS != bulk.status) {
+        fprintf(stderr, "\n  Got an error from the maxminddb library: %s\n\n",
+                MMDB_strerror(bulk.status));
+        exit_code = 4;
+    }
+
+    for (size_t i = 0; i < bulk.block_count; i++) {
+        free(bulk.blocks[i].input.data);
+        free(bulk.blocks[i].output.data);
+        free(bulk.blocks[i].errors.data);
+    }
+    free(bulk.blocks);
+    free(workers);
+    free(carry.data);
+    free_row_json(&bulk);
+    pthread_mutex_destroy(&bulk.lock);
+    pthread_cond_destroy(&bulk.changed);
+    if (stdin != input) {
+        fclose(input);
+    }
+    MMDB_close(mmdb);
+    free(lookup_path);
+
+    return exit_code;
+}
 
-LOCAL int benchmark(MMDB_s *mmdb, int iterations)
+/* With lookup paths, the data for an address only depends on its record,
+ * and there are usually far fewer records than addresses. We look the paths
+ * up in every record with MMDB_build_projection() and write the JSON for
+ * each record's data once, before any addresses are looked up.
+ *
+ * With --path, the data is an object with each path that the record has as a
+ * key. With a lookup path after the options, it is the value at that path. A
+ * record with nothing at any of the paths has no data. */
+LOCAL int build_row_json(bulk_s *bulk, const char **paths, int path_count,
+                         const char **lookup_path)
 {
-    char ip_address[16];
-    int exit_code = 0;
+    bool bare = 0 == path_count;
+    int count = bare ? 1 : path_count;
+    const char ***split = xcalloc(count, sizeof(char **));
+    if (bare) {
+        split[0] = lookup_path;
+    } else {
+        for (int i = 0; i < path_count; i++) {
+            split[i] = split_path(paths[i]);
+        }
+    }
+
+    int status = MMDB_build_projection(bulk->mmdb,
+                                       (const char *const *const *)split,
+                                       count, &bulk->projection);
+    if (MMDB_SUCCESS == status) {
+        bulk->has_projection = true;
+        bulk->row_json = xcalloc(bulk->projection.record_count,
+                                 sizeof(char *));
+    }
+
+    MMDB_projection_s *projection = &bulk->projection;
+    for (uint32_t row = 0;
+         MMDB_SUCCESS == status && row < projection->record_count; row++) {
+        buffer_s json = { 0 };
+        for (int i = 0; MMDB_SUCCESS == status && i < count; i++) {
+            MMDB_entry_data_s value;
+            status = MMDB_get_projection_value(projection, row, i, &value);
+            if (MMDB_SUCCESS != status || !value.has_data) {
+                continue;
+            }
+            if (!bare) {
+                append(&json, 0 == json.size ? "{" : ",", 1);
+                append_json_string(&json, paths[i]);
+                append(&json, ":", 1);
+            }
+            MMDB_entry_s entry = {
+                .mmdb = bulk->mmdb, .offset = value.offset
+            };
+            status = append_json(&json, &entry);
+        }
+        if (!bare && json.size) {
+            append(&json, "}", 1);
+        }
+        if (json.size) {
+            append(&json, "", 1);
+        }
+        bulk->row_json[row] = json.data;
+    }
+
+    if (!bare) {
+        for (int i = 0; i < path_count; i++) {
+            free((void *)split[i][0]);
+            free((void *)split[i]);
+        }
+    }
+    free(split);
+
+    return status;
+}
+
+/* This splits a path like "city.names.en" on each dot into a NULL
+ * terminated array of strings for MMDB_aget_value(). The strings all point
+ * into one copy of the path, which is the first element. */
+LOCAL const char **split_path(const char *path)
+{
+    char *copy = xstrdup(path);
+    int count = 1;
+    for (const char *p = path; *p; p++) {
+        count += '.' == *p;
+    }
+
+    const char **split = xcalloc(count + 1, sizeof(char *));
+    int i = 0;
+    split[i++] = copy;
+    for (char *p = copy; *p; p++) {
+        if ('.' == *p) {
+            *p = '\0';
+            split[i++] = p + 1;
+        }
+    }
+    return split;
+}
 
-    srand( time(NULL) );
-    clock_t time = clock();
+LOCAL void free_row_json(bulk_s *bulk)
+{
+    if (!bulk->has_projection) {
+        return;
+    }
+    for (uint32_t row = 0; row < bulk->projection.record_count; row++) {
+        free(bulk->row_json[row]);
+    }
+    free(bulk->row_json);
+    MMDB_free_projection(&bulk->projection);
+}
+
+/* This fills a block with about BLOCK_SIZE bytes of whole lines. Whatever is
+ * read after the last newline is carried over to the next block. A line that
+ * is longer than a block makes the block bigger. This returns false once the
+ * input has all been read. */
+LOCAL bool read_block(FILE *input, buffer_s *carry, buffer_s *block)
+{
+    block->size = 0;
+    append(block, carry->data, carry->size);
+    carry->size = 0;
+
+    while (true) {
+        reserve(block, BLOCK_SIZE);
+        size_t count = fread(block->data + block->size, 1,
+                             block->capacity - block->size, input);
+        block->size += count;
+        if (0 == count) {
+            /* There is room for the NUL at the end of the last line */
+            reserve(block, 1);
+            return false;
+        }
+
+        char *last_newline = NULL;
+        for (char *p = block->data + block->size; p > block->data; p--) {
+            if ('\n' == p[-1]) {
+                last_newline = p;
+                break;
+            }
+        }
+        if (NULL != last_newline) {
+            size_t rest = block->data + block->size - last_newline;
+            append(carry, last_newline, rest);
+            block->size -= rest;
+            return true;
+        }
+    }
+}
 
-    for (int i = 0; i < iterations; i++) {
-        random_ipv4(ip_address);
+LOCAL void *lookup_blocks(void *arg)
+{
+    worker_s *worker = arg;
+    bulk_s *bulk = worker->bulk;
 
-        MMDB_lookup_result_s result = lookup_or_die(mmdb, ip_address);
-        MMDB_entry_data_list_s *entry_data_list = NULL;
+    while (true) {
+        pthread_mutex_lock(&bulk->lock);
+        while (bulk->next_work == bulk->next_read && !bulk->eof) {
+            pthread_cond_wait(&bulk->changed, &bulk->lock);
+        }
+        if (bulk->next_work == bulk->next_read) {
+            pthread_mutex_unlock(&bulk->lock);
+            return NULL;
+        }
+        block_s *block = &bulk->blocks[bulk->next_work++ % bulk->block_count];
+        pthread_mutex_unlock(&bulk->lock);
 
-        if (result.found_entry) {
+        block->output.size = block->errors.size = 0;
+        bool bad_input = false;
+        int status = lookup_block(worker, block, &bad_input);
 
-            int status = MMDB_get_entry_data_list(&result.entry,
-                                                  &entry_data_list);
+        pthread_mutex_lock(&bulk->lock);
+        if (MMDB_SUCCESS != status && MMDB_SUCCESS == bulk->status) {
+            bulk->status = status;
+        }
+        bulk->bad_input |= bad_input;
+        block->done = true;
+        write_finished_blocks(bulk);
+        pthread_cond_broadcast(&bulk->changed);
+        pthread_mutex_unlock(&bulk->lock);
+    }
+}
 
+LOCAL int lookup_block(worker_s *worker, block_s *block, bool *bad_input)
+{
+    char *line = block->input.data;
+    char *end = line + block->input.size;
+    while (line < end) {
+        char *newline = memchr(line, '\n', end - line);
+        char *next = NULL == newline ? end : newline + 1;
+        char *line_end = NULL == newline ? end : newline;
+
+        while (line < line_end && (' ' == *line || '\t' == *line)) {
+            line++;
+        }
+        while (line_end > line && (' ' == line_end[-1] || '\t' == line_end[-1]
+                                   || '\r' == line_end[-1])) {
+            line_end--;
+        }
+        if (line_end > line) {
+            *line_end = '\0';
+            int status = lookup_line(worker, block, line, bad_input);
             if (MMDB_SUCCESS != status) {
-                fprintf(stderr, "Got an error looking up the entry data - %s\n",
-                        MMDB_strerror(status));
-                exit_code = 5;
-                MMDB_free_entry_data_list(entry_data_list);
-                goto end;
+                return status;
             }
         }
+        line = next;
+    }
+    return MMDB_SUCCESS;
+}
+
+LOCAL int lookup_line(worker_s *worker, block_s *block, const char *line,
+                      bool *bad_input)
+{
+    bulk_s *bulk = worker->bulk;
+    char message[512];
+
+    struct sockaddr_storage sockaddr;
+    if (strlen(line) > 255 || !parse_address(line, &sockaddr)) {
+        sprintf(message, "\n  %.255s is not a valid IP address\n\n", line);
+        append(&block->errors, message, strlen(message));
+        *bad_input = true;
+        return MMDB_SUCCESS;
+    }
+
+    int status;
+    MMDB_lookup_result_s result =
+        MMDB_join_sockaddr(&worker->join, (struct sockaddr *)&sockaddr,
+                           &status);
+    if (MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR == status) {
+        sprintf(message, "\n  Can't look up %s - %s\n\n", line,
+                MMDB_strerror(status));
+        append(&block->errors, message, strlen(message));
+        *bad_input = true;
+        return MMDB_SUCCESS;
+    }
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
 
-        MMDB_free_entry_data_list(entry_data_list);
+    buffer_s *output = &block->output;
+    char network[INET6_ADDRSTRLEN + 8];
+    format_network(bulk->mmdb, &worker->join.network, network);
+    append(output, "{\"ip\":\"", 7);
+    append(output, line, strlen(line));
+    append(output, "\",\"network\":\"", 13);
+    append(output, network, strlen(network));
+    append(output, "\"", 1);
+
+    if (result.found_entry && bulk->has_projection) {
+        uint32_t row;
+        status = MMDB_get_projection_row(&bulk->projection, &result.entry,
+                                         &row);
+        if (MMDB_SUCCESS == status && NULL != bulk->row_json[row]) {
+            append(output, ",\"data\":", 8);
+            append(output, bulk->row_json[row], strlen(bulk->row_json[row]));
+        }
+    } else if (result.found_entry) {
+        append(output, ",\"data\":", 8);
+        status = append_json(output, &result.entry);
     }
+    append(output, "}\n", 2);
 
-    time = clock() - time;
-    double seconds = ((double)time / CLOCKS_PER_SEC);
-    fprintf(
-        stdout,
-        "\n  Looked up %i addresses in %.2f seconds. %.2f lookups per second.\n\n",
-        iterations, seconds, iterations / seconds);
+    return status;
+}
 
- end:
-    MMDB_close(mmdb);
+/* This is called with the lock held after a block is done */
+LOCAL void write_finished_blocks(bulk_s *bulk)
+{
+    while (bulk->next_write < bulk->next_work) {
+        block_s *block = &bulk->blocks[bulk->next_write % bulk->block_count];
+        if (!block->done) {
+            break;
+        }
+        if (MMDB_SUCCESS == bulk->status && block->output.size) {
+            fwrite(block->output.data, 1, block->output.size, stdout);
+        }
+        if (MMDB_SUCCESS == bulk->status && block->errors.size) {
+            fwrite(block->errors.data, 1, block->errors.size, stderr);
+        }
+        block->done = false;
+        bulk->next_write++;
+    }
+}
 
-    return exit_code;
+LOCAL bool parse_address(const char *ip_address,
+                         struct sockaddr_storage *sockaddr)
+{
+    memset(sockaddr, 0, sizeof(struct sockaddr_storage));
+    if (NULL != strchr(ip_address, ':')) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)sockaddr;
+        sin6->sin6_family = AF_INET6;
+        return 1 == inet_pton(AF_INET6, ip_address, &sin6->sin6_addr);
+    }
+    struct sockaddr_in *sin = (struct sockaddr_in *)sockaddr;
+    sin->sin_family = AF_INET;
+    return 1 == inet_pton(AF_INET, ip_address, &sin->sin_addr);
+}
+
+/* An IPv4 network in an IPv6 database is printed as IPv4 */
+LOCAL void format_network(MMDB_s *mmdb, const MMDB_network_s *network,
+                          char *cidr)
+{
+    char ip[INET6_ADDRSTRLEN];
+    uint16_t prefix_length = network->prefix_length;
+    static const uint8_t ipv4_prefix[12] = { 0 };
+    if (4 == mmdb->metadata.ip_version) {
+        inet_ntop(AF_INET, network->address, ip, sizeof(ip));
+    } else if (prefix_length >= 96
+               && 0 == memcmp(network->address, ipv4_prefix, 12)) {
+        inet_ntop(AF_INET, network->address + 12, ip, sizeof(ip));
+        prefix_length -= 96;
+    } else {
+        inet_ntop(AF_INET6, network->address, ip, sizeof(ip));
+    }
+    sprintf(cidr, "%s/%u", ip, prefix_length);
+}
+
+/* This writes the record straight into the end of the buffer */
+LOCAL int append_json(buffer_s *buffer, MMDB_entry_s *entry)
+{
+    size_t needed;
+    reserve(buffer, 256);
+    int status = MMDB_entry_to_json(entry, buffer->data + buffer->size,
+                                    buffer->capacity - buffer->size, &needed);
+    if (MMDB_BUFFER_TOO_SMALL_ERROR == status) {
+        reserve(buffer, needed);
+        status = MMDB_entry_to_json(entry, buffer->data + buffer->size,
+                                    buffer->capacity - buffer->size,
+                                    &needed);
+    }
+    if (MMDB_SUCCESS == status) {
+        /* needed counts the NUL at the end */
+        buffer->size += needed - 1;
+    }
+    return status;
+}
+
+LOCAL void append_json_string(buffer_s *buffer, const char *string)
+{
+    append(buffer, "\"", 1);
+    for (const char *p = string; *p; p++) {
+        if ('"' == *p || '\\' == *p) {
+            append(buffer, "\\", 1);
+            append(buffer, p, 1);
+        } else if ((unsigned char)*p < 0x20) {
+            char escape[8];
+            sprintf(escape, "\\u%04x", (unsigned char)*p);
+            append(buffer, escape, 6);
+        } else {
+            append(buffer, p, 1);
+        }
+    }
+    append(buffer, "\"", 1);
+}
+
+LOCAL void append(buffer_s *buffer, const char *data, size_t size)
+{
+    if (0 == size) {
+        return;
+    }
+    reserve(buffer, size);
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+/* This makes sure there is room for size more bytes */
+LOCAL void reserve(buffer_s *buffer, size_t size)
+{
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity * 2 + 4096;
+        buffer->capacity = capacity > buffer->size + size
+                           ? capacity : buffer->size + size;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+        if (NULL == buffer->data) {
+            fprintf(stderr, "\n  Out of memory\n\n");
+            exit(2);
+        }
+    }
+}
+#endif
+
+LOCAL void *xcalloc(size_t count, size_t size)
+{
+    void *p = calloc(count, size);
+    if (NULL == p) {
+        fprintf(stderr, "\n  Out of memory\n\n");
+        exit(2);
+    }
+    return p;
+}
+
+LOCAL void *xrealloc(void *p, size_t size)
+{
+    void *new = realloc(p, size);
+    if (NULL == new) {
+        fprintf(stderr, "\n  Out of memory\n\n");
+        exit(2);
+    }
+    return new;
+}
+
+LOCAL char *xstrdup(const char *string)
+{
+    char *copy = xcalloc(strlen(string) + 1, 1);
+    return strcpy(copy, string);
 }
 
 LOCAL MMDB_lookup_result_s lookup_or_die(MMDB_s *mmdb, const char *ipstr)
@@ -384,14 +986,3 @@ LOCAL MMDB_lookup_result_s lookup_or_die(MMDB_s *mmdb, const char *ipstr)
 
     return result;
 }
-
-LOCAL void random_ipv4(char *ip)
-{
-    // rand() is perfectly fine for this use case
-    // coverity[dont_call]
-    int ip_int = rand();
-    uint8_t *bytes = (uint8_t *)&ip_int;
-
-    snprintf(ip, 16, "%u.%u.%u.%u",
-             *bytes, *(bytes + 1), *(bytes + 2), *(bytes + 3));
-}
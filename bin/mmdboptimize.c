@@ -0,0 +1,812 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "maxminddb.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This rewrites a database with the writer so that lookups touch less
+ * memory. Every network is copied with the same record, so the new database
+ * gives the same answer as the old one for every address.
+ *
+ * The writer already points to every value it has written before rather than
+ * writing it again, and lays the search tree out depth first. A query log
+ * changes both layouts: the records that the queries find are written first,
+ * most found first, so that they share pages at the start of the data
+ * section, and the nodes that the queries go through are numbered first, so
+ * that they share pages at the start of the search tree.
+ *
+ * Compacting the tree stores each distinct subtree once, which keeps every
+ * lookup's record and netmask. Merging networks also replaces each node
+ * whose two records are the same by that record, so lookups read fewer
+ * nodes but can report a shorter netmask.
+ *
+ * Hot paths move keys to the front of their maps, so that
+ * MMDB_get_value() finds them after comparing fewer keys. This is the only
+ * option that changes a record, as its keys come out in a different order. */
+
+#define MAX_HOT_PATHS (64)
+/* The size of "\xab\xcd\xefMaxMind.com", which comes between the data
+ * section and the metadata */
+#define METADATA_MARKER_SIZE (14)
+
+typedef union address_u {
+    struct sockaddr sa;
+    struct sockaddr_in sin;
+    struct sockaddr_in6 sin6;
+} address_u;
+
+typedef struct options_s {
+    char *mmdb_file;
+    char *output_file;
+    char *queries_file;
+    const char **hot_paths[MAX_HOT_PATHS];
+    int hot_path_count;
+    uint16_t record_size;
+    bool compact;
+    uint32_t compact_flags;
+} options_s;
+
+/* This is an open addressing hash table from the offset of a record in the
+ * old database to a number. Each key is the offset plus one, so that zero
+ * marks an empty slot. */
+typedef struct offset_table_s {
+    uint32_t *keys;
+    uint64_t *values;
+    uint32_t mask;
+    uint32_t count;
+} offset_table_s;
+
+typedef struct hit_s {
+    uint32_t offset;
+    uint64_t count;
+} hit_s;
+
+typedef struct optimizer_s {
+    options_s *options;
+    MMDB_s *mmdb;
+    MMDB_writer_s writer;
+    /* The record in the writer for each record that has been copied */
+    offset_table_s records;
+    MMDB_entry_data_s *values;
+    uint32_t value_capacity;
+    address_u *queries;
+    size_t query_count;
+} optimizer_s;
+
+#define LOCAL
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void usage(char *program, int exit_code, const char *error);
+LOCAL void get_options(int argc, char **argv, options_s *options);
+LOCAL const char **split_path(const char *path);
+LOCAL void set_up_optimizer(optimizer_s *opt, options_s *options,
+                            MMDB_s *mmdb);
+LOCAL void read_queries(optimizer_s *opt);
+LOCAL void tree_address(optimizer_s *opt, const address_u *query,
+                        uint8_t *address);
+LOCAL void add_hot_records(optimizer_s *opt);
+LOCAL int compare_hits(const void *a, const void *b);
+LOCAL void copy_networks(optimizer_s *opt);
+LOCAL uint32_t writer_record(optimizer_s *opt, uint32_t offset);
+LOCAL uint32_t flatten_record(optimizer_s *opt, uint32_t offset);
+LOCAL void move_hot_key(MMDB_entry_data_s *values, const char **path);
+LOCAL uint32_t value_end(const MMDB_entry_data_s *values, uint32_t index);
+LOCAL void reverse_values(MMDB_entry_data_s *values, uint32_t count);
+LOCAL void compact_tree(optimizer_s *opt);
+LOCAL void add_weights(optimizer_s *opt);
+LOCAL long write_database(optimizer_s *opt);
+LOCAL double average_depth(const char *file, MMDB_s *mmdb);
+LOCAL void free_optimizer(optimizer_s *opt);
+LOCAL uint64_t *offset_slot(offset_table_s *table, uint32_t offset);
+LOCAL void grow_table(offset_table_s *table);
+LOCAL void *xcalloc(size_t count, size_t size);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    options_s options = { 0 };
+    get_options(argc, argv, &options);
+
+    MMDB_s mmdb;
+    int status = MMDB_open(options.mmdb_file, MMDB_MODE_MMAP, &mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", options.mmdb_file,
+                MMDB_strerror(status));
+        exit(2);
+    }
+
+    optimizer_s opt;
+    set_up_optimizer(&opt, &options, &mmdb);
+
+    if (NULL != options.queries_file) {
+        read_queries(&opt);
+        add_hot_records(&opt);
+    }
+    copy_networks(&opt);
+    if (options.compact) {
+        compact_tree(&opt);
+    }
+    if (NULL != options.queries_file) {
+        add_weights(&opt);
+    }
+
+    long file_size = write_database(&opt);
+
+    MMDB_s new_mmdb;
+    status = MMDB_open(options.output_file, MMDB_MODE_MMAP, &new_mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", options.output_file,
+                MMDB_strerror(status));
+        exit(3);
+    }
+    double old_depth = average_depth(options.mmdb_file, &mmdb);
+    double new_depth = average_depth(options.output_file, &new_mmdb);
+
+    /* MMDB_s.data_section_size runs to the end of the file, so it includes
+     * the metadata */
+    uint32_t data_size = (uint32_t)(mmdb.metadata_section - mmdb.data_section)
+                         - METADATA_MARKER_SIZE;
+    fprintf(stdout, "nodes\t%u\t%u\naverage_depth\t%.2f\t%.2f\n"
+            "data_size\t%u\t%u\nfile_size\t%lld\t%ld\n",
+            mmdb.metadata.node_count, new_mmdb.metadata.node_count,
+            old_depth, new_depth, data_size, opt.writer.data_size,
+            (long long)mmdb.file_size, file_size);
+
+    MMDB_close(&new_mmdb);
+
+    free_optimizer(&opt);
+    MMDB_close(&mmdb);
+    exit(0);
+}
+
+LOCAL void usage(char *program, int exit_code, const char *error)
+{
+    if (NULL != error) {
+        fprintf(stderr, "\n  *ERROR: %s\n", error);
+    }
+
+    char *usage = "\n"
+                  "  %s --file /path/to/file.mmdb --output /path/to/new.mmdb\n"
+                  "\n"
+                  "  This application accepts the following options:\n"
+                  "\n"
+                  "      --file (-f)         The path to the MMDB file to optimize.\n"
+                  "                          Required.\n"
+                  "\n"
+                  "      --output (-o)       The path to write the new MMDB file to.\n"
+                  "                          Required.\n"
+                  "\n"
+                  "      --queries (-q)      A file of IP addresses, one per line, that\n"
+                  "                          lookups are expected to look like. The\n"
+                  "                          records and nodes they use are written\n"
+                  "                          first.\n"
+                  "\n"
+                  "      --hot-path (-p)     A path to a value in each record, such as\n"
+                  "                          city.names.en. The keys in the path are\n"
+                  "                          moved to the front of their maps. This can\n"
+                  "                          be given more than once, and the first\n"
+                  "                          path's keys come first.\n"
+                  "\n"
+                  "      --record-size (-r)  24, 28 or 32. This defaults to the record\n"
+                  "                          size of the database being optimized.\n"
+                  "\n"
+                  "      --compact (-c)      Store each distinct subtree of the search\n"
+                  "                          tree once. Every lookup still gets the same\n"
+                  "                          record and netmask.\n"
+                  "\n"
+                  "      --merge-networks    Like --compact, and also merge neighbouring\n"
+                  "      (-m)                networks with the same record into one, so\n"
+                  "                          lookups read fewer nodes. Lookups get the\n"
+                  "                          same record, but can get a shorter netmask.\n"
+                  "\n"
+                  "      --version           Print the program's version number and\n"
+                  "                          exit.\n"
+                  "\n"
+                  "      --help (-h -?)      Show usage information.\n"
+                  "\n"
+                  "  This writes a database that gives the same record for every address\n"
+                  "  as the one given, laid out for faster lookups. When it is done, it\n"
+                  "  prints the node count, average depth of the networks, data section\n"
+                  "  size and file size of both.\n"
+                  "\n";
+
+    fprintf(stdout, usage, program);
+    exit(exit_code);
+}
+
+LOCAL void get_options(int argc, char **argv, options_s *options)
+{
+    static int help = 0;
+    static int version = 0;
+    char *program = basename(argv[0]);
+
+    while (1) {
+        static struct option long_options[] = {
+            { "file",           required_argument, 0, 'f' },
+            { "output",         required_argument, 0, 'o' },
+            { "queries",        required_argument, 0, 'q' },
+            { "hot-path",       required_argument, 0, 'p' },
+            { "record-size",    required_argument, 0, 'r' },
+            { "compact",        no_argument,       0, 'c' },
+            { "merge-networks", no_argument,       0, 'm' },
+            { "version",        no_argument,       0, 'v' },
+            { "help",           no_argument,       0, 'h' },
+            { "?",              no_argument,       0, 1   },
+            { 0,                0,                 0, 0   }
+        };
+
+        int opt_index;
+        int opt_char = getopt_long(argc, argv, "f:o:q:p:r:cmh?",
+                                   long_options, &opt_index);
+
+        if (-1 == opt_char) {
+            break;
+        }
+
+        if ('f' == opt_char) {
+            options->mmdb_file = optarg;
+        } else if ('o' == opt_char) {
+            options->output_file = optarg;
+        } else if ('q' == opt_char) {
+            options->queries_file = optarg;
+        } else if ('p' == opt_char) {
+            if (MAX_HOT_PATHS == options->hot_path_count) {
+                usage(program, 1, "You can give at most 64 hot paths");
+            }
+            if ('\0' == *optarg) {
+                usage(program, 1, "A hot path can't be empty");
+            }
+            options->hot_paths[options->hot_path_count++] =
+                split_path(optarg);
+        } else if ('r' == opt_char) {
+            long record_size = strtol(optarg, NULL, 10);
+            if (24 != record_size && 28 != record_size
+                && 32 != record_size) {
+                usage(program, 1, "The record size must be 24, 28 or 32");
+            }
+            options->record_size = (uint16_t)record_size;
+        } else if ('c' == opt_char) {
+            options->compact = true;
+        } else if ('m' == opt_char) {
+            options->compact = true;
+            options->compact_flags |= MMDB_WRITER_COMPACT_MERGE_NETWORKS;
+        } else if ('v' == opt_char) {
+            version = 1;
+        } else if ('h' == opt_char || '?' == opt_char) {
+            help = 1;
+        }
+    }
+
+    if (help) {
+        usage(program, 0, NULL);
+    }
+
+    if (version) {
+        fprintf(stdout, "\n  %s version %s\n\n", program, VERSION);
+        exit(0);
+    }
+
+    if (NULL == options->mmdb_file) {
+        usage(program, 1, "You must provide a filename with --file");
+    }
+    if (NULL == options->output_file) {
+        usage(program, 1, "You must provide a filename with --output");
+    }
+}
+
+/* A path is split on dots, like a --path for mmdblookup */
+LOCAL const char **split_path(const char *path)
+{
+    size_t size = strlen(path) + 1;
+    char *copy = xcalloc(size, 1);
+    memcpy(copy, path, size);
+
+    int count = 1;
+    for (const char *p = path; *p; p++) {
+        count += '.' == *p;
+    }
+
+    const char **split = xcalloc(count + 1, sizeof(char *));
+    int i = 0;
+    split[i++] = copy;
+    for (char *p = copy; *p; p++) {
+        if ('.' == *p) {
+            *p = '\0';
+            split[i++] = p + 1;
+        }
+    }
+    return split;
+}
+
+LOCAL void set_up_optimizer(optimizer_s *opt, options_s *options,
+                            MMDB_s *mmdb)
+{
+    memset(opt, 0, sizeof(optimizer_s));
+    opt->options = options;
+    opt->mmdb = mmdb;
+
+    uint16_t record_size = options->record_size
+                           ? options->record_size
+                           : mmdb->metadata.record_size;
+    int status = MMDB_writer_init(&opt->writer, mmdb->metadata.ip_version,
+                                  record_size);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't set up the writer - %s\n\n",
+                MMDB_strerror(status));
+        exit(2);
+    }
+
+    /* The strings are in the old database, which stays open until the new
+     * one has been written */
+    opt->writer.metadata.database_type = mmdb->metadata.database_type;
+    opt->writer.metadata.languages = mmdb->metadata.languages;
+    opt->writer.metadata.description = mmdb->metadata.description;
+    opt->writer.metadata.build_epoch = mmdb->metadata.build_epoch;
+
+    grow_table(&opt->records);
+}
+
+/* This reads the file the same way as mmdbbench --input does */
+LOCAL void read_queries(optimizer_s *opt)
+{
+    const char *file = opt->options->queries_file;
+    FILE *fh = fopen(file, "r");
+    if (NULL == fh) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", file, strerror(errno));
+        exit(2);
+    }
+
+    size_t capacity = 0, skipped = 0;
+    char line[1024];
+    while (NULL != fgets(line, sizeof(line), fh)) {
+        char *ip = line + strspn(line, " \t");
+        ip[strcspn(ip, " \t\r\n")] = '\0';
+        if ('\0' == *ip) {
+            continue;
+        }
+
+        address_u address;
+        memset(&address, 0, sizeof(address));
+        if (1 == inet_pton(AF_INET, ip, &address.sin.sin_addr)) {
+            address.sin.sin_family = AF_INET;
+        } else if (6 == opt->mmdb->metadata.ip_version
+                   && 1 == inet_pton(AF_INET6, ip, &address.sin6.sin6_addr)) {
+            address.sin6.sin6_family = AF_INET6;
+        } else {
+            skipped++;
+            continue;
+        }
+
+        if (opt->query_count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            opt->queries = realloc(opt->queries,
+                                   capacity * sizeof(address_u));
+            if (NULL == opt->queries) {
+                fprintf(stderr, "\n  Can't allocate memory\n\n");
+                exit(2);
+            }
+        }
+        opt->queries[opt->query_count++] = address;
+    }
+    fclose(fh);
+
+    if (skipped) {
+        fprintf(stderr, "  Skipped %zu line%s of %s that can't be looked up\n",
+                skipped, 1 == skipped ? "" : "s", file);
+    }
+    if (0 == opt->query_count) {
+        fprintf(stderr, "\n  There are no addresses to use in %s\n\n", file);
+        exit(2);
+    }
+}
+
+/* This gives the address that a lookup of the query follows through the
+ * search tree. In an IPv6 database, that is ::a.b.c.d for an IPv4 address. */
+LOCAL void tree_address(optimizer_s *opt, const address_u *query,
+                        uint8_t *address)
+{
+    if (AF_INET6 == query->sa.sa_family) {
+        memcpy(address, &query->sin6.sin6_addr, 16);
+    } else if (6 == opt->mmdb->metadata.ip_version) {
+        memset(address, 0, 12);
+        memcpy(address + 12, &query->sin.sin_addr, 4);
+    } else {
+        memcpy(address, &query->sin.sin_addr, 4);
+    }
+}
+
+/* The records are added to the writer in the order that the queries find
+ * them most, so that they are at the start of the data section in that
+ * order. Everything else is added as copy_networks() finds it. */
+LOCAL void add_hot_records(optimizer_s *opt)
+{
+    offset_table_s counts = { 0 };
+    grow_table(&counts);
+
+    for (size_t i = 0; i < opt->query_count; i++) {
+        int mmdb_error;
+        MMDB_lookup_result_s result =
+            MMDB_lookup_sockaddr(opt->mmdb, &opt->queries[i].sa, &mmdb_error);
+        if (MMDB_SUCCESS != mmdb_error) {
+            fprintf(stderr, "\n  Can't look up a query - %s\n\n",
+                    MMDB_strerror(mmdb_error));
+            exit(3);
+        }
+        if (result.found_entry) {
+            (*offset_slot(&counts, result.entry.offset))++;
+        }
+    }
+
+    hit_s *hits = xcalloc(counts.count + 1, sizeof(hit_s));
+    uint32_t hit_count = 0;
+    for (uint32_t i = 0; i <= counts.mask; i++) {
+        if (counts.keys[i]) {
+            hits[hit_count++] = (hit_s) {
+                .offset = counts.keys[i] - 1,
+                .count  = counts.values[i]
+            };
+        }
+    }
+    qsort(hits, hit_count, sizeof(hit_s), compare_hits);
+
+    for (uint32_t i = 0; i < hit_count; i++) {
+        writer_record(opt, hits[i].offset);
+    }
+
+    free(hits);
+    free(counts.keys);
+    free(counts.values);
+}
+
+/* The most found records come first, and records found equally often stay
+ * in the order they are in the old database */
+LOCAL int compare_hits(const void *a, const void *b)
+{
+    const hit_s *hit_a = a;
+    const hit_s *hit_b = b;
+    if (hit_a->count != hit_b->count) {
+        return hit_a->count > hit_b->count ? -1 : 1;
+    }
+    return hit_a->offset < hit_b->offset ? -1 : hit_a->offset > hit_b->offset;
+}
+
+/* The networks come out of the iterator in order of address, which is the
+ * fastest order to insert them in. An IPv6 database can have networks such
+ * as ::ffff:0:0/96 that are aliases of the IPv4 subtree. They are aliased
+ * again once every network is in, so that they share the new subtree. */
+LOCAL void copy_networks(optimizer_s *opt)
+{
+    MMDB_network_iterator_s iterator;
+    int status = MMDB_network_iterator_init(
+        opt->mmdb, MMDB_NETWORK_ITERATOR_REPORT_ALIASES, &iterator);
+
+    MMDB_network_s *aliases = NULL;
+    uint32_t alias_count = 0;
+    bool found_network = true;
+    while (MMDB_SUCCESS == status) {
+        MMDB_network_s network;
+        status = MMDB_network_iterator_next(&iterator, &network,
+                                            &found_network);
+        if (MMDB_SUCCESS != status || !found_network) {
+            break;
+        }
+
+        if (MMDB_RECORD_TYPE_SEARCH_NODE == network.record_type) {
+            aliases = realloc(aliases,
+                              (alias_count + 1) * sizeof(MMDB_network_s));
+            if (NULL == aliases) {
+                fprintf(stderr, "\n  Can't allocate memory\n\n");
+                exit(2);
+            }
+            aliases[alias_count++] = network;
+            continue;
+        }
+
+        status = MMDB_writer_insert(&opt->writer, network.address,
+                                    network.prefix_length,
+                                    writer_record(opt,
+                                                  network.entry.offset));
+    }
+
+    uint8_t ipv4_subtree[16] = { 0 };
+    for (uint32_t i = 0; MMDB_SUCCESS == status && i < alias_count; i++) {
+        status = MMDB_writer_alias(&opt->writer, aliases[i].address,
+                                   aliases[i].prefix_length, ipv4_subtree,
+                                   opt->mmdb->ipv4_start_node.netmask);
+    }
+    free(aliases);
+
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't copy the networks - %s\n\n",
+                MMDB_strerror(status));
+        exit(3);
+    }
+}
+
+/* This gives the writer's record for the record at the offset in the old
+ * database, adding it to the writer the first time */
+LOCAL uint32_t writer_record(optimizer_s *opt, uint32_t offset)
+{
+    uint64_t *record = offset_slot(&opt->records, offset);
+    if (*record) {
+        return (uint32_t)*record;
+    }
+
+    uint32_t value_count = flatten_record(opt, offset);
+    /* The paths are moved in reverse, so that the first path's keys end up
+     * at the front */
+    for (int i = opt->options->hot_path_count - 1; i >= 0; i--) {
+        move_hot_key(opt->values, opt->options->hot_paths[i]);
+    }
+
+    uint32_t new_record;
+    int status = MMDB_writer_add_record(&opt->writer, opt->values,
+                                        value_count, &new_record);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't add a record - %s\n\n",
+                MMDB_strerror(status));
+        exit(3);
+    }
+
+    /* The table may have grown since we got the slot */
+    *offset_slot(&opt->records, offset) = new_record;
+    return new_record;
+}
+
+/* This puts the record's values in opt->values, in the order that
+ * MMDB_get_entry_data_list() gives them, and returns how many there are */
+LOCAL uint32_t flatten_record(optimizer_s *opt, uint32_t offset)
+{
+    MMDB_entry_s entry = { .mmdb = opt->mmdb, .offset = offset };
+    MMDB_entry_data_list_s *list;
+    int status = MMDB_get_entry_data_list(&entry, &list);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't read the record at offset %u - %s\n\n",
+                offset, MMDB_strerror(status));
+        exit(3);
+    }
+
+    uint32_t value_count = 0;
+    for (MMDB_entry_data_list_s *node = list; NULL != node;
+         node = node->next) {
+        if (value_count == opt->value_capacity) {
+            opt->value_capacity = opt->value_capacity
+                                  ? opt->value_capacity * 2 : 256;
+            opt->values = realloc(opt->values, opt->value_capacity
+                                  * sizeof(MMDB_entry_data_s));
+            if (NULL == opt->values) {
+                fprintf(stderr, "\n  Can't allocate memory\n\n");
+                exit(2);
+            }
+        }
+        opt->values[value_count++] = node->entry_data;
+    }
+    MMDB_free_entry_data_list(list);
+
+    return value_count;
+}
+
+/* This follows the path down from the record's first value. At each map,
+ * the key and its value are moved in front of the map's other keys by
+ * rotating them to the front. A number in the path picks an element of an
+ * array, which stays where it is. When the path names something that isn't
+ * there, the rest of it is ignored. */
+LOCAL void move_hot_key(MMDB_entry_data_s *values, const char **path)
+{
+    uint32_t index = 0;
+    for (; NULL != *path; path++) {
+        MMDB_entry_data_s *value = &values[index];
+        uint32_t first = index + 1;
+
+        if (MMDB_DATA_TYPE_MAP == value->type) {
+            size_t key_size = strlen(*path);
+            uint32_t key = first;
+            uint32_t i;
+            for (i = 0; i < value->data_size; i++) {
+                if (values[key].data_size == key_size
+                    && 0 == memcmp(values[key].utf8_string, *path,
+                                   key_size)) {
+                    break;
+                }
+                key = value_end(values, key + 1);
+            }
+            if (i == value->data_size) {
+                return;
+            }
+            uint32_t end = value_end(values, key + 1);
+            reverse_values(values + first, key - first);
+            reverse_values(values + key, end - key);
+            reverse_values(values + first, end - first);
+            index = first + 1;
+        } else if (MMDB_DATA_TYPE_ARRAY == value->type) {
+            char *end;
+            unsigned long element = strtoul(*path, &end, 10);
+            if (*path == end || '\0' != *end || element >= value->data_size) {
+                return;
+            }
+            index = first;
+            for (unsigned long i = 0; i < element; i++) {
+                index = value_end(values, index);
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+/* This gives the index after the value at index and everything in it */
+LOCAL uint32_t value_end(const MMDB_entry_data_s *values, uint32_t index)
+{
+    const MMDB_entry_data_s *value = &values[index++];
+    if (MMDB_DATA_TYPE_MAP == value->type) {
+        for (uint32_t i = 0; i < value->data_size; i++) {
+            index = value_end(values, index + 1);
+        }
+    } else if (MMDB_DATA_TYPE_ARRAY == value->type) {
+        for (uint32_t i = 0; i < value->data_size; i++) {
+            index = value_end(values, index);
+        }
+    }
+    return index;
+}
+
+LOCAL void reverse_values(MMDB_entry_data_s *values, uint32_t count)
+{
+    for (uint32_t i = 0, j = count; i + 1 < j; i++, j--) {
+        MMDB_entry_data_s value = values[i];
+        values[i] = values[j - 1];
+        values[j - 1] = value;
+    }
+}
+
+LOCAL void compact_tree(optimizer_s *opt)
+{
+    int status = MMDB_writer_compact(&opt->writer,
+                                     opt->options->compact_flags);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't compact the search tree - %s\n\n",
+                MMDB_strerror(status));
+        exit(3);
+    }
+}
+
+LOCAL void add_weights(optimizer_s *opt)
+{
+    for (size_t i = 0; i < opt->query_count; i++) {
+        uint8_t address[16];
+        tree_address(opt, &opt->queries[i], address);
+        int status = MMDB_writer_add_weight(&opt->writer, address, 1);
+        if (MMDB_SUCCESS != status) {
+            fprintf(stderr, "\n  Can't add a query's weight - %s\n\n",
+                    MMDB_strerror(status));
+            exit(3);
+        }
+    }
+}
+
+/* This returns the size of the file it wrote */
+LOCAL long write_database(optimizer_s *opt)
+{
+    char *file = opt->options->output_file;
+    FILE *stream = fopen(file, "wb");
+    if (NULL == stream) {
+        fprintf(stderr, "\n  Can't open %s for writing\n\n", file);
+        exit(2);
+    }
+
+    int status = MMDB_writer_write(&opt->writer, stream);
+    long size = ftell(stream);
+    if (0 != fclose(stream) && MMDB_SUCCESS == status) {
+        status = MMDB_IO_ERROR;
+    }
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't write %s - %s\n\n", file,
+                MMDB_strerror(status));
+        unlink(file);
+        exit(3);
+    }
+    return size;
+}
+
+/* This is the mean prefix length of the networks with data, which is the
+ * number of nodes a lookup that finds one of them reads. The IPv4 aliases
+ * are skipped, as they are by mmdbdiff. */
+LOCAL double average_depth(const char *file, MMDB_s *mmdb)
+{
+    MMDB_network_iterator_s iterator;
+    int status = MMDB_network_iterator_init(mmdb, 0, &iterator);
+
+    uint64_t networks = 0, total = 0;
+    bool found_network = true;
+    while (MMDB_SUCCESS == status && found_network) {
+        MMDB_network_s network;
+        status = MMDB_network_iterator_next(&iterator, &network,
+                                            &found_network);
+        if (MMDB_SUCCESS == status && found_network) {
+            networks++;
+            total += network.prefix_length;
+        }
+    }
+
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't read the networks in %s - %s\n\n", file,
+                MMDB_strerror(status));
+        exit(3);
+    }
+    return networks ? (double)total / networks : 0;
+}
+
+LOCAL void free_optimizer(optimizer_s *opt)
+{
+    MMDB_writer_free(&opt->writer);
+    free(opt->records.keys);
+    free(opt->records.values);
+    free(opt->values);
+    free(opt->queries);
+    for (int i = 0; i < opt->options->hot_path_count; i++) {
+        free((char *)opt->options->hot_paths[i][0]);
+        free(opt->options->hot_paths[i]);
+    }
+}
+
+/* This gives the value for the offset, adding it as 0 if it isn't in the
+ * table. The table is kept at most half full. */
+LOCAL uint64_t *offset_slot(offset_table_s *table, uint32_t offset)
+{
+    uint32_t slot = (offset * 2654435761U) & table->mask;
+    while (table->keys[slot]) {
+        if (table->keys[slot] == offset + 1) {
+            return &table->values[slot];
+        }
+        slot = (slot + 1) & table->mask;
+    }
+
+    if (2 * (table->count + 1) > table->mask + 1) {
+        grow_table(table);
+        return offset_slot(table, offset);
+    }
+    table->keys[slot] = offset + 1;
+    table->count++;
+    return &table->values[slot];
+}
+
+/* This doubles the size of the table, or sets up an empty one */
+LOCAL void grow_table(offset_table_s *table)
+{
+    offset_table_s old = *table;
+    uint32_t size = old.keys ? 2 * (old.mask + 1) : 1024;
+    table->keys = xcalloc(size, sizeof(uint32_t));
+    table->values = xcalloc(size, sizeof(uint64_t));
+    table->mask = size - 1;
+    table->count = 0;
+
+    if (NULL == old.keys) {
+        return;
+    }
+    for (uint32_t i = 0; i <= old.mask; i++) {
+        if (old.keys[i]) {
+            *offset_slot(table, old.keys[i] - 1) = old.values[i];
+        }
+    }
+    free(old.keys);
+    free(old.values);
+}
+
+LOCAL void *xcalloc(size_t count, size_t size)
+{
+    void *p = calloc(count, size);
+    if (NULL == p) {
+        fprintf(stderr, "\n  Can't allocate memory\n\n");
+        exit(2);
+    }
+    return p;
+}
@@ -0,0 +1,232 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "maxminddb.h"
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This prints the counts from MMDB_get_stats() for a database, one per line
+ * with tab separated fields, so that they are easy to read into a script or
+ * a spreadsheet. The first field of each line says what the line is, and
+ * the histograms have a line for each bucket that isn't empty. */
+
+#define LOCAL
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void usage(char *program, int exit_code, const char *error);
+LOCAL char *get_options(int argc, char **argv);
+LOCAL void print_tree_stats(MMDB_s *mmdb, MMDB_stats_s *stats);
+LOCAL void print_data_stats(MMDB_stats_s *stats);
+LOCAL const char *type_name(int type);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    char *mmdb_file = get_options(argc, argv);
+
+    MMDB_s mmdb;
+    int status = MMDB_open(mmdb_file, MMDB_MODE_MMAP, &mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", mmdb_file,
+                MMDB_strerror(status));
+        exit(2);
+    }
+
+    MMDB_stats_s stats;
+    status = MMDB_get_stats(&mmdb, &stats);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't get the stats for %s - %s\n\n", mmdb_file,
+                MMDB_strerror(status));
+        MMDB_close(&mmdb);
+        exit(3);
+    }
+
+    print_tree_stats(&mmdb, &stats);
+    print_data_stats(&stats);
+
+    MMDB_close(&mmdb);
+    exit(0);
+}
+
+LOCAL void usage(char *program, int exit_code, const char *error)
+{
+    if (NULL != error) {
+        fprintf(stderr, "\n  *ERROR: %s\n", error);
+    }
+
+    char *usage = "\n"
+                  "  %s --file /path/to/file.mmdb\n"
+                  "\n"
+                  "  This application accepts the following options:\n"
+                  "\n"
+                  "      --file (-f)     The path to the MMDB file. Required.\n"
+                  "\n"
+                  "      --version       Print the program's version number and exit.\n"
+                  "\n"
+                  "      --help (-h -?)  Show usage information.\n"
+                  "\n"
+                  "  This prints the number of nodes and networks at each depth of the\n"
+                  "  search tree, the number of records and their sizes, and how the\n"
+                  "  data section is used, one tab separated line for each count.\n"
+                  "\n";
+
+    fprintf(stdout, usage, program);
+    exit(exit_code);
+}
+
+LOCAL char *get_options(int argc, char **argv)
+{
+    static int help = 0;
+    static int version = 0;
+    char *mmdb_file = NULL;
+
+    while (1) {
+        static struct option options[] = {
+            { "file",    required_argument, 0, 'f' },
+            { "version", no_argument,       0, 'v' },
+            { "help",    no_argument,       0, 'h' },
+            { "?",       no_argument,       0, 1   },
+            { 0,         0,                 0, 0   }
+        };
+
+        int opt_index;
+        int opt_char = getopt_long(argc, argv, "f:h?", options, &opt_index);
+
+        if (-1 == opt_char) {
+            break;
+        }
+
+        if ('f' == opt_char) {
+            mmdb_file = optarg;
+        } else if ('v' == opt_char) {
+            version = 1;
+        } else if ('h' == opt_char || '?' == opt_char) {
+            help = 1;
+        }
+    }
+
+    char *program = basename(argv[0]);
+
+    if (help) {
+        usage(program, 0, NULL);
+    }
+
+    if (version) {
+        fprintf(stdout, "\n  %s version %s\n\n", program, VERSION);
+        exit(0);
+    }
+
+    if (NULL == mmdb_file) {
+        usage(program, 1, "You must provide a filename with --file");
+    }
+
+    return mmdb_file;
+}
+
+LOCAL void print_tree_stats(MMDB_s *mmdb, MMDB_stats_s *stats)
+{
+    fprintf(stdout, "nodes\t%u\t%u\n", stats->node_count,
+            mmdb->metadata.node_count);
+    for (int depth = 0; depth <= MMDB_STATS_MAX_DEPTH; depth++) {
+        if (stats->nodes_by_depth[depth]) {
+            fprintf(stdout, "nodes_at_depth\t%d\t%u\n", depth,
+                    stats->nodes_by_depth[depth]);
+        }
+    }
+
+    uint64_t data_networks = 0;
+    uint64_t empty_networks = 0;
+    uint64_t total_depth = 0;
+    for (int depth = 0; depth <= MMDB_STATS_MAX_DEPTH; depth++) {
+        data_networks += stats->data_networks_by_depth[depth];
+        empty_networks += stats->empty_networks_by_depth[depth];
+        total_depth += stats->data_networks_by_depth[depth] * depth;
+    }
+    fprintf(stdout, "data_networks\t%llu\nempty_networks\t%llu\n",
+            (unsigned long long)data_networks,
+            (unsigned long long)empty_networks);
+    for (int depth = 0; depth <= MMDB_STATS_MAX_DEPTH; depth++) {
+        if (stats->data_networks_by_depth[depth]
+            || stats->empty_networks_by_depth[depth]) {
+            fprintf(stdout, "networks_at_depth\t%d\t%llu\t%llu\n", depth,
+                    (unsigned long long)stats->data_networks_by_depth[depth],
+                    (unsigned long long)stats->empty_networks_by_depth[depth]);
+        }
+    }
+    fprintf(stdout, "average_depth\t%.2f\n",
+            data_networks ? (double)total_depth / data_networks : 0.0);
+}
+
+LOCAL void print_data_stats(MMDB_stats_s *stats)
+{
+    fprintf(stdout, "records\t%u\n", stats->record_count);
+    for (int i = 0; i < MMDB_STATS_SIZE_BUCKETS; i++) {
+        if (stats->record_sizes[i]) {
+            fprintf(stdout, "records_of_size\t%llu\t%u\n", 1ULL << i,
+                    stats->record_sizes[i]);
+        }
+    }
+
+    fprintf(stdout,
+            "data_size\t%u\nused_data_size\t%llu\nexpanded_data_size\t%llu\n"
+            "deduplication_ratio\t%.2f\n",
+            stats->data_size, (unsigned long long)stats->used_data_size,
+            (unsigned long long)stats->expanded_data_size,
+            stats->used_data_size
+            ? (double)stats->expanded_data_size / stats->used_data_size
+            : 0.0);
+    fprintf(stdout, "pointers\t%llu\t%llu\npointer_targets\t%u\n",
+            (unsigned long long)stats->type_counts[MMDB_DATA_TYPE_POINTER],
+            (unsigned long long)stats->type_bytes[MMDB_DATA_TYPE_POINTER],
+            stats->pointer_target_count);
+    fprintf(stdout, "strings\t%llu\t%llu\n",
+            (unsigned long long)stats->type_counts[MMDB_DATA_TYPE_UTF8_STRING],
+            (unsigned long long)stats->type_bytes[MMDB_DATA_TYPE_UTF8_STRING]);
+
+    for (int type = 0; type < MMDB_STATS_DATA_TYPES; type++) {
+        if (stats->type_counts[type]) {
+            fprintf(stdout, "type\t%s\t%llu\t%llu\n", type_name(type),
+                    (unsigned long long)stats->type_counts[type],
+                    (unsigned long long)stats->type_bytes[type]);
+        }
+    }
+}
+
+LOCAL const char *type_name(int type)
+{
+    switch (type) {
+    case MMDB_DATA_TYPE_POINTER:
+        return "pointer";
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        return "utf8_string";
+    case MMDB_DATA_TYPE_DOUBLE:
+        return "double";
+    case MMDB_DATA_TYPE_BYTES:
+        return "bytes";
+    case MMDB_DATA_TYPE_UINT16:
+        return "uint16";
+    case MMDB_DATA_TYPE_UINT32:
+        return "uint32";
+    case MMDB_DATA_TYPE_MAP:
+        return "map";
+    case MMDB_DATA_TYPE_INT32:
+        return "int32";
+    case MMDB_DATA_TYPE_UINT64:
+        return "uint64";
+    case MMDB_DATA_TYPE_UINT128:
+        return "uint128";
+    case MMDB_DATA_TYPE_ARRAY:
+        return "array";
+    case MMDB_DATA_TYPE_BOOLEAN:
+        return "boolean";
+    case MMDB_DATA_TYPE_FLOAT:
+        return "float";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,734 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "maxminddb.h"
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* This verifies a whole database with a pool of threads. It works in two
+ * phases. First the search tree is split into subtrees near the root and the
+ * threads take subtrees from a shared queue, checking every record in them
+ * and collecting the data section offsets that the records point to. Then
+ * the distinct offsets are split into chunks and the threads take chunks
+ * from the queue, decoding every record and checking its strings.
+ *
+ * Each error is found exactly once, however the work was split up. Each
+ * thread keeps the first errors by location that it found, and the lists are
+ * merged and sorted at the end, so the report is the same no matter how many
+ * threads there were. */
+
+#define MAX_THREADS (256)
+/* The search tree is split into about this many subtrees per thread so
+ * that a thread that gets a small subtree can take another one */
+#define SUBTREES_PER_THREAD (16)
+#define DATA_CHUNK_SIZE (256)
+/* This is how many errors are printed. Each thread keeps this many of the
+ * errors it found, the ones with the lowest locations, and counts the rest. */
+#define MAX_ERRORS (1000)
+
+#define SEARCH_TREE_SECTION (0)
+#define DATA_SECTION (1)
+
+typedef struct tree_node_s {
+    uint32_t node;
+    /* This is the number of address bits it takes to get to this node */
+    uint16_t depth;
+    /* This is false when the node was already checked through another path
+     * and is only being walked again because this path is deeper */
+    bool first_visit;
+} tree_node_s;
+
+typedef struct verify_error_s {
+    int section;
+    uint64_t location;
+    char message[128];
+} verify_error_s;
+
+typedef struct shared_state_s {
+    MMDB_s *mmdb;
+    tree_node_s *subtrees;
+    size_t subtree_count;
+    uint32_t *offsets;
+    size_t offset_count;
+    /* This is the next subtree or chunk of offsets to hand out */
+    size_t next_item;
+    /* This has one more than the depth of the deepest path to each node that
+     * some thread has started on, or 0 for the nodes not reached yet */
+    uint8_t *node_depths;
+    /* This has a bit for each offset in the data section where a string or
+     * map key that isn't valid UTF-8 has been reported */
+    uint8_t *bad_strings;
+} shared_state_s;
+
+typedef struct worker_s {
+    shared_state_s *shared;
+    pthread_t thread;
+    tree_node_s *stack;
+    size_t stack_size;
+    size_t stack_capacity;
+    uint32_t *offsets;
+    size_t offset_count;
+    size_t offset_capacity;
+    verify_error_s *errors;
+    size_t error_count;
+    uint64_t total_errors;
+    uint64_t nodes;
+} worker_s;
+
+#define LOCAL
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL void usage(char *program, int exit_code, const char *error);
+LOCAL void get_options(int argc, char **argv, char **mmdb_file,
+                       int *thread_count, int *quiet);
+LOCAL double now(void);
+LOCAL void split_search_tree(worker_s *worker, int thread_count);
+LOCAL void run_workers(worker_s *workers, int thread_count,
+                       void *(*phase)(void *));
+LOCAL void *verify_subtrees(void *arg);
+LOCAL void verify_node(worker_s *worker, tree_node_s item);
+LOCAL void verify_record(worker_s *worker, tree_node_s item,
+                         const char *side, uint64_t record, uint8_t type);
+LOCAL bool raise_depth(uint8_t *node_depths, uint32_t node, uint16_t depth,
+                       bool *first_visit);
+LOCAL bool mark_seen(uint8_t *seen, uint64_t bit);
+LOCAL size_t merge_offsets(shared_state_s *shared, worker_s *workers,
+                           int thread_count);
+LOCAL void *verify_records(void *arg);
+LOCAL int check_key(void *ctx, const char *key, uint32_t key_size);
+LOCAL int check_scalar(void *ctx, const MMDB_entry_data_s *entry_data);
+LOCAL bool is_valid_utf8(const uint8_t *string, uint32_t size);
+LOCAL void add_error(worker_s *worker, int section, uint64_t location,
+                     const char *fmt, ...);
+LOCAL void keep_first_errors(worker_s *worker);
+LOCAL void push_node(worker_s *worker, tree_node_s item);
+LOCAL void add_offset(worker_s *worker, uint32_t offset);
+LOCAL size_t take_work(shared_state_s *shared, size_t size);
+LOCAL uint64_t report_errors(worker_s *workers, int thread_count);
+LOCAL int compare_offsets(const void *a, const void *b);
+LOCAL int compare_errors(const void *a, const void *b);
+LOCAL void *xrealloc(void *p, size_t size);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int main(int argc, char **argv)
+{
+    char *mmdb_file = NULL;
+    int thread_count = 0;
+    int quiet = 0;
+
+    get_options(argc, argv, &mmdb_file, &thread_count, &quiet);
+
+    double start = now();
+
+    MMDB_s mmdb;
+    int status = MMDB_open(mmdb_file, MMDB_MODE_MMAP, &mmdb);
+    if (MMDB_SUCCESS != status) {
+        fprintf(stderr, "\n  Can't open %s - %s\n\n", mmdb_file,
+                MMDB_strerror(status));
+        exit(2);
+    }
+
+    shared_state_s shared = {
+        .mmdb        = &mmdb,
+        .node_depths = calloc(mmdb.metadata.node_count + 1, 1),
+        .bad_strings = calloc(mmdb.data_section_size / 8 + 1, 1)
+    };
+    worker_s *workers = calloc(thread_count, sizeof(worker_s));
+    if (NULL == shared.node_depths || NULL == shared.bad_strings
+        || NULL == workers) {
+        fprintf(stderr, "\n  Out of memory\n\n");
+        exit(2);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].shared = &shared;
+    }
+
+    split_search_tree(&workers[0], thread_count);
+    run_workers(workers, thread_count, verify_subtrees);
+
+    uint64_t nodes = 0;
+    for (int i = 0; i < thread_count; i++) {
+        nodes += workers[i].nodes;
+    }
+    size_t records = merge_offsets(&shared, workers, thread_count);
+    run_workers(workers, thread_count, verify_records);
+
+    uint64_t errors = report_errors(workers, thread_count);
+    if (!quiet) {
+        fprintf(stdout,
+                "\n  Checked %llu search tree nodes and %zu records in %.2f"
+                " seconds with %d threads. Found %llu errors.\n\n",
+                (unsigned long long)nodes, records, now() - start,
+                thread_count, (unsigned long long)errors);
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        free(workers[i].stack);
+        free(workers[i].offsets);
+        free(workers[i].errors);
+    }
+    free(workers);
+    free(shared.subtrees);
+    free(shared.offsets);
+    free(shared.node_depths);
+    free(shared.bad_strings);
+    MMDB_close(&mmdb);
+
+    exit(errors ? 1 : 0);
+}
+
+LOCAL void usage(char *program, int exit_code, const char *error)
+{
+    if (NULL != error) {
+        fprintf(stderr, "\n  *ERROR: %s\n", error);
+    }
+
+    char *usage = "\n"
+                  "  %s --file /path/to/file.mmdb\n"
+                  "\n"
+                  "  This application accepts the following options:\n"
+                  "\n"
+                  "      --file (-f)     The path to the MMDB file. Required.\n"
+                  "\n"
+                  "      --threads (-t)  The number of threads to use. This defaults to the\n"
+                  "                      number of online CPUs.\n"
+                  "\n"
+                  "      --quiet (-q)    Only print errors.\n"
+                  "\n"
+                  "      --version       Print the program's version number and exit.\n"
+                  "\n"
+                  "      --help (-h -?)  Show usage information.\n"
+                  "\n"
+                  "  This checks every record in the search tree and every record in the\n"
+                  "  data section that the search tree points to. It exits with 0 if the\n"
+                  "  database is valid and 1 if any errors were found.\n"
+                  "\n";
+
+    fprintf(stdout, usage, program);
+    exit(exit_code);
+}
+
+LOCAL void get_options(int argc, char **argv, char **mmdb_file,
+                       int *thread_count, int *quiet)
+{
+    static int help = 0;
+    static int version = 0;
+
+    while (1) {
+        static struct option options[] = {
+            { "file",    required_argument, 0, 'f' },
+            { "threads", required_argument, 0, 't' },
+            { "quiet",   no_argument,       0, 'q' },
+            { "version", no_argument,       0, 'n' },
+            { "help",    no_argument,       0, 'h' },
+            { "?",       no_argument,       0, 1   },
+            { 0,         0,                 0, 0   }
+        };
+
+        int opt_index;
+        int opt_char = getopt_long(argc, argv, "f:t:qnh?", options,
+                                   &opt_index);
+
+        if (-1 == opt_char) {
+            break;
+        }
+
+        if ('f' == opt_char) {
+            *mmdb_file = optarg;
+        } else if ('t' == opt_char) {
+            *thread_count = strtol(optarg, NULL, 10);
+        } else if ('q' == opt_char) {
+            *quiet = 1;
+        } else if ('n' == opt_char) {
+            version = 1;
+        } else if ('h' == opt_char || '?' == opt_char) {
+            help = 1;
+        }
+    }
+
+    char *program = basename(argv[0]);
+
+    if (help) {
+        usage(program, 0, NULL);
+    }
+
+    if (version) {
+        fprintf(stdout, "\n  %s version %s\n\n", program, VERSION);
+        exit(0);
+    }
+
+    if (NULL == *mmdb_file) {
+        usage(program, 1, "You must provide a filename with --file");
+    }
+
+    if (0 == *thread_count) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        *thread_count = cpus > 0 ? (int)cpus : 1;
+    }
+    if (*thread_count < 1 || *thread_count > MAX_THREADS) {
+        usage(program, 1, "The number of threads must be from 1 to 256");
+    }
+}
+
+LOCAL double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* This checks the top of the search tree one level at a time until there
+ * are enough subtrees to keep all of the threads busy. The nodes on the last
+ * level become the roots of the subtrees. */
+LOCAL void split_search_tree(worker_s *worker, int thread_count)
+{
+    shared_state_s *shared = worker->shared;
+    size_t wanted = (size_t)thread_count * SUBTREES_PER_THREAD;
+
+    tree_node_s root = { .node = 0, .depth = 0 };
+    raise_depth(shared->node_depths, 0, 0, &root.first_visit);
+    push_node(worker, root);
+
+    while (worker->stack_size > 0 && worker->stack_size < wanted) {
+        size_t count = worker->stack_size;
+        tree_node_s *level = malloc(count * sizeof(tree_node_s));
+        if (NULL == level) {
+            fprintf(stderr, "\n  Out of memory\n\n");
+            exit(2);
+        }
+        memcpy(level, worker->stack, count * sizeof(tree_node_s));
+        worker->stack_size = 0;
+        for (size_t i = 0; i < count; i++) {
+            verify_node(worker, level[i]);
+        }
+        free(level);
+    }
+
+    shared->subtree_count = worker->stack_size;
+    shared->subtrees = malloc((worker->stack_size + 1) * sizeof(tree_node_s));
+    if (NULL == shared->subtrees) {
+        fprintf(stderr, "\n  Out of memory\n\n");
+        exit(2);
+    }
+    memcpy(shared->subtrees, worker->stack,
+           worker->stack_size * sizeof(tree_node_s));
+    worker->stack_size = 0;
+}
+
+LOCAL void run_workers(worker_s *workers, int thread_count,
+                       void *(*phase)(void *))
+{
+    workers[0].shared->next_item = 0;
+
+    for (int i = 1; i < thread_count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, phase, &workers[i])) {
+            fprintf(stderr, "\n  Can't create a thread\n\n");
+            exit(2);
+        }
+    }
+    /* The main thread does its share of the work too */
+    phase(&workers[0]);
+    for (int i = 1; i < thread_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+}
+
+LOCAL void *verify_subtrees(void *arg)
+{
+    worker_s *worker = arg;
+    shared_state_s *shared = worker->shared;
+
+    size_t i;
+    while ((i = take_work(shared, 1)) < shared->subtree_count) {
+        push_node(worker, shared->subtrees[i]);
+        while (worker->stack_size > 0) {
+            verify_node(worker, worker->stack[--worker->stack_size]);
+        }
+    }
+
+    return NULL;
+}
+
+LOCAL void verify_node(worker_s *worker, tree_node_s item)
+{
+    MMDB_search_node_s node;
+    int status = MMDB_read_node(worker->shared->mmdb, item.node, &node);
+    if (MMDB_SUCCESS != status) {
+        if (item.first_visit) {
+            add_error(worker, SEARCH_TREE_SECTION, item.node,
+                      "can't read the node - %s", MMDB_strerror(status));
+        }
+        return;
+    }
+    worker->nodes += item.first_visit;
+
+    verify_record(worker, item, "left", node.left_record,
+                  node.left_record_type);
+    verify_record(worker, item, "right", node.right_record,
+                  node.right_record_type);
+}
+
+LOCAL void verify_record(worker_s *worker, tree_node_s item,
+                         const char *side, uint64_t record, uint8_t type)
+{
+    MMDB_s *mmdb = worker->shared->mmdb;
+    uint32_t node_count = mmdb->metadata.node_count;
+
+    /* Walking a node again only matters for the nodes below it, whose depth
+     * checks can turn out differently along a deeper path */
+    if (!item.first_visit && MMDB_RECORD_TYPE_SEARCH_NODE != type) {
+        return;
+    }
+
+    switch (type) {
+    case MMDB_RECORD_TYPE_SEARCH_NODE:
+        /* This is checked against the deepest path to the node, which doesn't
+         * depend on the path that a thread happened to take first. Only the
+         * walk along that path gets here, so it is reported once. */
+        if (item.depth + 1 >= mmdb->depth) {
+            add_error(worker, SEARCH_TREE_SECTION, item.node,
+                      "%s record points to node %llu after the last bit of"
+                      " the address", side, (unsigned long long)record);
+        } else {
+            tree_node_s child = {
+                .node  = (uint32_t)record,
+                .depth = item.depth + 1
+            };
+            if (raise_depth(worker->shared->node_depths, child.node,
+                            child.depth, &child.first_visit)) {
+                push_node(worker, child);
+            }
+        }
+        break;
+    case MMDB_RECORD_TYPE_EMPTY:
+        break;
+    case MMDB_RECORD_TYPE_DATA:
+        if (record - node_count < 16) {
+            add_error(worker, SEARCH_TREE_SECTION, item.node,
+                      "%s record points into the data section separator",
+                      side);
+        } else {
+            add_offset(worker, (uint32_t)(record - node_count - 16));
+        }
+        break;
+    default:
+        add_error(worker, SEARCH_TREE_SECTION, item.node,
+                  "%s record has an invalid value (%llu)", side,
+                  (unsigned long long)record);
+        break;
+    }
+}
+
+/* Nodes can be reached more than once, for example when an IPv6 database
+ * has aliases for the IPv4 part of the tree. This records a path of the
+ * given depth to a node and returns whether it is deeper than every path to
+ * the node so far, in which case the node has to be walked again. It sets
+ * first_visit if no path had reached the node before. */
+LOCAL bool raise_depth(uint8_t *node_depths, uint32_t node, uint16_t depth,
+                       bool *first_visit)
+{
+    uint8_t old = node_depths[node];
+    while (old < depth + 1) {
+        uint8_t seen = __sync_val_compare_and_swap(&node_depths[node], old,
+                                                   (uint8_t)(depth + 1));
+        if (seen == old) {
+            *first_visit = 0 == old;
+            return true;
+        }
+        old = seen;
+    }
+    return false;
+}
+
+/* This sets a bit and returns whether it was already set */
+LOCAL bool mark_seen(uint8_t *seen, uint64_t bit)
+{
+    uint8_t mask = (uint8_t)(1U << (bit & 7));
+    return __sync_fetch_and_or(&seen[bit >> 3], mask) & mask;
+}
+
+/* Most data records are pointed to by many records in the search tree, so
+ * we only decode each distinct one once */
+LOCAL size_t merge_offsets(shared_state_s *shared, worker_s *workers,
+                           int thread_count)
+{
+    size_t total = 0;
+    for (int i = 0; i < thread_count; i++) {
+        total += workers[i].offset_count;
+    }
+
+    shared->offsets = malloc((total + 1) * sizeof(uint32_t));
+    if (NULL == shared->offsets) {
+        fprintf(stderr, "\n  Out of memory\n\n");
+        exit(2);
+    }
+    size_t count = 0;
+    for (int i = 0; i < thread_count; i++) {
+        memcpy(shared->offsets + count, workers[i].offsets,
+               workers[i].offset_count * sizeof(uint32_t));
+        count += workers[i].offset_count;
+    }
+
+    qsort(shared->offsets, count, sizeof(uint32_t), compare_offsets);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (0 == unique || shared->offsets[unique - 1] != shared->offsets[i]) {
+            shared->offsets[unique++] = shared->offsets[i];
+        }
+    }
+    shared->offset_count = unique;
+
+    return unique;
+}
+
+LOCAL void *verify_records(void *arg)
+{
+    worker_s *worker = arg;
+    shared_state_s *shared = worker->shared;
+    MMDB_visitor_s visitor = {
+        .key    = check_key,
+        .scalar = check_scalar
+    };
+
+    size_t start;
+    while ((start = take_work(shared, DATA_CHUNK_SIZE)) <
+           shared->offset_count) {
+        size_t end = start + DATA_CHUNK_SIZE;
+        if (end > shared->offset_count) {
+            end = shared->offset_count;
+        }
+        for (size_t i = start; i < end; i++) {
+            MMDB_entry_s entry = {
+                .mmdb   = shared->mmdb,
+                .offset = shared->offsets[i]
+            };
+            int status = MMDB_walk_entry(&entry, &visitor, worker);
+            if (MMDB_SUCCESS != status) {
+                add_error(worker, DATA_SECTION, shared->offsets[i],
+                          "can't decode the record - %s",
+                          MMDB_strerror(status));
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* A key or string can be pointed to from many records, which may be checked
+ * by different threads, so a bad one is only reported by the first thread to
+ * find it */
+LOCAL int check_key(void *ctx, const char *key, uint32_t key_size)
+{
+    worker_s *worker = ctx;
+    if (!is_valid_utf8((const uint8_t *)key, key_size)) {
+        uint64_t location = (uint64_t)((const uint8_t *)key
+                                       - worker->shared->mmdb->data_section);
+        if (!mark_seen(worker->shared->bad_strings, location)) {
+            add_error(worker, DATA_SECTION, location,
+                      "map key is not valid UTF-8");
+        }
+    }
+    return MMDB_VISIT_CONTINUE;
+}
+
+LOCAL int check_scalar(void *ctx, const MMDB_entry_data_s *entry_data)
+{
+    worker_s *worker = ctx;
+    if (MMDB_DATA_TYPE_UTF8_STRING == entry_data->type
+        && !is_valid_utf8((const uint8_t *)entry_data->utf8_string,
+                          entry_data->data_size)
+        && !mark_seen(worker->shared->bad_strings, entry_data->offset)) {
+        add_error(worker, DATA_SECTION, entry_data->offset,
+                  "string is not valid UTF-8");
+    }
+    return MMDB_VISIT_CONTINUE;
+}
+
+/* This rejects overlong encodings, surrogates and code points past
+ * U+10FFFF as well as malformed sequences */
+LOCAL bool is_valid_utf8(const uint8_t *string, uint32_t size)
+{
+    uint32_t i = 0;
+    while (i < size) {
+        uint8_t c = string[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        uint32_t length, code_point, minimum;
+        if (0xc0 == (c & 0xe0)) {
+            length = 2;
+            code_point = c & 0x1f;
+            minimum = 0x80;
+        } else if (0xe0 == (c & 0xf0)) {
+            length = 3;
+            code_point = c & 0x0f;
+            minimum = 0x800;
+        } else if (0xf0 == (c & 0xf8)) {
+            length = 4;
+            code_point = c & 0x07;
+            minimum = 0x10000;
+        } else {
+            return false;
+        }
+
+        if (size - i < length) {
+            return false;
+        }
+        for (uint32_t j = 1; j < length; j++) {
+            if (0x80 != (string[i + j] & 0xc0)) {
+                return false;
+            }
+            code_point = (code_point << 6) | (string[i + j] & 0x3f);
+        }
+        if (code_point < minimum || code_point > 0x10ffff
+            || (code_point >= 0xd800 && code_point <= 0xdfff)) {
+            return false;
+        }
+        i += length;
+    }
+
+    return true;
+}
+
+LOCAL void add_error(worker_s *worker, int section, uint64_t location,
+                     const char *fmt, ...)
+{
+    worker->total_errors++;
+    if (NULL == worker->errors) {
+        worker->errors =
+            xrealloc(NULL, 2 * MAX_ERRORS * sizeof(verify_error_s));
+    } else if (worker->error_count == 2 * MAX_ERRORS) {
+        keep_first_errors(worker);
+    }
+
+    verify_error_s *error = &worker->errors[worker->error_count++];
+    error->section = section;
+    error->location = location;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error->message, sizeof(error->message), fmt, args);
+    va_end(args);
+}
+
+/* Only the first MAX_ERRORS errors by location are printed, and each of
+ * those is among the first MAX_ERRORS that the thread which found it kept */
+LOCAL void keep_first_errors(worker_s *worker)
+{
+    qsort(worker->errors, worker->error_count, sizeof(verify_error_s),
+          compare_errors);
+    if (worker->error_count > MAX_ERRORS) {
+        worker->error_count = MAX_ERRORS;
+    }
+}
+
+LOCAL void push_node(worker_s *worker, tree_node_s item)
+{
+    if (worker->stack_size == worker->stack_capacity) {
+        worker->stack_capacity = worker->stack_capacity * 2 + 64;
+        worker->stack = xrealloc(worker->stack,
+                                 worker->stack_capacity * sizeof(tree_node_s));
+    }
+    worker->stack[worker->stack_size++] = item;
+}
+
+LOCAL void add_offset(worker_s *worker, uint32_t offset)
+{
+    /* Neighboring records often point to the same data */
+    if (worker->offset_count > 0
+        && worker->offsets[worker->offset_count - 1] == offset) {
+        return;
+    }
+    if (worker->offset_count == worker->offset_capacity) {
+        worker->offset_capacity = worker->offset_capacity * 2 + 1024;
+        worker->offsets = xrealloc(worker->offsets,
+                                   worker->offset_capacity * sizeof(uint32_t));
+    }
+    worker->offsets[worker->offset_count++] = offset;
+}
+
+/* This hands out the next size items of work and returns the index of the
+ * first one */
+LOCAL size_t take_work(shared_state_s *shared, size_t size)
+{
+    return __sync_fetch_and_add(&shared->next_item, size);
+}
+
+LOCAL uint64_t report_errors(worker_s *workers, int thread_count)
+{
+    size_t count = 0;
+    uint64_t total = 0;
+    for (int i = 0; i < thread_count; i++) {
+        keep_first_errors(&workers[i]);
+        count += workers[i].error_count;
+        total += workers[i].total_errors;
+    }
+    if (0 == total) {
+        return 0;
+    }
+
+    verify_error_s *errors = xrealloc(NULL, count * sizeof(verify_error_s));
+    size_t merged = 0;
+    for (int i = 0; i < thread_count; i++) {
+        memcpy(errors + merged, workers[i].errors,
+               workers[i].error_count * sizeof(verify_error_s));
+        merged += workers[i].error_count;
+    }
+    qsort(errors, count, sizeof(verify_error_s), compare_errors);
+
+    size_t printed = count < MAX_ERRORS ? count : MAX_ERRORS;
+    for (size_t i = 0; i < printed; i++) {
+        fprintf(stdout, "  %s %llu: %s\n",
+                SEARCH_TREE_SECTION == errors[i].section
+                ? "search tree node" : "data section offset",
+                (unsigned long long)errors[i].location, errors[i].message);
+    }
+    if (total > printed) {
+        fprintf(stdout, "  ... and %llu more errors\n",
+                (unsigned long long)(total - printed));
+    }
+
+    free(errors);
+    return total;
+}
+
+LOCAL int compare_offsets(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+LOCAL int compare_errors(const void *a, const void *b)
+{
+    const verify_error_s *x = a;
+    const verify_error_s *y = b;
+    if (x->section != y->section) {
+        return x->section < y->section ? -1 : 1;
+    }
+    if (x->location != y->location) {
+        return x->location < y->location ? -1 : 1;
+    }
+    return strcmp(x->message, y->message);
+}
+
+LOCAL void *xrealloc(void *p, size_t size)
+{
+    void *new = realloc(p, size);
+    if (NULL == new) {
+        fprintf(stderr, "\n  Out of memory\n\n");
+        exit(2);
+    }
+    return new;
+}
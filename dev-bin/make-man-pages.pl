@@ -21,7 +21,14 @@ sub main {
     _make_man( $target, 'libmaxminddb', 3 );
     _make_lib_man_links($target);
 
+    _make_man( $target, 'mmdbbench', 1 );
+    _make_man( $target, 'mmdbdiff', 1 );
+    _make_man( $target, 'mmdbdump', 1 );
+    _make_man( $target, 'mmdbgen', 1 );
     _make_man( $target, 'mmdblookup', 1 );
+    _make_man( $target, 'mmdboptimize', 1 );
+    _make_man( $target, 'mmdbstats', 1 );
+    _make_man( $target, 'mmdbverify', 1 );
 }
 
 sub _make_man {
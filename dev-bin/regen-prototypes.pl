@@ -11,7 +11,7 @@ use List::MoreUtils qw( uniq );
 
 sub main {
     _regen_prototypes(
-        "$Bin/../src/maxminddb.c",
+        [ "$Bin/../src/maxminddb.c", "$Bin/../src/writer.c" ],
         "$Bin/../include/maxminddb.h"
     );
 
@@ -26,12 +26,14 @@ sub main {
 }
 
 sub _regen_prototypes {
-    my $c_file = shift;
-    my $h_file = shift;
+    my $c_files = shift;
+    my $h_file  = shift;
+
+    # The public functions of all of the C files go in the header, in the
+    # order the files are given.
+    $c_files = [$c_files] unless ref $c_files;
 
-    my $c_code      = read_file($c_file);
     my $h_code      = $h_file ? read_file($h_file) : q{};
-    my $orig_c_code = $c_code;
     my $orig_h_code = $h_code;
 
     my $script_name = basename($0);
@@ -47,8 +49,8 @@ sub _regen_prototypes {
     ( my $prototypes_start_re = $prototypes_start ) =~ s/ \n /\n */g;
     ( my $prototypes_end_re   = $prototypes_end ) =~ s/\n/\n */g;
 
-    for my $content ( $c_code, $h_code ) {
-        $content =~ s{
+    my $strip_prototypes = sub {
+        $_[0] =~ s{
                     [ ]*
                     \Q$indent_off\E
                     \n
@@ -62,29 +64,40 @@ sub _regen_prototypes {
                     \Q$indent_on\E
                     \n
             }{__PROTOTYPES__}sx;
-    }
+    };
 
-    my @prototypes = parse_prototypes($c_code);
+    my $external_prototypes = q{};
+    for my $c_file ( @{$c_files} ) {
+        my $c_code      = read_file($c_file);
+        my $orig_c_code = $c_code;
+        $strip_prototypes->($c_code);
 
-    if ($h_file) {
-        my $external_prototypes = join q{}, map {
+        my @prototypes = parse_prototypes($c_code);
+
+        $external_prototypes .= join q{}, map {
             my $p = 'extern ' . $_->{prototype};
             $p =~ s/^/    /;                # first line
             $p =~ s/\n/\n           /gm;    # the rest
             $p . ";\n"
             }
             grep { $_->{external} } @prototypes;
+
+        my $internal_prototypes = join q{}, uniq
+            map { $_->{prototype} . ";\n" }
+            grep { !$_->{external} } @prototypes;
+        $c_code
+            =~ s/__PROTOTYPES__/$indent_off\n$prototypes_start\n$internal_prototypes$prototypes_end\n$indent_on\n/;
+
+        write_file( $c_file, $c_code ) if $c_code ne $orig_c_code;
+    }
+
+    if ($h_file) {
+        $strip_prototypes->($h_code);
         $h_code
             =~ s/__PROTOTYPES__/    $indent_off\n    $prototypes_start\n$external_prototypes    $prototypes_end\n    $indent_on\n/;
         $h_code =~ s{\n *(/\* \*INDENT)}{\n    $1}g;
     }
 
-    my $internal_prototypes = join q{}, uniq
-        map { $_->{prototype} . ";\n" } grep { !$_->{external} } @prototypes;
-    $c_code
-        =~ s/__PROTOTYPES__/$indent_off\n$prototypes_start\n$internal_prototypes$prototypes_end\n$indent_on\n/;
-
-    write_file( $c_file, $c_code ) if $c_code ne $orig_c_code;
     write_file( $h_file, $h_code ) if $h_file && $h_code ne $orig_h_code;
 }
 
@@ -120,7 +133,7 @@ my $re_signature = qr/^($re_type ($re_identifier) $re_args) (?>[\ \t\n]*?{)/x;
             my ( $prototype, $name ) = $chunk =~ /^$re_signature/ms
                 or next;
 
-            next if $prototype =~ /^(?:DEBUG_FUNC|NO_PROTO)/;
+            next if $prototype =~ /^(?:DEBUG_FUNC|NO_PROTO|INTERNAL)/;
 
             push @protos,
                 {
@@ -54,6 +54,11 @@ typedef ADDRESS_FAMILY sa_family_t;
 #define MMDB_DATA_TYPE_BOOLEAN (14)
 #define MMDB_DATA_TYPE_FLOAT (15)
 
+/* return values for the MMDB_visitor_s callbacks */
+#define MMDB_VISIT_CONTINUE (0)
+#define MMDB_VISIT_SKIP (1)
+#define MMDB_VISIT_STOP (2)
+
 #define MMDB_RECORD_TYPE_SEARCH_NODE (0)
 #define MMDB_RECORD_TYPE_EMPTY (1)
 #define MMDB_RECORD_TYPE_DATA (2)
@@ -63,6 +68,36 @@ typedef ADDRESS_FAMILY sa_family_t;
 #define MMDB_MODE_MMAP (1)
 #define MMDB_MODE_MASK (7)
 
+/* This is set in MMDB_s.flags once MMDB_verify() succeeds */
+#define MMDB_VERIFIED (8)
+
+/* flags for MMDB_network_iterator_init(),
+ * MMDB_network_iterator_init_subtree() and MMDB_lookup_range() */
+#define MMDB_NETWORK_ITERATOR_INCLUDE_EMPTY (1)
+#define MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES (2)
+/* MMDB_lookup_range() only reports the first network for each record */
+#define MMDB_LOOKUP_RANGE_UNIQUE_DATA (4)
+/* An alias of the IPv4 subtree is returned as a network with a record type
+ * of MMDB_RECORD_TYPE_SEARCH_NODE rather than being skipped */
+#define MMDB_NETWORK_ITERATOR_REPORT_ALIASES (8)
+
+/* the kinds of change in MMDB_diff_s */
+#define MMDB_DIFF_ADDED (1)
+#define MMDB_DIFF_REMOVED (2)
+#define MMDB_DIFF_CHANGED (3)
+
+/* A search tree record in an MMDB_writer_s with this bit set has data. The
+ * rest of its bits are the offset of the data in the data section. */
+#define MMDB_WRITER_DATA_RECORD (0x80000000U)
+
+/* flags for MMDB_writer_compact() */
+#define MMDB_WRITER_COMPACT_MERGE_NETWORKS (1)
+
+/* sizes of the arrays in MMDB_stats_s */
+#define MMDB_STATS_MAX_DEPTH (128)
+#define MMDB_STATS_SIZE_BUCKETS (32)
+#define MMDB_STATS_DATA_TYPES (16)
+
 /* error codes */
 #define MMDB_SUCCESS (0)
 #define MMDB_FILE_OPEN_ERROR (1)
@@ -76,6 +111,11 @@ typedef ADDRESS_FAMILY sa_family_t;
 #define MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR (9)
 #define MMDB_INVALID_NODE_NUMBER_ERROR (10)
 #define MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR (11)
+#define MMDB_BUFFER_TOO_SMALL_ERROR (12)
+#define MMDB_TYPE_MISMATCH_ERROR (13)
+#define MMDB_INVALID_NETWORK_ERROR (14)
+#define MMDB_IP_VERSION_MISMATCH_ERROR (15)
+#define MMDB_DATABASE_TOO_BIG_ERROR (16)
 
 #if !(MMDB_UINT128_IS_BYTE_ARRAY)
 #if MMDB_UINT128_USING_MODE
@@ -137,6 +177,40 @@ typedef struct MMDB_entry_data_list_s {
     struct MMDB_entry_data_list_s *next;
 } MMDB_entry_data_list_s;
 
+/* This is one element of the flat representation of a map or array. The
+ * elements are stored in the same depth-first order as the linked list. */
+typedef struct MMDB_entry_data_node_s {
+    MMDB_entry_data_s entry_data;
+    /* This is the number of direct children of a map or array. For a map this
+     * counts both the keys and the values. It is 0 for all other types. */
+    uint32_t child_count;
+    /* This is the index of the first element that is not part of this
+     * element's subtree, so a caller can skip a whole map or array at
+     * once. */
+    uint32_t subtree_end;
+} MMDB_entry_data_node_s;
+
+/* This is the return type when someone asks for all the entry data in a map
+ * or array as one contiguous array */
+typedef struct MMDB_entry_data_array_s {
+    MMDB_entry_data_node_s *nodes;
+    uint32_t count;
+    uint32_t capacity;
+} MMDB_entry_data_array_s;
+
+/* These are the callbacks for MMDB_walk_entry(). Any of them may be NULL.
+ * Each one returns an MMDB_VISIT_* constant. Returning MMDB_VISIT_SKIP from
+ * begin_map or begin_array skips the contents and the matching end callback,
+ * and returning it from key skips that key's value. */
+typedef struct MMDB_visitor_s {
+    int (*begin_map)(void *ctx, uint32_t size);
+    int (*end_map)(void *ctx);
+    int (*begin_array)(void *ctx, uint32_t size);
+    int (*end_array)(void *ctx);
+    int (*key)(void *ctx, const char *key, uint32_t key_size);
+    int (*scalar)(void *ctx, const MMDB_entry_data_s *entry_data);
+} MMDB_visitor_s;
+
 typedef struct MMDB_description_s {
     const char *language;
     const char *description;
@@ -189,6 +263,185 @@ typedef struct MMDB_search_node_s {
     MMDB_entry_s right_record_entry;
 } MMDB_search_node_s;
 
+/* This is a set of open databases to look up an address in all at once.
+ * mmdbs points to count handles, which the caller opens and closes. */
+typedef struct MMDB_set_s {
+    MMDB_s **mmdbs;
+    size_t count;
+} MMDB_set_s;
+
+/* This is one network in the search tree, as returned by
+ * MMDB_network_iterator_next() */
+typedef struct MMDB_network_s {
+    uint8_t address[16];
+    uint16_t prefix_length;
+    uint8_t record_type;
+    MMDB_entry_s entry;
+} MMDB_network_s;
+
+/* This is a record in the search tree that MMDB_network_iterator_next() still
+ * has to visit */
+typedef struct MMDB_network_iterator_node_s {
+    uint32_t record;
+    uint16_t prefix_length;
+} MMDB_network_iterator_node_s;
+
+/* This holds the state of a walk over every network in the search tree. The
+ * tree is at most 128 levels deep and we only ever keep the right record of
+ * each node on the way down, so the stack can never hold more than 128
+ * records. */
+typedef struct MMDB_network_iterator_s {
+    MMDB_s *mmdb;
+    uint32_t flags;
+    uint8_t address[16];
+    uint16_t prefix_length;
+    uint32_t stack_size;
+    MMDB_network_iterator_node_s stack[128];
+} MMDB_network_iterator_s;
+
+/* This holds the state of a join of addresses in ascending order against
+ * the networks in a database. network is the network that the last address
+ * given to MMDB_join_sockaddr() is in. */
+typedef struct MMDB_join_s {
+    MMDB_network_iterator_s iterator;
+    MMDB_network_s network;
+    bool has_network;
+} MMDB_join_s;
+
+/* This is one network whose data is different in two databases, as passed to
+ * the callback for MMDB_diff(). old_entry is only set for a network that was
+ * removed or changed and new_entry for one that was added or changed. */
+typedef struct MMDB_diff_s {
+    int change;
+    uint8_t address[16];
+    uint16_t prefix_length;
+    MMDB_entry_s old_entry;
+    MMDB_entry_s new_entry;
+} MMDB_diff_s;
+
+/* This holds the values at a set of lookup paths for every distinct data
+ * record in a database. value_offsets[i][row] is the data section offset of
+ * the value at the i-th path for the record at offsets[row], or UINT32_MAX if
+ * the record has nothing at that path. MMDB_get_projection_value() decodes
+ * it. */
+typedef struct MMDB_projection_s {
+    MMDB_s *mmdb;
+    uint32_t path_count;
+    uint32_t record_count;
+    /* The data section offsets of the records, in ascending order */
+    uint32_t *offsets;
+    uint32_t **value_offsets;
+    /* This maps a record's offset to its row. It has row + 1 in each used
+     * slot and 0 in empty ones. */
+    uint32_t *rows_by_offset;
+    uint32_t rows_by_offset_mask;
+    /* The number of bytes allocated for the projection */
+    size_t memory_size;
+} MMDB_projection_s;
+
+/* This holds the value at one lookup path for every distinct data record in
+ * a database as a dense array of the C type for an MMDB_DATA_TYPE_* type.
+ * Rows are the same as in an MMDB_projection_s. */
+typedef struct MMDB_column_s {
+    MMDB_s *mmdb;
+    /* This is an MMDB_DATA_TYPE_* constant */
+    uint32_t type;
+    uint32_t record_count;
+    /* The data section offsets of the records, in ascending order */
+    uint32_t *offsets;
+    /* This is false for records that have nothing at the path or that have
+     * a value of another type there */
+    bool *has_data;
+    /* Only the member for the column's type is set */
+    union {
+        const char **utf8_string;
+        const uint8_t **bytes;
+        uint16_t *uint16;
+        uint32_t *uint32;
+        int32_t *int32;
+        uint64_t *uint64;
+        double *double_value;
+        float *float_value;
+        bool *boolean;
+        void *any;
+    } values;
+    /* The sizes of strings and bytes, or NULL for other types */
+    uint32_t *sizes;
+    uint32_t *rows_by_offset;
+    uint32_t rows_by_offset_mask;
+    /* The number of bytes allocated for the column */
+    size_t memory_size;
+} MMDB_column_s;
+
+/* These are counts of how the search tree and data section of a database
+ * are laid out, as filled in by MMDB_get_stats(). A depth is the number of
+ * nodes above a node or record, so a network's depth is its prefix length
+ * in the tree and the number of nodes that a lookup in it reads. */
+typedef struct MMDB_stats_s {
+    /* The number of nodes that lookups can reach, and how many of them are
+     * at each depth. A node that can be reached at more than one depth is
+     * counted at the shallowest. */
+    uint32_t node_count;
+    uint32_t nodes_by_depth[MMDB_STATS_MAX_DEPTH + 1];
+    /* The number of networks with data, and with no data, at each depth.
+     * The IPv4 aliases in an IPv6 database are left out. */
+    uint64_t data_networks_by_depth[MMDB_STATS_MAX_DEPTH + 1];
+    uint64_t empty_networks_by_depth[MMDB_STATS_MAX_DEPTH + 1];
+    /* The number of distinct data records. record_sizes[i] is the number of
+     * them whose expanded size is at least 2^i bytes and less than 2^(i + 1),
+     * except that the last bucket has every bigger record too. */
+    uint32_t record_count;
+    uint32_t record_sizes[MMDB_STATS_SIZE_BUCKETS];
+    /* The size of the data section without the metadata, the number of
+     * bytes in it that the records use, and the size the records would be
+     * if every pointer were replaced by the value it points to */
+    uint32_t data_size;
+    uint64_t used_data_size;
+    uint64_t expanded_data_size;
+    /* The number of distinct values that pointers point to. The pointers
+     * themselves are counted in type_counts[MMDB_DATA_TYPE_POINTER]. */
+    uint32_t pointer_target_count;
+    /* The number of values of each MMDB_DATA_TYPE_* type in the used part of
+     * the data section, and the bytes they take. For maps and arrays, this
+     * is only the bytes before their first element. Map keys are counted
+     * as strings. */
+    uint64_t type_counts[MMDB_STATS_DATA_TYPES];
+    uint64_t type_bytes[MMDB_STATS_DATA_TYPES];
+} MMDB_stats_s;
+
+/* This is a database that is being built in memory. Records are added with
+ * MMDB_writer_add_record(), networks with MMDB_writer_insert(), and the
+ * whole database is written out with MMDB_writer_write(). */
+typedef struct MMDB_writer_s {
+    /* The caller sets database_type, languages, description and build_epoch.
+     * The writer doesn't copy or free any of the strings. */
+    MMDB_metadata_s metadata;
+    /* The search tree. Node n has its left record in nodes[2 * n] and its
+     * right record in nodes[2 * n + 1], and node 0 is the root. A record is
+     * 0 when it is empty, has MMDB_WRITER_DATA_RECORD set when it has data,
+     * and is otherwise the number of the node it points to. After
+     * MMDB_writer_alias(), two records can point to the same node. */
+    uint32_t *nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    /* The data section, without the metadata */
+    uint8_t *data;
+    uint32_t data_size;
+    uint32_t data_capacity;
+    /* This is an open addressing hash table of the values in the data
+     * section that can be pointed to rather than written again. Each slot
+     * has a value's hash, its offset plus one, so that zero marks an empty
+     * slot, and its size. */
+    uint64_t *value_hashes;
+    uint32_t *value_offsets;
+    uint32_t *value_sizes;
+    uint32_t value_mask;
+    uint32_t value_count;
+    /* The weight of each node from MMDB_writer_add_weight(), or NULL if no
+     * weights were added */
+    uint64_t *node_weights;
+} MMDB_writer_s;
+
     /* *INDENT-OFF* */
     /* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
     extern int MMDB_open(const char *const filename, uint32_t flags, MMDB_s *const mmdb);
@@ -200,8 +453,59 @@ typedef struct MMDB_search_node_s {
                MMDB_s *const mmdb,
                const struct sockaddr *const sockaddr,
                int *const mmdb_error);
+    extern void MMDB_set_lookup_string(const MMDB_set_s *const set,
+                                       const char *const ipstr,
+                                       int *const gai_error,
+                                       MMDB_lookup_result_s *const results,
+                                       int *const mmdb_errors);
+    extern void MMDB_set_lookup_sockaddr(const MMDB_set_s *const set,
+                                         const struct sockaddr *const sockaddr,
+                                         MMDB_lookup_result_s *const results,
+                                         int *const mmdb_errors);
     extern int MMDB_read_node(MMDB_s *const mmdb, uint32_t node_number,
                               MMDB_search_node_s *const node);
+    extern int MMDB_network_iterator_init(
+        MMDB_s *const mmdb, uint32_t flags,
+        MMDB_network_iterator_s *const iterator);
+    extern int MMDB_network_iterator_init_subtree(
+        MMDB_s *const mmdb, uint32_t flags, const uint8_t *const address,
+        uint16_t prefix_length, MMDB_network_iterator_s *const iterator);
+    extern int MMDB_network_iterator_next(
+        MMDB_network_iterator_s *const iterator,
+        MMDB_network_s *const network, bool *const found_network);
+    extern int MMDB_lookup_range(
+        MMDB_s *const mmdb, const struct sockaddr *const sockaddr,
+        uint16_t prefix_length, uint32_t flags,
+        int (*callback)(void *ctx, const MMDB_network_s *network),
+        void *ctx);
+    extern int MMDB_join_init(MMDB_s *const mmdb, MMDB_join_s *const join);
+    extern MMDB_lookup_result_s MMDB_join_sockaddr(
+        MMDB_join_s *const join, const struct sockaddr *const sockaddr,
+        int *const mmdb_error);
+    extern int MMDB_diff(MMDB_s *const old_mmdb, MMDB_s *const new_mmdb,
+                         uint32_t flags,
+                         int (*callback)(void *ctx, const MMDB_diff_s *diff),
+                         void *ctx);
+    extern int MMDB_verify(MMDB_s *const mmdb);
+    extern int MMDB_get_stats(MMDB_s *const mmdb, MMDB_stats_s *const stats);
+    extern int MMDB_build_projection(MMDB_s *const mmdb,
+                                     const char *const *const *const paths,
+                                     uint32_t path_count,
+                                     MMDB_projection_s *const projection);
+    extern int MMDB_get_projection_row(
+        const MMDB_projection_s *const projection,
+        const MMDB_entry_s *const entry, uint32_t *const row);
+    extern int MMDB_get_projection_value(
+        const MMDB_projection_s *const projection, uint32_t row,
+        uint32_t path_index, MMDB_entry_data_s *const entry_data);
+    extern void MMDB_free_projection(MMDB_projection_s *const projection);
+    extern int MMDB_export_column(MMDB_s *const mmdb,
+                                  const char *const *const path,
+                                  uint32_t type, MMDB_column_s *const column);
+    extern int MMDB_get_column_row(const MMDB_column_s *const column,
+                                   const MMDB_entry_s *const entry,
+                                   uint32_t *const row);
+    extern void MMDB_free_column(MMDB_column_s *const column);
     extern int MMDB_get_value(MMDB_entry_s *const start,
                               MMDB_entry_data_s *const entry_data,
                               ...);
@@ -211,17 +515,85 @@ typedef struct MMDB_search_node_s {
     extern int MMDB_aget_value(MMDB_entry_s *const start,
                                MMDB_entry_data_s *const entry_data,
                                const char *const *const path);
+    extern int MMDB_get_utf8(MMDB_entry_s *const start,
+                             const char *const *const path,
+                             const char **value, uint32_t *size);
+    extern int MMDB_get_bytes(MMDB_entry_s *const start,
+                              const char *const *const path,
+                              const uint8_t **value, uint32_t *size);
+    extern int MMDB_get_uint16(MMDB_entry_s *const start,
+                               const char *const *const path,
+                               uint16_t *value);
+    extern int MMDB_get_uint32(MMDB_entry_s *const start,
+                               const char *const *const path,
+                               uint32_t *value);
+    extern int MMDB_get_int32(MMDB_entry_s *const start,
+                              const char *const *const path,
+                              int32_t *value);
+    extern int MMDB_get_uint64(MMDB_entry_s *const start,
+                               const char *const *const path,
+                               uint64_t *value);
+    extern int MMDB_get_double(MMDB_entry_s *const start,
+                               const char *const *const path,
+                               double *value);
+    extern int MMDB_get_float(MMDB_entry_s *const start,
+                              const char *const *const path,
+                              float *value);
+    extern int MMDB_get_boolean(MMDB_entry_s *const start,
+                                const char *const *const path,
+                                bool *value);
+    extern int MMDB_get_localized_name(MMDB_entry_s *const start,
+                                       const char *const *const path,
+                                       const char *const *const languages,
+                                       size_t language_count,
+                                       MMDB_entry_data_s *const entry_data);
     extern int MMDB_get_metadata_as_entry_data_list(
                MMDB_s *const mmdb, MMDB_entry_data_list_s **const entry_data_list);
     extern int MMDB_get_entry_data_list(
                MMDB_entry_s *start, MMDB_entry_data_list_s **const entry_data_list);
+    extern int MMDB_get_entry_data_array(
+               MMDB_entry_s *start, MMDB_entry_data_array_s **const entry_data_array);
+    extern int MMDB_walk_entry(MMDB_entry_s *const start,
+                               const MMDB_visitor_s *const visitor, void *ctx);
     extern void MMDB_free_entry_data_list(MMDB_entry_data_list_s *const entry_data_list);
+    extern void MMDB_free_entry_data_array(
+               MMDB_entry_data_array_s *const entry_data_array);
     extern void MMDB_close(MMDB_s *const mmdb);
     extern const char *MMDB_lib_version(void);
     extern int MMDB_dump_entry_data_list(FILE *const stream,
                                          MMDB_entry_data_list_s *const entry_data_list,
                                          int indent);
+    extern int MMDB_dump_entry_data_array(
+               FILE *const stream, MMDB_entry_data_array_s *const entry_data_array,
+               int indent);
+    extern int MMDB_dump_entry_data_array_as_json(
+               FILE *const stream, MMDB_entry_data_array_s *const entry_data_array);
+    extern int MMDB_entry_to_json(MMDB_entry_s *const entry, char *buffer,
+                                  size_t capacity, size_t *needed);
+    extern int MMDB_entry_to_msgpack(MMDB_entry_s *const entry, uint8_t *buffer,
+                                     size_t capacity, size_t *needed);
+    extern int MMDB_entry_to_cbor(MMDB_entry_s *const entry, uint8_t *buffer,
+                                  size_t capacity, size_t *needed);
     extern const char *MMDB_strerror(int error_code);
+    extern int MMDB_writer_init(MMDB_writer_s *const writer, uint16_t ip_version,
+                                uint16_t record_size);
+    extern int MMDB_writer_add_record(MMDB_writer_s *const writer,
+                                      const MMDB_entry_data_s *const values,
+                                      uint32_t value_count, uint32_t *const record);
+    extern int MMDB_writer_insert(MMDB_writer_s *const writer,
+                                  const uint8_t *const address, uint16_t prefix_length,
+                                  uint32_t record);
+    extern int MMDB_writer_alias(MMDB_writer_s *const writer,
+                                 const uint8_t *const address, uint16_t prefix_length,
+                                 const uint8_t *const target,
+                                 uint16_t target_prefix_length);
+    extern int MMDB_writer_add_weight(MMDB_writer_s *const writer,
+                                      const uint8_t *const address,
+                                      uint64_t weight);
+    extern int MMDB_writer_compact(MMDB_writer_s *const writer,
+                                   uint32_t flags);
+    extern int MMDB_writer_write(MMDB_writer_s *const writer, FILE *const stream);
+    extern void MMDB_writer_free(MMDB_writer_s *const writer);
     /* --prototypes end - don't remove this comment-- */
     /* *INDENT-ON* */
 
@@ -0,0 +1,81 @@
+#ifndef MAXMINDDB_INTERNAL_H
+#define MAXMINDDB_INTERNAL_H
+
+/* This is what the library's source files share with each other. It isn't
+ * installed, and nothing in it is part of the API. */
+
+#include "maxminddb.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MMDB_DATA_SECTION_SEPARATOR (16)
+#define MAXIMUM_DATA_STRUCTURE_DEPTH (512)
+/* This is the biggest size that a control byte and three size bytes can
+ * hold */
+#define MAXIMUM_DATA_SIZE (65821 + 0xffffff)
+
+#define METADATA_MARKER "\xab\xcd\xefMaxMind.com"
+
+/* When the size doesn't fit in the control byte, the bytes that follow it
+ * are added to one of these, indexed by the number of size bytes. */
+static const uint32_t size_bases[4] = { 0, 29, 285, 65821 };
+
+#ifdef MMDB_DEBUG
+#define LOCAL
+#define NO_PROTO
+#define DEBUG_FUNC
+#define DEBUG_MSG(msg) fprintf(stderr, msg "\n")
+#define DEBUG_MSGF(fmt, ...) fprintf(stderr, fmt "\n", __VA_ARGS__)
+#define DEBUG_BINARY(fmt, byte)                                 \
+    do {                                                        \
+        char *binary = byte_to_binary(byte);                    \
+        if (NULL == binary) {                                   \
+            fprintf(stderr, "Malloc failed in DEBUG_BINARY\n"); \
+            abort();                                            \
+        }                                                       \
+        fprintf(stderr, fmt "\n", binary);                      \
+        free(binary);                                           \
+    } while (0)
+#define DEBUG_NL fprintf(stderr, "\n")
+#else
+#define LOCAL static
+#define NO_PROTO static
+#define DEBUG_MSG(...)
+#define DEBUG_MSGF(...)
+#define DEBUG_BINARY(...)
+#define DEBUG_NL
+#endif
+
+/* Functions that one source file defines for another are INTERNAL rather
+ * than LOCAL. Where the compiler supports it, they are hidden so that they
+ * aren't exported from the shared library, and they have an mmdb_ prefix in
+ * case they are visible anyway, as they are in a static build.
+ * dev-bin/regen-prototypes.pl leaves them out of maxminddb.h. */
+#if defined(__GNUC__) && !defined(_WIN32)
+#define INTERNAL __attribute__((visibility("hidden")))
+#else
+#define INTERNAL
+#endif
+
+/* None of the values we check on the lhs are bigger than uint32_t, so on
+ * platforms where SIZE_MAX is a 64-bit integer, this would be a no-op, and it
+ * makes the compiler complain if we do the check anyway. */
+#if SIZE_MAX == UINT32_MAX
+#define MAYBE_CHECK_SIZE_OVERFLOW(lhs, rhs, error) \
+    if ((lhs) > (rhs)) {                           \
+        return error;                              \
+    }
+#else
+#define MAYBE_CHECK_SIZE_OVERFLOW(...)
+#endif
+
+INTERNAL uint64_t mmdb_hash_mix(uint64_t hash, uint64_t value);
+INTERNAL int mmdb_hash_scalar(void *ctx,
+                              const MMDB_entry_data_s *entry_data);
+INTERNAL int mmdb_decode_one(MMDB_s *mmdb, uint32_t offset,
+                             MMDB_entry_data_s *entry_data);
+INTERNAL int mmdb_uint128_to_bytes(const MMDB_entry_data_s *entry_data,
+                                   uint8_t *bytes);
+
+#endif /* MAXMINDDB_INTERNAL_H */
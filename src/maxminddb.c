@@ -3,6 +3,7 @@
 #endif
 #include "maxminddb.h"
 #include "maxminddb-compat-util.h"
+#include "maxminddb-internal.h"
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -11,6 +12,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifdef _WIN32
 #include <windows.h>
@@ -21,35 +27,6 @@
 #include <unistd.h>
 #endif
 
-#define MMDB_DATA_SECTION_SEPARATOR (16)
-#define MAXIMUM_DATA_STRUCTURE_DEPTH (512)
-
-#ifdef MMDB_DEBUG
-#define LOCAL
-#define NO_PROTO
-#define DEBUG_FUNC
-#define DEBUG_MSG(msg) fprintf(stderr, msg "\n")
-#define DEBUG_MSGF(fmt, ...) fprintf(stderr, fmt "\n", __VA_ARGS__)
-#define DEBUG_BINARY(fmt, byte)                                 \
-    do {                                                        \
-        char *binary = byte_to_binary(byte);                    \
-        if (NULL == binary) {                                   \
-            fprintf(stderr, "Malloc failed in DEBUG_BINARY\n"); \
-            abort();                                            \
-        }                                                       \
-        fprintf(stderr, fmt "\n", binary);                      \
-        free(binary);                                           \
-    } while (0)
-#define DEBUG_NL fprintf(stderr, "\n")
-#else
-#define LOCAL static
-#define NO_PROTO static
-#define DEBUG_MSG(...)
-#define DEBUG_MSGF(...)
-#define DEBUG_BINARY(...)
-#define DEBUG_NL
-#endif
-
 #ifdef MMDB_DEBUG
 DEBUG_FUNC char *byte_to_binary(uint8_t byte)
 {
@@ -107,18 +84,6 @@ DEBUG_FUNC char *type_num_to_name(uint8_t num)
 }
 #endif
 
-/* None of the values we check on the lhs are bigger than uint32_t, so on
- * platforms where SIZE_MAX is a 64-bit integer, this would be a no-op, and it
- * makes the compiler complain if we do the check anyway. */
-#if SIZE_MAX == UINT32_MAX
-#define MAYBE_CHECK_SIZE_OVERFLOW(lhs, rhs, error) \
-    if ((lhs) > (rhs)) {                           \
-        return error;                              \
-    }
-#else
-#define MAYBE_CHECK_SIZE_OVERFLOW(...)
-#endif
-
 typedef struct record_info_s {
     uint16_t record_length;
     uint32_t (*left_record_getter)(const uint8_t *);
@@ -126,7 +91,131 @@ typedef struct record_info_s {
     uint8_t right_record_offset;
 } record_info_s;
 
-#define METADATA_MARKER "\xab\xcd\xefMaxMind.com"
+/* This is the state of one search tree walk in MMDB_set_lookup_sockaddr(),
+ * which takes one step in each tree in turn. */
+typedef struct tree_walk_s {
+    MMDB_s *mmdb;
+    record_info_s record_info;
+    const uint8_t *address;
+    uint32_t value;
+    int current_bit;
+    MMDB_lookup_result_s *result;
+    int *mmdb_error;
+} tree_walk_s;
+
+/* This is the set of data offsets that MMDB_lookup_range() has already
+ * reported when it is asked for each record only once. It is an open
+ * addressing hash table that is kept at most half full. Each slot holds an
+ * offset plus one, so that zero marks an empty slot. */
+typedef struct offset_set_s {
+    uint32_t *slots;
+    uint32_t mask;
+    uint32_t count;
+} offset_set_s;
+
+/* This is one of the databases in MMDB_diff(). node_hashes holds the hash of
+ * the subtree under each search tree node once it has been worked out, or
+ * zero before then. data_hashes caches the hash of each data record, keyed
+ * on its offset plus one in data_offsets, since many networks usually share
+ * a record. */
+typedef struct diff_side_s {
+    MMDB_s *mmdb;
+    record_info_s record_info;
+    uint64_t *node_hashes;
+    uint32_t *data_offsets;
+    uint64_t *data_hashes;
+    uint32_t data_mask;
+    uint32_t data_count;
+} diff_side_s;
+
+typedef struct diff_state_s {
+    diff_side_s sides[2];
+    uint32_t flags;
+    int (*callback)(void *ctx, const MMDB_diff_s *diff);
+    void *ctx;
+    uint8_t address[16];
+    bool stopped;
+} diff_state_s;
+
+/* This is the state of the data section walk in MMDB_get_stats(). counted
+ * has a bit for each offset whose value has been counted, so that a value
+ * that is both inside a record and pointed to is only counted once. The
+ * expanded size of each value that a pointer points to is cached, keyed on
+ * its offset plus one in target_offsets, since many pointers usually point
+ * to the same value. */
+typedef struct stats_walk_s {
+    MMDB_s *mmdb;
+    MMDB_stats_s *stats;
+    uint8_t *counted;
+    uint32_t *target_offsets;
+    uint64_t *target_sizes;
+    uint32_t target_mask;
+} stats_walk_s;
+
+/* Every hash of a data record or a subtree has its lowest bit set. The hash
+ * of an empty record doesn't, so it can't match one with data, and no hash
+ * is zero, which node_hashes uses for a hash it doesn't have yet. */
+#define EMPTY_RECORD_HASH (2)
+
+/* MMDB_set_lookup_sockaddr() walks this many trees at once */
+#define SET_BATCH_SIZE (8)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address)
+#endif
+
+/* This is the state for MMDB_entry_to_json() and the binary transcoders.
+ * Output that doesn't fit in the buffer is still counted in size so that we
+ * can tell the caller how big the buffer needs to be. */
+typedef struct output_writer_s {
+    char *buffer;
+    size_t limit;
+    size_t size;
+    bool need_comma;
+    int status;
+} output_writer_s;
+
+/* This is everything that a control byte tells us on its own. mmdb_decode_one()
+ * looks the control byte up in control_bytes[] rather than taking it apart
+ * with shifts and masks each time. */
+typedef struct control_byte_s {
+    /* This is the type from the top three bits. It is
+     * MMDB_DATA_TYPE_EXTENDED when the real type is in the next byte. */
+    uint8_t type;
+    /* This is the size from the low five bits when it is less than 29. It is
+     * 0 when the size is in the bytes that follow. */
+    uint8_t inline_size;
+    /* This is the number of bytes after the control byte (and the extended
+     * type byte) that hold the size. It is 0, 1, 2 or 3. */
+    uint8_t size_bytes;
+    /* For pointers, this is the number of bytes that hold the pointer */
+    uint8_t pointer_size;
+} control_byte_s;
+
+#define CONTROL_BYTE(c)                                                 \
+    {                                                                   \
+        (c) >> 5,                                                       \
+        ((c) & 31) < 29 ? (c) & 31 : 0,                                 \
+        ((c) & 31) < 29 ? 0 : ((c) & 31) - 28,                          \
+        1 == (c) >> 5 ? (((c) >> 3) & 3) + 1 : 0                        \
+    }
+#define CONTROL_BYTES_4(c)                                              \
+    CONTROL_BYTE(c), CONTROL_BYTE((c) + 1), CONTROL_BYTE((c) + 2),      \
+    CONTROL_BYTE((c) + 3)
+#define CONTROL_BYTES_16(c)                                             \
+    CONTROL_BYTES_4(c), CONTROL_BYTES_4((c) + 4),                       \
+    CONTROL_BYTES_4((c) + 8), CONTROL_BYTES_4((c) + 12)
+#define CONTROL_BYTES_64(c)                                             \
+    CONTROL_BYTES_16(c), CONTROL_BYTES_16((c) + 16),                    \
+    CONTROL_BYTES_16((c) + 32), CONTROL_BYTES_16((c) + 48)
+
+static const control_byte_s control_bytes[256] = {
+    CONTROL_BYTES_64(0), CONTROL_BYTES_64(64),
+    CONTROL_BYTES_64(128), CONTROL_BYTES_64(192)
+};
+
 /* This is 128kb */
 #define METADATA_BLOCK_MAX_SIZE 131072
 
@@ -150,9 +239,25 @@ LOCAL int populate_languages_metadata(MMDB_s *mmdb, MMDB_s *metadata_db,
 LOCAL int populate_description_metadata(MMDB_s *mmdb, MMDB_s *metadata_db,
                                         MMDB_entry_s *metadata_start);
 LOCAL int resolve_any_address(const char *ipstr, struct addrinfo **addresses);
+LOCAL int address_for_database(MMDB_s *mmdb, const struct sockaddr *sockaddr,
+                               uint8_t *mapped_address, uint8_t **address);
 LOCAL int find_address_in_search_tree(MMDB_s *mmdb, uint8_t *address,
                                       sa_family_t address_family,
                                       MMDB_lookup_result_s *result);
+LOCAL int find_start_node(MMDB_s *mmdb, sa_family_t address_family,
+                          MMDB_lookup_result_s *result, uint32_t *value,
+                          int *start_bit, bool *done);
+LOCAL int find_address_in_verified_tree(MMDB_s *mmdb, uint8_t *address,
+                                        record_info_s record_info,
+                                        uint32_t value, int start_bit,
+                                        MMDB_lookup_result_s *result);
+LOCAL void lookup_batch(MMDB_s *const *mmdbs, size_t count,
+                        const struct sockaddr *sockaddr,
+                        MMDB_lookup_result_s *results, int *mmdb_errors);
+LOCAL int start_tree_walk(tree_walk_s *walk, MMDB_s *mmdb,
+                          const struct sockaddr *sockaddr,
+                          uint8_t *mapped_address, bool *done);
+LOCAL int tree_walk_step(tree_walk_s *walk, bool *done);
 LOCAL record_info_s record_info_for_database(MMDB_s *mmdb);
 LOCAL int find_ipv4_start_node(MMDB_s *mmdb);
 LOCAL uint8_t maybe_populate_result(MMDB_s *mmdb, uint32_t record,
@@ -161,29 +266,115 @@ LOCAL uint8_t maybe_populate_result(MMDB_s *mmdb, uint32_t record,
 LOCAL uint8_t record_type(MMDB_s *const mmdb, uint64_t record);
 LOCAL uint32_t get_left_28_bit_record(const uint8_t *record);
 LOCAL uint32_t get_right_28_bit_record(const uint8_t *record);
+LOCAL int start_network_iterator(MMDB_s *mmdb, uint32_t flags,
+                                 const uint8_t *address,
+                                 uint16_t prefix_length, bool covering,
+                                 MMDB_network_iterator_s *iterator);
+LOCAL int add_offset(offset_set_s *set, uint32_t offset, bool *added);
+LOCAL int seek_join(MMDB_join_s *join, const uint8_t *address);
+LOCAL int descend_join(MMDB_join_s *join, const uint8_t *address,
+                       uint32_t record, uint16_t depth);
+LOCAL bool network_contains(const uint8_t *network, uint16_t prefix_length,
+                            const uint8_t *address);
+LOCAL int start_diff_side(diff_side_s *side, MMDB_s *mmdb);
+LOCAL int diff_records(diff_state_s *diff, const uint64_t *records,
+                       const uint8_t *types, uint16_t depth);
+LOCAL int report_difference(diff_state_s *diff, const uint64_t *records,
+                            const uint8_t *types, uint16_t depth);
+LOCAL bool is_diff_alias(diff_state_s *diff, const uint64_t *records,
+                         const uint8_t *types, uint16_t depth);
+LOCAL int read_node_records(diff_side_s *side, uint32_t node, uint64_t *left,
+                            uint64_t *right);
+LOCAL int subtree_hash(diff_side_s *side, uint64_t record, uint8_t type,
+                       uint16_t depth, uint64_t *hash);
+LOCAL int data_record_hash(diff_side_s *side, uint32_t offset,
+                           uint64_t *hash);
+LOCAL int grow_data_hashes(diff_side_s *side);
+LOCAL uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t size);
+LOCAL int hash_begin_container(void *ctx, uint32_t size);
+LOCAL int hash_end_container(void *ctx);
+LOCAL int hash_key(void *ctx, const char *key, uint32_t key_size);
+LOCAL bool is_ipv4_alias(MMDB_network_iterator_s *iterator, uint32_t record);
+LOCAL void set_network_address_bits(uint8_t *address, uint16_t prefix_length,
+                                    uint16_t depth);
 LOCAL uint32_t data_section_offset_for_record(MMDB_s *const mmdb,
                                               uint64_t record);
+LOCAL int verify_record(MMDB_s *mmdb, uint64_t record, uint8_t *verified);
+LOCAL int verify_data(MMDB_s *mmdb, uint32_t offset, uint8_t *verified,
+                      int depth, uint32_t *offset_to_next);
+LOCAL bool mark_verified(uint8_t *verified, uint32_t offset);
+LOCAL int count_tree_stats(MMDB_s *mmdb, MMDB_stats_s *stats);
+LOCAL int count_data_stats(MMDB_s *mmdb, MMDB_stats_s *stats);
+LOCAL int count_value_stats(stats_walk_s *walk, uint32_t offset, int depth,
+                            bool count, uint32_t *offset_to_next,
+                            uint64_t *expanded_size);
+LOCAL int pointer_target_size(stats_walk_s *walk, uint32_t offset, int depth,
+                              uint64_t *expanded_size);
+LOCAL int grow_target_sizes(stats_walk_s *walk);
+LOCAL int index_data_records(MMDB_s *mmdb, uint32_t *record_count,
+                             uint32_t **offsets, uint32_t **rows_by_offset,
+                             uint32_t *rows_by_offset_mask);
+LOCAL int find_data_records(MMDB_s *mmdb, uint8_t *is_record,
+                            uint32_t *record_count);
+LOCAL int mark_data_record(MMDB_s *mmdb, uint64_t record, uint8_t *is_record,
+                           uint32_t *record_count);
+LOCAL void add_row(uint32_t *rows_by_offset, uint32_t mask, uint32_t offset,
+                   uint32_t row);
+LOCAL int find_row(const uint32_t *offsets, const uint32_t *rows_by_offset,
+                   uint32_t mask, uint32_t offset, uint32_t *row);
+LOCAL uint32_t row_slot(uint32_t offset, uint32_t mask);
+LOCAL int allocate_projection(MMDB_projection_s *projection);
+LOCAL int fill_projection(MMDB_projection_s *projection,
+                          const char *const *const *const paths);
+LOCAL int find_value_offset(MMDB_entry_s *entry,
+                            const char *const *const path,
+                            uint32_t *value_offset);
+LOCAL size_t column_value_size(uint32_t type);
+LOCAL int fill_column(MMDB_column_s *column, const char *const *const path);
 LOCAL int path_length(va_list va_path);
+LOCAL int lookup_path(const char *path_elem, MMDB_s *mmdb,
+                      MMDB_entry_data_s *entry_data, uint32_t *value_offset);
 LOCAL int lookup_path_in_array(const char *path_elem, MMDB_s *mmdb,
-                               MMDB_entry_data_s *entry_data);
+                               MMDB_entry_data_s *entry_data,
+                               uint32_t *value_offset);
 LOCAL int lookup_path_in_map(const char *path_elem, MMDB_s *mmdb,
-                             MMDB_entry_data_s *entry_data);
+                             MMDB_entry_data_s *entry_data,
+                             uint32_t *value_offset);
+LOCAL int get_scalar(MMDB_entry_s *const start,
+                     const char *const *const path, int type,
+                     const uint8_t **payload, uint32_t *size);
+LOCAL int decode_scalar(MMDB_s *mmdb, uint32_t offset, int expected_type,
+                        const uint8_t **payload, uint32_t *size);
+LOCAL int find_names_map(MMDB_entry_s *const start,
+                         const char *const *const path,
+                         MMDB_entry_data_s *names);
+LOCAL int first_known_language(MMDB_s *mmdb,
+                               const char *const *const languages,
+                               size_t language_count, size_t *first);
+LOCAL bool is_known_language(MMDB_s *mmdb, const char *language);
 LOCAL int skip_map_or_array(MMDB_s *mmdb, MMDB_entry_data_s *entry_data);
 LOCAL int decode_one_follow(MMDB_s *mmdb, uint32_t offset,
                             MMDB_entry_data_s *entry_data);
-LOCAL int decode_one(MMDB_s *mmdb, uint32_t offset,
-                     MMDB_entry_data_s *entry_data);
+LOCAL void decode_one_verified(const uint8_t *mem, uint32_t offset,
+                               MMDB_entry_data_s *entry_data);
 LOCAL int get_ext_type(int raw_ext_type);
 LOCAL uint32_t get_ptr_from(uint8_t ctrl, uint8_t const *const ptr,
                             int ptr_size);
 LOCAL int get_entry_data_list(MMDB_s *mmdb, uint32_t offset,
                               MMDB_entry_data_list_s *const entry_data_list,
                               int depth);
+LOCAL int get_entry_data_array(MMDB_s *mmdb, uint32_t offset,
+                               MMDB_entry_data_array_s *const entry_data_array,
+                               int depth);
+LOCAL int new_entry_data_node(MMDB_entry_data_array_s *const entry_data_array,
+                              uint32_t *index);
+LOCAL int walk_entry(MMDB_s *mmdb, uint32_t offset,
+                     const MMDB_visitor_s *visitor, void *ctx, int depth,
+                     uint32_t *offset_to_next);
 LOCAL float get_ieee754_float(const uint8_t *restrict p);
 LOCAL double get_ieee754_double(const uint8_t *restrict p);
 LOCAL uint32_t get_uint32(const uint8_t *p);
 LOCAL uint32_t get_uint24(const uint8_t *p);
-LOCAL uint32_t get_uint16(const uint8_t *p);
 LOCAL uint64_t get_uintX(const uint8_t *p, int length);
 LOCAL int32_t get_sintX(const uint8_t *p, int length);
 LOCAL MMDB_entry_data_list_s *new_entry_data_list(void);
@@ -193,6 +384,53 @@ LOCAL void free_descriptions_metadata(MMDB_s *mmdb);
 LOCAL MMDB_entry_data_list_s *dump_entry_data_list(
     FILE *stream, MMDB_entry_data_list_s *entry_data_list, int indent,
     int *status);
+LOCAL int dump_entry_data(FILE *stream, MMDB_entry_data_s *entry_data,
+                          int indent);
+LOCAL int dump_entry_data_array(FILE *stream,
+                                MMDB_entry_data_array_s *entry_data_array,
+                                uint32_t index, int indent);
+LOCAL int dump_entry_data_array_as_json(
+    FILE *stream, MMDB_entry_data_array_s *entry_data_array, uint32_t index);
+LOCAL void print_json_string(FILE *stream, const char *string, uint32_t size);
+LOCAL int json_escape_char(uint8_t c, char *escape);
+LOCAL const char *format_json_double(char *buffer, double value,
+                                     bool is_float);
+LOCAL bool format_short_double(char *buffer, double value);
+LOCAL int json_begin_map(void *ctx, uint32_t size);
+LOCAL int json_end_map(void *ctx);
+LOCAL int json_begin_array(void *ctx, uint32_t size);
+LOCAL int json_end_array(void *ctx);
+LOCAL int json_key(void *ctx, const char *key, uint32_t key_size);
+LOCAL int json_scalar(void *ctx, const MMDB_entry_data_s *entry_data);
+LOCAL void output_write(output_writer_s *writer, const char *data,
+                        size_t size);
+LOCAL void output_write_char(output_writer_s *writer, char c);
+LOCAL void json_write_separator(output_writer_s *writer);
+LOCAL void json_write_string(output_writer_s *writer, const char *string,
+                             uint32_t size);
+LOCAL uint32_t json_string_safe_prefix(const uint8_t *string, uint32_t size);
+LOCAL void json_write_uint64(output_writer_s *writer, uint64_t value);
+LOCAL void json_write_hex(output_writer_s *writer, const uint8_t *bytes,
+                          uint32_t size);
+LOCAL int entry_to_binary(MMDB_entry_s *const entry,
+                          const MMDB_visitor_s *visitor, uint8_t *buffer,
+                          size_t capacity, size_t *needed);
+LOCAL int msgpack_begin_map(void *ctx, uint32_t size);
+LOCAL int msgpack_begin_array(void *ctx, uint32_t size);
+LOCAL int msgpack_key(void *ctx, const char *key, uint32_t key_size);
+LOCAL int msgpack_scalar(void *ctx, const MMDB_entry_data_s *entry_data);
+LOCAL void msgpack_write_uint64(output_writer_s *writer, uint64_t value);
+LOCAL void msgpack_write_sized(output_writer_s *writer, uint32_t size,
+                               uint8_t fix_type, uint8_t fix_limit,
+                               uint8_t type8, uint8_t type16, uint8_t type32);
+LOCAL int cbor_begin_map(void *ctx, uint32_t size);
+LOCAL int cbor_begin_array(void *ctx, uint32_t size);
+LOCAL int cbor_key(void *ctx, const char *key, uint32_t key_size);
+LOCAL int cbor_scalar(void *ctx, const MMDB_entry_data_s *entry_data);
+LOCAL void cbor_write_head(output_writer_s *writer, uint8_t major_type,
+                           uint64_t value);
+LOCAL void output_write_big_endian(output_writer_s *writer, uint64_t value,
+                                   int bytes);
 LOCAL void print_indentation(FILE *stream, int i);
 LOCAL char *bytes_to_hex(uint8_t *bytes, uint32_t size);
 /* --prototypes end - don't remove this comment-- */
@@ -200,7 +438,7 @@ LOCAL char *bytes_to_hex(uint8_t *bytes, uint32_t size);
 
 #define CHECKED_DECODE_ONE(mmdb, offset, entry_data)                        \
     do {                                                                    \
-        int status = decode_one(mmdb, offset, entry_data);                  \
+        int status = mmdb_decode_one(mmdb, offset, entry_data);             \
         if (MMDB_SUCCESS != status) {                                       \
             DEBUG_MSGF("CHECKED_DECODE_ONE failed."                         \
                        " status = %d (%s)", status, MMDB_strerror(status)); \
@@ -218,6 +456,10 @@ LOCAL char *bytes_to_hex(uint8_t *bytes, uint32_t size);
         }                                                                   \
     } while (0)
 
+/* This is returned internally when a visitor callback asks MMDB_walk_entry()
+ * to stop. It is never returned to the caller. */
+#define WALK_STOPPED (-1)
+
 #define FREE_AND_SET_NULL(p) { free((void *)(p)); (p) = NULL; }
 
 int MMDB_open(const char *const filename, uint32_t flags, MMDB_s *const mmdb)
@@ -228,6 +470,7 @@ int MMDB_open(const char *const filename, uint32_t flags, MMDB_s *const mmdb)
     mmdb->data_section = NULL;
     mmdb->metadata.database_type = NULL;
     mmdb->metadata.languages.count = 0;
+    mmdb->metadata.languages.names = NULL;
     mmdb->metadata.description.count = 0;
 
     mmdb->filename = mmdb_strdup(filename);
@@ -239,7 +482,8 @@ int MMDB_open(const char *const filename, uint32_t flags, MMDB_s *const mmdb)
     if ((flags & MMDB_MODE_MASK) == 0) {
         flags |= MMDB_MODE_MMAP;
     }
-    mmdb->flags = flags;
+    /* A handle is only verified once MMDB_verify() says so */
+    mmdb->flags = flags & ~(uint32_t)MMDB_VERIFIED;
 
     if (MMDB_SUCCESS != (status = map_file(mmdb)) ) {
         goto cleanup;
@@ -846,30 +1090,45 @@ MMDB_lookup_result_s MMDB_lookup_sockaddr(
     };
 
     uint8_t mapped_address[16], *address;
+    *mmdb_error = address_for_database(mmdb, sockaddr, mapped_address,
+                                       &address);
+    if (MMDB_SUCCESS != *mmdb_error) {
+        return result;
+    }
+
+    *mmdb_error =
+        find_address_in_search_tree(mmdb, address, sockaddr->sa_family,
+                                    &result);
+
+    return result;
+}
+
+/* This finds the bytes of the address to look up in the database. An IPv4
+ * address in an IPv6 database is mapped into mapped_address, which must have
+ * room for 16 bytes. */
+LOCAL int address_for_database(MMDB_s *mmdb, const struct sockaddr *sockaddr,
+                               uint8_t *mapped_address, uint8_t **address)
+{
     if (mmdb->metadata.ip_version == 4) {
         if (sockaddr->sa_family == AF_INET6) {
-            *mmdb_error = MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR;
-            return result;
+            return MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR;
         }
-        address = (uint8_t *)&((struct sockaddr_in *)sockaddr)->sin_addr.s_addr;
+        *address =
+            (uint8_t *)&((struct sockaddr_in *)sockaddr)->sin_addr.s_addr;
     } else {
         if (sockaddr->sa_family == AF_INET6) {
-            address =
+            *address =
                 (uint8_t *)&((struct sockaddr_in6 *)sockaddr)->sin6_addr.
                 s6_addr;
         } else {
-            address = mapped_address;
-            memset(address, 0, 12);
-            memcpy(address + 12,
+            *address = mapped_address;
+            memset(mapped_address, 0, 12);
+            memcpy(mapped_address + 12,
                    &((struct sockaddr_in *)sockaddr)->sin_addr.s_addr, 4);
         }
     }
 
-    *mmdb_error =
-        find_address_in_search_tree(mmdb, address, sockaddr->sa_family,
-                                    &result);
-
-    return result;
+    return MMDB_SUCCESS;
 }
 
 LOCAL int find_address_in_search_tree(MMDB_s *mmdb, uint8_t *address,
@@ -884,9 +1143,74 @@ LOCAL int find_address_in_search_tree(MMDB_s *mmdb, uint8_t *address,
     DEBUG_NL;
     DEBUG_MSG("Looking for address in search tree");
 
-    uint32_t value = 0;
+    uint32_t value;
     uint16_t max_depth0 = mmdb->depth - 1;
-    uint16_t start_bit = max_depth0;
+    int start_bit;
+    bool done;
+    int status = find_start_node(mmdb, address_family, result, &value,
+                                 &start_bit, &done);
+    if (MMDB_SUCCESS != status || done) {
+        return status;
+    }
+
+    if (mmdb->flags & MMDB_VERIFIED) {
+        return find_address_in_verified_tree(mmdb, address, record_info,
+                                             value, start_bit, result);
+    }
+
+    const uint8_t *search_tree = mmdb->file_content;
+    const uint8_t *record_pointer;
+    for (int current_bit = start_bit; current_bit >= 0; current_bit--) {
+        uint8_t bit_is_true =
+            address[(max_depth0 - current_bit) >> 3]
+            & (1U << (~(max_depth0 - current_bit) & 7)) ? 1 : 0;
+
+        DEBUG_MSGF("Looking at bit %i - bit's value is %i", current_bit,
+                   bit_is_true);
+        DEBUG_MSGF("  current node = %u", value);
+
+        record_pointer = &search_tree[value * record_info.record_length];
+        if (record_pointer + record_info.record_length > mmdb->data_section) {
+            return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+        }
+        if (bit_is_true) {
+            record_pointer += record_info.right_record_offset;
+            value = record_info.right_record_getter(record_pointer);
+        } else {
+            value = record_info.left_record_getter(record_pointer);
+        }
+
+        uint8_t type = maybe_populate_result(mmdb, value, (uint16_t)current_bit,
+                                             result);
+        if (MMDB_RECORD_TYPE_INVALID == type) {
+            return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+        }
+
+        if (MMDB_RECORD_TYPE_SEARCH_NODE != type) {
+            return MMDB_SUCCESS;
+        }
+
+        DEBUG_MSGF("  proceeding to search tree node %i", value);
+    }
+
+    DEBUG_MSG(
+        "Reached the end of the address bits without leaving the search tree");
+
+    // We should not be able to reach this return. If we do, something very bad happened.
+    return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+}
+
+/* This finds the node and bit that a search for an address of the given
+ * family starts at. For an IPv4 address in an IPv6 database this is the IPv4
+ * start node. If that is already a data record, the result is filled in and
+ * done is set. */
+LOCAL int find_start_node(MMDB_s *mmdb, sa_family_t address_family,
+                          MMDB_lookup_result_s *result, uint32_t *value,
+                          int *start_bit, bool *done)
+{
+    *value = 0;
+    *start_bit = mmdb->depth - 1;
+    *done = false;
 
     if (mmdb->metadata.ip_version == 6 && address_family == AF_INET) {
         int mmdb_error = find_ipv4_start_node(mmdb);
@@ -907,28 +1231,37 @@ LOCAL int find_address_in_search_tree(MMDB_s *mmdb, uint8_t *address,
 
         /* We have an IPv6 database with no IPv4 data */
         if (MMDB_RECORD_TYPE_SEARCH_NODE != type) {
+            *done = true;
             return MMDB_SUCCESS;
         }
 
-        value = mmdb->ipv4_start_node.node_value;
-        start_bit -= mmdb->ipv4_start_node.netmask;
+        *value = mmdb->ipv4_start_node.node_value;
+        *start_bit -= mmdb->ipv4_start_node.netmask;
     }
 
+    return MMDB_SUCCESS;
+}
+
+/* This is the loop from find_address_in_search_tree() without the checks on
+ * each record. MMDB_verify() has already checked that every record in the
+ * tree is either a node in the tree, the empty record or a valid offset in
+ * the data section. */
+LOCAL int find_address_in_verified_tree(MMDB_s *mmdb, uint8_t *address,
+                                        record_info_s record_info,
+                                        uint32_t value, int start_bit,
+                                        MMDB_lookup_result_s *result)
+{
     const uint8_t *search_tree = mmdb->file_content;
-    const uint8_t *record_pointer;
+    uint32_t node_count = mmdb->metadata.node_count;
+    uint16_t max_depth0 = mmdb->depth - 1;
+
     for (int current_bit = start_bit; current_bit >= 0; current_bit--) {
         uint8_t bit_is_true =
             address[(max_depth0 - current_bit) >> 3]
             & (1U << (~(max_depth0 - current_bit) & 7)) ? 1 : 0;
 
-        DEBUG_MSGF("Looking at bit %i - bit's value is %i", current_bit,
-                   bit_is_true);
-        DEBUG_MSGF("  current node = %u", value);
-
-        record_pointer = &search_tree[value * record_info.record_length];
-        if (record_pointer + record_info.record_length > mmdb->data_section) {
-            return MMDB_CORRUPT_SEARCH_TREE_ERROR;
-        }
+        const uint8_t *record_pointer =
+            &search_tree[value * record_info.record_length];
         if (bit_is_true) {
             record_pointer += record_info.right_record_offset;
             value = record_info.right_record_getter(record_pointer);
@@ -936,24 +1269,199 @@ LOCAL int find_address_in_search_tree(MMDB_s *mmdb, uint8_t *address,
             value = record_info.left_record_getter(record_pointer);
         }
 
-        uint8_t type = maybe_populate_result(mmdb, value, (uint16_t)current_bit,
-                                             result);
+        if (value >= node_count) {
+            result->netmask = mmdb->depth - (uint16_t)current_bit;
+            result->entry.offset = data_section_offset_for_record(mmdb, value);
+            result->found_entry = value > node_count;
+            return MMDB_SUCCESS;
+        }
+    }
+
+    return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+}
+
+void MMDB_set_lookup_string(const MMDB_set_s *const set,
+                            const char *const ipstr, int *const gai_error,
+                            MMDB_lookup_result_s *const results,
+                            int *const mmdb_errors)
+{
+    struct addrinfo *addresses = NULL;
+    *gai_error = resolve_any_address(ipstr, &addresses);
+
+    if (!*gai_error) {
+        MMDB_set_lookup_sockaddr(set, addresses->ai_addr, results,
+                                 mmdb_errors);
+    } else {
+        for (size_t i = 0; i < set->count; i++) {
+            results[i] = (MMDB_lookup_result_s) {
+                .found_entry = false,
+                .netmask     = 0,
+                .entry       = {
+                    .mmdb    = set->mmdbs[i],
+                    .offset  = 0
+                }
+            };
+            mmdb_errors[i] = MMDB_SUCCESS;
+        }
+    }
+
+    if (NULL != addresses) {
+        freeaddrinfo(addresses);
+    }
+}
+
+void MMDB_set_lookup_sockaddr(const MMDB_set_s *const set,
+                              const struct sockaddr *const sockaddr,
+                              MMDB_lookup_result_s *const results,
+                              int *const mmdb_errors)
+{
+    for (size_t i = 0; i < set->count; i += SET_BATCH_SIZE) {
+        size_t count = set->count - i < SET_BATCH_SIZE
+                       ? set->count - i : SET_BATCH_SIZE;
+        lookup_batch(set->mmdbs + i, count, sockaddr, results + i,
+                     mmdb_errors + i);
+    }
+}
+
+/* This looks the address up in each database the same way as
+ * MMDB_lookup_sockaddr(), but rather than walking one tree at a time it
+ * takes one step in each tree in turn. Each step prefetches the next node in
+ * its tree, so the memory for it is on its way while we step through the
+ * other trees. */
+LOCAL void lookup_batch(MMDB_s *const *mmdbs, size_t count,
+                        const struct sockaddr *sockaddr,
+                        MMDB_lookup_result_s *results, int *mmdb_errors)
+{
+    tree_walk_s walks[SET_BATCH_SIZE];
+    /* Every IPv6 database maps an IPv4 address the same way */
+    uint8_t mapped_address[16];
+    size_t active = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        results[i] = (MMDB_lookup_result_s) {
+            .found_entry = false,
+            .netmask     = 0,
+            .entry       = {
+                .mmdb    = mmdbs[i],
+                .offset  = 0
+            }
+        };
+
+        tree_walk_s *walk = &walks[active];
+        walk->result = &results[i];
+        walk->mmdb_error = &mmdb_errors[i];
+        bool done;
+        mmdb_errors[i] = start_tree_walk(walk, mmdbs[i], sockaddr,
+                                         mapped_address, &done);
+        if (MMDB_SUCCESS == mmdb_errors[i] && !done) {
+            active++;
+        }
+    }
+
+    while (active > 0) {
+        for (size_t i = 0; i < active;) {
+            bool done;
+            int status = tree_walk_step(&walks[i], &done);
+            if (MMDB_SUCCESS != status || done) {
+                *walks[i].mmdb_error = status;
+                walks[i] = walks[--active];
+            } else {
+                i++;
+            }
+        }
+    }
+}
+
+LOCAL int start_tree_walk(tree_walk_s *walk, MMDB_s *mmdb,
+                          const struct sockaddr *sockaddr,
+                          uint8_t *mapped_address, bool *done)
+{
+    walk->mmdb = mmdb;
+    walk->record_info = record_info_for_database(mmdb);
+    if (0 == walk->record_info.right_record_offset) {
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+    }
+
+    uint8_t *address;
+    int status = address_for_database(mmdb, sockaddr, mapped_address,
+                                      &address);
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+    walk->address = address;
+
+    status = find_start_node(mmdb, sockaddr->sa_family, walk->result,
+                             &walk->value, &walk->current_bit, done);
+    if (MMDB_SUCCESS == status && !*done) {
+        PREFETCH(&mmdb->file_content[(uint64_t)walk->value
+                                     * walk->record_info.record_length]);
+    }
+    return status;
+}
+
+/* This is one iteration of the loop in find_address_in_search_tree(), or
+ * of the one in find_address_in_verified_tree() for a verified database. It
+ * sets done once it reaches a record that isn't a search tree node. */
+LOCAL int tree_walk_step(tree_walk_s *walk, bool *done)
+{
+    MMDB_s *mmdb = walk->mmdb;
+    const record_info_s *record_info = &walk->record_info;
+    uint16_t max_depth0 = mmdb->depth - 1;
+    int current_bit = walk->current_bit;
+    bool verified = mmdb->flags & MMDB_VERIFIED;
+
+    *done = false;
+    if (current_bit < 0) {
+        DEBUG_MSG("Reached the end of the address bits without leaving the "
+                  "search tree");
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
+
+    uint8_t bit_is_true =
+        walk->address[(max_depth0 - current_bit) >> 3]
+        & (1U << (~(max_depth0 - current_bit) & 7)) ? 1 : 0;
+
+    const uint8_t *record_pointer =
+        &mmdb->file_content[walk->value * record_info->record_length];
+    if (!verified
+        && record_pointer + record_info->record_length > mmdb->data_section) {
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
+    uint32_t value;
+    if (bit_is_true) {
+        record_pointer += record_info->right_record_offset;
+        value = record_info->right_record_getter(record_pointer);
+    } else {
+        value = record_info->left_record_getter(record_pointer);
+    }
+
+    if (verified) {
+        uint32_t node_count = mmdb->metadata.node_count;
+        if (value >= node_count) {
+            walk->result->netmask = mmdb->depth - (uint16_t)current_bit;
+            walk->result->entry.offset =
+                data_section_offset_for_record(mmdb, value);
+            walk->result->found_entry = value > node_count;
+            *done = true;
+            return MMDB_SUCCESS;
+        }
+    } else {
+        uint8_t type = maybe_populate_result(mmdb, value,
+                                             (uint16_t)current_bit,
+                                             walk->result);
         if (MMDB_RECORD_TYPE_INVALID == type) {
             return MMDB_CORRUPT_SEARCH_TREE_ERROR;
         }
-
         if (MMDB_RECORD_TYPE_SEARCH_NODE != type) {
+            *done = true;
             return MMDB_SUCCESS;
         }
-
-        DEBUG_MSGF("  proceeding to search tree node %i", value);
     }
 
-    DEBUG_MSG(
-        "Reached the end of the address bits without leaving the search tree");
-
-    // We should not be able to reach this return. If we do, something very bad happened.
-    return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    walk->value = value;
+    walk->current_bit = current_bit - 1;
+    PREFETCH(&mmdb->file_content[value * record_info->record_length]);
+    return MMDB_SUCCESS;
 }
 
 LOCAL record_info_s record_info_for_database(MMDB_s *mmdb)
@@ -1115,974 +1623,4428 @@ int MMDB_read_node(MMDB_s *const mmdb, uint32_t node_number,
     return MMDB_SUCCESS;
 }
 
-LOCAL uint32_t data_section_offset_for_record(MMDB_s *const mmdb,
-                                              uint64_t record)
+int MMDB_network_iterator_init(MMDB_s *const mmdb, uint32_t flags,
+                               MMDB_network_iterator_s *const iterator)
 {
-    return (uint32_t)record - mmdb->metadata.node_count -
-           MMDB_DATA_SECTION_SEPARATOR;
+    static const uint8_t root_address[16] = { 0 };
+    return MMDB_network_iterator_init_subtree(mmdb, flags, root_address, 0,
+                                              iterator);
 }
 
-int MMDB_get_value(MMDB_entry_s *const start,
-                   MMDB_entry_data_s *const entry_data,
-                   ...)
+int MMDB_network_iterator_init_subtree(MMDB_s *const mmdb, uint32_t flags,
+                                       const uint8_t *const address,
+                                       uint16_t prefix_length,
+                                       MMDB_network_iterator_s *const iterator)
 {
-    va_list path;
-    va_start(path, entry_data);
-    int status = MMDB_vget_value(start, entry_data, path);
-    va_end(path);
-    return status;
+    return start_network_iterator(mmdb, flags, address, prefix_length, false,
+                                  iterator);
 }
 
-int MMDB_vget_value(MMDB_entry_s *const start,
-                    MMDB_entry_data_s *const entry_data,
-                    va_list va_path)
+/* This walks the tree depth first, always taking the left record of a node
+ * next and pushing the right one on the stack, so networks come out in
+ * ascending order of address. Each stack entry is a right record, and since
+ * everything visited after it was pushed is inside its left sibling, the
+ * bits of the address above it are still the ones we need when we pop it. */
+int MMDB_network_iterator_next(MMDB_network_iterator_s *const iterator,
+                               MMDB_network_s *const network,
+                               bool *const found_network)
 {
-    int length = path_length(va_path);
-    const char *path_elem;
-    int i = 0;
-
-    MAYBE_CHECK_SIZE_OVERFLOW(length, SIZE_MAX / sizeof(const char *) - 1,
-                              MMDB_INVALID_METADATA_ERROR);
+    MMDB_s *mmdb = iterator->mmdb;
+    record_info_s record_info = record_info_for_database(mmdb);
+    bool verified = mmdb->flags & MMDB_VERIFIED;
+
+    *found_network = false;
+    while (iterator->stack_size > 0) {
+        MMDB_network_iterator_node_s next =
+            iterator->stack[--iterator->stack_size];
+        uint32_t record = next.record;
+        uint16_t prefix_length = next.prefix_length;
+        /* The subtree's root is the only record on the stack that isn't a
+         * right record, and its address is already set */
+        if (prefix_length > iterator->prefix_length) {
+            set_network_address_bits(iterator->address, prefix_length,
+                                     mmdb->depth);
+        }
 
-    const char **path = malloc((length + 1) * sizeof(const char *));
-    if (NULL == path) {
-        return MMDB_OUT_OF_MEMORY_ERROR;
-    }
+        /* The root is the only record with a prefix length of 0. Its
+         * "record" is node 0, which record_type() would call invalid. */
+        uint8_t type = 0 == prefix_length
+                       ? MMDB_RECORD_TYPE_SEARCH_NODE
+                       : record_type(mmdb, record);
+        while (MMDB_RECORD_TYPE_SEARCH_NODE == type) {
+            if (prefix_length > iterator->prefix_length
+                && is_ipv4_alias(iterator, record)) {
+                break;
+            }
+            if (prefix_length >= mmdb->depth) {
+                DEBUG_MSG("search tree is deeper than the address size");
+                return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+            }
 
-    while (NULL != (path_elem = va_arg(va_path, char *))) {
-        path[i] = path_elem;
-        i++;
-    }
-    path[i] = NULL;
+            const uint8_t *record_pointer =
+                &mmdb->file_content[(uint64_t)record
+                                    * record_info.record_length];
+            if (!verified && record_pointer + record_info.record_length
+                > mmdb->data_section) {
+                return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+            }
+            prefix_length++;
+            iterator->stack[iterator->stack_size++] =
+                (MMDB_network_iterator_node_s) {
+                .record        = record_info.right_record_getter(
+                    record_pointer + record_info.right_record_offset),
+                .prefix_length = prefix_length
+            };
+            record = record_info.left_record_getter(record_pointer);
+            type = record_type(mmdb, record);
+        }
 
-    int status = MMDB_aget_value(start, entry_data, path);
+        if (MMDB_RECORD_TYPE_INVALID == type) {
+            return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+        }
+        /* The inner loop only stops at a node when it is an alias */
+        if ((MMDB_RECORD_TYPE_SEARCH_NODE == type
+             && !(iterator->flags & MMDB_NETWORK_ITERATOR_REPORT_ALIASES))
+            || (MMDB_RECORD_TYPE_EMPTY == type
+                && !(iterator->flags & MMDB_NETWORK_ITERATOR_INCLUDE_EMPTY))) {
+            continue;
+        }
 
-    free((char **)path);
+        memcpy(network->address, iterator->address, sizeof(network->address));
+        network->prefix_length = prefix_length;
+        network->record_type = type;
+        network->entry = (MMDB_entry_s) {
+            .mmdb   = mmdb,
+            .offset = MMDB_RECORD_TYPE_DATA == type
+                      ? data_section_offset_for_record(mmdb, record) : 0
+        };
+        *found_network = true;
+        return MMDB_SUCCESS;
+    }
 
-    return status;
+    return MMDB_SUCCESS;
 }
 
-LOCAL int path_length(va_list va_path)
+/* This walks down from the root to the subtree, so that the iterator only
+ * has the subtree's root on its stack. If we find a data or empty record
+ * before we get that deep, the subtree is part of a bigger network. When
+ * covering is true, as it is for MMDB_lookup_range(), we return that
+ * network. Otherwise, to make sure every network comes out of exactly one
+ * subtree, that network only comes out of the first subtree in it.
+ *
+ * A range names its network explicitly, so it can be inside an IPv4 alias.
+ * Subtrees are how callers split up the whole tree, so one inside an alias
+ * is empty unless aliases were asked for. */
+LOCAL int start_network_iterator(MMDB_s *mmdb, uint32_t flags,
+                                 const uint8_t *address,
+                                 uint16_t prefix_length, bool covering,
+                                 MMDB_network_iterator_s *iterator)
 {
-    int i = 0;
-    const char *ignore;
-    va_list path_copy;
-    va_copy(path_copy, va_path);
+    iterator->mmdb = mmdb;
+    iterator->flags = flags;
+    iterator->prefix_length = prefix_length;
+    iterator->stack_size = 0;
+    memset(iterator->address, 0, sizeof(iterator->address));
 
-    while (NULL != (ignore = va_arg(path_copy, char *))) {
-        i++;
+    record_info_s record_info = record_info_for_database(mmdb);
+    if (0 == record_info.right_record_offset) {
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+    }
+    if (prefix_length > mmdb->depth) {
+        return MMDB_INVALID_NETWORK_ERROR;
     }
 
-    va_end(path_copy);
-
-    return i;
-}
-
-int MMDB_aget_value(MMDB_entry_s *const start,
-                    MMDB_entry_data_s *const entry_data,
-                    const char *const *const path)
-{
-    MMDB_s *mmdb = start->mmdb;
-    uint32_t offset = start->offset;
+    if (mmdb->metadata.ip_version == 6
+        && !(flags & MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES)) {
+        int status = find_ipv4_start_node(mmdb);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+    }
 
-    memset(entry_data, 0, sizeof(MMDB_entry_data_s));
-    DEBUG_NL;
-    DEBUG_MSG("looking up value by path");
+    /* We start at the root, which is node 0 */
+    uint32_t record = 0;
+    uint16_t depth = 0;
+    uint8_t type = MMDB_RECORD_TYPE_SEARCH_NODE;
+    for (; depth < prefix_length && MMDB_RECORD_TYPE_SEARCH_NODE == type;
+         depth++) {
+        if (!covering && depth > 0 && is_ipv4_alias(iterator, record)) {
+            return MMDB_SUCCESS;
+        }
 
-    CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, entry_data);
+        const uint8_t *record_pointer =
+            &mmdb->file_content[(uint64_t)record * record_info.record_length];
+        if (!(mmdb->flags & MMDB_VERIFIED)
+            && record_pointer + record_info.record_length
+            > mmdb->data_section) {
+            return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+        }
+        if (address[depth >> 3] & (0x80 >> (depth & 7))) {
+            iterator->address[depth >> 3] |= 0x80 >> (depth & 7);
+            record = record_info.right_record_getter(
+                record_pointer + record_info.right_record_offset);
+        } else {
+            record = record_info.left_record_getter(record_pointer);
+        }
+        type = record_type(mmdb, record);
+    }
 
-    DEBUG_NL;
-    DEBUG_MSGF("top level element is a %s", type_num_to_name(entry_data->type));
-
-    /* Can this happen? It'd probably represent a pathological case under
-     * normal use, but there's nothing preventing someone from passing an
-     * invalid MMDB_entry_s struct to this function */
-    if (!entry_data->has_data) {
-        return MMDB_INVALID_LOOKUP_PATH_ERROR;
+    if (MMDB_RECORD_TYPE_INVALID == type) {
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
     }
-
-    const char *path_elem;
-    int i = 0;
-    while (NULL != (path_elem = path[i++])) {
-        DEBUG_NL;
-        DEBUG_MSGF("path elem = %s", path_elem);
-
-        /* XXX - it'd be good to find a quicker way to skip through these
-           entries that doesn't involve decoding them
-           completely. Basically we need to just use the size from the
-           control byte to advance our pointer rather than calling
-           decode_one(). */
-        if (entry_data->type == MMDB_DATA_TYPE_ARRAY) {
-            int status = lookup_path_in_array(path_elem, mmdb, entry_data);
-            if (MMDB_SUCCESS != status) {
-                memset(entry_data, 0, sizeof(MMDB_entry_data_s));
-                return status;
-            }
-        } else if (entry_data->type == MMDB_DATA_TYPE_MAP) {
-            int status = lookup_path_in_map(path_elem, mmdb, entry_data);
-            if (MMDB_SUCCESS != status) {
-                memset(entry_data, 0, sizeof(MMDB_entry_data_s));
-                return status;
+    if (!covering) {
+        if (MMDB_RECORD_TYPE_SEARCH_NODE == type && depth > 0
+            && is_ipv4_alias(iterator, record)) {
+            return MMDB_SUCCESS;
+        }
+        for (uint16_t bit = depth; bit < prefix_length; bit++) {
+            if (address[bit >> 3] & (0x80 >> (bit & 7))) {
+                return MMDB_SUCCESS;
             }
-        } else {
-            /* Once we make the code traverse maps & arrays without calling
-             * decode_one() we can get rid of this. */
-            memset(entry_data, 0, sizeof(MMDB_entry_data_s));
-            return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
         }
     }
 
+    iterator->stack[0] = (MMDB_network_iterator_node_s) {
+        .record        = record,
+        .prefix_length = depth
+    };
+    iterator->stack_size = 1;
+
     return MMDB_SUCCESS;
 }
 
-LOCAL int lookup_path_in_array(const char *path_elem, MMDB_s *mmdb,
-                               MMDB_entry_data_s *entry_data)
+/* The prefix length is for the sockaddr's address family, so an IPv4 range
+ * in an IPv6 database is under ::/96 like it is for a lookup. */
+int MMDB_lookup_range(MMDB_s *const mmdb,
+                      const struct sockaddr *const sockaddr,
+                      uint16_t prefix_length, uint32_t flags,
+                      int (*callback)(void *ctx,
+                                      const MMDB_network_s *network),
+                      void *ctx)
 {
-    uint32_t size = entry_data->data_size;
-    char *first_invalid;
-
-    int saved_errno = errno;
-    errno = 0;
-    int array_index = strtol(path_elem, &first_invalid, 10);
-    if (array_index < 0 || ERANGE == errno) {
-        errno = saved_errno;
-        return MMDB_INVALID_LOOKUP_PATH_ERROR;
+    uint8_t mapped_address[16], *address;
+    int status = address_for_database(mmdb, sockaddr, mapped_address,
+                                      &address);
+    if (MMDB_SUCCESS != status) {
+        return status;
     }
-    errno = saved_errno;
-
-    if (*first_invalid || (uint32_t)array_index >= size) {
-        return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
+    if (prefix_length > (sockaddr->sa_family == AF_INET6 ? 128 : 32)) {
+        return MMDB_INVALID_NETWORK_ERROR;
+    }
+    if (mmdb->metadata.ip_version == 6 && sockaddr->sa_family == AF_INET) {
+        prefix_length += 96;
     }
 
-    for (int i = 0; i < array_index; i++) {
-        /* We don't want to follow a pointer here. If the next element is a
-         * pointer we simply skip it and keep going */
-        CHECKED_DECODE_ONE(mmdb, entry_data->offset_to_next, entry_data);
-        int status = skip_map_or_array(mmdb, entry_data);
-        if (MMDB_SUCCESS != status) {
-            return status;
+    MMDB_network_iterator_s iterator;
+    status = start_network_iterator(mmdb, flags, address, prefix_length, true,
+                                    &iterator);
+
+    offset_set_s seen = { .slots = NULL, .mask = 0, .count = 0 };
+    MMDB_network_s network;
+    bool found_network;
+    while (MMDB_SUCCESS == status
+           && MMDB_SUCCESS == (status = MMDB_network_iterator_next(
+                                   &iterator, &network, &found_network))
+           && found_network) {
+        if (flags & MMDB_LOOKUP_RANGE_UNIQUE_DATA
+            && MMDB_RECORD_TYPE_DATA == network.record_type) {
+            bool added;
+            status = add_offset(&seen, network.entry.offset, &added);
+            if (!added) {
+                continue;
+            }
+        }
+        if (MMDB_VISIT_STOP == callback(ctx, &network)) {
+            break;
         }
     }
 
-    MMDB_entry_data_s value;
-    CHECKED_DECODE_ONE_FOLLOW(mmdb, entry_data->offset_to_next, &value);
-    memcpy(entry_data, &value, sizeof(MMDB_entry_data_s));
+    free(seen.slots);
+    return status;
+}
+
+/* This adds an offset to the set if it isn't there already. added is false
+ * when it was. */
+LOCAL int add_offset(offset_set_s *set, uint32_t offset, bool *added)
+{
+    *added = false;
+    if (set->count * 2 >= set->mask) {
+        uint32_t slots = set->slots ? (set->mask + 1) * 2 : 64;
+        offset_set_s bigger = {
+            .slots = calloc(slots, sizeof(uint32_t)),
+            .mask  = slots - 1,
+            .count = set->count
+        };
+        if (NULL == bigger.slots) {
+            return MMDB_OUT_OF_MEMORY_ERROR;
+        }
+        for (uint32_t i = 0; set->slots && i <= set->mask; i++) {
+            if (set->slots[i]) {
+                uint32_t slot = row_slot(set->slots[i] - 1, bigger.mask);
+                while (bigger.slots[slot]) {
+                    slot = (slot + 1) & bigger.mask;
+                }
+                bigger.slots[slot] = set->slots[i];
+            }
+        }
+        free(set->slots);
+        *set = bigger;
+    }
 
+    uint32_t slot = row_slot(offset, set->mask);
+    while (set->slots[slot]) {
+        if (set->slots[slot] == offset + 1) {
+            return MMDB_SUCCESS;
+        }
+        slot = (slot + 1) & set->mask;
+    }
+    set->slots[slot] = offset + 1;
+    set->count++;
+    *added = true;
     return MMDB_SUCCESS;
 }
 
-LOCAL int lookup_path_in_map(const char *path_elem, MMDB_s *mmdb,
-                             MMDB_entry_data_s *entry_data)
+int MMDB_join_init(MMDB_s *const mmdb, MMDB_join_s *const join)
 {
-    uint32_t size = entry_data->data_size;
-    uint32_t offset = entry_data->offset_to_next;
-    size_t path_elem_len = strlen(path_elem);
-
-    while (size-- > 0) {
-        MMDB_entry_data_s key, value;
-        CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, &key);
+    memset(join, 0, sizeof(MMDB_join_s));
+    join->iterator.mmdb = mmdb;
+    /* Every address must be in some network, so the stack holds the empty
+     * records and the aliases too */
+    join->iterator.flags = MMDB_NETWORK_ITERATOR_INCLUDE_EMPTY
+                           | MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES;
 
-        uint32_t offset_to_value = key.offset_to_next;
+    record_info_s record_info = record_info_for_database(mmdb);
+    if (0 == record_info.right_record_offset) {
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+    }
+    return MMDB_SUCCESS;
+}
 
-        if (MMDB_DATA_TYPE_UTF8_STRING != key.type) {
-            return MMDB_INVALID_DATA_ERROR;
+/* This looks up an address like MMDB_lookup_sockaddr() does, but keeps the
+ * network iterator's stack of right records that are still ahead of the last
+ * address. Those are the subtrees after its network in ascending order, so
+ * for a later address we pop the ones that end before it and only walk down
+ * the one it is in. With addresses in ascending order, each node in the tree
+ * is read at most once over the whole join, and an address in the same
+ * network as the last one doesn't read any.
+ *
+ * An address before the current network starts again from the root, so
+ * addresses out of order are still looked up correctly. */
+MMDB_lookup_result_s MMDB_join_sockaddr(MMDB_join_s *const join,
+                                        const struct sockaddr *const sockaddr,
+                                        int *const mmdb_error)
+{
+    MMDB_network_iterator_s *iterator = &join->iterator;
+    MMDB_s *mmdb = iterator->mmdb;
+    MMDB_lookup_result_s result = {
+        .found_entry = false,
+        .netmask     = 0,
+        .entry       = {
+            .mmdb    = mmdb,
+            .offset  = 0
         }
+    };
 
-        if (key.data_size == path_elem_len &&
-            !memcmp(path_elem, key.utf8_string, path_elem_len)) {
-
-            DEBUG_MSG("found key matching path elem");
+    uint8_t mapped_address[16], *address;
+    *mmdb_error = address_for_database(mmdb, sockaddr, mapped_address,
+                                       &address);
+    if (MMDB_SUCCESS != *mmdb_error) {
+        return result;
+    }
 
-            CHECKED_DECODE_ONE_FOLLOW(mmdb, offset_to_value, &value);
-            memcpy(entry_data, &value, sizeof(MMDB_entry_data_s));
-            return MMDB_SUCCESS;
-        } else {
-            /* We don't want to follow a pointer here. If the next element is
-             * a pointer we simply skip it and keep going */
-            CHECKED_DECODE_ONE(mmdb, offset_to_value, &value);
-            int status = skip_map_or_array(mmdb, &value);
-            if (MMDB_SUCCESS != status) {
-                return status;
+    bool found = join->has_network
+                 && network_contains(join->network.address,
+                                     join->network.prefix_length, address);
+    if (!found && join->has_network
+        && memcmp(address, join->network.address, mmdb->depth / 8) > 0) {
+        while (iterator->stack_size > 0) {
+            MMDB_network_iterator_node_s next =
+                iterator->stack[--iterator->stack_size];
+            set_network_address_bits(iterator->address, next.prefix_length,
+                                     mmdb->depth);
+            if (network_contains(iterator->address, next.prefix_length,
+                                 address)) {
+                *mmdb_error = descend_join(join, address, next.record,
+                                           next.prefix_length);
+                found = true;
+                break;
             }
-            offset = value.offset_to_next;
         }
     }
+    if (!found) {
+        *mmdb_error = seek_join(join, address);
+    }
+    if (MMDB_SUCCESS != *mmdb_error) {
+        join->has_network = false;
+        return result;
+    }
 
-    memset(entry_data, 0, sizeof(MMDB_entry_data_s));
-    return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
+    result.netmask = join->network.prefix_length;
+    if (MMDB_RECORD_TYPE_DATA == join->network.record_type) {
+        result.found_entry = true;
+        result.entry = join->network.entry;
+    }
+    return result;
 }
 
-LOCAL int skip_map_or_array(MMDB_s *mmdb, MMDB_entry_data_s *entry_data)
+/* This empties the iterator and walks down to the address from the root.
+ * The IPv4 networks of an IPv6 database are all in the subtree under ::/96,
+ * so we start an IPv4 address there like a lookup does. Once a later address
+ * is past that subtree, it starts again from the root. */
+LOCAL int seek_join(MMDB_join_s *join, const uint8_t *address)
 {
-    if (entry_data->type == MMDB_DATA_TYPE_MAP) {
-        uint32_t size = entry_data->data_size;
-        while (size-- > 0) {
-            CHECKED_DECODE_ONE(mmdb, entry_data->offset_to_next, entry_data);   // key
-            CHECKED_DECODE_ONE(mmdb, entry_data->offset_to_next, entry_data);   // value
-            int status = skip_map_or_array(mmdb, entry_data);
-            if (MMDB_SUCCESS != status) {
-                return status;
-            }
+    MMDB_network_iterator_s *iterator = &join->iterator;
+    MMDB_s *mmdb = iterator->mmdb;
+
+    iterator->stack_size = 0;
+    iterator->prefix_length = 0;
+    memset(iterator->address, 0, sizeof(iterator->address));
+
+    static const uint8_t ipv4_prefix[12] = { 0 };
+    if (mmdb->metadata.ip_version == 6
+        && 0 == memcmp(address, ipv4_prefix, 12)) {
+        int status = find_ipv4_start_node(mmdb);
+        if (MMDB_SUCCESS != status) {
+            return status;
         }
-    } else if (entry_data->type == MMDB_DATA_TYPE_ARRAY) {
-        uint32_t size = entry_data->data_size;
-        while (size-- > 0) {
-            CHECKED_DECODE_ONE(mmdb, entry_data->offset_to_next, entry_data);   // value
-            int status = skip_map_or_array(mmdb, entry_data);
-            if (MMDB_SUCCESS != status) {
-                return status;
-            }
+        /* If the start node isn't a search node, the IPv4 space is inside a
+         * bigger network and we find that from the root */
+        if (mmdb->ipv4_start_node.node_value < mmdb->metadata.node_count) {
+            return descend_join(join, address,
+                                mmdb->ipv4_start_node.node_value,
+                                mmdb->ipv4_start_node.netmask);
         }
     }
 
-    return MMDB_SUCCESS;
+    return descend_join(join, address, 0, 0);
 }
 
-LOCAL int decode_one_follow(MMDB_s *mmdb, uint32_t offset,
-                            MMDB_entry_data_s *entry_data)
+/* This walks down from a record to the network that the address is in and
+ * makes it the join's current network. The iterator's address must already
+ * have the bits above the record set. On the way down we push the right
+ * record of every node where we go left, which leaves the iterator just as
+ * it would be if it had walked the tree up to this network. */
+LOCAL int descend_join(MMDB_join_s *join, const uint8_t *address,
+                       uint32_t record, uint16_t depth)
 {
-    CHECKED_DECODE_ONE(mmdb, offset, entry_data);
-    if (entry_data->type == MMDB_DATA_TYPE_POINTER) {
-        uint32_t next = entry_data->offset_to_next;
-        CHECKED_DECODE_ONE(mmdb, entry_data->pointer, entry_data);
-        /* Pointers to pointers are illegal under the spec */
-        if (entry_data->type == MMDB_DATA_TYPE_POINTER) {
-            DEBUG_MSG("pointer points to another pointer");
-            return MMDB_INVALID_DATA_ERROR;
-        }
+    MMDB_network_iterator_s *iterator = &join->iterator;
+    MMDB_s *mmdb = iterator->mmdb;
+    record_info_s record_info = record_info_for_database(mmdb);
 
-        /* The pointer could point to any part of the data section but the
-         * next entry for this particular offset may be the one after the
-         * pointer, not the one after whatever the pointer points to. This
-         * depends on whether the pointer points to something that is a simple
-         * value or a compound value. For a compound value, the next one is
-         * the one after the pointer result, not the one after the pointer. */
-        if (entry_data->type != MMDB_DATA_TYPE_MAP
-            && entry_data->type != MMDB_DATA_TYPE_ARRAY) {
+    join->has_network = false;
 
-            entry_data->offset_to_next = next;
+    /* The root is node 0, which record_type() would call invalid */
+    uint8_t type = 0 == depth
+                   ? MMDB_RECORD_TYPE_SEARCH_NODE
+                   : record_type(mmdb, record);
+    while (MMDB_RECORD_TYPE_SEARCH_NODE == type) {
+        if (depth >= mmdb->depth) {
+            DEBUG_MSG("search tree is deeper than the address size");
+            return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+        }
+
+        const uint8_t *record_pointer =
+            &mmdb->file_content[(uint64_t)record * record_info.record_length];
+        if (!(mmdb->flags & MMDB_VERIFIED)
+            && record_pointer + record_info.record_length
+            > mmdb->data_section) {
+            return MMDB_CORRUPT_SEARCH_TREE_ERROR;
         }
+        uint32_t right = record_info.right_record_getter(
+            record_pointer + record_info.right_record_offset);
+        if (address[depth >> 3] & (0x80 >> (depth & 7))) {
+            iterator->address[depth >> 3] |= 0x80 >> (depth & 7);
+            record = right;
+        } else {
+            iterator->stack[iterator->stack_size++] =
+                (MMDB_network_iterator_node_s) {
+                .record        = right,
+                .prefix_length = depth + 1
+            };
+            record = record_info.left_record_getter(record_pointer);
+        }
+        depth++;
+        type = record_type(mmdb, record);
+    }
+
+    if (MMDB_RECORD_TYPE_INVALID == type) {
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
     }
 
+    memcpy(join->network.address, iterator->address,
+           sizeof(join->network.address));
+    join->network.prefix_length = depth;
+    join->network.record_type = type;
+    join->network.entry = (MMDB_entry_s) {
+        .mmdb   = mmdb,
+        .offset = MMDB_RECORD_TYPE_DATA == type
+                  ? data_section_offset_for_record(mmdb, record) : 0
+    };
+    join->has_network = true;
+
     return MMDB_SUCCESS;
 }
 
-#if !MMDB_UINT128_IS_BYTE_ARRAY
-NO_PROTO mmdb_uint128_t get_uint128(const uint8_t *p, int length)
+LOCAL bool network_contains(const uint8_t *network, uint16_t prefix_length,
+                            const uint8_t *address)
 {
-    mmdb_uint128_t value = 0;
-    while (length-- > 0) {
-        value <<= 8;
-        value += *p++;
+    uint16_t bytes = prefix_length >> 3;
+    if (0 != memcmp(network, address, bytes)) {
+        return false;
     }
-    return value;
+    uint8_t bits = prefix_length & 7;
+    if (0 == bits) {
+        return true;
+    }
+    uint8_t mask = (uint8_t)(0xff << (8 - bits));
+    return (network[bytes] & mask) == (address[bytes] & mask);
 }
-#endif
 
-LOCAL int decode_one(MMDB_s *mmdb, uint32_t offset,
-                     MMDB_entry_data_s *entry_data)
+/* This walks the two search trees side by side. Where one tree has a search
+ * node and the other has a data or empty record, the record stands for both
+ * halves of the node. Each subtree gets a hash of everything under it, so any
+ * two subtrees with the same hash are skipped without looking inside them.
+ *
+ * A node whose two halves hash the same gets the hash of one half. That way
+ * the hash only depends on which data each address maps to and not on how
+ * the tree is split up, so a /8 in one tree matches two /9s with the same
+ * data in the other. Data records are hashed by their decoded contents, which
+ * lets us compare records across files where their offsets and pointers are
+ * different. */
+int MMDB_diff(MMDB_s *const old_mmdb, MMDB_s *const new_mmdb, uint32_t flags,
+              int (*callback)(void *ctx, const MMDB_diff_s *diff), void *ctx)
 {
-    const uint8_t *mem = mmdb->data_section;
-
-    if (offset + 1 > mmdb->data_section_size) {
-        DEBUG_MSGF("Offset (%d) past data section (%d)", offset,
-                   mmdb->data_section_size);
-        return MMDB_INVALID_DATA_ERROR;
+    if (old_mmdb->metadata.ip_version != new_mmdb->metadata.ip_version) {
+        return MMDB_IP_VERSION_MISMATCH_ERROR;
     }
 
-    entry_data->offset = offset;
-    entry_data->has_data = true;
+    diff_state_s diff = {
+        .flags    = flags,
+        .callback = callback,
+        .ctx      = ctx,
+        .stopped  = false
+    };
+    int status = start_diff_side(&diff.sides[0], old_mmdb);
+    if (MMDB_SUCCESS == status) {
+        status = start_diff_side(&diff.sides[1], new_mmdb);
+    }
 
-    DEBUG_NL;
-    DEBUG_MSGF("Offset: %i", offset);
+    if (MMDB_SUCCESS == status) {
+        /* Both trees start at node 0 */
+        static const uint64_t roots[2] = { 0, 0 };
+        static const uint8_t root_types[2] = {
+            MMDB_RECORD_TYPE_SEARCH_NODE, MMDB_RECORD_TYPE_SEARCH_NODE
+        };
+        status = diff_records(&diff, roots, root_types, 0);
+    }
 
-    uint8_t ctrl = mem[offset++];
-    DEBUG_BINARY("Control byte: %s", ctrl);
+    for (int i = 0; i < 2; i++) {
+        free(diff.sides[i].node_hashes);
+        free(diff.sides[i].data_offsets);
+        free(diff.sides[i].data_hashes);
+    }
+    return status;
+}
 
-    int type = (ctrl >> 5) & 7;
-    DEBUG_MSGF("Type: %i (%s)", type, type_num_to_name(type));
+LOCAL int start_diff_side(diff_side_s *side, MMDB_s *mmdb)
+{
+    memset(side, 0, sizeof(diff_side_s));
+    side->mmdb = mmdb;
+    side->record_info = record_info_for_database(mmdb);
+    if (0 == side->record_info.right_record_offset) {
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+    }
 
-    if (type == MMDB_DATA_TYPE_EXTENDED) {
-        if (offset + 1 > mmdb->data_section_size) {
-            DEBUG_MSGF("Extended type offset (%d) past data section (%d)",
-                       offset,
-                       mmdb->data_section_size);
-            return MMDB_INVALID_DATA_ERROR;
+    if (mmdb->metadata.ip_version == 6) {
+        int status = find_ipv4_start_node(mmdb);
+        if (MMDB_SUCCESS != status) {
+            return status;
         }
-        type = get_ext_type(mem[offset++]);
-        DEBUG_MSGF("Extended type: %i (%s)", type, type_num_to_name(type));
     }
 
-    entry_data->type = type;
-
-    if (type == MMDB_DATA_TYPE_POINTER) {
-        int psize = ((ctrl >> 3) & 3) + 1;
-        DEBUG_MSGF("Pointer size: %i", psize);
+    side->node_hashes = calloc(mmdb->metadata.node_count, sizeof(uint64_t));
+    if (NULL == side->node_hashes) {
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+    return grow_data_hashes(side);
+}
 
-        if (offset + psize > mmdb->data_section_size) {
-            DEBUG_MSGF("Pointer offset (%d) past data section (%d)", offset +
-                       psize,
-                       mmdb->data_section_size);
-            return MMDB_INVALID_DATA_ERROR;
+/* records and types hold the record from the old tree and then the one from
+ * the new tree for the network at diff->address with a prefix length of
+ * depth. */
+LOCAL int diff_records(diff_state_s *diff, const uint64_t *records,
+                       const uint8_t *types, uint16_t depth)
+{
+    uint64_t hashes[2];
+    for (int i = 0; i < 2; i++) {
+        int status = subtree_hash(&diff->sides[i], records[i], types[i],
+                                  depth, &hashes[i]);
+        if (MMDB_SUCCESS != status) {
+            return status;
         }
-        entry_data->pointer = get_ptr_from(ctrl, &mem[offset], psize);
-        DEBUG_MSGF("Pointer to: %i", entry_data->pointer);
+    }
+    if (hashes[0] == hashes[1]) {
+        return MMDB_SUCCESS;
+    }
 
-        entry_data->data_size = psize;
-        entry_data->offset_to_next = offset + psize;
+    if (MMDB_RECORD_TYPE_SEARCH_NODE != types[0]
+        && MMDB_RECORD_TYPE_SEARCH_NODE != types[1]) {
+        return report_difference(diff, records, types, depth);
+    }
+    if (is_diff_alias(diff, records, types, depth)) {
         return MMDB_SUCCESS;
     }
+    /* A subtree's hash may have been worked out where it was less deep, so
+     * subtree_hash() hasn't always checked this for us */
+    if (depth >= diff->sides[0].mmdb->depth) {
+        DEBUG_MSG("search tree is deeper than the address size");
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
 
-    uint32_t size = ctrl & 31;
-    switch (size) {
-    case 29:
-        if (offset + 1 > mmdb->data_section_size) {
-            DEBUG_MSGF("String end (%d, case 29) past data section (%d)",
-                       offset,
-                       mmdb->data_section_size);
-            return MMDB_INVALID_DATA_ERROR;
-        }
-        size = 29 + mem[offset++];
-        break;
-    case 30:
-        if (offset + 2 > mmdb->data_section_size) {
-            DEBUG_MSGF("String end (%d, case 30) past data section (%d)",
-                       offset,
-                       mmdb->data_section_size);
-            return MMDB_INVALID_DATA_ERROR;
+    uint64_t left[2], right[2];
+    uint8_t left_types[2], right_types[2];
+    for (int i = 0; i < 2; i++) {
+        if (MMDB_RECORD_TYPE_SEARCH_NODE != types[i]) {
+            left[i] = right[i] = records[i];
+            left_types[i] = right_types[i] = types[i];
+            continue;
         }
-        size = 285 + get_uint16(&mem[offset]);
-        offset += 2;
-        break;
-    case 31:
-        if (offset + 3 > mmdb->data_section_size) {
-            DEBUG_MSGF("String end (%d, case 31) past data section (%d)",
-                       offset,
-                       mmdb->data_section_size);
-            return MMDB_INVALID_DATA_ERROR;
+        int status = read_node_records(&diff->sides[i], (uint32_t)records[i],
+                                       &left[i], &right[i]);
+        if (MMDB_SUCCESS != status) {
+            return status;
         }
-        size = 65821 + get_uint24(&mem[offset]);
-        offset += 3;
-    default:
-        break;
+        left_types[i] = record_type(diff->sides[i].mmdb, left[i]);
+        right_types[i] = record_type(diff->sides[i].mmdb, right[i]);
     }
 
-    DEBUG_MSGF("Size: %i", size);
-
-    if (type == MMDB_DATA_TYPE_MAP || type == MMDB_DATA_TYPE_ARRAY) {
-        entry_data->data_size = size;
-        entry_data->offset_to_next = offset;
+    int status = diff_records(diff, left, left_types, depth + 1);
+    if (MMDB_SUCCESS != status || diff->stopped) {
+        return status;
+    }
+    diff->address[depth >> 3] |= 0x80 >> (depth & 7);
+    status = diff_records(diff, right, right_types, depth + 1);
+    diff->address[depth >> 3] &= ~(0x80 >> (depth & 7));
+    return status;
+}
+
+LOCAL int report_difference(diff_state_s *diff, const uint64_t *records,
+                            const uint8_t *types, uint16_t depth)
+{
+    MMDB_diff_s change = {
+        .change        = MMDB_RECORD_TYPE_EMPTY == types[0]
+                         ? MMDB_DIFF_ADDED
+                         : MMDB_RECORD_TYPE_EMPTY == types[1]
+                         ? MMDB_DIFF_REMOVED : MMDB_DIFF_CHANGED,
+        .prefix_length = depth
+    };
+    memcpy(change.address, diff->address, sizeof(change.address));
+
+    MMDB_entry_s *entries[2] = { &change.old_entry, &change.new_entry };
+    for (int i = 0; i < 2; i++) {
+        MMDB_s *mmdb = diff->sides[i].mmdb;
+        *entries[i] = (MMDB_entry_s) {
+            .mmdb   = mmdb,
+            .offset = MMDB_RECORD_TYPE_DATA == types[i]
+                      ? data_section_offset_for_record(mmdb, records[i]) : 0
+        };
+    }
+
+    if (MMDB_VISIT_STOP == diff->callback(diff->ctx, &change)) {
+        diff->stopped = true;
+    }
+    return MMDB_SUCCESS;
+}
+
+/* Unless the caller asked for them, we skip the aliases of the IPv4 subtree
+ * in either tree, the same way the network iterator does. */
+LOCAL bool is_diff_alias(diff_state_s *diff, const uint64_t *records,
+                         const uint8_t *types, uint16_t depth)
+{
+    if (diff->flags & MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES
+        || diff->sides[0].mmdb->metadata.ip_version != 6 || 0 == depth) {
+        return false;
+    }
+
+    bool is_alias = false;
+    for (int i = 0; i < 2; i++) {
+        is_alias |= MMDB_RECORD_TYPE_SEARCH_NODE == types[i]
+                    && records[i]
+                    == diff->sides[i].mmdb->ipv4_start_node.node_value;
+    }
+    if (!is_alias) {
+        return false;
+    }
+    for (int i = 0; i < 16; i++) {
+        if (diff->address[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+LOCAL int read_node_records(diff_side_s *side, uint32_t node, uint64_t *left,
+                            uint64_t *right)
+{
+    MMDB_s *mmdb = side->mmdb;
+    record_info_s record_info = side->record_info;
+    const uint8_t *record_pointer =
+        &mmdb->file_content[(uint64_t)node * record_info.record_length];
+    if (!(mmdb->flags & MMDB_VERIFIED)
+        && record_pointer + record_info.record_length > mmdb->data_section) {
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
+    *left = record_info.left_record_getter(record_pointer);
+    *right = record_info.right_record_getter(
+        record_pointer + record_info.right_record_offset);
+    return MMDB_SUCCESS;
+}
+
+LOCAL int subtree_hash(diff_side_s *side, uint64_t record, uint8_t type,
+                       uint16_t depth, uint64_t *hash)
+{
+    if (MMDB_RECORD_TYPE_EMPTY == type) {
+        *hash = EMPTY_RECORD_HASH;
         return MMDB_SUCCESS;
     }
+    if (MMDB_RECORD_TYPE_DATA == type) {
+        return data_record_hash(
+            side, data_section_offset_for_record(side->mmdb, record), hash);
+    }
+    if (MMDB_RECORD_TYPE_SEARCH_NODE != type) {
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
 
-    if (type == MMDB_DATA_TYPE_BOOLEAN) {
-        entry_data->boolean = size ? true : false;
-        entry_data->data_size = 0;
-        entry_data->offset_to_next = offset;
-        DEBUG_MSGF("boolean value: %s", entry_data->boolean ? "true" : "false");
+    if (side->node_hashes[record]) {
+        *hash = side->node_hashes[record];
+        return MMDB_SUCCESS;
+    }
+    if (depth >= side->mmdb->depth) {
+        DEBUG_MSG("search tree is deeper than the address size");
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
+
+    uint64_t left, right, left_hash, right_hash;
+    int status = read_node_records(side, (uint32_t)record, &left, &right);
+    if (MMDB_SUCCESS == status) {
+        status = subtree_hash(side, left, record_type(side->mmdb, left),
+                              depth + 1, &left_hash);
+    }
+    if (MMDB_SUCCESS == status) {
+        status = subtree_hash(side, right, record_type(side->mmdb, right),
+                              depth + 1, &right_hash);
+    }
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+
+    *hash = left_hash == right_hash
+            ? left_hash
+            : mmdb_hash_mix(mmdb_hash_mix(0x6a09e667f3bcc908ULL, left_hash),
+                            right_hash)
+                  | 1;
+    side->node_hashes[record] = *hash;
+    return MMDB_SUCCESS;
+}
+
+LOCAL int data_record_hash(diff_side_s *side, uint32_t offset,
+                           uint64_t *hash)
+{
+    uint32_t slot = row_slot(offset, side->data_mask);
+    while (side->data_offsets[slot]) {
+        if (side->data_offsets[slot] == offset + 1) {
+            *hash = side->data_hashes[slot];
+            return MMDB_SUCCESS;
+        }
+        slot = (slot + 1) & side->data_mask;
+    }
+
+    static const MMDB_visitor_s hash_visitor = {
+        .begin_map   = hash_begin_container,
+        .end_map     = hash_end_container,
+        .begin_array = hash_begin_container,
+        .end_array   = hash_end_container,
+        .key         = hash_key,
+        .scalar      = mmdb_hash_scalar,
+    };
+    MMDB_entry_s entry = { .mmdb = side->mmdb, .offset = offset };
+    *hash = 0xbb67ae8584caa73bULL;
+    int status = MMDB_walk_entry(&entry, &hash_visitor, hash);
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+    *hash |= 1;
+
+    side->data_offsets[slot] = offset + 1;
+    side->data_hashes[slot] = *hash;
+    if (++side->data_count * 2 > side->data_mask) {
+        return grow_data_hashes(side);
+    }
+    return MMDB_SUCCESS;
+}
+
+LOCAL int grow_data_hashes(diff_side_s *side)
+{
+    uint32_t slots = side->data_offsets ? (side->data_mask + 1) * 2 : 256;
+    uint32_t *offsets = calloc(slots, sizeof(uint32_t));
+    uint64_t *hashes = malloc(slots * sizeof(uint64_t));
+    if (NULL == offsets || NULL == hashes) {
+        free(offsets);
+        free(hashes);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    for (uint32_t i = 0; side->data_offsets && i <= side->data_mask; i++) {
+        if (side->data_offsets[i]) {
+            uint32_t slot = row_slot(side->data_offsets[i] - 1, slots - 1);
+            while (offsets[slot]) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            offsets[slot] = side->data_offsets[i];
+            hashes[slot] = side->data_hashes[i];
+        }
+    }
+
+    free(side->data_offsets);
+    free(side->data_hashes);
+    side->data_offsets = offsets;
+    side->data_hashes = hashes;
+    side->data_mask = slots - 1;
+    return MMDB_SUCCESS;
+}
+
+INTERNAL uint64_t mmdb_hash_mix(uint64_t hash, uint64_t value)
+{
+    hash ^= value;
+    hash *= 0x9e3779b97f4a7c15ULL;
+    return hash ^ (hash >> 29);
+}
+
+LOCAL uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t size)
+{
+    const uint8_t *p = bytes;
+    hash = mmdb_hash_mix(hash, size);
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        hash = mmdb_hash_mix(hash, word);
+    }
+    if (size > 0) {
+        uint64_t word = 0;
+        memcpy(&word, p, size);
+        hash = mmdb_hash_mix(hash, word);
+    }
+    return hash;
+}
+
+/* These hash the events from MMDB_walk_entry(). Maps and arrays are hashed
+ * with their sizes and where they end, so a value can't be confused with the
+ * same values nested differently. Map keys are hashed in the order they are
+ * stored in. */
+LOCAL int hash_begin_container(void *ctx, uint32_t size)
+{
+    uint64_t *hash = ctx;
+    *hash = mmdb_hash_mix(*hash, 0x100000000ULL | size);
+    return MMDB_VISIT_CONTINUE;
+}
+
+LOCAL int hash_end_container(void *ctx)
+{
+    uint64_t *hash = ctx;
+    *hash = mmdb_hash_mix(*hash, 0x200000000ULL);
+    return MMDB_VISIT_CONTINUE;
+}
+
+LOCAL int hash_key(void *ctx, const char *key, uint32_t key_size)
+{
+    uint64_t *hash = ctx;
+    *hash = hash_bytes(*hash, key, key_size);
+    return MMDB_VISIT_CONTINUE;
+}
+
+INTERNAL int mmdb_hash_scalar(void *ctx,
+                              const MMDB_entry_data_s *entry_data)
+{
+    uint64_t *hash = ctx;
+    *hash = mmdb_hash_mix(*hash, entry_data->type);
+    switch (entry_data->type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        *hash = hash_bytes(*hash, entry_data->utf8_string,
+                           entry_data->data_size);
+        break;
+    case MMDB_DATA_TYPE_BYTES:
+        *hash = hash_bytes(*hash, entry_data->bytes, entry_data->data_size);
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+        *hash = hash_bytes(*hash, &entry_data->double_value, sizeof(double));
+        break;
+    case MMDB_DATA_TYPE_FLOAT:
+        *hash = hash_bytes(*hash, &entry_data->float_value, sizeof(float));
+        break;
+    case MMDB_DATA_TYPE_UINT16:
+        *hash = mmdb_hash_mix(*hash, entry_data->uint16);
+        break;
+    case MMDB_DATA_TYPE_UINT32:
+        *hash = mmdb_hash_mix(*hash, entry_data->uint32);
+        break;
+    case MMDB_DATA_TYPE_INT32:
+        *hash = mmdb_hash_mix(*hash, (uint32_t)entry_data->int32);
+        break;
+    case MMDB_DATA_TYPE_UINT64:
+        *hash = mmdb_hash_mix(*hash, entry_data->uint64);
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+        *hash = hash_bytes(*hash, &entry_data->uint128,
+                           sizeof(entry_data->uint128));
+        break;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        *hash = mmdb_hash_mix(*hash, entry_data->boolean);
+        break;
+    }
+    return MMDB_VISIT_CONTINUE;
+}
+
+/* An IPv6 database usually has the IPv4 subtree under ::/96 linked in again
+ * under prefixes such as ::ffff:0:0/96 and 2002::/16. Unless the caller asked
+ * for these aliases, we skip any record pointing at the IPv4 start node that
+ * isn't the one under ::/96. */
+LOCAL bool is_ipv4_alias(MMDB_network_iterator_s *iterator, uint32_t record)
+{
+    MMDB_s *mmdb = iterator->mmdb;
+    if (mmdb->metadata.ip_version != 6
+        || iterator->flags & MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES
+        || record != mmdb->ipv4_start_node.node_value) {
+        return false;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        if (iterator->address[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* This clears every bit of the address from the last bit of the prefix on
+ * and then sets that last bit, which is what we want for a right record. The
+ * bits before it are left alone. */
+LOCAL void set_network_address_bits(uint8_t *address, uint16_t prefix_length,
+                                    uint16_t depth)
+{
+    uint16_t bit = prefix_length - 1;
+    address[bit >> 3] &= (uint8_t)(0xff00 >> (bit & 7));
+    address[bit >> 3] |= (uint8_t)(0x80 >> (bit & 7));
+    for (int i = (bit >> 3) + 1; i < depth / 8; i++) {
+        address[i] = 0;
+    }
+}
+
+LOCAL uint32_t data_section_offset_for_record(MMDB_s *const mmdb,
+                                              uint64_t record)
+{
+    return (uint32_t)record - mmdb->metadata.node_count -
+           MMDB_DATA_SECTION_SEPARATOR;
+}
+
+int MMDB_verify(MMDB_s *const mmdb)
+{
+    record_info_s record_info = record_info_for_database(mmdb);
+    if (0 == record_info.right_record_offset) {
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+    }
+
+    /* MMDB_open() works out the search tree size with 32-bit math, so we
+     * check it again here without the chance of an overflow. */
+    uint64_t search_tree_size =
+        (uint64_t)mmdb->metadata.node_count * record_info.record_length;
+    if (mmdb->file_size < 0
+        || search_tree_size + MMDB_DATA_SECTION_SEPARATOR
+        > (uint64_t)mmdb->file_size
+        || mmdb->data_section != mmdb->file_content + search_tree_size
+        + MMDB_DATA_SECTION_SEPARATOR) {
+        DEBUG_MSG("search tree is bigger than the file");
+        return MMDB_INVALID_METADATA_ERROR;
+    }
+
+    for (int i = 1; i <= MMDB_DATA_SECTION_SEPARATOR; i++) {
+        if (mmdb->data_section[-i]) {
+            DEBUG_MSG("data section separator is not all zeros");
+            return MMDB_INVALID_DATA_ERROR;
+        }
+    }
+
+    /* This has a bit for each offset in the data section. A bit is set once
+     * we have started verifying the value at that offset, so that data that
+     * many records or pointers share is only verified once. */
+    uint8_t *verified = calloc(mmdb->data_section_size / 8 + 1, 1);
+    if (NULL == verified) {
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    int status = MMDB_SUCCESS;
+    const uint8_t *search_tree = mmdb->file_content;
+    for (uint32_t node = 0;
+         node < mmdb->metadata.node_count && MMDB_SUCCESS == status; node++) {
+        const uint8_t *record_pointer =
+            &search_tree[(uint64_t)node * record_info.record_length];
+        status = verify_record(mmdb,
+                               record_info.left_record_getter(record_pointer),
+                               verified);
+        if (MMDB_SUCCESS == status) {
+            record_pointer += record_info.right_record_offset;
+            status = verify_record(
+                mmdb, record_info.right_record_getter(record_pointer),
+                verified);
+        }
+    }
+
+    free(verified);
+
+    if (MMDB_SUCCESS == status) {
+        mmdb->flags |= MMDB_VERIFIED;
+    }
+    return status;
+}
+
+LOCAL int verify_record(MMDB_s *mmdb, uint64_t record, uint8_t *verified)
+{
+    uint32_t node_count = mmdb->metadata.node_count;
+
+    /* This is the same as the check in record_type() */
+    if (0 == record) {
+        DEBUG_MSG("record has a value of 0");
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
+    if (record <= node_count) {
+        return MMDB_SUCCESS;
+    }
+
+    /* record_type() doesn't allow for the separator, so it lets through
+     * records that point before the start of the data section or up to 16
+     * bytes past its end */
+    if (record - node_count < MMDB_DATA_SECTION_SEPARATOR
+        || record - node_count - MMDB_DATA_SECTION_SEPARATOR
+        >= mmdb->data_section_size) {
+        DEBUG_MSG("record has a value that points outside of the database");
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
+
+    uint32_t offset = data_section_offset_for_record(mmdb, record);
+    if (mark_verified(verified, offset)) {
+        return MMDB_SUCCESS;
+    }
+
+    uint32_t offset_to_next;
+    return verify_data(mmdb, offset, verified, 0, &offset_to_next);
+}
+
+/* This decodes the value at offset and everything inside it, following
+ * pointers, with all of the usual checks. Once this has succeeded for every
+ * record in the search tree, every offset that the library can be asked to
+ * decode has been decoded successfully at least once. */
+LOCAL int verify_data(MMDB_s *mmdb, uint32_t offset, uint8_t *verified,
+                      int depth, uint32_t *offset_to_next)
+{
+    if (depth >= MAXIMUM_DATA_STRUCTURE_DEPTH) {
+        DEBUG_MSG("reached the maximum data structure depth");
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    MMDB_entry_data_s entry_data;
+    CHECKED_DECODE_ONE(mmdb, offset, &entry_data);
+    *offset_to_next = entry_data.offset_to_next;
+
+    uint32_t next = entry_data.offset_to_next;
+    int status;
+    switch (entry_data.type) {
+    case MMDB_DATA_TYPE_POINTER:
+        offset = entry_data.pointer;
+        CHECKED_DECODE_ONE(mmdb, offset, &entry_data);
+        if (MMDB_DATA_TYPE_POINTER == entry_data.type) {
+            DEBUG_MSG("pointer points to another pointer");
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        if (mark_verified(verified, offset)) {
+            return MMDB_SUCCESS;
+        }
+        return verify_data(mmdb, offset, verified, depth + 1, &next);
+    case MMDB_DATA_TYPE_MAP:
+        for (uint32_t i = 0; i < entry_data.data_size; i++) {
+            MMDB_entry_data_s key;
+            CHECKED_DECODE_ONE_FOLLOW(mmdb, next, &key);
+            if (MMDB_DATA_TYPE_UTF8_STRING != key.type) {
+                DEBUG_MSGF("map key has type %d", key.type);
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            status = verify_data(mmdb, key.offset_to_next, verified,
+                                 depth + 1, &next);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+        }
+        *offset_to_next = next;
+        return MMDB_SUCCESS;
+    case MMDB_DATA_TYPE_ARRAY:
+        for (uint32_t i = 0; i < entry_data.data_size; i++) {
+            status = verify_data(mmdb, next, verified, depth + 1, &next);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+        }
+        *offset_to_next = next;
+        return MMDB_SUCCESS;
+    case MMDB_DATA_TYPE_UTF8_STRING:
+    case MMDB_DATA_TYPE_DOUBLE:
+    case MMDB_DATA_TYPE_BYTES:
+    case MMDB_DATA_TYPE_UINT16:
+    case MMDB_DATA_TYPE_UINT32:
+    case MMDB_DATA_TYPE_INT32:
+    case MMDB_DATA_TYPE_UINT64:
+    case MMDB_DATA_TYPE_UINT128:
+    case MMDB_DATA_TYPE_BOOLEAN:
+    case MMDB_DATA_TYPE_FLOAT:
         return MMDB_SUCCESS;
+    default:
+        DEBUG_MSGF("unknown data type %d", entry_data.type);
+        return MMDB_INVALID_DATA_ERROR;
+    }
+}
+
+/* This marks an offset as verified and returns whether it already was */
+LOCAL bool mark_verified(uint8_t *verified, uint32_t offset)
+{
+    uint8_t bit = (uint8_t)(1U << (offset & 7));
+    bool was_verified = verified[offset >> 3] & bit;
+    verified[offset >> 3] |= bit;
+    return was_verified;
+}
+
+int MMDB_get_stats(MMDB_s *const mmdb, MMDB_stats_s *const stats)
+{
+    memset(stats, 0, sizeof(MMDB_stats_s));
+
+    record_info_s record_info = record_info_for_database(mmdb);
+    if (0 == record_info.right_record_offset) {
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+    }
+
+    /* data_section_size runs to the end of the file, so it includes the
+     * metadata and the marker before it */
+    stats->data_size = (uint32_t)(mmdb->metadata_section - mmdb->data_section)
+                       - (uint32_t)(sizeof(METADATA_MARKER) - 1);
+
+    int status = count_tree_stats(mmdb, stats);
+    if (MMDB_SUCCESS == status) {
+        status = count_data_stats(mmdb, stats);
+    }
+    return status;
+}
+
+/* This walks every path through the search tree in the same way as
+ * MMDB_network_iterator_next(), so a subtree that more than one record
+ * points to has its networks counted under each of them. Its nodes are only
+ * counted once, at the shallowest depth that they are seen at. */
+LOCAL int count_tree_stats(MMDB_s *mmdb, MMDB_stats_s *stats)
+{
+    record_info_s record_info = record_info_for_database(mmdb);
+    bool verified = mmdb->flags & MMDB_VERIFIED;
+
+    /* Any record pointing at the IPv4 start node other than the one at the
+     * end of the first 96 left records is an alias */
+    uint32_t ipv4_start_node = 0;
+    if (6 == mmdb->metadata.ip_version) {
+        int status = find_ipv4_start_node(mmdb);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+        if (96 == mmdb->ipv4_start_node.netmask) {
+            ipv4_start_node = mmdb->ipv4_start_node.node_value;
+        }
     }
 
-    // check that the data doesn't extend past the end of the memory
-    // buffer
-    if (offset + size > mmdb->data_section_size) {
-        DEBUG_MSGF("Data end (%d) past data section (%d)", offset + size,
-                   mmdb->data_section_size);
-        return MMDB_INVALID_DATA_ERROR;
-    }
+    uint8_t *node_depths = malloc((size_t)mmdb->metadata.node_count + 1);
+    if (NULL == node_depths) {
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+    memset(node_depths, 0xff, (size_t)mmdb->metadata.node_count + 1);
+
+    MMDB_network_iterator_node_s stack[MMDB_STATS_MAX_DEPTH + 1];
+    int stack_size = 0;
+    stack[stack_size++] = (MMDB_network_iterator_node_s) {
+        .record        = 0,
+        .prefix_length = 0
+    };
+    int status = MMDB_SUCCESS;
+    while (stack_size > 0 && MMDB_SUCCESS == status) {
+        MMDB_network_iterator_node_s next = stack[--stack_size];
+        uint32_t record = next.record;
+        uint16_t depth = next.prefix_length;
+        /* Only the records reached from the root without popping anything
+         * are on the path of left records to the IPv4 start node */
+        bool on_ipv4_path = 0 == depth;
+
+        uint8_t type = 0 == depth
+                       ? MMDB_RECORD_TYPE_SEARCH_NODE
+                       : record_type(mmdb, record);
+        while (MMDB_RECORD_TYPE_SEARCH_NODE == type) {
+            if (0 != ipv4_start_node && record == ipv4_start_node
+                && !on_ipv4_path) {
+                break;
+            }
+            if (depth >= mmdb->depth) {
+                DEBUG_MSG("search tree is deeper than the address size");
+                status = MMDB_CORRUPT_SEARCH_TREE_ERROR;
+                break;
+            }
+
+            const uint8_t *record_pointer =
+                &mmdb->file_content[(uint64_t)record
+                                    * record_info.record_length];
+            if (!verified && record_pointer + record_info.record_length
+                > mmdb->data_section) {
+                status = MMDB_CORRUPT_SEARCH_TREE_ERROR;
+                break;
+            }
+            if (node_depths[record] > depth) {
+                node_depths[record] = (uint8_t)depth;
+            }
+
+            depth++;
+            stack[stack_size++] = (MMDB_network_iterator_node_s) {
+                .record        = record_info.right_record_getter(
+                    record_pointer + record_info.right_record_offset),
+                .prefix_length = depth
+            };
+            record = record_info.left_record_getter(record_pointer);
+            type = record_type(mmdb, record);
+        }
+
+        if (MMDB_RECORD_TYPE_INVALID == type) {
+            status = MMDB_CORRUPT_SEARCH_TREE_ERROR;
+        } else if (MMDB_RECORD_TYPE_DATA == type) {
+            stats->data_networks_by_depth[depth]++;
+        } else if (MMDB_RECORD_TYPE_EMPTY == type) {
+            stats->empty_networks_by_depth[depth]++;
+        }
+    }
+
+    for (uint32_t node = 0;
+         node < mmdb->metadata.node_count && MMDB_SUCCESS == status; node++) {
+        if (0xff != node_depths[node]) {
+            stats->node_count++;
+            stats->nodes_by_depth[node_depths[node]]++;
+        }
+    }
+
+    free(node_depths);
+    return status;
+}
+
+LOCAL int count_data_stats(MMDB_s *mmdb, MMDB_stats_s *stats)
+{
+    stats_walk_s walk = { .mmdb = mmdb, .stats = stats };
+
+    uint8_t *is_record = calloc(mmdb->data_section_size / 8 + 1, 1);
+    walk.counted = calloc(mmdb->data_section_size / 8 + 1, 1);
+    int status = NULL == is_record || NULL == walk.counted
+                 ? MMDB_OUT_OF_MEMORY_ERROR
+                 : grow_target_sizes(&walk);
+    if (MMDB_SUCCESS == status) {
+        status = find_data_records(mmdb, is_record, &stats->record_count);
+    }
+
+    for (uint32_t i = 0;
+         i <= mmdb->data_section_size / 8 && MMDB_SUCCESS == status; i++) {
+        for (int bit = 0; is_record[i] >> bit && MMDB_SUCCESS == status;
+             bit++) {
+            if (!(is_record[i] & (1U << bit))) {
+                continue;
+            }
+
+            uint32_t offset_to_next;
+            uint64_t size;
+            status = count_value_stats(&walk, i * 8 + bit, 0, true,
+                                       &offset_to_next, &size);
+            if (MMDB_SUCCESS == status) {
+                stats->expanded_data_size += size;
+                int bucket = 0;
+                while (bucket < MMDB_STATS_SIZE_BUCKETS - 1
+                       && size >> (bucket + 1)) {
+                    bucket++;
+                }
+                stats->record_sizes[bucket]++;
+            }
+        }
+    }
+
+    free(is_record);
+    free(walk.counted);
+    free(walk.target_offsets);
+    free(walk.target_sizes);
+    return status;
+}
+
+/* This counts the value at offset and everything inside it, unless count is
+ * false or the value has been counted before, and works out its expanded
+ * size. A value that has been counted has had everything inside it counted
+ * too, so we only need to walk it again for its size and its end. */
+LOCAL int count_value_stats(stats_walk_s *walk, uint32_t offset, int depth,
+                            bool count, uint32_t *offset_to_next,
+                            uint64_t *expanded_size)
+{
+    if (depth >= MAXIMUM_DATA_STRUCTURE_DEPTH) {
+        DEBUG_MSG("reached the maximum data structure depth");
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    if (count && mark_verified(walk->counted, offset)) {
+        count = false;
+    }
+
+    MMDB_entry_data_s entry_data;
+    CHECKED_DECODE_ONE(walk->mmdb, offset, &entry_data);
+    uint32_t next = entry_data.offset_to_next;
+    if (entry_data.type >= MMDB_STATS_DATA_TYPES) {
+        DEBUG_MSGF("unknown data type %d", entry_data.type);
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    if (count) {
+        walk->stats->type_counts[entry_data.type]++;
+        walk->stats->type_bytes[entry_data.type] += next - offset;
+        walk->stats->used_data_size += next - offset;
+    }
+
+    *offset_to_next = next;
+    if (MMDB_DATA_TYPE_POINTER == entry_data.type) {
+        return pointer_target_size(walk, entry_data.pointer, depth + 1,
+                                   expanded_size);
+    }
+
+    *expanded_size = next - offset;
+    if (MMDB_DATA_TYPE_MAP != entry_data.type
+        && MMDB_DATA_TYPE_ARRAY != entry_data.type) {
+        return MMDB_SUCCESS;
+    }
+
+    /* A map has a key and a value for each entry */
+    uint32_t values = MMDB_DATA_TYPE_MAP == entry_data.type
+                      ? entry_data.data_size * 2 : entry_data.data_size;
+    for (uint32_t i = 0; i < values; i++) {
+        uint64_t size;
+        int status = count_value_stats(walk, next, depth + 1, count, &next,
+                                       &size);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+        *expanded_size += size;
+    }
+    *offset_to_next = next;
+    return MMDB_SUCCESS;
+}
+
+LOCAL int pointer_target_size(stats_walk_s *walk, uint32_t offset, int depth,
+                              uint64_t *expanded_size)
+{
+    uint32_t slot = row_slot(offset, walk->target_mask);
+    while (walk->target_offsets[slot]) {
+        if (walk->target_offsets[slot] == offset + 1) {
+            *expanded_size = walk->target_sizes[slot];
+            return MMDB_SUCCESS;
+        }
+        slot = (slot + 1) & walk->target_mask;
+    }
+
+    MMDB_entry_data_s entry_data;
+    CHECKED_DECODE_ONE(walk->mmdb, offset, &entry_data);
+    if (MMDB_DATA_TYPE_POINTER == entry_data.type) {
+        DEBUG_MSG("pointer points to another pointer");
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    uint32_t offset_to_next;
+    int status = count_value_stats(walk, offset, depth, true,
+                                   &offset_to_next, expanded_size);
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+
+    /* The walk can have grown the table, so we find the slot again */
+    slot = row_slot(offset, walk->target_mask);
+    while (walk->target_offsets[slot]) {
+        slot = (slot + 1) & walk->target_mask;
+    }
+    walk->target_offsets[slot] = offset + 1;
+    walk->target_sizes[slot] = *expanded_size;
+    if (++walk->stats->pointer_target_count * 2 > walk->target_mask) {
+        return grow_target_sizes(walk);
+    }
+    return MMDB_SUCCESS;
+}
+
+LOCAL int grow_target_sizes(stats_walk_s *walk)
+{
+    uint32_t slots = walk->target_offsets ? (walk->target_mask + 1) * 2 : 256;
+    uint32_t *offsets = calloc(slots, sizeof(uint32_t));
+    uint64_t *sizes = malloc(slots * sizeof(uint64_t));
+    if (NULL == offsets || NULL == sizes) {
+        free(offsets);
+        free(sizes);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    for (uint32_t i = 0; walk->target_offsets && i <= walk->target_mask;
+         i++) {
+        if (walk->target_offsets[i]) {
+            uint32_t slot = row_slot(walk->target_offsets[i] - 1, slots - 1);
+            while (offsets[slot]) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            offsets[slot] = walk->target_offsets[i];
+            sizes[slot] = walk->target_sizes[i];
+        }
+    }
+
+    free(walk->target_offsets);
+    free(walk->target_sizes);
+    walk->target_offsets = offsets;
+    walk->target_sizes = sizes;
+    walk->target_mask = slots - 1;
+    return MMDB_SUCCESS;
+}
+
+int MMDB_build_projection(MMDB_s *const mmdb,
+                          const char *const *const *const paths,
+                          uint32_t path_count,
+                          MMDB_projection_s *const projection)
+{
+    memset(projection, 0, sizeof(MMDB_projection_s));
+    projection->mmdb = mmdb;
+    projection->path_count = path_count;
+
+    int status = index_data_records(mmdb, &projection->record_count,
+                                    &projection->offsets,
+                                    &projection->rows_by_offset,
+                                    &projection->rows_by_offset_mask);
+    if (MMDB_SUCCESS == status) {
+        status = allocate_projection(projection);
+    }
+    if (MMDB_SUCCESS == status) {
+        status = fill_projection(projection, paths);
+    }
+
+    if (MMDB_SUCCESS != status) {
+        MMDB_free_projection(projection);
+    }
+    return status;
+}
+
+/* This finds every distinct record that the search tree points to. It
+ * allocates and fills in the offsets of the records in ascending order and
+ * a hash table that maps each offset to its index in offsets, which
+ * find_row() uses. */
+LOCAL int index_data_records(MMDB_s *mmdb, uint32_t *record_count,
+                             uint32_t **offsets, uint32_t **rows_by_offset,
+                             uint32_t *rows_by_offset_mask)
+{
+    /* This has a bit for each offset in the data section that a search tree
+     * record points to. Scanning it in order gives us the records sorted by
+     * offset with no duplicates. */
+    uint8_t *is_record = calloc(mmdb->data_section_size / 8 + 1, 1);
+    if (NULL == is_record) {
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    int status = find_data_records(mmdb, is_record, record_count);
+    if (MMDB_SUCCESS != status) {
+        free(is_record);
+        return status;
+    }
+
+    /* The offset to row table is kept at most half full so that probes stay
+     * short. */
+    uint32_t slots = 2;
+    while (slots < (uint64_t)*record_count * 2) {
+        slots *= 2;
+    }
+    *rows_by_offset_mask = slots - 1;
+
+    *offsets = malloc(*record_count * sizeof(uint32_t) + 1);
+    *rows_by_offset = calloc(slots, sizeof(uint32_t));
+    if (NULL == *offsets || NULL == *rows_by_offset) {
+        free(is_record);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    uint32_t row = 0;
+    for (uint32_t i = 0; i <= mmdb->data_section_size / 8; i++) {
+        for (int bit = 0; is_record[i] >> bit; bit++) {
+            if (is_record[i] & (1U << bit)) {
+                (*offsets)[row] = i * 8 + bit;
+                add_row(*rows_by_offset, *rows_by_offset_mask, i * 8 + bit,
+                        row++);
+            }
+        }
+    }
+
+    free(is_record);
+    return MMDB_SUCCESS;
+}
+
+LOCAL int find_data_records(MMDB_s *mmdb, uint8_t *is_record,
+                            uint32_t *record_count)
+{
+    record_info_s record_info = record_info_for_database(mmdb);
+    if (0 == record_info.right_record_offset) {
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+    }
+
+    *record_count = 0;
+    const uint8_t *search_tree = mmdb->file_content;
+    for (uint32_t node = 0; node < mmdb->metadata.node_count; node++) {
+        const uint8_t *record_pointer =
+            &search_tree[(uint64_t)node * record_info.record_length];
+        int status = mark_data_record(
+            mmdb, record_info.left_record_getter(record_pointer), is_record,
+            record_count);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+        record_pointer += record_info.right_record_offset;
+        status = mark_data_record(
+            mmdb, record_info.right_record_getter(record_pointer), is_record,
+            record_count);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+    }
+
+    return MMDB_SUCCESS;
+}
+
+LOCAL int mark_data_record(MMDB_s *mmdb, uint64_t record, uint8_t *is_record,
+                           uint32_t *record_count)
+{
+    uint8_t type = record_type(mmdb, record);
+    if (MMDB_RECORD_TYPE_INVALID == type) {
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
+    if (MMDB_RECORD_TYPE_DATA != type) {
+        return MMDB_SUCCESS;
+    }
+
+    /* record_type() lets through records up to 16 bytes past the end of the
+     * data section, which would be past the end of is_record */
+    uint32_t offset = data_section_offset_for_record(mmdb, record);
+    if (offset >= mmdb->data_section_size) {
+        DEBUG_MSG("record has a value that points outside of the database");
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+    }
+
+    if (!mark_verified(is_record, offset)) {
+        (*record_count)++;
+    }
+    return MMDB_SUCCESS;
+}
+
+LOCAL void add_row(uint32_t *rows_by_offset, uint32_t mask, uint32_t offset,
+                   uint32_t row)
+{
+    uint32_t slot = row_slot(offset, mask);
+    while (rows_by_offset[slot]) {
+        slot = (slot + 1) & mask;
+    }
+    rows_by_offset[slot] = row + 1;
+}
+
+LOCAL int find_row(const uint32_t *offsets, const uint32_t *rows_by_offset,
+                   uint32_t mask, uint32_t offset, uint32_t *row)
+{
+    uint32_t slot = row_slot(offset, mask);
+    uint32_t found;
+    while (0 != (found = rows_by_offset[slot])) {
+        if (offsets[found - 1] == offset) {
+            *row = found - 1;
+            return MMDB_SUCCESS;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    /* The entry wasn't found by a lookup in this database */
+    return MMDB_INVALID_DATA_ERROR;
+}
+
+LOCAL uint32_t row_slot(uint32_t offset, uint32_t mask)
+{
+    return (uint32_t)(offset * 2654435761U) & mask;
+}
+
+LOCAL int allocate_projection(MMDB_projection_s *projection)
+{
+    uint32_t record_count = projection->record_count;
+
+    projection->value_offsets =
+        calloc(projection->path_count + 1, sizeof(uint32_t *));
+    if (NULL == projection->value_offsets) {
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+    projection->memory_size =
+        record_count * sizeof(uint32_t)
+        + (projection->rows_by_offset_mask + (size_t)1) * sizeof(uint32_t)
+        + projection->path_count * sizeof(uint32_t *);
+
+    for (uint32_t i = 0; i < projection->path_count; i++) {
+        projection->value_offsets[i] =
+            malloc(record_count * sizeof(uint32_t) + 1);
+        if (NULL == projection->value_offsets[i]) {
+            return MMDB_OUT_OF_MEMORY_ERROR;
+        }
+        projection->memory_size += record_count * sizeof(uint32_t);
+    }
+
+    return MMDB_SUCCESS;
+}
+
+/* Only the offset of each value is stored, so a cell takes four bytes
+ * rather than a whole MMDB_entry_data_s. MMDB_get_projection_value() decodes
+ * the one value at that offset, which is much less work than following the
+ * path again. A path that doesn't match a record isn't an error. It leaves
+ * UINT32_MAX in the cell instead. */
+LOCAL int fill_projection(MMDB_projection_s *projection,
+                          const char *const *const *const paths)
+{
+    MMDB_entry_s entry = { .mmdb = projection->mmdb };
+    for (uint32_t row = 0; row < projection->record_count; row++) {
+        entry.offset = projection->offsets[row];
+        for (uint32_t i = 0; i < projection->path_count; i++) {
+            uint32_t *value_offset = &projection->value_offsets[i][row];
+            int status = find_value_offset(&entry, paths[i], value_offset);
+            if (MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR == status) {
+                *value_offset = UINT32_MAX;
+            } else if (MMDB_SUCCESS != status) {
+                return status;
+            }
+        }
+    }
+
+    return MMDB_SUCCESS;
+}
+
+/* This follows the path the same way MMDB_aget_value() does, but stops at
+ * the offset of the value rather than decoding it. The offset is the one
+ * before any pointer is followed, so decoding it with decode_one_follow()
+ * gives exactly what MMDB_aget_value() would. */
+LOCAL int find_value_offset(MMDB_entry_s *entry,
+                            const char *const *const path,
+                            uint32_t *value_offset)
+{
+    MMDB_s *mmdb = entry->mmdb;
+    MMDB_entry_data_s entry_data;
+
+    *value_offset = entry->offset;
+    for (int i = 0; NULL != path[i]; i++) {
+        CHECKED_DECODE_ONE_FOLLOW(mmdb, *value_offset, &entry_data);
+        int status = lookup_path(path[i], mmdb, &entry_data, value_offset);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+    }
+
+    return MMDB_SUCCESS;
+}
+
+int MMDB_get_projection_row(const MMDB_projection_s *const projection,
+                            const MMDB_entry_s *const entry,
+                            uint32_t *const row)
+{
+    if (entry->mmdb != projection->mmdb) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    return find_row(projection->offsets, projection->rows_by_offset,
+                    projection->rows_by_offset_mask, entry->offset, row);
+}
+
+int MMDB_get_projection_value(const MMDB_projection_s *const projection,
+                              uint32_t row, uint32_t path_index,
+                              MMDB_entry_data_s *const entry_data)
+{
+    memset(entry_data, 0, sizeof(MMDB_entry_data_s));
+    if (row >= projection->record_count
+        || path_index >= projection->path_count) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    uint32_t offset = projection->value_offsets[path_index][row];
+    if (UINT32_MAX == offset) {
+        return MMDB_SUCCESS;
+    }
+    return decode_one_follow(projection->mmdb, offset, entry_data);
+}
+
+void MMDB_free_projection(MMDB_projection_s *const projection)
+{
+    if (NULL != projection->value_offsets) {
+        for (uint32_t i = 0; i < projection->path_count; i++) {
+            free(projection->value_offsets[i]);
+        }
+    }
+    free(projection->value_offsets);
+    free(projection->offsets);
+    free(projection->rows_by_offset);
+    memset(projection, 0, sizeof(MMDB_projection_s));
+}
+
+int MMDB_export_column(MMDB_s *const mmdb, const char *const *const path,
+                       uint32_t type, MMDB_column_s *const column)
+{
+    memset(column, 0, sizeof(MMDB_column_s));
+    column->mmdb = mmdb;
+    column->type = type;
+
+    size_t value_size = column_value_size(type);
+    if (0 == value_size) {
+        return MMDB_TYPE_MISMATCH_ERROR;
+    }
+
+    int status = index_data_records(mmdb, &column->record_count,
+                                    &column->offsets, &column->rows_by_offset,
+                                    &column->rows_by_offset_mask);
+    if (MMDB_SUCCESS == status) {
+        uint32_t record_count = column->record_count;
+        bool has_sizes = MMDB_DATA_TYPE_UTF8_STRING == type
+                         || MMDB_DATA_TYPE_BYTES == type;
+        column->has_data = calloc(record_count + 1, sizeof(bool));
+        column->values.any = calloc(record_count + 1, value_size);
+        column->sizes =
+            has_sizes ? calloc(record_count + 1, sizeof(uint32_t)) : NULL;
+        if (NULL == column->has_data || NULL == column->values.any
+            || (has_sizes && NULL == column->sizes)) {
+            status = MMDB_OUT_OF_MEMORY_ERROR;
+        }
+        column->memory_size =
+            record_count * (sizeof(uint32_t) + sizeof(bool) + value_size
+                            + (has_sizes ? sizeof(uint32_t) : 0))
+            + (column->rows_by_offset_mask + (size_t)1) * sizeof(uint32_t);
+    }
+    if (MMDB_SUCCESS == status) {
+        status = fill_column(column, path);
+    }
+
+    if (MMDB_SUCCESS != status) {
+        MMDB_free_column(column);
+    }
+    return status;
+}
+
+/* This is the size of one value in a column of the given type, or 0 for the
+ * types that a column can't hold */
+LOCAL size_t column_value_size(uint32_t type)
+{
+    switch (type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        return sizeof(const char *);
+    case MMDB_DATA_TYPE_BYTES:
+        return sizeof(const uint8_t *);
+    case MMDB_DATA_TYPE_UINT16:
+        return sizeof(uint16_t);
+    case MMDB_DATA_TYPE_UINT32:
+        return sizeof(uint32_t);
+    case MMDB_DATA_TYPE_INT32:
+        return sizeof(int32_t);
+    case MMDB_DATA_TYPE_UINT64:
+        return sizeof(uint64_t);
+    case MMDB_DATA_TYPE_DOUBLE:
+        return sizeof(double);
+    case MMDB_DATA_TYPE_FLOAT:
+        return sizeof(float);
+    case MMDB_DATA_TYPE_BOOLEAN:
+        return sizeof(bool);
+    default:
+        return 0;
+    }
+}
+
+/* This decodes the value at the path in each record with get_scalar(), the
+ * same way the typed getters do. A record without the path, or with a value
+ * of another type there, is left with has_data set to false and a zero
+ * value, so one odd record doesn't lose the column for all the others. */
+LOCAL int fill_column(MMDB_column_s *column, const char *const *const path)
+{
+    MMDB_entry_s entry = { .mmdb = column->mmdb };
+    for (uint32_t row = 0; row < column->record_count; row++) {
+        entry.offset = column->offsets[row];
+        const uint8_t *payload;
+        uint32_t size;
+        int status = get_scalar(&entry, path, column->type, &payload, &size);
+        if (MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR == status
+            || MMDB_TYPE_MISMATCH_ERROR == status) {
+            continue;
+        }
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+
+        switch (column->type) {
+        case MMDB_DATA_TYPE_UTF8_STRING:
+            column->values.utf8_string[row] =
+                0 == size ? "" : (const char *)payload;
+            column->sizes[row] = size;
+            break;
+        case MMDB_DATA_TYPE_BYTES:
+            column->values.bytes[row] = payload;
+            column->sizes[row] = size;
+            break;
+        case MMDB_DATA_TYPE_UINT16:
+            if (size > 2) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            column->values.uint16[row] = (uint16_t)get_uintX(payload, size);
+            break;
+        case MMDB_DATA_TYPE_UINT32:
+            if (size > 4) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            column->values.uint32[row] = (uint32_t)get_uintX(payload, size);
+            break;
+        case MMDB_DATA_TYPE_INT32:
+            if (size > 4) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            column->values.int32[row] = get_sintX(payload, size);
+            break;
+        case MMDB_DATA_TYPE_UINT64:
+            if (size > 8) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            column->values.uint64[row] = get_uintX(payload, size);
+            break;
+        case MMDB_DATA_TYPE_DOUBLE:
+            if (size != 8) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            column->values.double_value[row] = get_ieee754_double(payload);
+            break;
+        case MMDB_DATA_TYPE_FLOAT:
+            if (size != 4) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            column->values.float_value[row] = get_ieee754_float(payload);
+            break;
+        case MMDB_DATA_TYPE_BOOLEAN:
+            column->values.boolean[row] = size ? true : false;
+            break;
+        }
+        column->has_data[row] = true;
+    }
+
+    return MMDB_SUCCESS;
+}
+
+int MMDB_get_column_row(const MMDB_column_s *const column,
+                        const MMDB_entry_s *const entry, uint32_t *const row)
+{
+    if (entry->mmdb != column->mmdb) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    return find_row(column->offsets, column->rows_by_offset,
+                    column->rows_by_offset_mask, entry->offset, row);
+}
+
+void MMDB_free_column(MMDB_column_s *const column)
+{
+    free(column->offsets);
+    free(column->has_data);
+    free(column->values.any);
+    free(column->sizes);
+    free(column->rows_by_offset);
+    memset(column, 0, sizeof(MMDB_column_s));
+}
+
+int MMDB_get_value(MMDB_entry_s *const start,
+                   MMDB_entry_data_s *const entry_data,
+                   ...)
+{
+    va_list path;
+    va_start(path, entry_data);
+    int status = MMDB_vget_value(start, entry_data, path);
+    va_end(path);
+    return status;
+}
+
+int MMDB_vget_value(MMDB_entry_s *const start,
+                    MMDB_entry_data_s *const entry_data,
+                    va_list va_path)
+{
+    int length = path_length(va_path);
+    const char *path_elem;
+    int i = 0;
+
+    MAYBE_CHECK_SIZE_OVERFLOW(length, SIZE_MAX / sizeof(const char *) - 1,
+                              MMDB_INVALID_METADATA_ERROR);
+
+    const char **path = malloc((length + 1) * sizeof(const char *));
+    if (NULL == path) {
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    while (NULL != (path_elem = va_arg(va_path, char *))) {
+        path[i] = path_elem;
+        i++;
+    }
+    path[i] = NULL;
+
+    int status = MMDB_aget_value(start, entry_data, path);
+
+    free((char **)path);
+
+    return status;
+}
+
+LOCAL int path_length(va_list va_path)
+{
+    int i = 0;
+    const char *ignore;
+    va_list path_copy;
+    va_copy(path_copy, va_path);
+
+    while (NULL != (ignore = va_arg(path_copy, char *))) {
+        i++;
+    }
+
+    va_end(path_copy);
+
+    return i;
+}
+
+int MMDB_aget_value(MMDB_entry_s *const start,
+                    MMDB_entry_data_s *const entry_data,
+                    const char *const *const path)
+{
+    MMDB_s *mmdb = start->mmdb;
+    uint32_t offset = start->offset;
+
+    memset(entry_data, 0, sizeof(MMDB_entry_data_s));
+    DEBUG_NL;
+    DEBUG_MSG("looking up value by path");
+
+    /* The decoder for a verified database doesn't check offsets, so we
+     * check the one offset that comes from the caller. */
+    if (offset >= mmdb->data_section_size) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, entry_data);
+
+    DEBUG_NL;
+    DEBUG_MSGF("top level element is a %s", type_num_to_name(entry_data->type));
+
+    /* Can this happen? It'd probably represent a pathological case under
+     * normal use, but there's nothing preventing someone from passing an
+     * invalid MMDB_entry_s struct to this function */
+    if (!entry_data->has_data) {
+        return MMDB_INVALID_LOOKUP_PATH_ERROR;
+    }
+
+    const char *path_elem;
+    int i = 0;
+    while (NULL != (path_elem = path[i++])) {
+        DEBUG_NL;
+        DEBUG_MSGF("path elem = %s", path_elem);
+
+        uint32_t value_offset;
+        int status = lookup_path(path_elem, mmdb, entry_data, &value_offset);
+        if (MMDB_SUCCESS == status) {
+            status = decode_one_follow(mmdb, value_offset, entry_data);
+        }
+        if (MMDB_SUCCESS != status) {
+            memset(entry_data, 0, sizeof(MMDB_entry_data_s));
+            return status;
+        }
+    }
+
+    return MMDB_SUCCESS;
+}
+
+/* This finds the offset of the value for one path element in the map or
+ * array in entry_data. The value isn't decoded, so it may be a pointer. */
+LOCAL int lookup_path(const char *path_elem, MMDB_s *mmdb,
+                      MMDB_entry_data_s *entry_data, uint32_t *value_offset)
+{
+    /* XXX - it'd be good to find a quicker way to skip through these
+       entries that doesn't involve decoding them
+       completely. Basically we need to just use the size from the
+       control byte to advance our pointer rather than calling
+       mmdb_decode_one(). */
+    if (entry_data->type == MMDB_DATA_TYPE_ARRAY) {
+        return lookup_path_in_array(path_elem, mmdb, entry_data,
+                                    value_offset);
+    } else if (entry_data->type == MMDB_DATA_TYPE_MAP) {
+        return lookup_path_in_map(path_elem, mmdb, entry_data, value_offset);
+    }
+
+    /* Once we make the code traverse maps & arrays without calling
+     * mmdb_decode_one() we can get rid of this. */
+    return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
+}
+
+LOCAL int lookup_path_in_array(const char *path_elem, MMDB_s *mmdb,
+                               MMDB_entry_data_s *entry_data,
+                               uint32_t *value_offset)
+{
+    uint32_t size = entry_data->data_size;
+    char *first_invalid;
+
+    int saved_errno = errno;
+    errno = 0;
+    int array_index = strtol(path_elem, &first_invalid, 10);
+    if (array_index < 0 || ERANGE == errno) {
+        errno = saved_errno;
+        return MMDB_INVALID_LOOKUP_PATH_ERROR;
+    }
+    errno = saved_errno;
+
+    if (*first_invalid || (uint32_t)array_index >= size) {
+        return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
+    }
+
+    for (int i = 0; i < array_index; i++) {
+        /* We don't want to follow a pointer here. If the next element is a
+         * pointer we simply skip it and keep going */
+        CHECKED_DECODE_ONE(mmdb, entry_data->offset_to_next, entry_data);
+        int status = skip_map_or_array(mmdb, entry_data);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+    }
+
+    *value_offset = entry_data->offset_to_next;
+
+    return MMDB_SUCCESS;
+}
+
+LOCAL int lookup_path_in_map(const char *path_elem, MMDB_s *mmdb,
+                             MMDB_entry_data_s *entry_data,
+                             uint32_t *value_offset)
+{
+    uint32_t size = entry_data->data_size;
+    uint32_t offset = entry_data->offset_to_next;
+    size_t path_elem_len = strlen(path_elem);
+
+    while (size-- > 0) {
+        MMDB_entry_data_s key, value;
+        CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, &key);
+
+        uint32_t offset_to_value = key.offset_to_next;
+
+        if (MMDB_DATA_TYPE_UTF8_STRING != key.type) {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+
+        if (key.data_size == path_elem_len &&
+            !memcmp(path_elem, key.utf8_string, path_elem_len)) {
+
+            DEBUG_MSG("found key matching path elem");
+
+            *value_offset = offset_to_value;
+            return MMDB_SUCCESS;
+        } else {
+            /* We don't want to follow a pointer here. If the next element is
+             * a pointer we simply skip it and keep going */
+            CHECKED_DECODE_ONE(mmdb, offset_to_value, &value);
+            int status = skip_map_or_array(mmdb, &value);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+            offset = value.offset_to_next;
+        }
+    }
+
+    return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
+}
+
+int MMDB_get_utf8(MMDB_entry_s *const start, const char *const *const path,
+                  const char **value, uint32_t *size)
+{
+    const uint8_t *payload;
+    int status = get_scalar(start, path, MMDB_DATA_TYPE_UTF8_STRING,
+                            &payload, size);
+    if (MMDB_SUCCESS == status) {
+        *value = 0 == *size ? "" : (const char *)payload;
+    }
+    return status;
+}
+
+int MMDB_get_bytes(MMDB_entry_s *const start, const char *const *const path,
+                   const uint8_t **value, uint32_t *size)
+{
+    return get_scalar(start, path, MMDB_DATA_TYPE_BYTES, value, size);
+}
+
+int MMDB_get_uint16(MMDB_entry_s *const start, const char *const *const path,
+                    uint16_t *value)
+{
+    const uint8_t *payload;
+    uint32_t size;
+    int status = get_scalar(start, path, MMDB_DATA_TYPE_UINT16, &payload,
+                            &size);
+    if (MMDB_SUCCESS == status) {
+        if (size > 2) {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        *value = (uint16_t)get_uintX(payload, size);
+    }
+    return status;
+}
+
+int MMDB_get_uint32(MMDB_entry_s *const start, const char *const *const path,
+                    uint32_t *value)
+{
+    const uint8_t *payload;
+    uint32_t size;
+    int status = get_scalar(start, path, MMDB_DATA_TYPE_UINT32, &payload,
+                            &size);
+    if (MMDB_SUCCESS == status) {
+        if (size > 4) {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        *value = (uint32_t)get_uintX(payload, size);
+    }
+    return status;
+}
+
+int MMDB_get_int32(MMDB_entry_s *const start, const char *const *const path,
+                   int32_t *value)
+{
+    const uint8_t *payload;
+    uint32_t size;
+    int status = get_scalar(start, path, MMDB_DATA_TYPE_INT32, &payload,
+                            &size);
+    if (MMDB_SUCCESS == status) {
+        if (size > 4) {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        *value = get_sintX(payload, size);
+    }
+    return status;
+}
+
+int MMDB_get_uint64(MMDB_entry_s *const start, const char *const *const path,
+                    uint64_t *value)
+{
+    const uint8_t *payload;
+    uint32_t size;
+    int status = get_scalar(start, path, MMDB_DATA_TYPE_UINT64, &payload,
+                            &size);
+    if (MMDB_SUCCESS == status) {
+        if (size > 8) {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        *value = get_uintX(payload, size);
+    }
+    return status;
+}
+
+int MMDB_get_double(MMDB_entry_s *const start, const char *const *const path,
+                    double *value)
+{
+    const uint8_t *payload;
+    uint32_t size;
+    int status = get_scalar(start, path, MMDB_DATA_TYPE_DOUBLE, &payload,
+                            &size);
+    if (MMDB_SUCCESS == status) {
+        if (size != 8) {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        *value = get_ieee754_double(payload);
+    }
+    return status;
+}
+
+int MMDB_get_float(MMDB_entry_s *const start, const char *const *const path,
+                   float *value)
+{
+    const uint8_t *payload;
+    uint32_t size;
+    int status = get_scalar(start, path, MMDB_DATA_TYPE_FLOAT, &payload,
+                            &size);
+    if (MMDB_SUCCESS == status) {
+        if (size != 4) {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        *value = get_ieee754_float(payload);
+    }
+    return status;
+}
+
+int MMDB_get_boolean(MMDB_entry_s *const start, const char *const *const path,
+                     bool *value)
+{
+    const uint8_t *payload;
+    uint32_t size;
+    int status = get_scalar(start, path, MMDB_DATA_TYPE_BOOLEAN, &payload,
+                            &size);
+    if (MMDB_SUCCESS == status) {
+        /* A boolean has no payload. Its value is in the size. */
+        *value = size ? true : false;
+    }
+    return status;
+}
+
+/* This follows the path the same way as MMDB_aget_value() but only finds
+ * the offset of the value at the end of it. That value is then decoded by
+ * decode_scalar() rather than into an MMDB_entry_data_s. */
+LOCAL int get_scalar(MMDB_entry_s *const start,
+                     const char *const *const path, int type,
+                     const uint8_t **payload, uint32_t *size)
+{
+    MMDB_s *mmdb = start->mmdb;
+    uint32_t offset = start->offset;
+
+    if (offset >= mmdb->data_section_size) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    MMDB_entry_data_s entry_data;
+    for (int i = 0; NULL != path[i]; i++) {
+        CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, &entry_data);
+        int status = lookup_path(path[i], mmdb, &entry_data, &offset);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+    }
+
+    return decode_scalar(mmdb, offset, type, payload, size);
+}
+
+/* This decodes just enough of the value at offset, following a pointer if
+ * there is one, to check its type and find its payload. For a boolean the
+ * size is the value and payload points past the control byte. */
+LOCAL int decode_scalar(MMDB_s *mmdb, uint32_t offset, int expected_type,
+                        const uint8_t **payload, uint32_t *size)
+{
+    const uint8_t *mem = mmdb->data_section;
+    uint32_t data_section_size = mmdb->data_section_size;
+    /* MMDB_verify() has already decoded everything we can get to */
+    bool check = !(mmdb->flags & MMDB_VERIFIED);
+
+    for (bool followed = false;; followed = true) {
+        if (check && offset >= data_section_size) {
+            DEBUG_MSGF("Offset (%d) past data section (%d)", offset,
+                       data_section_size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+
+        uint8_t ctrl = mem[offset++];
+        const control_byte_s *control = &control_bytes[ctrl];
+        int type = control->type;
+        if (type == MMDB_DATA_TYPE_EXTENDED) {
+            if (check && offset >= data_section_size) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            type = get_ext_type(mem[offset++]);
+        }
+
+        if (type == MMDB_DATA_TYPE_POINTER) {
+            /* Pointers to pointers are illegal under the spec */
+            int psize = control->pointer_size;
+            if (followed || (check && offset + psize > data_section_size)) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            offset = get_ptr_from(ctrl, &mem[offset], psize);
+            continue;
+        }
+
+        if (type != expected_type) {
+            DEBUG_MSGF("expected %s but found %s",
+                       type_num_to_name(expected_type),
+                       type_num_to_name(type));
+            return MMDB_TYPE_MISMATCH_ERROR;
+        }
+
+        *size = control->inline_size;
+        if (control->size_bytes) {
+            int size_bytes = control->size_bytes;
+            if (check && offset + size_bytes > data_section_size) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            *size = size_bases[size_bytes]
+                    + (uint32_t)get_uintX(&mem[offset], size_bytes);
+            offset += size_bytes;
+        }
+
+        if (check && type != MMDB_DATA_TYPE_BOOLEAN
+            && offset + *size > data_section_size) {
+            DEBUG_MSGF("Data end (%d) past data section (%d)",
+                       offset + *size, data_section_size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+
+        *payload = &mem[offset];
+        return MMDB_SUCCESS;
+    }
+}
+
+int MMDB_get_localized_name(MMDB_entry_s *const start,
+                            const char *const *const path,
+                            const char *const *const languages,
+                            size_t language_count,
+                            MMDB_entry_data_s *const entry_data)
+{
+    MMDB_s *mmdb = start->mmdb;
+    memset(entry_data, 0, sizeof(MMDB_entry_data_s));
+
+    /* If none of the languages are ones the database says it has, there is
+     * no point in looking at the record at all. */
+    size_t first;
+    int status = first_known_language(mmdb, languages, language_count,
+                                      &first);
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+
+    MMDB_entry_data_s names;
+    status = find_names_map(start, path, &names);
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+
+    /* We go through the map once, keeping the value for the most preferred
+     * language seen so far, and stop early if we find the first one. */
+    size_t best = language_count;
+    uint32_t best_offset = 0;
+    uint32_t offset = names.offset_to_next;
+    for (uint32_t i = 0; i < names.data_size && best > first; i++) {
+        MMDB_entry_data_s key;
+        CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, &key);
+        if (MMDB_DATA_TYPE_UTF8_STRING != key.type) {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        uint32_t offset_to_value = key.offset_to_next;
+
+        for (size_t j = first; j < best; j++) {
+            if (key.data_size == strlen(languages[j])
+                && !memcmp(languages[j], key.utf8_string, key.data_size)
+                && is_known_language(mmdb, languages[j])) {
+                best = j;
+                best_offset = offset_to_value;
+                break;
+            }
+        }
+
+        MMDB_entry_data_s value;
+        CHECKED_DECODE_ONE(mmdb, offset_to_value, &value);
+        status = skip_map_or_array(mmdb, &value);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+        offset = value.offset_to_next;
+    }
+
+    if (best == language_count) {
+        return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
+    }
+
+    status = decode_one_follow(mmdb, best_offset, entry_data);
+    if (MMDB_SUCCESS != status) {
+        memset(entry_data, 0, sizeof(MMDB_entry_data_s));
+    }
+    return status;
+}
+
+/* This follows the path and then finds the map under its "names" key */
+LOCAL int find_names_map(MMDB_entry_s *const start,
+                         const char *const *const path,
+                         MMDB_entry_data_s *names)
+{
+    MMDB_s *mmdb = start->mmdb;
+    uint32_t offset = start->offset;
+
+    if (offset >= mmdb->data_section_size) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    for (int i = 0; NULL != path[i]; i++) {
+        CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, names);
+        int status = lookup_path(path[i], mmdb, names, &offset);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+    }
+
+    CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, names);
+    if (MMDB_DATA_TYPE_MAP != names->type) {
+        return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
+    }
+    int status = lookup_path_in_map("names", mmdb, names, &offset);
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+
+    CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, names);
+    if (MMDB_DATA_TYPE_MAP != names->type) {
+        return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
+    }
+    return MMDB_SUCCESS;
+}
+
+LOCAL int first_known_language(MMDB_s *mmdb,
+                               const char *const *const languages,
+                               size_t language_count, size_t *first)
+{
+    for (*first = 0; *first < language_count; (*first)++) {
+        if (is_known_language(mmdb, languages[*first])) {
+            return MMDB_SUCCESS;
+        }
+    }
+    return MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR;
+}
+
+/* A database without a list of languages in its metadata might have any
+ * language. */
+LOCAL bool is_known_language(MMDB_s *mmdb, const char *language)
+{
+    if (0 == mmdb->metadata.languages.count) {
+        return true;
+    }
+    for (size_t i = 0; i < mmdb->metadata.languages.count; i++) {
+        if (0 == strcmp(language, mmdb->metadata.languages.names[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+LOCAL int skip_map_or_array(MMDB_s *mmdb, MMDB_entry_data_s *entry_data)
+{
+    if (entry_data->type == MMDB_DATA_TYPE_MAP) {
+        uint32_t size = entry_data->data_size;
+        while (size-- > 0) {
+            CHECKED_DECODE_ONE(mmdb, entry_data->offset_to_next, entry_data);   // key
+            CHECKED_DECODE_ONE(mmdb, entry_data->offset_to_next, entry_data);   // value
+            int status = skip_map_or_array(mmdb, entry_data);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+        }
+    } else if (entry_data->type == MMDB_DATA_TYPE_ARRAY) {
+        uint32_t size = entry_data->data_size;
+        while (size-- > 0) {
+            CHECKED_DECODE_ONE(mmdb, entry_data->offset_to_next, entry_data);   // value
+            int status = skip_map_or_array(mmdb, entry_data);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+        }
+    }
+
+    return MMDB_SUCCESS;
+}
+
+LOCAL int decode_one_follow(MMDB_s *mmdb, uint32_t offset,
+                            MMDB_entry_data_s *entry_data)
+{
+    CHECKED_DECODE_ONE(mmdb, offset, entry_data);
+    if (entry_data->type == MMDB_DATA_TYPE_POINTER) {
+        uint32_t next = entry_data->offset_to_next;
+        CHECKED_DECODE_ONE(mmdb, entry_data->pointer, entry_data);
+        /* Pointers to pointers are illegal under the spec */
+        if (entry_data->type == MMDB_DATA_TYPE_POINTER) {
+            DEBUG_MSG("pointer points to another pointer");
+            return MMDB_INVALID_DATA_ERROR;
+        }
+
+        /* The pointer could point to any part of the data section but the
+         * next entry for this particular offset may be the one after the
+         * pointer, not the one after whatever the pointer points to. This
+         * depends on whether the pointer points to something that is a simple
+         * value or a compound value. For a compound value, the next one is
+         * the one after the pointer result, not the one after the pointer. */
+        if (entry_data->type != MMDB_DATA_TYPE_MAP
+            && entry_data->type != MMDB_DATA_TYPE_ARRAY) {
+
+            entry_data->offset_to_next = next;
+        }
+    }
+
+    return MMDB_SUCCESS;
+}
+
+#if !MMDB_UINT128_IS_BYTE_ARRAY
+NO_PROTO mmdb_uint128_t get_uint128(const uint8_t *p, int length)
+{
+    mmdb_uint128_t value = 0;
+    while (length-- > 0) {
+        value <<= 8;
+        value += *p++;
+    }
+    return value;
+}
+#endif
+
+INTERNAL int mmdb_decode_one(MMDB_s *mmdb, uint32_t offset,
+                             MMDB_entry_data_s *entry_data)
+{
+    const uint8_t *mem = mmdb->data_section;
+
+    if (mmdb->flags & MMDB_VERIFIED) {
+        decode_one_verified(mem, offset, entry_data);
+        return MMDB_SUCCESS;
+    }
+
+    if (offset + 1 > mmdb->data_section_size) {
+        DEBUG_MSGF("Offset (%d) past data section (%d)", offset,
+                   mmdb->data_section_size);
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    entry_data->offset = offset;
+    entry_data->has_data = true;
+
+    DEBUG_NL;
+    DEBUG_MSGF("Offset: %i", offset);
+
+    uint8_t ctrl = mem[offset++];
+    DEBUG_BINARY("Control byte: %s", ctrl);
+
+    const control_byte_s *control = &control_bytes[ctrl];
+    int type = control->type;
+    DEBUG_MSGF("Type: %i (%s)", type, type_num_to_name(type));
+
+    if (type == MMDB_DATA_TYPE_EXTENDED) {
+        if (offset + 1 > mmdb->data_section_size) {
+            DEBUG_MSGF("Extended type offset (%d) past data section (%d)",
+                       offset,
+                       mmdb->data_section_size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        type = get_ext_type(mem[offset++]);
+        DEBUG_MSGF("Extended type: %i (%s)", type, type_num_to_name(type));
+    }
+
+    entry_data->type = type;
+
+    if (type == MMDB_DATA_TYPE_POINTER) {
+        int psize = control->pointer_size;
+        DEBUG_MSGF("Pointer size: %i", psize);
+
+        if (offset + psize > mmdb->data_section_size) {
+            DEBUG_MSGF("Pointer offset (%d) past data section (%d)", offset +
+                       psize,
+                       mmdb->data_section_size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        entry_data->pointer = get_ptr_from(ctrl, &mem[offset], psize);
+        DEBUG_MSGF("Pointer to: %i", entry_data->pointer);
+
+        entry_data->data_size = psize;
+        entry_data->offset_to_next = offset + psize;
+        return MMDB_SUCCESS;
+    }
+
+    uint32_t size = control->inline_size;
+    if (control->size_bytes) {
+        int size_bytes = control->size_bytes;
+        if (offset + size_bytes > mmdb->data_section_size) {
+            DEBUG_MSGF("Size bytes end (%d) past data section (%d)",
+                       offset + size_bytes,
+                       mmdb->data_section_size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        size = size_bases[size_bytes]
+               + (uint32_t)get_uintX(&mem[offset], size_bytes);
+        offset += size_bytes;
+    }
+
+    DEBUG_MSGF("Size: %i", size);
+
+    switch (type) {
+    case MMDB_DATA_TYPE_MAP:
+    case MMDB_DATA_TYPE_ARRAY:
+        entry_data->data_size = size;
+        entry_data->offset_to_next = offset;
+        return MMDB_SUCCESS;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        entry_data->boolean = size ? true : false;
+        entry_data->data_size = 0;
+        entry_data->offset_to_next = offset;
+        DEBUG_MSGF("boolean value: %s", entry_data->boolean ? "true" : "false");
+        return MMDB_SUCCESS;
+    }
+
+    // check that the data doesn't extend past the end of the memory
+    // buffer
+    if (offset + size > mmdb->data_section_size) {
+        DEBUG_MSGF("Data end (%d) past data section (%d)", offset + size,
+                   mmdb->data_section_size);
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    switch (type) {
+    case MMDB_DATA_TYPE_UINT16:
+        if (size > 2) {
+            DEBUG_MSGF("uint16 of size %d", size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        entry_data->uint16 = (uint16_t)get_uintX(&mem[offset], size);
+        DEBUG_MSGF("uint16 value: %u", entry_data->uint16);
+        break;
+    case MMDB_DATA_TYPE_UINT32:
+        if (size > 4) {
+            DEBUG_MSGF("uint32 of size %d", size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        entry_data->uint32 = (uint32_t)get_uintX(&mem[offset], size);
+        DEBUG_MSGF("uint32 value: %u", entry_data->uint32);
+        break;
+    case MMDB_DATA_TYPE_INT32:
+        if (size > 4) {
+            DEBUG_MSGF("int32 of size %d", size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        entry_data->int32 = get_sintX(&mem[offset], size);
+        DEBUG_MSGF("int32 value: %i", entry_data->int32);
+        break;
+    case MMDB_DATA_TYPE_UINT64:
+        if (size > 8) {
+            DEBUG_MSGF("uint64 of size %d", size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        entry_data->uint64 = get_uintX(&mem[offset], size);
+        DEBUG_MSGF("uint64 value: %" PRIu64, entry_data->uint64);
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+        if (size > 16) {
+            DEBUG_MSGF("uint128 of size %d", size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+#if MMDB_UINT128_IS_BYTE_ARRAY
+        memset(entry_data->uint128, 0, 16);
+        if (size > 0) {
+            memcpy(entry_data->uint128 + 16 - size, &mem[offset], size);
+        }
+#else
+        entry_data->uint128 = get_uint128(&mem[offset], size);
+#endif
+        break;
+    case MMDB_DATA_TYPE_FLOAT:
+        if (size != 4) {
+            DEBUG_MSGF("float of size %d", size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        entry_data->float_value = get_ieee754_float(&mem[offset]);
+        DEBUG_MSGF("float value: %f", entry_data->float_value);
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+        if (size != 8) {
+            DEBUG_MSGF("double of size %d", size);
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        entry_data->double_value = get_ieee754_double(&mem[offset]);
+        DEBUG_MSGF("double value: %f", entry_data->double_value);
+        break;
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        entry_data->utf8_string = size == 0 ? "" : (char *)&mem[offset];
+        entry_data->data_size = size;
+#ifdef MMDB_DEBUG
+        char *string = mmdb_strndup(entry_data->utf8_string,
+                                    size > 50 ? 50 : size);
+        if (NULL == string) {
+            abort();
+        }
+        DEBUG_MSGF("string value: %s", string);
+        free(string);
+#endif
+        break;
+    case MMDB_DATA_TYPE_BYTES:
+        entry_data->bytes = &mem[offset];
+        entry_data->data_size = size;
+        break;
+    }
+
+    entry_data->offset_to_next = offset + size;
+
+    return MMDB_SUCCESS;
+}
+
+/* This is mmdb_decode_one() without any of its checks. It is only used once
+ * MMDB_verify() has decoded every value that we can reach with all of the
+ * checks, so none of them can fail here. */
+LOCAL void decode_one_verified(const uint8_t *mem, uint32_t offset,
+                               MMDB_entry_data_s *entry_data)
+{
+    entry_data->offset = offset;
+    entry_data->has_data = true;
+
+    uint8_t ctrl = mem[offset++];
+    const control_byte_s *control = &control_bytes[ctrl];
+    int type = control->type;
+    if (type == MMDB_DATA_TYPE_EXTENDED) {
+        type = get_ext_type(mem[offset++]);
+    }
+
+    entry_data->type = type;
+
+    if (type == MMDB_DATA_TYPE_POINTER) {
+        int psize = control->pointer_size;
+        entry_data->pointer = get_ptr_from(ctrl, &mem[offset], psize);
+        entry_data->data_size = psize;
+        entry_data->offset_to_next = offset + psize;
+        return;
+    }
+
+    uint32_t size = control->inline_size;
+    if (control->size_bytes) {
+        size = size_bases[control->size_bytes]
+               + (uint32_t)get_uintX(&mem[offset], control->size_bytes);
+        offset += control->size_bytes;
+    }
+
+    switch (type) {
+    case MMDB_DATA_TYPE_MAP:
+    case MMDB_DATA_TYPE_ARRAY:
+        entry_data->data_size = size;
+        entry_data->offset_to_next = offset;
+        return;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        entry_data->boolean = size ? true : false;
+        entry_data->data_size = 0;
+        entry_data->offset_to_next = offset;
+        return;
+    case MMDB_DATA_TYPE_UINT16:
+        entry_data->uint16 = (uint16_t)get_uintX(&mem[offset], size);
+        break;
+    case MMDB_DATA_TYPE_UINT32:
+        entry_data->uint32 = (uint32_t)get_uintX(&mem[offset], size);
+        break;
+    case MMDB_DATA_TYPE_INT32:
+        entry_data->int32 = get_sintX(&mem[offset], size);
+        break;
+    case MMDB_DATA_TYPE_UINT64:
+        entry_data->uint64 = get_uintX(&mem[offset], size);
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+#if MMDB_UINT128_IS_BYTE_ARRAY
+        memset(entry_data->uint128, 0, 16);
+        if (size > 0) {
+            memcpy(entry_data->uint128 + 16 - size, &mem[offset], size);
+        }
+#else
+        entry_data->uint128 = get_uint128(&mem[offset], size);
+#endif
+        break;
+    case MMDB_DATA_TYPE_FLOAT:
+        entry_data->float_value = get_ieee754_float(&mem[offset]);
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+        entry_data->double_value = get_ieee754_double(&mem[offset]);
+        break;
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        entry_data->utf8_string = size == 0 ? "" : (char *)&mem[offset];
+        entry_data->data_size = size;
+        break;
+    case MMDB_DATA_TYPE_BYTES:
+        entry_data->bytes = &mem[offset];
+        entry_data->data_size = size;
+        break;
+    }
+
+    entry_data->offset_to_next = offset + size;
+}
+
+LOCAL int get_ext_type(int raw_ext_type)
+{
+    return 7 + raw_ext_type;
+}
+
+LOCAL uint32_t get_ptr_from(uint8_t ctrl, uint8_t const *const ptr,
+                            int ptr_size)
+{
+    uint32_t new_offset;
+    switch (ptr_size) {
+    case 1:
+        new_offset = ( (ctrl & 7) << 8) + ptr[0];
+        break;
+    case 2:
+        new_offset = 2048 + ( (ctrl & 7) << 16 ) + ( ptr[0] << 8) + ptr[1];
+        break;
+    case 3:
+        new_offset = 2048 + 524288 + ( (ctrl & 7) << 24 ) + get_uint24(ptr);
+        break;
+    case 4:
+    default:
+        new_offset = get_uint32(ptr);
+        break;
+    }
+    return new_offset;
+}
+
+int MMDB_get_metadata_as_entry_data_list(
+    MMDB_s *const mmdb, MMDB_entry_data_list_s **const entry_data_list)
+{
+    MMDB_s metadata_db = make_fake_metadata_db(mmdb);
+
+    MMDB_entry_s metadata_start = {
+        .mmdb   = &metadata_db,
+        .offset = 0
+    };
+
+    return MMDB_get_entry_data_list(&metadata_start, entry_data_list);
+}
+
+int MMDB_get_entry_data_list(
+    MMDB_entry_s *start, MMDB_entry_data_list_s **const entry_data_list)
+{
+    *entry_data_list = new_entry_data_list();
+    if (NULL == *entry_data_list) {
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+    if (start->offset >= start->mmdb->data_section_size) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    return get_entry_data_list(start->mmdb, start->offset, *entry_data_list, 0);
+}
+
+int MMDB_get_entry_data_array(
+    MMDB_entry_s *start, MMDB_entry_data_array_s **const entry_data_array)
+{
+    *entry_data_array = calloc(1, sizeof(MMDB_entry_data_array_s));
+    if (NULL == *entry_data_array) {
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+    if (start->offset >= start->mmdb->data_section_size) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    return get_entry_data_array(start->mmdb, start->offset, *entry_data_array,
+                                0);
+}
+
+LOCAL int get_entry_data_list(MMDB_s *mmdb, uint32_t offset,
+                              MMDB_entry_data_list_s *const entry_data_list,
+                              int depth)
+{
+    if (depth >= MAXIMUM_DATA_STRUCTURE_DEPTH) {
+        DEBUG_MSG("reached the maximum data structure depth");
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    depth++;
+    CHECKED_DECODE_ONE(mmdb, offset, &entry_data_list->entry_data);
+
+    switch (entry_data_list->entry_data.type) {
+    case MMDB_DATA_TYPE_POINTER:
+        {
+            uint32_t next_offset = entry_data_list->entry_data.offset_to_next;
+            uint32_t last_offset;
+            CHECKED_DECODE_ONE(mmdb, last_offset =
+                                   entry_data_list->entry_data.pointer,
+                               &entry_data_list->entry_data);
+
+            /* Pointers to pointers are illegal under the spec */
+            if (entry_data_list->entry_data.type == MMDB_DATA_TYPE_POINTER) {
+                DEBUG_MSG("pointer points to another pointer");
+                return MMDB_INVALID_DATA_ERROR;
+            }
+
+            if (entry_data_list->entry_data.type == MMDB_DATA_TYPE_ARRAY
+                || entry_data_list->entry_data.type == MMDB_DATA_TYPE_MAP) {
+
+                int status =
+                    get_entry_data_list(mmdb, last_offset, entry_data_list,
+                                        depth);
+                if (MMDB_SUCCESS != status) {
+                    DEBUG_MSG("get_entry_data_list on pointer failed.");
+                    return status;
+                }
+            }
+            entry_data_list->entry_data.offset_to_next = next_offset;
+        }
+        break;
+    case MMDB_DATA_TYPE_ARRAY:
+        {
+            uint32_t array_size = entry_data_list->entry_data.data_size;
+            uint32_t array_offset = entry_data_list->entry_data.offset_to_next;
+            MMDB_entry_data_list_s *previous = entry_data_list;
+            while (array_size-- > 0) {
+                MMDB_entry_data_list_s *entry_data_list_to = previous->next =
+                                                                 new_entry_data_list();
+                if (NULL == entry_data_list_to) {
+                    return MMDB_OUT_OF_MEMORY_ERROR;
+                }
+
+                int status =
+                    get_entry_data_list(mmdb, array_offset, entry_data_list_to,
+                                        depth);
+                if (MMDB_SUCCESS != status) {
+                    DEBUG_MSG("get_entry_data_list on array element failed.");
+                    return status;
+                }
+
+                array_offset = entry_data_list_to->entry_data.offset_to_next;
+                while (previous->next) {
+                    previous = previous->next;
+                }
+            }
+            entry_data_list->entry_data.offset_to_next = array_offset;
+
+        }
+        break;
+    case MMDB_DATA_TYPE_MAP:
+        {
+            uint32_t size = entry_data_list->entry_data.data_size;
+
+            offset = entry_data_list->entry_data.offset_to_next;
+            MMDB_entry_data_list_s *previous = entry_data_list;
+            while (size-- > 0) {
+                MMDB_entry_data_list_s *entry_data_list_to = previous->next =
+                                                                 new_entry_data_list();
+                if (NULL == entry_data_list_to) {
+                    return MMDB_OUT_OF_MEMORY_ERROR;
+                }
+
+                int status =
+                    get_entry_data_list(mmdb, offset, entry_data_list_to,
+                                        depth);
+                if (MMDB_SUCCESS != status) {
+                    DEBUG_MSG("get_entry_data_list on map key failed.");
+                    return status;
+                }
+
+                while (previous->next) {
+                    previous = previous->next;
+                }
+
+                offset = entry_data_list_to->entry_data.offset_to_next;
+                entry_data_list_to = previous->next =
+                                         new_entry_data_list();
+
+                if (NULL == entry_data_list_to) {
+                    return MMDB_OUT_OF_MEMORY_ERROR;
+                }
+
+                status = get_entry_data_list(mmdb, offset, entry_data_list_to,
+                                             depth);
+                if (MMDB_SUCCESS != status) {
+                    DEBUG_MSG("get_entry_data_list on map element failed.");
+                    return status;
+                }
+
+                while (previous->next) {
+                    previous = previous->next;
+                }
+                offset = entry_data_list_to->entry_data.offset_to_next;
+            }
+            entry_data_list->entry_data.offset_to_next = offset;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return MMDB_SUCCESS;
+}
+
+LOCAL int get_entry_data_array(MMDB_s *mmdb, uint32_t offset,
+                               MMDB_entry_data_array_s *const entry_data_array,
+                               int depth)
+{
+    if (depth >= MAXIMUM_DATA_STRUCTURE_DEPTH) {
+        DEBUG_MSG("reached the maximum data structure depth");
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    depth++;
+
+    /* The nodes may move when the array grows, so we only hold on to
+     * indexes across the recursive calls below. */
+    uint32_t index;
+    int status = new_entry_data_node(entry_data_array, &index);
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+
+    MMDB_entry_data_s *entry_data = &entry_data_array->nodes[index].entry_data;
+    CHECKED_DECODE_ONE(mmdb, offset, entry_data);
+
+    uint32_t next_offset = 0;
+    if (MMDB_DATA_TYPE_POINTER == entry_data->type) {
+        next_offset = entry_data->offset_to_next;
+        CHECKED_DECODE_ONE(mmdb, entry_data->pointer, entry_data);
+
+        /* Pointers to pointers are illegal under the spec */
+        if (MMDB_DATA_TYPE_POINTER == entry_data->type) {
+            DEBUG_MSG("pointer points to another pointer");
+            return MMDB_INVALID_DATA_ERROR;
+        }
+    }
+
+    uint32_t child_count = 0;
+    if (MMDB_DATA_TYPE_MAP == entry_data->type) {
+        MAYBE_CHECK_SIZE_OVERFLOW(entry_data->data_size, UINT32_MAX / 2,
+                                  MMDB_INVALID_DATA_ERROR);
+        child_count = entry_data->data_size * 2;
+    } else if (MMDB_DATA_TYPE_ARRAY == entry_data->type) {
+        child_count = entry_data->data_size;
+    }
+
+    offset = entry_data->offset_to_next;
+    for (uint32_t i = 0; i < child_count; i++) {
+        uint32_t child = entry_data_array->count;
+        status = get_entry_data_array(mmdb, offset, entry_data_array, depth);
+        if (MMDB_SUCCESS != status) {
+            DEBUG_MSG("get_entry_data_array on map or array member failed.");
+            return status;
+        }
+        offset = entry_data_array->nodes[child].entry_data.offset_to_next;
+    }
+
+    MMDB_entry_data_node_s *node = &entry_data_array->nodes[index];
+    node->child_count = child_count;
+    node->subtree_end = entry_data_array->count;
+    if (child_count) {
+        node->entry_data.offset_to_next = offset;
+    }
+    if (next_offset) {
+        node->entry_data.offset_to_next = next_offset;
+    }
+
+    return MMDB_SUCCESS;
+}
+
+LOCAL int new_entry_data_node(MMDB_entry_data_array_s *const entry_data_array,
+                              uint32_t *index)
+{
+    if (entry_data_array->count == entry_data_array->capacity) {
+        uint32_t capacity =
+            entry_data_array->capacity ? entry_data_array->capacity * 2 : 16;
+        if (capacity <= entry_data_array->capacity) {
+            return MMDB_OUT_OF_MEMORY_ERROR;
+        }
+        MAYBE_CHECK_SIZE_OVERFLOW(capacity,
+                                  SIZE_MAX / sizeof(MMDB_entry_data_node_s),
+                                  MMDB_OUT_OF_MEMORY_ERROR);
+
+        MMDB_entry_data_node_s *nodes =
+            realloc(entry_data_array->nodes,
+                    capacity * sizeof(MMDB_entry_data_node_s));
+        if (NULL == nodes) {
+            return MMDB_OUT_OF_MEMORY_ERROR;
+        }
+        entry_data_array->nodes = nodes;
+        entry_data_array->capacity = capacity;
+    }
+
+    *index = entry_data_array->count++;
+    memset(&entry_data_array->nodes[*index], 0,
+           sizeof(MMDB_entry_data_node_s));
+
+    return MMDB_SUCCESS;
+}
+
+int MMDB_walk_entry(MMDB_entry_s *const start,
+                    const MMDB_visitor_s *const visitor, void *ctx)
+{
+    if (start->offset >= start->mmdb->data_section_size) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    uint32_t offset_to_next;
+    int status = walk_entry(start->mmdb, start->offset, visitor, ctx, 0,
+                            &offset_to_next);
+    return WALK_STOPPED == status ? MMDB_SUCCESS : status;
+}
+
+/* When visitor is NULL we are skipping a subtree. We still walk it so that
+ * the depth limit applies, but we don't need to follow pointers because the
+ * pointer itself tells us where the next value starts. */
+LOCAL int walk_entry(MMDB_s *mmdb, uint32_t offset,
+                     const MMDB_visitor_s *visitor, void *ctx, int depth,
+                     uint32_t *offset_to_next)
+{
+    if (depth >= MAXIMUM_DATA_STRUCTURE_DEPTH) {
+        DEBUG_MSG("reached the maximum data structure depth");
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    depth++;
+
+    MMDB_entry_data_s entry_data;
+    CHECKED_DECODE_ONE(mmdb, offset, &entry_data);
+
+    uint32_t next_offset = 0;
+    if (MMDB_DATA_TYPE_POINTER == entry_data.type) {
+        next_offset = entry_data.offset_to_next;
+        if (NULL == visitor) {
+            *offset_to_next = next_offset;
+            return MMDB_SUCCESS;
+        }
+
+        CHECKED_DECODE_ONE(mmdb, entry_data.pointer, &entry_data);
+        /* Pointers to pointers are illegal under the spec */
+        if (MMDB_DATA_TYPE_POINTER == entry_data.type) {
+            DEBUG_MSG("pointer points to another pointer");
+            return MMDB_INVALID_DATA_ERROR;
+        }
+    }
+
+    int visit = MMDB_VISIT_CONTINUE;
+    int status;
+    uint32_t size = entry_data.data_size;
+    offset = entry_data.offset_to_next;
+
+    switch (entry_data.type) {
+    case MMDB_DATA_TYPE_MAP:
+        if (visitor && visitor->begin_map) {
+            visit = visitor->begin_map(ctx, size);
+        }
+        if (MMDB_VISIT_STOP == visit) {
+            return WALK_STOPPED;
+        }
+        if (MMDB_VISIT_SKIP == visit) {
+            visitor = NULL;
+        }
+
+        while (size-- > 0) {
+            MMDB_entry_data_s key;
+            CHECKED_DECODE_ONE_FOLLOW(mmdb, offset, &key);
+            if (MMDB_DATA_TYPE_UTF8_STRING != key.type) {
+                DEBUG_MSG("map key is not a string");
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            offset = key.offset_to_next;
+
+            visit = MMDB_VISIT_CONTINUE;
+            if (visitor && visitor->key) {
+                visit = visitor->key(ctx, key.utf8_string, key.data_size);
+            }
+            if (MMDB_VISIT_STOP == visit) {
+                return WALK_STOPPED;
+            }
+
+            status = walk_entry(mmdb, offset,
+                                MMDB_VISIT_SKIP == visit ? NULL : visitor,
+                                ctx, depth, &offset);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+        }
+
+        if (visitor && visitor->end_map &&
+            MMDB_VISIT_STOP == visitor->end_map(ctx)) {
+            return WALK_STOPPED;
+        }
+        break;
+    case MMDB_DATA_TYPE_ARRAY:
+        if (visitor && visitor->begin_array) {
+            visit = visitor->begin_array(ctx, size);
+        }
+        if (MMDB_VISIT_STOP == visit) {
+            return WALK_STOPPED;
+        }
+        if (MMDB_VISIT_SKIP == visit) {
+            visitor = NULL;
+        }
+
+        while (size-- > 0) {
+            status = walk_entry(mmdb, offset, visitor, ctx, depth, &offset);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+        }
+
+        if (visitor && visitor->end_array &&
+            MMDB_VISIT_STOP == visitor->end_array(ctx)) {
+            return WALK_STOPPED;
+        }
+        break;
+    default:
+        if (visitor && visitor->scalar &&
+            MMDB_VISIT_STOP == visitor->scalar(ctx, &entry_data)) {
+            return WALK_STOPPED;
+        }
+        break;
+    }
+
+    *offset_to_next = next_offset ? next_offset : offset;
+    return MMDB_SUCCESS;
+}
+
+LOCAL float get_ieee754_float(const uint8_t *restrict p)
+{
+    volatile float f;
+    uint8_t *q = (void *)&f;
+/* Windows builds don't use autoconf but we can assume they're all
+ * little-endian. */
+#if MMDB_LITTLE_ENDIAN || _WIN32
+    q[3] = p[0];
+    q[2] = p[1];
+    q[1] = p[2];
+    q[0] = p[3];
+#else
+    memcpy(q, p, 4);
+#endif
+    return f;
+}
+
+LOCAL double get_ieee754_double(const uint8_t *restrict p)
+{
+    volatile double d;
+    uint8_t *q = (void *)&d;
+#if MMDB_LITTLE_ENDIAN || _WIN32
+    q[7] = p[0];
+    q[6] = p[1];
+    q[5] = p[2];
+    q[4] = p[3];
+    q[3] = p[4];
+    q[2] = p[5];
+    q[1] = p[6];
+    q[0] = p[7];
+#else
+    memcpy(q, p, 8);
+#endif
+
+    return d;
+}
+
+LOCAL uint32_t get_uint32(const uint8_t *p)
+{
+    return p[0] * 16777216U + p[1] * 65536 + p[2] * 256 + p[3];
+}
+
+LOCAL uint32_t get_uint24(const uint8_t *p)
+{
+    return p[0] * 65536U + p[1] * 256 + p[2];
+}
+
+LOCAL uint64_t get_uintX(const uint8_t *p, int length)
+{
+    uint64_t value = 0;
+    while (length-- > 0) {
+        value <<= 8;
+        value += *p++;
+    }
+    return value;
+}
+
+LOCAL int32_t get_sintX(const uint8_t *p, int length)
+{
+    return (int32_t)get_uintX(p, length);
+}
+
+LOCAL MMDB_entry_data_list_s *new_entry_data_list(void)
+{
+    /* We need calloc here in order to ensure that the ->next pointer in the
+     * struct doesn't point to some random address. */
+    return calloc(1, sizeof(MMDB_entry_data_list_s));
+}
+
+void MMDB_free_entry_data_list(MMDB_entry_data_list_s *const entry_data_list)
+{
+    if (entry_data_list == NULL) {
+        return;
+    }
+    if (entry_data_list->next) {
+        MMDB_free_entry_data_list(entry_data_list->next);
+    }
+    free(entry_data_list);
+}
+
+void MMDB_free_entry_data_array(
+    MMDB_entry_data_array_s *const entry_data_array)
+{
+    if (entry_data_array == NULL) {
+        return;
+    }
+    free(entry_data_array->nodes);
+    free(entry_data_array);
+}
+
+void MMDB_close(MMDB_s *const mmdb)
+{
+    free_mmdb_struct(mmdb);
+}
+
+LOCAL void free_mmdb_struct(MMDB_s *const mmdb)
+{
+    if (!mmdb) {
+        return;
+    }
+
+    if (NULL != mmdb->filename) {
+        FREE_AND_SET_NULL(mmdb->filename);
+    }
+    if (NULL != mmdb->file_content) {
+#ifdef _WIN32
+        UnmapViewOfFile(mmdb->file_content);
+        /* Winsock is only initialized if open was successful so we only have
+         * to cleanup then. */
+        WSACleanup();
+#else
+        munmap((void *)mmdb->file_content, mmdb->file_size);
+#endif
+    }
+
+    if (NULL != mmdb->metadata.database_type) {
+        FREE_AND_SET_NULL(mmdb->metadata.database_type);
+    }
+
+    free_languages_metadata(mmdb);
+    free_descriptions_metadata(mmdb);
+}
+
+LOCAL void free_languages_metadata(MMDB_s *mmdb)
+{
+    /* The names array is allocated even when there are no languages */
+    for (size_t i = 0; i < mmdb->metadata.languages.count; i++) {
+        FREE_AND_SET_NULL(mmdb->metadata.languages.names[i]);
+    }
+    FREE_AND_SET_NULL(mmdb->metadata.languages.names);
+}
+
+LOCAL void free_descriptions_metadata(MMDB_s *mmdb)
+{
+    if (!mmdb->metadata.description.count) {
+        return;
+    }
+
+    for (size_t i = 0; i < mmdb->metadata.description.count; i++) {
+        if (NULL != mmdb->metadata.description.descriptions[i]) {
+            if (NULL !=
+                mmdb->metadata.description.descriptions[i]->language) {
+                FREE_AND_SET_NULL(
+                    mmdb->metadata.description.descriptions[i]->language);
+            }
+
+            if (NULL !=
+                mmdb->metadata.description.descriptions[i]->description) {
+                FREE_AND_SET_NULL(
+                    mmdb->metadata.description.descriptions[i]->description);
+            }
+            FREE_AND_SET_NULL(mmdb->metadata.description.descriptions[i]);
+        }
+    }
+
+    FREE_AND_SET_NULL(mmdb->metadata.description.descriptions);
+}
+
+const char *MMDB_lib_version(void)
+{
+    return PACKAGE_VERSION;
+}
+
+int MMDB_dump_entry_data_list(FILE *const stream,
+                              MMDB_entry_data_list_s *const entry_data_list,
+                              int indent)
+{
+    int status;
+    dump_entry_data_list(stream, entry_data_list, indent, &status);
+    return status;
+}
+
+LOCAL MMDB_entry_data_list_s *dump_entry_data_list(
+    FILE *stream, MMDB_entry_data_list_s *entry_data_list, int indent,
+    int *status)
+{
+    switch (entry_data_list->entry_data.type) {
+    case MMDB_DATA_TYPE_MAP:
+        {
+            uint32_t size = entry_data_list->entry_data.data_size;
+
+            print_indentation(stream, indent);
+            fprintf(stream, "{\n");
+            indent += 2;
+
+            for (entry_data_list = entry_data_list->next;
+                 size && entry_data_list; size--) {
+
+                if (MMDB_DATA_TYPE_UTF8_STRING !=
+                    entry_data_list->entry_data.type) {
+                    *status = MMDB_INVALID_DATA_ERROR;
+                    return NULL;
+                }
+                char *key =
+                    mmdb_strndup(
+                        (char *)entry_data_list->entry_data.utf8_string,
+                        entry_data_list->entry_data.data_size);
+                if (NULL == key) {
+                    *status = MMDB_OUT_OF_MEMORY_ERROR;
+                    return NULL;
+                }
+
+                print_indentation(stream, indent);
+                fprintf(stream, "\"%s\": \n", key);
+                free(key);
+
+                entry_data_list = entry_data_list->next;
+                entry_data_list =
+                    dump_entry_data_list(stream, entry_data_list, indent + 2,
+                                         status);
 
-    if (type == MMDB_DATA_TYPE_UINT16) {
-        if (size > 2) {
-            DEBUG_MSGF("uint16 of size %d", size);
-            return MMDB_INVALID_DATA_ERROR;
+                if (MMDB_SUCCESS != *status) {
+                    return NULL;
+                }
+            }
+
+            indent -= 2;
+            print_indentation(stream, indent);
+            fprintf(stream, "}\n");
         }
-        entry_data->uint16 = (uint16_t)get_uintX(&mem[offset], size);
-        DEBUG_MSGF("uint16 value: %u", entry_data->uint16);
-    } else if (type == MMDB_DATA_TYPE_UINT32) {
-        if (size > 4) {
-            DEBUG_MSGF("uint32 of size %d", size);
-            return MMDB_INVALID_DATA_ERROR;
+        break;
+    case MMDB_DATA_TYPE_ARRAY:
+        {
+            uint32_t size = entry_data_list->entry_data.data_size;
+
+            print_indentation(stream, indent);
+            fprintf(stream, "[\n");
+            indent += 2;
+
+            for (entry_data_list = entry_data_list->next;
+                 size && entry_data_list; size--) {
+                entry_data_list =
+                    dump_entry_data_list(stream, entry_data_list, indent,
+                                         status);
+                if (MMDB_SUCCESS != *status) {
+                    return NULL;
+                }
+            }
+
+            indent -= 2;
+            print_indentation(stream, indent);
+            fprintf(stream, "]\n");
         }
-        entry_data->uint32 = (uint32_t)get_uintX(&mem[offset], size);
-        DEBUG_MSGF("uint32 value: %u", entry_data->uint32);
-    } else if (type == MMDB_DATA_TYPE_INT32) {
-        if (size > 4) {
-            DEBUG_MSGF("int32 of size %d", size);
-            return MMDB_INVALID_DATA_ERROR;
+        break;
+    default:
+        *status = dump_entry_data(stream, &entry_data_list->entry_data, indent);
+        if (MMDB_SUCCESS != *status) {
+            return NULL;
         }
-        entry_data->int32 = get_sintX(&mem[offset], size);
-        DEBUG_MSGF("int32 value: %i", entry_data->int32);
-    } else if (type == MMDB_DATA_TYPE_UINT64) {
-        if (size > 8) {
-            DEBUG_MSGF("uint64 of size %d", size);
-            return MMDB_INVALID_DATA_ERROR;
+        entry_data_list = entry_data_list->next;
+        break;
+    }
+
+    *status = MMDB_SUCCESS;
+    return entry_data_list;
+}
+
+LOCAL int dump_entry_data(FILE *stream, MMDB_entry_data_s *entry_data,
+                          int indent)
+{
+    switch (entry_data->type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        {
+            char *string = mmdb_strndup((char *)entry_data->utf8_string,
+                                        entry_data->data_size);
+            if (NULL == string) {
+                return MMDB_OUT_OF_MEMORY_ERROR;
+            }
+            print_indentation(stream, indent);
+            fprintf(stream, "\"%s\" <utf8_string>\n", string);
+            free(string);
         }
-        entry_data->uint64 = get_uintX(&mem[offset], size);
-        DEBUG_MSGF("uint64 value: %" PRIu64, entry_data->uint64);
-    } else if (type == MMDB_DATA_TYPE_UINT128) {
-        if (size > 16) {
-            DEBUG_MSGF("uint128 of size %d", size);
-            return MMDB_INVALID_DATA_ERROR;
+        break;
+    case MMDB_DATA_TYPE_BYTES:
+        {
+            char *hex_string = bytes_to_hex((uint8_t *)entry_data->bytes,
+                                            entry_data->data_size);
+            if (NULL == hex_string) {
+                return MMDB_OUT_OF_MEMORY_ERROR;
+            }
+
+            print_indentation(stream, indent);
+            fprintf(stream, "%s <bytes>\n", hex_string);
+            free(hex_string);
         }
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+        print_indentation(stream, indent);
+        fprintf(stream, "%f <double>\n", entry_data->double_value);
+        break;
+    case MMDB_DATA_TYPE_FLOAT:
+        print_indentation(stream, indent);
+        fprintf(stream, "%f <float>\n", entry_data->float_value);
+        break;
+    case MMDB_DATA_TYPE_UINT16:
+        print_indentation(stream, indent);
+        fprintf(stream, "%u <uint16>\n", entry_data->uint16);
+        break;
+    case MMDB_DATA_TYPE_UINT32:
+        print_indentation(stream, indent);
+        fprintf(stream, "%u <uint32>\n", entry_data->uint32);
+        break;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        print_indentation(stream, indent);
+        fprintf(stream, "%s <boolean>\n",
+                entry_data->boolean ? "true" : "false");
+        break;
+    case MMDB_DATA_TYPE_UINT64:
+        print_indentation(stream, indent);
+        fprintf(stream, "%" PRIu64 " <uint64>\n", entry_data->uint64);
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+        print_indentation(stream, indent);
 #if MMDB_UINT128_IS_BYTE_ARRAY
-        memset(entry_data->uint128, 0, 16);
-        if (size > 0) {
-            memcpy(entry_data->uint128 + 16 - size, &mem[offset], size);
+        char *hex_string = bytes_to_hex((uint8_t *)entry_data->uint128, 16);
+        if (NULL == hex_string) {
+            return MMDB_OUT_OF_MEMORY_ERROR;
         }
+        fprintf(stream, "0x%s <uint128>\n", hex_string);
+        free(hex_string);
 #else
-        entry_data->uint128 = get_uint128(&mem[offset], size);
+        uint64_t high = entry_data->uint128 >> 64;
+        uint64_t low = (uint64_t)entry_data->uint128;
+        fprintf(stream, "0x%016" PRIX64 "%016" PRIX64 " <uint128>\n", high,
+                low);
 #endif
-    } else if (type == MMDB_DATA_TYPE_FLOAT) {
-        if (size != 4) {
-            DEBUG_MSGF("float of size %d", size);
-            return MMDB_INVALID_DATA_ERROR;
-        }
-        size = 4;
-        entry_data->float_value = get_ieee754_float(&mem[offset]);
-        DEBUG_MSGF("float value: %f", entry_data->float_value);
-    } else if (type == MMDB_DATA_TYPE_DOUBLE) {
-        if (size != 8) {
-            DEBUG_MSGF("double of size %d", size);
-            return MMDB_INVALID_DATA_ERROR;
+        break;
+    case MMDB_DATA_TYPE_INT32:
+        print_indentation(stream, indent);
+        fprintf(stream, "%d <int32>\n", entry_data->int32);
+        break;
+    default:
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    return MMDB_SUCCESS;
+}
+
+int MMDB_dump_entry_data_array(FILE *const stream,
+                               MMDB_entry_data_array_s *const entry_data_array,
+                               int indent)
+{
+    if (0 == entry_data_array->count) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    return dump_entry_data_array(stream, entry_data_array, 0, indent);
+}
+
+LOCAL int dump_entry_data_array(FILE *stream,
+                                MMDB_entry_data_array_s *entry_data_array,
+                                uint32_t index, int indent)
+{
+    MMDB_entry_data_node_s *node = &entry_data_array->nodes[index];
+    uint32_t child = index + 1;
+    int status;
+
+    switch (node->entry_data.type) {
+    case MMDB_DATA_TYPE_MAP:
+        print_indentation(stream, indent);
+        fprintf(stream, "{\n");
+        indent += 2;
+
+        for (uint32_t i = 0; i < node->child_count; i += 2) {
+            MMDB_entry_data_s *key = &entry_data_array->nodes[child].entry_data;
+            if (MMDB_DATA_TYPE_UTF8_STRING != key->type) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+
+            print_indentation(stream, indent);
+            fprintf(stream, "\"%.*s\": \n", (int)key->data_size,
+                    key->utf8_string);
+
+            child = entry_data_array->nodes[child].subtree_end;
+            status = dump_entry_data_array(stream, entry_data_array, child,
+                                           indent + 2);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+            child = entry_data_array->nodes[child].subtree_end;
         }
-        size = 8;
-        entry_data->double_value = get_ieee754_double(&mem[offset]);
-        DEBUG_MSGF("double value: %f", entry_data->double_value);
-    } else if (type == MMDB_DATA_TYPE_UTF8_STRING) {
-        entry_data->utf8_string = size == 0 ? "" : (char *)&mem[offset];
-        entry_data->data_size = size;
-#ifdef MMDB_DEBUG
-        char *string = mmdb_strndup(entry_data->utf8_string,
-                                    size > 50 ? 50 : size);
-        if (NULL == string) {
-            abort();
+
+        indent -= 2;
+        print_indentation(stream, indent);
+        fprintf(stream, "}\n");
+        break;
+    case MMDB_DATA_TYPE_ARRAY:
+        print_indentation(stream, indent);
+        fprintf(stream, "[\n");
+        indent += 2;
+
+        for (uint32_t i = 0; i < node->child_count; i++) {
+            status = dump_entry_data_array(stream, entry_data_array, child,
+                                           indent);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+            child = entry_data_array->nodes[child].subtree_end;
         }
-        DEBUG_MSGF("string value: %s", string);
-        free(string);
-#endif
-    } else if (type == MMDB_DATA_TYPE_BYTES) {
-        entry_data->bytes = &mem[offset];
-        entry_data->data_size = size;
-    }
 
-    entry_data->offset_to_next = offset + size;
+        indent -= 2;
+        print_indentation(stream, indent);
+        fprintf(stream, "]\n");
+        break;
+    default:
+        return dump_entry_data(stream, &node->entry_data, indent);
+    }
 
     return MMDB_SUCCESS;
 }
 
-LOCAL int get_ext_type(int raw_ext_type)
+int MMDB_dump_entry_data_array_as_json(
+    FILE *const stream, MMDB_entry_data_array_s *const entry_data_array)
 {
-    return 7 + raw_ext_type;
+    if (0 == entry_data_array->count) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    return dump_entry_data_array_as_json(stream, entry_data_array, 0);
 }
 
-LOCAL uint32_t get_ptr_from(uint8_t ctrl, uint8_t const *const ptr,
-                            int ptr_size)
+LOCAL int dump_entry_data_array_as_json(
+    FILE *stream, MMDB_entry_data_array_s *entry_data_array, uint32_t index)
 {
-    uint32_t new_offset;
-    switch (ptr_size) {
-    case 1:
-        new_offset = ( (ctrl & 7) << 8) + ptr[0];
+    MMDB_entry_data_node_s *node = &entry_data_array->nodes[index];
+    MMDB_entry_data_s *entry_data = &node->entry_data;
+    uint32_t child = index + 1;
+    int status;
+
+    switch (entry_data->type) {
+    case MMDB_DATA_TYPE_MAP:
+        fputc('{', stream);
+        for (uint32_t i = 0; i < node->child_count; i += 2) {
+            MMDB_entry_data_s *key = &entry_data_array->nodes[child].entry_data;
+            if (MMDB_DATA_TYPE_UTF8_STRING != key->type) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            if (i) {
+                fputc(',', stream);
+            }
+            print_json_string(stream, key->utf8_string, key->data_size);
+            fputc(':', stream);
+
+            child = entry_data_array->nodes[child].subtree_end;
+            status =
+                dump_entry_data_array_as_json(stream, entry_data_array, child);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+            child = entry_data_array->nodes[child].subtree_end;
+        }
+        fputc('}', stream);
         break;
-    case 2:
-        new_offset = 2048 + ( (ctrl & 7) << 16 ) + ( ptr[0] << 8) + ptr[1];
+    case MMDB_DATA_TYPE_ARRAY:
+        fputc('[', stream);
+        for (uint32_t i = 0; i < node->child_count; i++) {
+            if (i) {
+                fputc(',', stream);
+            }
+            status =
+                dump_entry_data_array_as_json(stream, entry_data_array, child);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+            child = entry_data_array->nodes[child].subtree_end;
+        }
+        fputc(']', stream);
+        break;
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        print_json_string(stream, entry_data->utf8_string,
+                          entry_data->data_size);
+        break;
+    case MMDB_DATA_TYPE_BYTES:
+        {
+            char *hex_string = bytes_to_hex((uint8_t *)entry_data->bytes,
+                                            entry_data->data_size);
+            if (NULL == hex_string) {
+                return MMDB_OUT_OF_MEMORY_ERROR;
+            }
+            fprintf(stream, "\"%s\"", hex_string);
+            free(hex_string);
+        }
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+        {
+            char buffer[32];
+            fputs(format_json_double(buffer, entry_data->double_value, false),
+                  stream);
+        }
+        break;
+    case MMDB_DATA_TYPE_FLOAT:
+        {
+            char buffer[32];
+            fputs(format_json_double(buffer, entry_data->float_value, true),
+                  stream);
+        }
+        break;
+    case MMDB_DATA_TYPE_UINT16:
+        fprintf(stream, "%u", entry_data->uint16);
+        break;
+    case MMDB_DATA_TYPE_UINT32:
+        fprintf(stream, "%u", entry_data->uint32);
+        break;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        fputs(entry_data->boolean ? "true" : "false", stream);
+        break;
+    case MMDB_DATA_TYPE_UINT64:
+        fprintf(stream, "%" PRIu64, entry_data->uint64);
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+        {
+            /* JSON consumers generally can't represent 128-bit integers, so
+             * these are written as a hex string like the dump output. */
+#if MMDB_UINT128_IS_BYTE_ARRAY
+            char *hex_string =
+                bytes_to_hex((uint8_t *)entry_data->uint128, 16);
+            if (NULL == hex_string) {
+                return MMDB_OUT_OF_MEMORY_ERROR;
+            }
+            fprintf(stream, "\"0x%s\"", hex_string);
+            free(hex_string);
+#else
+            uint64_t high = entry_data->uint128 >> 64;
+            uint64_t low = (uint64_t)entry_data->uint128;
+            fprintf(stream, "\"0x%016" PRIX64 "%016" PRIX64 "\"", high, low);
+#endif
+        }
         break;
-    case 3:
-        new_offset = 2048 + 524288 + ( (ctrl & 7) << 24 ) + get_uint24(ptr);
+    case MMDB_DATA_TYPE_INT32:
+        fprintf(stream, "%d", entry_data->int32);
         break;
-    case 4:
     default:
-        new_offset = get_uint32(ptr);
-        break;
+        return MMDB_INVALID_DATA_ERROR;
     }
-    return new_offset;
+
+    return MMDB_SUCCESS;
 }
 
-int MMDB_get_metadata_as_entry_data_list(
-    MMDB_s *const mmdb, MMDB_entry_data_list_s **const entry_data_list)
+LOCAL void print_json_string(FILE *stream, const char *string, uint32_t size)
 {
-    MMDB_s metadata_db = make_fake_metadata_db(mmdb);
+    uint32_t start = 0;
 
-    MMDB_entry_s metadata_start = {
-        .mmdb   = &metadata_db,
-        .offset = 0
-    };
+    fputc('"', stream);
+    for (uint32_t i = 0; i < size; i++) {
+        uint8_t c = (uint8_t)string[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
 
-    return MMDB_get_entry_data_list(&metadata_start, entry_data_list);
+        fwrite(string + start, 1, i - start, stream);
+        start = i + 1;
+
+        char escape[6];
+        fwrite(escape, 1, json_escape_char(c, escape), stream);
+    }
+    fwrite(string + start, 1, size - start, stream);
+    fputc('"', stream);
 }
 
-int MMDB_get_entry_data_list(
-    MMDB_entry_s *start, MMDB_entry_data_list_s **const entry_data_list)
+/* This writes the JSON escape sequence for a character that can't appear
+ * unescaped in a JSON string and returns its length. */
+LOCAL int json_escape_char(uint8_t c, char *escape)
 {
-    *entry_data_list = new_entry_data_list();
-    if (NULL == *entry_data_list) {
-        return MMDB_OUT_OF_MEMORY_ERROR;
+    static const char hex[] = "0123456789abcdef";
+
+    escape[0] = '\\';
+    switch (c) {
+    case '"':
+    case '\\':
+        escape[1] = c;
+        return 2;
+    case '\n':
+        escape[1] = 'n';
+        return 2;
+    case '\r':
+        escape[1] = 'r';
+        return 2;
+    case '\t':
+        escape[1] = 't';
+        return 2;
+    case '\b':
+        escape[1] = 'b';
+        return 2;
+    case '\f':
+        escape[1] = 'f';
+        return 2;
+    default:
+        escape[1] = 'u';
+        escape[2] = '0';
+        escape[3] = '0';
+        escape[4] = hex[c >> 4];
+        escape[5] = hex[c & 15];
+        return 6;
     }
-    return get_entry_data_list(start->mmdb, start->offset, *entry_data_list, 0);
 }
 
-LOCAL int get_entry_data_list(MMDB_s *mmdb, uint32_t offset,
-                              MMDB_entry_data_list_s *const entry_data_list,
-                              int depth)
+/* This writes the shortest representation that reads back as the same value.
+ * JSON has no representation for NaN or infinity so those become null. */
+LOCAL const char *format_json_double(char *buffer, double value,
+                                     bool is_float)
 {
-    if (depth >= MAXIMUM_DATA_STRUCTURE_DEPTH) {
-        DEBUG_MSG("reached the maximum data structure depth");
-        return MMDB_INVALID_DATA_ERROR;
+    if (value != value || value - value != 0) {
+        strcpy(buffer, "null");
+        return buffer;
     }
-    depth++;
-    CHECKED_DECODE_ONE(mmdb, offset, &entry_data_list->entry_data);
 
-    switch (entry_data_list->entry_data.type) {
-    case MMDB_DATA_TYPE_POINTER:
-        {
-            uint32_t next_offset = entry_data_list->entry_data.offset_to_next;
-            uint32_t last_offset;
-            CHECKED_DECODE_ONE(mmdb, last_offset =
-                                   entry_data_list->entry_data.pointer,
-                               &entry_data_list->entry_data);
+    if (!is_float && format_short_double(buffer, value)) {
+        return buffer;
+    }
 
-            /* Pointers to pointers are illegal under the spec */
-            if (entry_data_list->entry_data.type == MMDB_DATA_TYPE_POINTER) {
-                DEBUG_MSG("pointer points to another pointer");
-                return MMDB_INVALID_DATA_ERROR;
-            }
+    int precision = is_float ? 6 : 15;
+    int max_precision = is_float ? 9 : 17;
+    for (; precision < max_precision; precision++) {
+        sprintf(buffer, "%.*g", precision, value);
+        if (is_float ? strtof(buffer, NULL) == (float)value :
+            strtod(buffer, NULL) == value) {
+            return buffer;
+        }
+    }
+    sprintf(buffer, "%.*g", max_precision, value);
+    return buffer;
+}
 
-            if (entry_data_list->entry_data.type == MMDB_DATA_TYPE_ARRAY
-                || entry_data_list->entry_data.type == MMDB_DATA_TYPE_MAP) {
+/* Most doubles in a database, like coordinates, have only a few decimal
+ * places. For those we can find the shortest representation without going
+ * through sprintf() and strtod(). Any decimal with at most 15 significant
+ * digits survives a round trip through a double, so limiting this to 15
+ * digits means we produce exactly what "%.15g" would. */
+LOCAL bool format_short_double(char *buffer, double value)
+{
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+        1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+    };
 
-                int status =
-                    get_entry_data_list(mmdb, last_offset, entry_data_list,
-                                        depth);
-                if (MMDB_SUCCESS != status) {
-                    DEBUG_MSG("get_entry_data_list on pointer failed.");
-                    return status;
-                }
-            }
-            entry_data_list->entry_data.offset_to_next = next_offset;
+    double magnitude = value < 0 ? -value : value;
+    if (!(magnitude >= 1e-4 && magnitude < 1e15)) {
+        return false;
+    }
+
+    int places = 0;
+    uint64_t digits = 0;
+    for (; places < 16; places++) {
+        double scaled = magnitude * powers_of_ten[places];
+        if (scaled >= 1e15) {
+            return false;
         }
-        break;
-    case MMDB_DATA_TYPE_ARRAY:
-        {
-            uint32_t array_size = entry_data_list->entry_data.data_size;
-            uint32_t array_offset = entry_data_list->entry_data.offset_to_next;
-            MMDB_entry_data_list_s *previous = entry_data_list;
-            while (array_size-- > 0) {
-                MMDB_entry_data_list_s *entry_data_list_to = previous->next =
-                                                                 new_entry_data_list();
-                if (NULL == entry_data_list_to) {
-                    return MMDB_OUT_OF_MEMORY_ERROR;
-                }
+        digits = (uint64_t)(scaled + 0.5);
+        /* Division by an exact power of ten is correctly rounded, so this
+         * tells us whether the decimal reads back as the same double. */
+        if ((double)digits / powers_of_ten[places] == magnitude) {
+            break;
+        }
+    }
+    if (16 == places) {
+        return false;
+    }
+    for (; places > 0 && 0 == digits % 10; places--) {
+        digits /= 10;
+    }
 
-                int status =
-                    get_entry_data_list(mmdb, array_offset, entry_data_list_to,
-                                        depth);
-                if (MMDB_SUCCESS != status) {
-                    DEBUG_MSG("get_entry_data_list on array element failed.");
-                    return status;
-                }
+    char reversed[32];
+    int length = 0;
+    for (int i = 0; i < places || digits > 0; i++) {
+        if (i == places && places > 0) {
+            reversed[length++] = '.';
+        }
+        reversed[length++] = '0' + digits % 10;
+        digits /= 10;
+    }
+    if (length == places) {
+        reversed[length++] = '.';
+        reversed[length++] = '0';
+    }
 
-                array_offset = entry_data_list_to->entry_data.offset_to_next;
-                while (previous->next) {
-                    previous = previous->next;
-                }
-            }
-            entry_data_list->entry_data.offset_to_next = array_offset;
+    char *p = buffer;
+    if (value < 0) {
+        *p++ = '-';
+    }
+    while (length > 0) {
+        *p++ = reversed[--length];
+    }
+    *p = '\0';
+    return true;
+}
 
-        }
-        break;
-    case MMDB_DATA_TYPE_MAP:
-        {
-            uint32_t size = entry_data_list->entry_data.data_size;
+int MMDB_entry_to_json(MMDB_entry_s *const entry, char *buffer, size_t capacity,
+                       size_t *needed)
+{
+    static const MMDB_visitor_s json_visitor = {
+        .begin_map   = json_begin_map,
+        .end_map     = json_end_map,
+        .begin_array = json_begin_array,
+        .end_array   = json_end_array,
+        .key         = json_key,
+        .scalar      = json_scalar,
+    };
 
-            offset = entry_data_list->entry_data.offset_to_next;
-            MMDB_entry_data_list_s *previous = entry_data_list;
-            while (size-- > 0) {
-                MMDB_entry_data_list_s *entry_data_list_to = previous->next =
-                                                                 new_entry_data_list();
-                if (NULL == entry_data_list_to) {
-                    return MMDB_OUT_OF_MEMORY_ERROR;
-                }
+    output_writer_s writer = {
+        .buffer     = buffer,
+        .limit      = capacity ? capacity - 1 : 0,
+        .size       = 0,
+        .need_comma = false,
+        .status     = MMDB_SUCCESS,
+    };
 
-                int status =
-                    get_entry_data_list(mmdb, offset, entry_data_list_to,
-                                        depth);
-                if (MMDB_SUCCESS != status) {
-                    DEBUG_MSG("get_entry_data_list on map key failed.");
-                    return status;
-                }
+    int status = MMDB_walk_entry(entry, &json_visitor, &writer);
+    if (MMDB_SUCCESS != status) {
+        return status;
+    }
+    if (MMDB_SUCCESS != writer.status) {
+        return writer.status;
+    }
 
-                while (previous->next) {
-                    previous = previous->next;
-                }
+    if (capacity) {
+        buffer[writer.size < writer.limit ? writer.size : writer.limit] = '\0';
+    }
+    if (NULL != needed) {
+        *needed = writer.size + 1;
+    }
 
-                offset = entry_data_list_to->entry_data.offset_to_next;
-                entry_data_list_to = previous->next =
-                                         new_entry_data_list();
+    return writer.size < capacity ? MMDB_SUCCESS : MMDB_BUFFER_TOO_SMALL_ERROR;
+}
 
-                if (NULL == entry_data_list_to) {
-                    return MMDB_OUT_OF_MEMORY_ERROR;
-                }
+LOCAL int json_begin_map(void *ctx, uint32_t size)
+{
+    (void)size;
+    output_writer_s *writer = ctx;
+    json_write_separator(writer);
+    output_write_char(writer, '{');
+    writer->need_comma = false;
+    return MMDB_VISIT_CONTINUE;
+}
 
-                status = get_entry_data_list(mmdb, offset, entry_data_list_to,
-                                             depth);
-                if (MMDB_SUCCESS != status) {
-                    DEBUG_MSG("get_entry_data_list on map element failed.");
-                    return status;
-                }
+LOCAL int json_end_map(void *ctx)
+{
+    output_writer_s *writer = ctx;
+    output_write_char(writer, '}');
+    writer->need_comma = true;
+    return MMDB_VISIT_CONTINUE;
+}
 
-                while (previous->next) {
-                    previous = previous->next;
-                }
-                offset = entry_data_list_to->entry_data.offset_to_next;
-            }
-            entry_data_list->entry_data.offset_to_next = offset;
-        }
-        break;
-    default:
-        break;
-    }
+LOCAL int json_begin_array(void *ctx, uint32_t size)
+{
+    (void)size;
+    output_writer_s *writer = ctx;
+    json_write_separator(writer);
+    output_write_char(writer, '[');
+    writer->need_comma = false;
+    return MMDB_VISIT_CONTINUE;
+}
 
-    return MMDB_SUCCESS;
+LOCAL int json_end_array(void *ctx)
+{
+    output_writer_s *writer = ctx;
+    output_write_char(writer, ']');
+    writer->need_comma = true;
+    return MMDB_VISIT_CONTINUE;
 }
 
-LOCAL float get_ieee754_float(const uint8_t *restrict p)
+LOCAL int json_key(void *ctx, const char *key, uint32_t key_size)
 {
-    volatile float f;
-    uint8_t *q = (void *)&f;
-/* Windows builds don't use autoconf but we can assume they're all
- * little-endian. */
-#if MMDB_LITTLE_ENDIAN || _WIN32
-    q[3] = p[0];
-    q[2] = p[1];
-    q[1] = p[2];
-    q[0] = p[3];
-#else
-    memcpy(q, p, 4);
-#endif
-    return f;
+    output_writer_s *writer = ctx;
+    json_write_separator(writer);
+    json_write_string(writer, key, key_size);
+    output_write_char(writer, ':');
+    writer->need_comma = false;
+    return MMDB_VISIT_CONTINUE;
 }
 
-LOCAL double get_ieee754_double(const uint8_t *restrict p)
+LOCAL int json_scalar(void *ctx, const MMDB_entry_data_s *entry_data)
 {
-    volatile double d;
-    uint8_t *q = (void *)&d;
-#if MMDB_LITTLE_ENDIAN || _WIN32
-    q[7] = p[0];
-    q[6] = p[1];
-    q[5] = p[2];
-    q[4] = p[3];
-    q[3] = p[4];
-    q[2] = p[5];
-    q[1] = p[6];
-    q[0] = p[7];
-#else
-    memcpy(q, p, 8);
-#endif
+    output_writer_s *writer = ctx;
+    char buffer[32];
 
-    return d;
+    json_write_separator(writer);
+    writer->need_comma = true;
+
+    switch (entry_data->type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        json_write_string(writer, entry_data->utf8_string,
+                          entry_data->data_size);
+        break;
+    case MMDB_DATA_TYPE_BYTES:
+        output_write_char(writer, '"');
+        json_write_hex(writer, entry_data->bytes, entry_data->data_size);
+        output_write_char(writer, '"');
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+        format_json_double(buffer, entry_data->double_value, false);
+        output_write(writer, buffer, strlen(buffer));
+        break;
+    case MMDB_DATA_TYPE_FLOAT:
+        format_json_double(buffer, entry_data->float_value, true);
+        output_write(writer, buffer, strlen(buffer));
+        break;
+    case MMDB_DATA_TYPE_UINT16:
+        json_write_uint64(writer, entry_data->uint16);
+        break;
+    case MMDB_DATA_TYPE_UINT32:
+        json_write_uint64(writer, entry_data->uint32);
+        break;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        if (entry_data->boolean) {
+            output_write(writer, "true", 4);
+        } else {
+            output_write(writer, "false", 5);
+        }
+        break;
+    case MMDB_DATA_TYPE_UINT64:
+        json_write_uint64(writer, entry_data->uint64);
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+        {
+            uint8_t bytes[16];
+            mmdb_uint128_to_bytes(entry_data, bytes);
+            output_write(writer, "\"0x", 3);
+            json_write_hex(writer, bytes, 16);
+            output_write_char(writer, '"');
+        }
+        break;
+    case MMDB_DATA_TYPE_INT32:
+        if (entry_data->int32 < 0) {
+            output_write_char(writer, '-');
+            json_write_uint64(writer, -(int64_t)entry_data->int32);
+        } else {
+            json_write_uint64(writer, entry_data->int32);
+        }
+        break;
+    default:
+        writer->status = MMDB_INVALID_DATA_ERROR;
+        return MMDB_VISIT_STOP;
+    }
+
+    return MMDB_VISIT_CONTINUE;
 }
 
-LOCAL uint32_t get_uint32(const uint8_t *p)
+LOCAL void output_write(output_writer_s *writer, const char *data,
+                        size_t size)
 {
-    return p[0] * 16777216U + p[1] * 65536 + p[2] * 256 + p[3];
+    if (writer->size < writer->limit) {
+        size_t available = writer->limit - writer->size;
+        memcpy(writer->buffer + writer->size, data,
+               size < available ? size : available);
+    }
+    writer->size += size;
 }
 
-LOCAL uint32_t get_uint24(const uint8_t *p)
+LOCAL void output_write_char(output_writer_s *writer, char c)
 {
-    return p[0] * 65536U + p[1] * 256 + p[2];
+    if (writer->size < writer->limit) {
+        writer->buffer[writer->size] = c;
+    }
+    writer->size++;
 }
 
-LOCAL uint32_t get_uint16(const uint8_t *p)
+LOCAL void json_write_separator(output_writer_s *writer)
 {
-    return p[0] * 256U + p[1];
+    if (writer->need_comma) {
+        output_write_char(writer, ',');
+    }
 }
 
-LOCAL uint64_t get_uintX(const uint8_t *p, int length)
+LOCAL void json_write_string(output_writer_s *writer, const char *string,
+                             uint32_t size)
 {
-    uint64_t value = 0;
-    while (length-- > 0) {
-        value <<= 8;
-        value += *p++;
+    output_write_char(writer, '"');
+    while (size > 0) {
+        uint32_t safe = json_string_safe_prefix((const uint8_t *)string, size);
+        output_write(writer, string, safe);
+        if (safe == size) {
+            break;
+        }
+
+        char escape[6];
+        output_write(writer, escape,
+                   json_escape_char((uint8_t)string[safe], escape));
+        string += safe + 1;
+        size -= safe + 1;
     }
-    return value;
+    output_write_char(writer, '"');
 }
 
-LOCAL int32_t get_sintX(const uint8_t *p, int length)
+/* This returns the number of bytes at the start of the string that can be
+ * copied into a JSON string as is. Most strings in a database need no
+ * escaping at all, so with SSE2 we check 16 bytes at a time. */
+LOCAL uint32_t json_string_safe_prefix(const uint8_t *string, uint32_t size)
 {
-    return (int32_t)get_uintX(p, length);
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(string + i));
+        /* min(c, 0x1f) == c is an unsigned c <= 0x1f */
+        __m128i unsafe =
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk),
+                         _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                      _mm_cmpeq_epi8(chunk, backslash)));
+        int mask = _mm_movemask_epi8(unsafe);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < size; i++) {
+        uint8_t c = string[i];
+        if (c < 0x20 || c == '"' || c == '\\') {
+            break;
+        }
+    }
+    return i;
 }
 
-LOCAL MMDB_entry_data_list_s *new_entry_data_list(void)
+LOCAL void json_write_uint64(output_writer_s *writer, uint64_t value)
 {
-    /* We need calloc here in order to ensure that the ->next pointer in the
-     * struct doesn't point to some random address. */
-    return calloc(1, sizeof(MMDB_entry_data_list_s));
+    char digits[20];
+    int i = sizeof(digits);
+    do {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    output_write(writer, digits + i, sizeof(digits) - i);
 }
 
-void MMDB_free_entry_data_list(MMDB_entry_data_list_s *const entry_data_list)
+LOCAL void json_write_hex(output_writer_s *writer, const uint8_t *bytes,
+                          uint32_t size)
 {
-    if (entry_data_list == NULL) {
-        return;
-    }
-    if (entry_data_list->next) {
-        MMDB_free_entry_data_list(entry_data_list->next);
+    static const char hex[] = "0123456789ABCDEF";
+    char buffer[64];
+
+    while (size > 0) {
+        uint32_t n = size < sizeof(buffer) / 2 ? size : sizeof(buffer) / 2;
+        for (uint32_t i = 0; i < n; i++) {
+            buffer[2 * i] = hex[bytes[i] >> 4];
+            buffer[2 * i + 1] = hex[bytes[i] & 15];
+        }
+        output_write(writer, buffer, 2 * n);
+        bytes += n;
+        size -= n;
     }
-    free(entry_data_list);
 }
 
-void MMDB_close(MMDB_s *const mmdb)
+int MMDB_entry_to_msgpack(MMDB_entry_s *const entry, uint8_t *buffer,
+                          size_t capacity, size_t *needed)
 {
-    free_mmdb_struct(mmdb);
+    static const MMDB_visitor_s msgpack_visitor = {
+        .begin_map   = msgpack_begin_map,
+        .begin_array = msgpack_begin_array,
+        .key         = msgpack_key,
+        .scalar      = msgpack_scalar,
+    };
+
+    return entry_to_binary(entry, &msgpack_visitor, buffer, capacity, needed);
 }
 
-LOCAL void free_mmdb_struct(MMDB_s *const mmdb)
+int MMDB_entry_to_cbor(MMDB_entry_s *const entry, uint8_t *buffer,
+                       size_t capacity, size_t *needed)
 {
-    if (!mmdb) {
-        return;
-    }
+    static const MMDB_visitor_s cbor_visitor = {
+        .begin_map   = cbor_begin_map,
+        .begin_array = cbor_begin_array,
+        .key         = cbor_key,
+        .scalar      = cbor_scalar,
+    };
 
-    if (NULL != mmdb->filename) {
-        FREE_AND_SET_NULL(mmdb->filename);
+    return entry_to_binary(entry, &cbor_visitor, buffer, capacity, needed);
+}
+
+LOCAL int entry_to_binary(MMDB_entry_s *const entry,
+                          const MMDB_visitor_s *visitor, uint8_t *buffer,
+                          size_t capacity, size_t *needed)
+{
+    output_writer_s writer = {
+        .buffer = (char *)buffer,
+        .limit  = capacity,
+        .size   = 0,
+        .status = MMDB_SUCCESS,
+    };
+
+    int status = MMDB_walk_entry(entry, visitor, &writer);
+    if (MMDB_SUCCESS != status) {
+        return status;
     }
-    if (NULL != mmdb->file_content) {
-#ifdef _WIN32
-        UnmapViewOfFile(mmdb->file_content);
-        /* Winsock is only initialized if open was successful so we only have
-         * to cleanup then. */
-        WSACleanup();
-#else
-        munmap((void *)mmdb->file_content, mmdb->file_size);
-#endif
+    if (MMDB_SUCCESS != writer.status) {
+        return writer.status;
     }
 
-    if (NULL != mmdb->metadata.database_type) {
-        FREE_AND_SET_NULL(mmdb->metadata.database_type);
+    if (NULL != needed) {
+        *needed = writer.size;
     }
 
-    free_languages_metadata(mmdb);
-    free_descriptions_metadata(mmdb);
+    return writer.size <= capacity ? MMDB_SUCCESS : MMDB_BUFFER_TOO_SMALL_ERROR;
 }
 
-LOCAL void free_languages_metadata(MMDB_s *mmdb)
+LOCAL int msgpack_begin_map(void *ctx, uint32_t size)
 {
-    if (!mmdb->metadata.languages.count) {
-        return;
-    }
+    msgpack_write_sized(ctx, size, 0x80, 16, 0, 0xde, 0xdf);
+    return MMDB_VISIT_CONTINUE;
+}
 
-    for (size_t i = 0; i < mmdb->metadata.languages.count; i++) {
-        FREE_AND_SET_NULL(mmdb->metadata.languages.names[i]);
-    }
-    FREE_AND_SET_NULL(mmdb->metadata.languages.names);
+LOCAL int msgpack_begin_array(void *ctx, uint32_t size)
+{
+    msgpack_write_sized(ctx, size, 0x90, 16, 0, 0xdc, 0xdd);
+    return MMDB_VISIT_CONTINUE;
 }
 
-LOCAL void free_descriptions_metadata(MMDB_s *mmdb)
+LOCAL int msgpack_key(void *ctx, const char *key, uint32_t key_size)
 {
-    if (!mmdb->metadata.description.count) {
-        return;
-    }
+    msgpack_write_sized(ctx, key_size, 0xa0, 32, 0xd9, 0xda, 0xdb);
+    output_write(ctx, key, key_size);
+    return MMDB_VISIT_CONTINUE;
+}
 
-    for (size_t i = 0; i < mmdb->metadata.description.count; i++) {
-        if (NULL != mmdb->metadata.description.descriptions[i]) {
-            if (NULL !=
-                mmdb->metadata.description.descriptions[i]->language) {
-                FREE_AND_SET_NULL(
-                    mmdb->metadata.description.descriptions[i]->language);
-            }
+LOCAL int msgpack_scalar(void *ctx, const MMDB_entry_data_s *entry_data)
+{
+    output_writer_s *writer = ctx;
+    uint64_t bits;
 
-            if (NULL !=
-                mmdb->metadata.description.descriptions[i]->description) {
-                FREE_AND_SET_NULL(
-                    mmdb->metadata.description.descriptions[i]->description);
+    switch (entry_data->type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        msgpack_write_sized(writer, entry_data->data_size, 0xa0, 32, 0xd9,
+                            0xda, 0xdb);
+        output_write(writer, entry_data->utf8_string, entry_data->data_size);
+        break;
+    case MMDB_DATA_TYPE_BYTES:
+        /* There is no fixed size bin type so we pass a limit of 0 */
+        msgpack_write_sized(writer, entry_data->data_size, 0, 0, 0xc4, 0xc5,
+                            0xc6);
+        output_write(writer, (const char *)entry_data->bytes,
+                     entry_data->data_size);
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+        memcpy(&bits, &entry_data->double_value, 8);
+        output_write_char(writer, (char)0xcb);
+        output_write_big_endian(writer, bits, 8);
+        break;
+    case MMDB_DATA_TYPE_FLOAT:
+        {
+            uint32_t float_bits;
+            memcpy(&float_bits, &entry_data->float_value, 4);
+            output_write_char(writer, (char)0xca);
+            output_write_big_endian(writer, float_bits, 4);
+        }
+        break;
+    case MMDB_DATA_TYPE_UINT16:
+        msgpack_write_uint64(writer, entry_data->uint16);
+        break;
+    case MMDB_DATA_TYPE_UINT32:
+        msgpack_write_uint64(writer, entry_data->uint32);
+        break;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        output_write_char(writer,
+                          entry_data->boolean ? (char)0xc3 : (char)0xc2);
+        break;
+    case MMDB_DATA_TYPE_UINT64:
+        msgpack_write_uint64(writer, entry_data->uint64);
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+        {
+            /* MessagePack has no 128-bit integers, so values that don't fit
+             * in a uint64 are written as 16 big-endian bytes of bin data. */
+            uint8_t bytes[16];
+            int length = mmdb_uint128_to_bytes(entry_data, bytes);
+            if (length <= 8) {
+                msgpack_write_uint64(writer, get_uintX(bytes + 16 - length,
+                                                       length));
+            } else {
+                msgpack_write_sized(writer, 16, 0, 0, 0xc4, 0xc5, 0xc6);
+                output_write(writer, (const char *)bytes, 16);
+            }
+        }
+        break;
+    case MMDB_DATA_TYPE_INT32:
+        {
+            int32_t value = entry_data->int32;
+            if (value >= 0) {
+                msgpack_write_uint64(writer, (uint64_t)value);
+            } else if (value >= -32) {
+                output_write_char(writer, (char)(uint8_t)value);
+            } else if (value >= INT8_MIN) {
+                output_write_char(writer, (char)0xd0);
+                output_write_big_endian(writer, (uint8_t)value, 1);
+            } else if (value >= INT16_MIN) {
+                output_write_char(writer, (char)0xd1);
+                output_write_big_endian(writer, (uint16_t)value, 2);
+            } else {
+                output_write_char(writer, (char)0xd2);
+                output_write_big_endian(writer, (uint32_t)value, 4);
             }
-            FREE_AND_SET_NULL(mmdb->metadata.description.descriptions[i]);
         }
+        break;
+    default:
+        writer->status = MMDB_INVALID_DATA_ERROR;
+        return MMDB_VISIT_STOP;
     }
 
-    FREE_AND_SET_NULL(mmdb->metadata.description.descriptions);
+    return MMDB_VISIT_CONTINUE;
 }
 
-const char *MMDB_lib_version(void)
+LOCAL void msgpack_write_uint64(output_writer_s *writer, uint64_t value)
 {
-    return PACKAGE_VERSION;
+    if (value < 128) {
+        output_write_char(writer, (char)value);
+    } else if (value <= UINT8_MAX) {
+        output_write_char(writer, (char)0xcc);
+        output_write_big_endian(writer, value, 1);
+    } else if (value <= UINT16_MAX) {
+        output_write_char(writer, (char)0xcd);
+        output_write_big_endian(writer, value, 2);
+    } else if (value <= UINT32_MAX) {
+        output_write_char(writer, (char)0xce);
+        output_write_big_endian(writer, value, 4);
+    } else {
+        output_write_char(writer, (char)0xcf);
+        output_write_big_endian(writer, value, 8);
+    }
 }
 
-int MMDB_dump_entry_data_list(FILE *const stream,
-                              MMDB_entry_data_list_s *const entry_data_list,
-                              int indent)
+/* MessagePack strings, bin data, arrays and maps all pick the smallest of a
+ * "fix" type with the size in the low bits or a type followed by an 8, 16 or
+ * 32 bit size. A type8 of 0 means there is no 8 bit form. */
+LOCAL void msgpack_write_sized(output_writer_s *writer, uint32_t size,
+                               uint8_t fix_type, uint8_t fix_limit,
+                               uint8_t type8, uint8_t type16, uint8_t type32)
 {
-    int status;
-    dump_entry_data_list(stream, entry_data_list, indent, &status);
-    return status;
+    if (size < fix_limit) {
+        output_write_char(writer, (char)(fix_type | size));
+    } else if (type8 && size <= UINT8_MAX) {
+        output_write_char(writer, (char)type8);
+        output_write_big_endian(writer, size, 1);
+    } else if (size <= UINT16_MAX) {
+        output_write_char(writer, (char)type16);
+        output_write_big_endian(writer, size, 2);
+    } else {
+        output_write_char(writer, (char)type32);
+        output_write_big_endian(writer, size, 4);
+    }
 }
 
-LOCAL MMDB_entry_data_list_s *dump_entry_data_list(
-    FILE *stream, MMDB_entry_data_list_s *entry_data_list, int indent,
-    int *status)
+LOCAL int cbor_begin_map(void *ctx, uint32_t size)
 {
-    switch (entry_data_list->entry_data.type) {
-    case MMDB_DATA_TYPE_MAP:
-        {
-            uint32_t size = entry_data_list->entry_data.data_size;
-
-            print_indentation(stream, indent);
-            fprintf(stream, "{\n");
-            indent += 2;
-
-            for (entry_data_list = entry_data_list->next;
-                 size && entry_data_list; size--) {
-
-                if (MMDB_DATA_TYPE_UTF8_STRING !=
-                    entry_data_list->entry_data.type) {
-                    *status = MMDB_INVALID_DATA_ERROR;
-                    return NULL;
-                }
-                char *key =
-                    mmdb_strndup(
-                        (char *)entry_data_list->entry_data.utf8_string,
-                        entry_data_list->entry_data.data_size);
-                if (NULL == key) {
-                    *status = MMDB_OUT_OF_MEMORY_ERROR;
-                    return NULL;
-                }
-
-                print_indentation(stream, indent);
-                fprintf(stream, "\"%s\": \n", key);
-                free(key);
-
-                entry_data_list = entry_data_list->next;
-                entry_data_list =
-                    dump_entry_data_list(stream, entry_data_list, indent + 2,
-                                         status);
-
-                if (MMDB_SUCCESS != *status) {
-                    return NULL;
-                }
-            }
+    cbor_write_head(ctx, 5, size);
+    return MMDB_VISIT_CONTINUE;
+}
 
-            indent -= 2;
-            print_indentation(stream, indent);
-            fprintf(stream, "}\n");
-        }
-        break;
-    case MMDB_DATA_TYPE_ARRAY:
-        {
-            uint32_t size = entry_data_list->entry_data.data_size;
+LOCAL int cbor_begin_array(void *ctx, uint32_t size)
+{
+    cbor_write_head(ctx, 4, size);
+    return MMDB_VISIT_CONTINUE;
+}
 
-            print_indentation(stream, indent);
-            fprintf(stream, "[\n");
-            indent += 2;
+LOCAL int cbor_key(void *ctx, const char *key, uint32_t key_size)
+{
+    cbor_write_head(ctx, 3, key_size);
+    output_write(ctx, key, key_size);
+    return MMDB_VISIT_CONTINUE;
+}
 
-            for (entry_data_list = entry_data_list->next;
-                 size && entry_data_list; size--) {
-                entry_data_list =
-                    dump_entry_data_list(stream, entry_data_list, indent,
-                                         status);
-                if (MMDB_SUCCESS != *status) {
-                    return NULL;
-                }
-            }
+LOCAL int cbor_scalar(void *ctx, const MMDB_entry_data_s *entry_data)
+{
+    output_writer_s *writer = ctx;
+    uint64_t bits;
 
-            indent -= 2;
-            print_indentation(stream, indent);
-            fprintf(stream, "]\n");
-        }
-        break;
+    switch (entry_data->type) {
     case MMDB_DATA_TYPE_UTF8_STRING:
-        {
-            char *string =
-                mmdb_strndup((char *)entry_data_list->entry_data.utf8_string,
-                             entry_data_list->entry_data.data_size);
-            if (NULL == string) {
-                *status = MMDB_OUT_OF_MEMORY_ERROR;
-                return NULL;
-            }
-            print_indentation(stream, indent);
-            fprintf(stream, "\"%s\" <utf8_string>\n", string);
-            free(string);
-            entry_data_list = entry_data_list->next;
-        }
+        cbor_write_head(writer, 3, entry_data->data_size);
+        output_write(writer, entry_data->utf8_string, entry_data->data_size);
         break;
     case MMDB_DATA_TYPE_BYTES:
-        {
-            char *hex_string =
-                bytes_to_hex((uint8_t *)entry_data_list->entry_data.bytes,
-                             entry_data_list->entry_data.data_size);
-            if (NULL == hex_string) {
-                *status = MMDB_OUT_OF_MEMORY_ERROR;
-                return NULL;
-            }
-
-            print_indentation(stream, indent);
-            fprintf(stream, "%s <bytes>\n", hex_string);
-            free(hex_string);
-
-            entry_data_list = entry_data_list->next;
-        }
+        cbor_write_head(writer, 2, entry_data->data_size);
+        output_write(writer, (const char *)entry_data->bytes,
+                     entry_data->data_size);
         break;
     case MMDB_DATA_TYPE_DOUBLE:
-        print_indentation(stream, indent);
-        fprintf(stream, "%f <double>\n",
-                entry_data_list->entry_data.double_value);
-        entry_data_list = entry_data_list->next;
+        memcpy(&bits, &entry_data->double_value, 8);
+        output_write_char(writer, (char)0xfb);
+        output_write_big_endian(writer, bits, 8);
         break;
     case MMDB_DATA_TYPE_FLOAT:
-        print_indentation(stream, indent);
-        fprintf(stream, "%f <float>\n",
-                entry_data_list->entry_data.float_value);
-        entry_data_list = entry_data_list->next;
+        {
+            uint32_t float_bits;
+            memcpy(&float_bits, &entry_data->float_value, 4);
+            output_write_char(writer, (char)0xfa);
+            output_write_big_endian(writer, float_bits, 4);
+        }
         break;
     case MMDB_DATA_TYPE_UINT16:
-        print_indentation(stream, indent);
-        fprintf(stream, "%u <uint16>\n", entry_data_list->entry_data.uint16);
-        entry_data_list = entry_data_list->next;
+        cbor_write_head(writer, 0, entry_data->uint16);
         break;
     case MMDB_DATA_TYPE_UINT32:
-        print_indentation(stream, indent);
-        fprintf(stream, "%u <uint32>\n", entry_data_list->entry_data.uint32);
-        entry_data_list = entry_data_list->next;
+        cbor_write_head(writer, 0, entry_data->uint32);
         break;
     case MMDB_DATA_TYPE_BOOLEAN:
-        print_indentation(stream, indent);
-        fprintf(stream, "%s <boolean>\n",
-                entry_data_list->entry_data.boolean ? "true" : "false");
-        entry_data_list = entry_data_list->next;
+        output_write_char(writer,
+                          entry_data->boolean ? (char)0xf5 : (char)0xf4);
         break;
     case MMDB_DATA_TYPE_UINT64:
-        print_indentation(stream, indent);
-        fprintf(stream, "%" PRIu64 " <uint64>\n",
-                entry_data_list->entry_data.uint64);
-        entry_data_list = entry_data_list->next;
+        cbor_write_head(writer, 0, entry_data->uint64);
         break;
     case MMDB_DATA_TYPE_UINT128:
-        print_indentation(stream, indent);
-#if MMDB_UINT128_IS_BYTE_ARRAY
-        char *hex_string =
-            bytes_to_hex((uint8_t *)entry_data_list->entry_data.uint128, 16);
-        if (NULL == hex_string) {
-            *status = MMDB_OUT_OF_MEMORY_ERROR;
-            return NULL;
+        {
+            /* Values that don't fit in a uint64 are written as a positive
+             * bignum, which is tag 2 followed by a byte string. */
+            uint8_t bytes[16];
+            int length = mmdb_uint128_to_bytes(entry_data, bytes);
+            if (length <= 8) {
+                cbor_write_head(writer, 0, get_uintX(bytes + 16 - length,
+                                                     length));
+            } else {
+                cbor_write_head(writer, 6, 2);
+                cbor_write_head(writer, 2, length);
+                output_write(writer, (const char *)bytes + 16 - length,
+                             length);
+            }
         }
-        fprintf(stream, "0x%s <uint128>\n", hex_string);
-        free(hex_string);
-#else
-        uint64_t high = entry_data_list->entry_data.uint128 >> 64;
-        uint64_t low = (uint64_t)entry_data_list->entry_data.uint128;
-        fprintf(stream, "0x%016" PRIX64 "%016" PRIX64 " <uint128>\n", high,
-                low);
-#endif
-        entry_data_list = entry_data_list->next;
         break;
     case MMDB_DATA_TYPE_INT32:
-        print_indentation(stream, indent);
-        fprintf(stream, "%d <int32>\n", entry_data_list->entry_data.int32);
-        entry_data_list = entry_data_list->next;
+        if (entry_data->int32 >= 0) {
+            cbor_write_head(writer, 0, (uint64_t)entry_data->int32);
+        } else {
+            cbor_write_head(writer, 1,
+                            (uint64_t)(-1 - (int64_t)entry_data->int32));
+        }
         break;
     default:
-        *status = MMDB_INVALID_DATA_ERROR;
-        return NULL;
+        writer->status = MMDB_INVALID_DATA_ERROR;
+        return MMDB_VISIT_STOP;
     }
 
-    *status = MMDB_SUCCESS;
-    return entry_data_list;
+    return MMDB_VISIT_CONTINUE;
+}
+
+LOCAL void cbor_write_head(output_writer_s *writer, uint8_t major_type,
+                           uint64_t value)
+{
+    uint8_t initial = (uint8_t)(major_type << 5);
+    if (value < 24) {
+        output_write_char(writer, (char)(initial | value));
+    } else if (value <= UINT8_MAX) {
+        output_write_char(writer, (char)(initial | 24));
+        output_write_big_endian(writer, value, 1);
+    } else if (value <= UINT16_MAX) {
+        output_write_char(writer, (char)(initial | 25));
+        output_write_big_endian(writer, value, 2);
+    } else if (value <= UINT32_MAX) {
+        output_write_char(writer, (char)(initial | 26));
+        output_write_big_endian(writer, value, 4);
+    } else {
+        output_write_char(writer, (char)(initial | 27));
+        output_write_big_endian(writer, value, 8);
+    }
+}
+
+LOCAL void output_write_big_endian(output_writer_s *writer, uint64_t value,
+                                   int bytes)
+{
+    char buffer[8];
+    for (int i = bytes - 1; i >= 0; i--) {
+        buffer[i] = (char)(value & 0xff);
+        value >>= 8;
+    }
+    output_write(writer, buffer, bytes);
+}
+
+/* This writes a uint128 as 16 big-endian bytes and returns the number of
+ * bytes that are left once the leading zero bytes are dropped. */
+INTERNAL int mmdb_uint128_to_bytes(const MMDB_entry_data_s *entry_data,
+                                   uint8_t *bytes)
+{
+#if MMDB_UINT128_IS_BYTE_ARRAY
+    memcpy(bytes, entry_data->uint128, 16);
+#else
+    for (int i = 0; i < 16; i++) {
+        bytes[i] = (uint8_t)(entry_data->uint128 >> (8 * (15 - i)));
+    }
+#endif
+
+    int length = 16;
+    for (; length > 0 && 0 == bytes[16 - length]; length--) {
+    }
+    return length;
 }
 
 LOCAL void print_indentation(FILE *stream, int i)
@@ -2144,6 +6106,18 @@ const char *MMDB_strerror(int error_code)
     case MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR:
         return
             "You attempted to look up an IPv6 address in an IPv4-only database";
+    case MMDB_BUFFER_TOO_SMALL_ERROR:
+        return "The buffer is too small for the output";
+    case MMDB_TYPE_MISMATCH_ERROR:
+        return "The value at the lookup path is not of the requested type";
+    case MMDB_INVALID_NETWORK_ERROR:
+        return
+            "The network's prefix length is longer than the addresses in the database";
+    case MMDB_IP_VERSION_MISMATCH_ERROR:
+        return "The databases are for different IP versions";
+    case MMDB_DATABASE_TOO_BIG_ERROR:
+        return
+            "The database has too many nodes or too much data for its record size";
     default:
         return "Unknown error code";
     }
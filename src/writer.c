@@ -0,0 +1,1190 @@
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "maxminddb.h"
+#include "maxminddb-internal.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* This is the writer behind the MMDB_writer_* functions. It builds a search
+ * tree in memory and writes a standard v2 database. */
+
+/* *INDENT-OFF* */
+/* --prototypes automatically generated by dev-bin/regen-prototypes.pl - don't remove this comment */
+LOCAL int new_writer_node(MMDB_writer_s *writer, uint32_t record,
+                          uint32_t *node);
+LOCAL int hash_writer_value(const MMDB_entry_data_s *values,
+                            uint32_t value_count, uint32_t index, int depth,
+                            uint32_t *ends, uint64_t *hashes);
+LOCAL bool find_written_value(MMDB_writer_s *writer,
+                              const MMDB_entry_data_s *values,
+                              const uint32_t *ends, uint64_t hash,
+                              uint32_t index, uint32_t *slot);
+LOCAL bool written_value_equals(MMDB_s *data, uint32_t offset,
+                                const MMDB_entry_data_s *values,
+                                const uint32_t *ends, uint32_t index,
+                                uint32_t *next_offset);
+LOCAL bool scalars_equal(const MMDB_entry_data_s *a,
+                         const MMDB_entry_data_s *b);
+LOCAL int write_writer_value(MMDB_writer_s *writer,
+                             const MMDB_entry_data_s *values,
+                             const uint32_t *ends, const uint64_t *hashes,
+                             uint32_t index);
+LOCAL int write_inline_value(MMDB_writer_s *writer,
+                             const MMDB_entry_data_s *values,
+                             const uint32_t *ends, const uint64_t *hashes,
+                             uint32_t index);
+LOCAL int uint64_to_bytes(uint64_t value, uint8_t *bytes);
+LOCAL int write_control(MMDB_writer_s *writer, uint32_t type, uint32_t size);
+LOCAL uint32_t pointer_size(uint32_t offset);
+LOCAL int write_pointer(MMDB_writer_s *writer, uint32_t offset);
+LOCAL int append_writer_data(MMDB_writer_s *writer, const void *bytes,
+                             uint32_t size);
+LOCAL int add_written_value(MMDB_writer_s *writer, uint64_t hash,
+                            uint32_t offset, uint32_t size);
+LOCAL int grow_written_values(MMDB_writer_s *writer);
+LOCAL int set_writer_record(MMDB_writer_s *writer, const uint8_t *address,
+                            uint16_t prefix_length, uint32_t record);
+LOCAL uint32_t ipv4_writer_node(MMDB_writer_s *writer);
+LOCAL uint32_t merge_writer_node(MMDB_writer_s *writer, uint32_t flags,
+                                 uint32_t node, uint32_t ipv4_node,
+                                 uint32_t *table, size_t mask);
+LOCAL int number_writer_nodes(MMDB_writer_s *writer, uint32_t *numbers,
+                              uint32_t *order, uint32_t *count);
+LOCAL int number_writer_pass(MMDB_writer_s *writer, bool hot,
+                             uint32_t *numbers, uint32_t *order,
+                             uint32_t *count);
+LOCAL bool is_writer_node(uint32_t record);
+LOCAL int write_writer_tree(MMDB_writer_s *writer, const uint32_t *numbers,
+                            const uint32_t *order, FILE *stream);
+LOCAL void encode_writer_node(uint32_t left, uint32_t right,
+                              uint16_t record_size, uint8_t *bytes);
+LOCAL int write_writer_metadata(MMDB_writer_s *writer);
+LOCAL uint32_t add_metadata_string(MMDB_entry_data_s *values, uint32_t i,
+                                   const char *string);
+LOCAL uint32_t add_metadata_uint(MMDB_entry_data_s *values, uint32_t i,
+                                 const char *key, uint32_t type,
+                                 uint64_t value);
+/* --prototypes end - don't remove this comment-- */
+/* *INDENT-ON* */
+
+int MMDB_writer_init(MMDB_writer_s *const writer, uint16_t ip_version,
+                     uint16_t record_size)
+{
+    memset(writer, 0, sizeof(MMDB_writer_s));
+    if (4 != ip_version && 6 != ip_version) {
+        return MMDB_INVALID_METADATA_ERROR;
+    }
+    if (24 != record_size && 28 != record_size && 32 != record_size) {
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+    }
+
+    writer->metadata.ip_version = ip_version;
+    writer->metadata.record_size = record_size;
+    writer->metadata.binary_format_major_version = 2;
+    writer->metadata.binary_format_minor_version = 0;
+    writer->metadata.build_epoch = (uint64_t)time(NULL);
+
+    /* The root is node 0. No record can point at it, which leaves 0 free to
+     * mean an empty record. */
+    uint32_t root;
+    int status = new_writer_node(writer, 0, &root);
+    if (MMDB_SUCCESS != status) {
+        MMDB_writer_free(writer);
+    }
+    return status;
+}
+
+/* This makes a new node with both of its records set to record */
+LOCAL int new_writer_node(MMDB_writer_s *writer, uint32_t record,
+                          uint32_t *node)
+{
+    if (writer->node_count == writer->node_capacity) {
+        /* Node numbers have to stay below MMDB_WRITER_DATA_RECORD */
+        if (writer->node_capacity >= MMDB_WRITER_DATA_RECORD) {
+            return MMDB_DATABASE_TOO_BIG_ERROR;
+        }
+        uint32_t capacity = writer->node_capacity
+                            ? writer->node_capacity * 2 : 1024;
+        if (capacity > MMDB_WRITER_DATA_RECORD) {
+            capacity = MMDB_WRITER_DATA_RECORD;
+        }
+        MAYBE_CHECK_SIZE_OVERFLOW(capacity, SIZE_MAX / (2 * sizeof(uint32_t)),
+                                  MMDB_OUT_OF_MEMORY_ERROR);
+        uint32_t *nodes = realloc(writer->nodes,
+                                  capacity * 2 * sizeof(uint32_t));
+        if (NULL == nodes) {
+            return MMDB_OUT_OF_MEMORY_ERROR;
+        }
+        writer->nodes = nodes;
+        if (NULL != writer->node_weights) {
+            uint64_t *weights = realloc(writer->node_weights,
+                                        capacity * sizeof(uint64_t));
+            if (NULL == weights) {
+                return MMDB_OUT_OF_MEMORY_ERROR;
+            }
+            writer->node_weights = weights;
+        }
+        writer->node_capacity = capacity;
+    }
+
+    *node = writer->node_count++;
+    writer->nodes[2 * *node] = record;
+    writer->nodes[2 * *node + 1] = record;
+    if (NULL != writer->node_weights) {
+        writer->node_weights[*node] = 0;
+    }
+    return MMDB_SUCCESS;
+}
+
+/* A record is written in two passes. The first checks that the values make
+ * up exactly one value and works out a hash of each value in it, including
+ * the nested ones, from the hashes of its children. The second writes the
+ * record. Any nested value that was already written is replaced by a
+ * pointer to it, as long as the pointer is smaller. */
+int MMDB_writer_add_record(MMDB_writer_s *const writer,
+                           const MMDB_entry_data_s *const values,
+                           uint32_t value_count, uint32_t *const record)
+{
+    if (0 == value_count) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    uint32_t *ends = malloc(value_count * sizeof(uint32_t));
+    uint64_t *hashes = malloc(value_count * sizeof(uint64_t));
+    if (NULL == ends || NULL == hashes) {
+        free(ends);
+        free(hashes);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    int status = hash_writer_value(values, value_count, 0, 0, ends, hashes);
+    if (MMDB_SUCCESS == status && ends[0] != value_count) {
+        DEBUG_MSG("the values are more than one value");
+        status = MMDB_INVALID_DATA_ERROR;
+    }
+
+    uint32_t slot;
+    if (MMDB_SUCCESS == status
+        && find_written_value(writer, values, ends, hashes[0], 0, &slot)) {
+        *record = writer->value_offsets[slot] - 1;
+    } else if (MMDB_SUCCESS == status) {
+        /* Every record goes in the table, however small it is, so that
+         * networks with the same data always share one record */
+        uint32_t offset = writer->data_size;
+        status = write_inline_value(writer, values, ends, hashes, 0);
+        if (MMDB_SUCCESS == status) {
+            status = add_written_value(writer, hashes[0], offset,
+                                       writer->data_size - offset);
+        }
+        *record = offset;
+    }
+
+    free(ends);
+    free(hashes);
+    return status;
+}
+
+/* This sets ends[index] to the index after the value at index and
+ * hashes[index] to its hash, and does the same for every value inside it */
+LOCAL int hash_writer_value(const MMDB_entry_data_s *values,
+                            uint32_t value_count, uint32_t index, int depth,
+                            uint32_t *ends, uint64_t *hashes)
+{
+    if (depth >= MAXIMUM_DATA_STRUCTURE_DEPTH) {
+        DEBUG_MSG("reached the maximum data structure depth");
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    const MMDB_entry_data_s *value = &values[index];
+    uint64_t hash = mmdb_hash_mix(0x3c6ef372fe94f82bULL, value->type);
+    uint32_t next = index + 1;
+    switch (value->type) {
+    case MMDB_DATA_TYPE_MAP:
+    case MMDB_DATA_TYPE_ARRAY:
+        {
+            if (value->data_size > MAXIMUM_DATA_SIZE) {
+                return MMDB_INVALID_DATA_ERROR;
+            }
+            hash = mmdb_hash_mix(hash, value->data_size);
+            uint64_t children = MMDB_DATA_TYPE_MAP == value->type
+                                ? 2 * (uint64_t)value->data_size
+                                : value->data_size;
+            for (uint64_t i = 0; i < children; i++) {
+                if (next >= value_count) {
+                    DEBUG_MSG("a map or array is missing some values");
+                    return MMDB_INVALID_DATA_ERROR;
+                }
+                if (MMDB_DATA_TYPE_MAP == value->type && 0 == i % 2
+                    && MMDB_DATA_TYPE_UTF8_STRING != values[next].type) {
+                    DEBUG_MSGF("map key has type %d", values[next].type);
+                    return MMDB_INVALID_DATA_ERROR;
+                }
+                int status = hash_writer_value(values, value_count, next,
+                                               depth + 1, ends, hashes);
+                if (MMDB_SUCCESS != status) {
+                    return status;
+                }
+                hash = mmdb_hash_mix(hash, hashes[next]);
+                next = ends[next];
+            }
+        }
+        break;
+    case MMDB_DATA_TYPE_UTF8_STRING:
+    case MMDB_DATA_TYPE_BYTES:
+        if (value->data_size > MAXIMUM_DATA_SIZE
+            || (value->data_size > 0 && NULL == value->bytes)) {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+        mmdb_hash_scalar(&hash, value);
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+    case MMDB_DATA_TYPE_UINT16:
+    case MMDB_DATA_TYPE_UINT32:
+    case MMDB_DATA_TYPE_INT32:
+    case MMDB_DATA_TYPE_UINT64:
+    case MMDB_DATA_TYPE_UINT128:
+    case MMDB_DATA_TYPE_BOOLEAN:
+    case MMDB_DATA_TYPE_FLOAT:
+        mmdb_hash_scalar(&hash, value);
+        break;
+    default:
+        DEBUG_MSGF("can't write a value of type %d", value->type);
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    ends[index] = next;
+    hashes[index] = hash;
+    return MMDB_SUCCESS;
+}
+
+/* This looks for a value that is already in the data section. Values with
+ * the same hash are decoded and compared, so a hash collision can't make
+ * two different values share a record. */
+LOCAL bool find_written_value(MMDB_writer_s *writer,
+                              const MMDB_entry_data_s *values,
+                              const uint32_t *ends, uint64_t hash,
+                              uint32_t index, uint32_t *slot)
+{
+    if (NULL == writer->value_offsets) {
+        return false;
+    }
+
+    MMDB_s data = {
+        .data_section      = writer->data,
+        .data_section_size = writer->data_size
+    };
+    for (*slot = (uint32_t)hash & writer->value_mask;
+         writer->value_offsets[*slot];
+         *slot = (*slot + 1) & writer->value_mask) {
+        uint32_t next;
+        if (writer->value_hashes[*slot] == hash
+            && written_value_equals(&data, writer->value_offsets[*slot] - 1,
+                                    values, ends, index, &next)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* This compares the value in the data section at offset, following a
+ * pointer if there is one there, with the value at index. next_offset is
+ * set to the offset after the value or the pointer. */
+LOCAL bool written_value_equals(MMDB_s *data, uint32_t offset,
+                                const MMDB_entry_data_s *values,
+                                const uint32_t *ends, uint32_t index,
+                                uint32_t *next_offset)
+{
+    MMDB_entry_data_s stored;
+    if (MMDB_SUCCESS != mmdb_decode_one(data, offset, &stored)) {
+        return false;
+    }
+    uint32_t next = stored.offset_to_next;
+    bool pointer = MMDB_DATA_TYPE_POINTER == stored.type;
+    if (pointer
+        && MMDB_SUCCESS != mmdb_decode_one(data, stored.pointer, &stored)) {
+        return false;
+    }
+
+    const MMDB_entry_data_s *value = &values[index];
+    if (stored.type != value->type) {
+        return false;
+    }
+    if (MMDB_DATA_TYPE_MAP != value->type
+        && MMDB_DATA_TYPE_ARRAY != value->type) {
+        *next_offset = next;
+        return scalars_equal(&stored, value);
+    }
+
+    if (stored.data_size != value->data_size) {
+        return false;
+    }
+    uint32_t child_offset = stored.offset_to_next;
+    for (uint32_t child = index + 1; child < ends[index];
+         child = ends[child]) {
+        if (!written_value_equals(data, child_offset, values, ends, child,
+                                  &child_offset)) {
+            return false;
+        }
+    }
+    *next_offset = pointer ? next : child_offset;
+    return true;
+}
+
+/* Floating point values are compared bit for bit, so 0.0 and -0.0 are
+ * different values and a NaN is the same as itself */
+LOCAL bool scalars_equal(const MMDB_entry_data_s *a,
+                         const MMDB_entry_data_s *b)
+{
+    switch (a->type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+    case MMDB_DATA_TYPE_BYTES:
+        return a->data_size == b->data_size
+               && (0 == a->data_size
+                   || 0 == memcmp(a->bytes, b->bytes, a->data_size));
+    case MMDB_DATA_TYPE_DOUBLE:
+        return 0 == memcmp(&a->double_value, &b->double_value,
+                           sizeof(double));
+    case MMDB_DATA_TYPE_FLOAT:
+        return 0 == memcmp(&a->float_value, &b->float_value, sizeof(float));
+    case MMDB_DATA_TYPE_UINT16:
+        return a->uint16 == b->uint16;
+    case MMDB_DATA_TYPE_UINT32:
+        return a->uint32 == b->uint32;
+    case MMDB_DATA_TYPE_INT32:
+        return a->int32 == b->int32;
+    case MMDB_DATA_TYPE_UINT64:
+        return a->uint64 == b->uint64;
+    case MMDB_DATA_TYPE_UINT128:
+        {
+            uint8_t a_bytes[16], b_bytes[16];
+            mmdb_uint128_to_bytes(a, a_bytes);
+            mmdb_uint128_to_bytes(b, b_bytes);
+            return 0 == memcmp(a_bytes, b_bytes, 16);
+        }
+    case MMDB_DATA_TYPE_BOOLEAN:
+        return a->boolean == b->boolean;
+    default:
+        return false;
+    }
+}
+
+/* This writes a value inside a map or array. When hashes is NULL, nothing
+ * is deduplicated. */
+LOCAL int write_writer_value(MMDB_writer_s *writer,
+                             const MMDB_entry_data_s *values,
+                             const uint32_t *ends, const uint64_t *hashes,
+                             uint32_t index)
+{
+    if (NULL == hashes) {
+        return write_inline_value(writer, values, ends, hashes, index);
+    }
+
+    uint32_t slot;
+    bool found = find_written_value(writer, values, ends, hashes[index],
+                                    index, &slot);
+    if (found) {
+        uint32_t offset = writer->value_offsets[slot] - 1;
+        if (pointer_size(offset) < writer->value_sizes[slot]) {
+            return write_pointer(writer, offset);
+        }
+    }
+
+    uint32_t offset = writer->data_size;
+    int status = write_inline_value(writer, values, ends, hashes, index);
+    uint32_t size = writer->data_size - offset;
+    if (MMDB_SUCCESS == status && !found && pointer_size(offset) < size) {
+        status = add_written_value(writer, hashes[index], offset, size);
+    }
+    return status;
+}
+
+LOCAL int write_inline_value(MMDB_writer_s *writer,
+                             const MMDB_entry_data_s *values,
+                             const uint32_t *ends, const uint64_t *hashes,
+                             uint32_t index)
+{
+    const MMDB_entry_data_s *value = &values[index];
+    uint8_t bytes[16];
+    int length = 0;
+    switch (value->type) {
+    case MMDB_DATA_TYPE_MAP:
+    case MMDB_DATA_TYPE_ARRAY:
+        {
+            int status = write_control(writer, value->type, value->data_size);
+            for (uint32_t child = index + 1;
+                 MMDB_SUCCESS == status && child < ends[index];
+                 child = ends[child]) {
+                status = write_writer_value(writer, values, ends, hashes,
+                                            child);
+            }
+            return status;
+        }
+    case MMDB_DATA_TYPE_UTF8_STRING:
+    case MMDB_DATA_TYPE_BYTES:
+        {
+            int status = write_control(writer, value->type, value->data_size);
+            if (MMDB_SUCCESS == status) {
+                status = append_writer_data(writer, value->bytes,
+                                            value->data_size);
+            }
+            return status;
+        }
+    case MMDB_DATA_TYPE_DOUBLE:
+        {
+            uint64_t bits;
+            memcpy(&bits, &value->double_value, sizeof(bits));
+            uint64_to_bytes(bits, bytes);
+            length = 8;
+        }
+        break;
+    case MMDB_DATA_TYPE_FLOAT:
+        {
+            uint32_t bits;
+            memcpy(&bits, &value->float_value, sizeof(bits));
+            uint64_to_bytes(bits, bytes);
+            length = 4;
+        }
+        break;
+    case MMDB_DATA_TYPE_UINT16:
+        length = uint64_to_bytes(value->uint16, bytes);
+        break;
+    case MMDB_DATA_TYPE_UINT32:
+        length = uint64_to_bytes(value->uint32, bytes);
+        break;
+    case MMDB_DATA_TYPE_INT32:
+        /* A negative number needs all four bytes for its sign */
+        length = uint64_to_bytes((uint32_t)value->int32, bytes);
+        break;
+    case MMDB_DATA_TYPE_UINT64:
+        length = uint64_to_bytes(value->uint64, bytes);
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+        {
+            uint8_t uint128[16];
+            length = mmdb_uint128_to_bytes(value, uint128);
+            memcpy(bytes, uint128 + 16 - length, length);
+        }
+        break;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        /* A boolean's value is its size */
+        return write_control(writer, value->type, value->boolean ? 1 : 0);
+    default:
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    /* uint64_to_bytes() leaves the significant bytes at the end */
+    const uint8_t *start = MMDB_DATA_TYPE_UINT128 == value->type
+                           ? bytes : bytes + 8 - length;
+    int status = write_control(writer, value->type, length);
+    if (MMDB_SUCCESS == status) {
+        status = append_writer_data(writer, start, length);
+    }
+    return status;
+}
+
+/* This writes a value as 8 big-endian bytes and returns the number of bytes
+ * that are left once the leading zero bytes are dropped */
+LOCAL int uint64_to_bytes(uint64_t value, uint8_t *bytes)
+{
+    for (int i = 7; i >= 0; i--) {
+        bytes[i] = (uint8_t)value;
+        value >>= 8;
+    }
+    int length = 8;
+    for (; length > 0 && 0 == bytes[8 - length]; length--) {
+    }
+    return length;
+}
+
+LOCAL int write_control(MMDB_writer_s *writer, uint32_t type, uint32_t size)
+{
+    uint8_t bytes[5];
+    int length = 1;
+    bytes[0] = (uint8_t)((type > 7 ? MMDB_DATA_TYPE_EXTENDED : type) << 5);
+    if (type > 7) {
+        bytes[length++] = (uint8_t)(type - 7);
+    }
+
+    if (size < size_bases[1]) {
+        bytes[0] |= (uint8_t)size;
+        return append_writer_data(writer, bytes, length);
+    }
+    int size_bytes = size < size_bases[2] ? 1 : size < size_bases[3] ? 2 : 3;
+    bytes[0] |= (uint8_t)(28 + size_bytes);
+    size -= size_bases[size_bytes];
+    for (int i = size_bytes - 1; i >= 0; i--) {
+        bytes[length + i] = (uint8_t)size;
+        size >>= 8;
+    }
+    return append_writer_data(writer, bytes, length + size_bytes);
+}
+
+/* Pointers come in four sizes, and each of the first three starts where the
+ * one before it stops */
+LOCAL uint32_t pointer_size(uint32_t offset)
+{
+    return offset < 2048 ? 2 : offset < 526336 ? 3 : offset < 134744064 ? 4 : 5;
+}
+
+LOCAL int write_pointer(MMDB_writer_s *writer, uint32_t offset)
+{
+    static const uint32_t pointer_bases[4] = { 0, 2048, 526336, 0 };
+    int size = pointer_size(offset) - 2;
+    uint32_t value = offset - pointer_bases[size];
+
+    uint8_t bytes[5];
+    bytes[0] = (uint8_t)((MMDB_DATA_TYPE_POINTER << 5) | (size << 3));
+    if (size < 3) {
+        bytes[0] |= (uint8_t)(value >> (8 * (size + 1)));
+    }
+    for (int i = size + 1; i > 0; i--) {
+        bytes[i] = (uint8_t)value;
+        value >>= 8;
+    }
+    return append_writer_data(writer, bytes, size + 2);
+}
+
+LOCAL int append_writer_data(MMDB_writer_s *writer, const void *bytes,
+                             uint32_t size)
+{
+    if (size > writer->data_capacity - writer->data_size) {
+        /* Data offsets have to stay below MMDB_WRITER_DATA_RECORD */
+        if (size >= MMDB_WRITER_DATA_RECORD - writer->data_size) {
+            return MMDB_DATABASE_TOO_BIG_ERROR;
+        }
+        uint32_t capacity = writer->data_capacity
+                            ? writer->data_capacity : 4096;
+        while (capacity - writer->data_size < size
+               && capacity < MMDB_WRITER_DATA_RECORD) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(writer->data, capacity);
+        if (NULL == data) {
+            return MMDB_OUT_OF_MEMORY_ERROR;
+        }
+        writer->data = data;
+        writer->data_capacity = capacity;
+    }
+
+    if (size > 0) {
+        memcpy(writer->data + writer->data_size, bytes, size);
+    }
+    writer->data_size += size;
+    return MMDB_SUCCESS;
+}
+
+LOCAL int add_written_value(MMDB_writer_s *writer, uint64_t hash,
+                            uint32_t offset, uint32_t size)
+{
+    if (writer->value_count * 2 >= writer->value_mask) {
+        int status = grow_written_values(writer);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+    }
+
+    uint32_t slot = (uint32_t)hash & writer->value_mask;
+    while (writer->value_offsets[slot]) {
+        slot = (slot + 1) & writer->value_mask;
+    }
+    writer->value_hashes[slot] = hash;
+    writer->value_offsets[slot] = offset + 1;
+    writer->value_sizes[slot] = size;
+    writer->value_count++;
+    return MMDB_SUCCESS;
+}
+
+LOCAL int grow_written_values(MMDB_writer_s *writer)
+{
+    uint32_t slots = writer->value_offsets ? (writer->value_mask + 1) * 2
+                     : 1024;
+    uint64_t *hashes = malloc(slots * sizeof(uint64_t));
+    uint32_t *offsets = calloc(slots, sizeof(uint32_t));
+    uint32_t *sizes = malloc(slots * sizeof(uint32_t));
+    if (0 == slots || NULL == hashes || NULL == offsets || NULL == sizes) {
+        free(hashes);
+        free(offsets);
+        free(sizes);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    for (uint32_t i = 0;
+         writer->value_offsets && i <= writer->value_mask; i++) {
+        if (writer->value_offsets[i]) {
+            uint32_t slot = (uint32_t)writer->value_hashes[i] & (slots - 1);
+            while (offsets[slot]) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            hashes[slot] = writer->value_hashes[i];
+            offsets[slot] = writer->value_offsets[i];
+            sizes[slot] = writer->value_sizes[i];
+        }
+    }
+
+    free(writer->value_hashes);
+    free(writer->value_offsets);
+    free(writer->value_sizes);
+    writer->value_hashes = hashes;
+    writer->value_offsets = offsets;
+    writer->value_sizes = sizes;
+    writer->value_mask = slots - 1;
+    return MMDB_SUCCESS;
+}
+
+/* A network replaces everything that was in the tree for its addresses. If
+ * it is inside a network that is already there, the records on the way down
+ * to it are split, so the rest of the bigger network keeps its data. */
+int MMDB_writer_insert(MMDB_writer_s *const writer,
+                       const uint8_t *const address, uint16_t prefix_length,
+                       uint32_t record)
+{
+    if (prefix_length > (4 == writer->metadata.ip_version ? 32 : 128)) {
+        return MMDB_INVALID_NETWORK_ERROR;
+    }
+    if (record >= writer->data_size) {
+        return MMDB_INVALID_DATA_ERROR;
+    }
+    return set_writer_record(writer, address, prefix_length,
+                             record | MMDB_WRITER_DATA_RECORD);
+}
+
+/* This sets the record for a network to a node, data or empty record,
+ * splitting any data or empty record above it into nodes on the way */
+LOCAL int set_writer_record(MMDB_writer_s *writer, const uint8_t *address,
+                            uint16_t prefix_length, uint32_t record)
+{
+    /* The root has to be a node, so /0 is both of its records */
+    if (0 == prefix_length) {
+        writer->nodes[0] = record;
+        writer->nodes[1] = record;
+        return MMDB_SUCCESS;
+    }
+
+    uint32_t node = 0;
+    for (uint16_t depth = 0; depth + 1 < prefix_length; depth++) {
+        uint32_t bit = (address[depth >> 3] >> (7 - (depth & 7))) & 1;
+        uint32_t child = writer->nodes[2 * node + bit];
+        if (0 == child || child & MMDB_WRITER_DATA_RECORD) {
+            uint32_t new_node;
+            int status = new_writer_node(writer, child, &new_node);
+            if (MMDB_SUCCESS != status) {
+                return status;
+            }
+            writer->nodes[2 * node + bit] = new_node;
+            child = new_node;
+        }
+        node = child;
+    }
+
+    uint16_t last = prefix_length - 1;
+    writer->nodes[2 * node + ((address[last >> 3] >> (7 - (last & 7))) & 1)] =
+        record;
+    return MMDB_SUCCESS;
+}
+
+/* The alias gets whatever record the tree has for the target, which is
+ * usually a node. If the target is inside a bigger network, that is the
+ * network's data. An alias inside its own target would make a loop. */
+int MMDB_writer_alias(MMDB_writer_s *const writer,
+                      const uint8_t *const address, uint16_t prefix_length,
+                      const uint8_t *const target,
+                      uint16_t target_prefix_length)
+{
+    uint16_t max_length = 4 == writer->metadata.ip_version ? 32 : 128;
+    if (prefix_length > max_length || 0 == target_prefix_length
+        || target_prefix_length > max_length) {
+        return MMDB_INVALID_NETWORK_ERROR;
+    }
+    /* The target's subtree is linked in at prefix_length, so a longer alias
+     * would put its records past the end of the address */
+    if (prefix_length > target_prefix_length) {
+        return MMDB_INVALID_NETWORK_ERROR;
+    }
+    if (prefix_length == target_prefix_length) {
+        uint16_t depth = 0;
+        while (depth < target_prefix_length
+               && ((address[depth >> 3] ^ target[depth >> 3])
+                   & (0x80 >> (depth & 7))) == 0) {
+            depth++;
+        }
+        if (depth == target_prefix_length) {
+            return MMDB_INVALID_NETWORK_ERROR;
+        }
+    }
+
+    uint32_t record = 0;
+    for (uint16_t depth = 0; depth < target_prefix_length; depth++) {
+        uint32_t bit = (target[depth >> 3] >> (7 - (depth & 7))) & 1;
+        record = writer->nodes[2 * record + bit];
+        if (0 == record || record & MMDB_WRITER_DATA_RECORD) {
+            break;
+        }
+    }
+    return set_writer_record(writer, address, prefix_length, record);
+}
+
+/* The weights only change the order that MMDB_writer_write() puts the nodes
+ * in. A lookup reads every node from the root down to the record it ends
+ * at, so each of those nodes gets the weight. */
+int MMDB_writer_add_weight(MMDB_writer_s *const writer,
+                           const uint8_t *const address, uint64_t weight)
+{
+    if (NULL == writer->node_weights) {
+        writer->node_weights = calloc(writer->node_capacity,
+                                      sizeof(uint64_t));
+        if (NULL == writer->node_weights) {
+            return MMDB_OUT_OF_MEMORY_ERROR;
+        }
+    }
+
+    uint16_t bits = 4 == writer->metadata.ip_version ? 32 : 128;
+    uint32_t node = 0;
+    for (uint16_t depth = 0; depth < bits; depth++) {
+        writer->node_weights[node] += weight;
+        uint32_t bit = (address[depth >> 3] >> (7 - (depth & 7))) & 1;
+        uint32_t child = writer->nodes[2 * node + bit];
+        if (0 == child || child & MMDB_WRITER_DATA_RECORD) {
+            break;
+        }
+        node = child;
+    }
+    return MMDB_SUCCESS;
+}
+
+/* This works up from the bottom of the tree, pointing every record at a
+ * node to the first node found with the same two records, so that each
+ * distinct subtree is only stored once. Lookups read the same nodes as
+ * before and end at the same record with the same netmask. With
+ * MMDB_WRITER_COMPACT_MERGE_NETWORKS, a node whose two records are the same
+ * data or empty record is also replaced by that record. This makes the two
+ * networks into one with a prefix a bit shorter, so lookups in it read one
+ * node less and report the shorter netmask.
+ *
+ * The root is never merged, and neither is the node for ::/96 in an IPv6
+ * tree. Readers treat any other record pointing at that node as an alias
+ * of the IPv4 subtree and skip its networks when iterating. */
+int MMDB_writer_compact(MMDB_writer_s *const writer, uint32_t flags)
+{
+    /* The table holds each distinct node plus one, so that zero marks an
+     * empty slot */
+    size_t slots = 1024;
+    while (slots < 2 * (size_t)writer->node_count) {
+        slots *= 2;
+    }
+    uint32_t *merged = malloc(writer->node_count * sizeof(uint32_t));
+    uint32_t *table = calloc(slots, sizeof(uint32_t));
+    if (NULL == merged || NULL == table) {
+        free(merged);
+        free(table);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+    memset(merged, 0xff, writer->node_count * sizeof(uint32_t));
+    uint32_t ipv4_node = ipv4_writer_node(writer);
+
+    /* The stack is the path from the root to the node we are at. A node is
+     * only taken off once both of its children have been merged. */
+    uint32_t stack[130];
+    uint32_t stack_size = 0;
+    int status = MMDB_SUCCESS;
+
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        uint32_t node = stack[stack_size - 1];
+        /* A node that two records point to can be on the stack twice */
+        if (UINT32_MAX != merged[node]) {
+            stack_size--;
+            continue;
+        }
+
+        uint32_t child = writer->nodes[2 * node];
+        if (!is_writer_node(child) || UINT32_MAX != merged[child]) {
+            child = writer->nodes[2 * node + 1];
+        }
+        if (is_writer_node(child) && UINT32_MAX == merged[child]) {
+            if (sizeof(stack) / sizeof(stack[0]) == stack_size) {
+                status = MMDB_CORRUPT_SEARCH_TREE_ERROR;
+                break;
+            }
+            stack[stack_size++] = child;
+            continue;
+        }
+
+        stack_size--;
+        for (int i = 0; i < 2; i++) {
+            uint32_t record = writer->nodes[2 * node + i];
+            if (is_writer_node(record)) {
+                writer->nodes[2 * node + i] = merged[record];
+            }
+        }
+        merged[node] = merge_writer_node(writer, flags, node, ipv4_node,
+                                         table, slots - 1);
+    }
+
+    /* A node that was merged into another passes its weight on, so that
+     * the other node is still numbered where both would have been */
+    if (MMDB_SUCCESS == status && NULL != writer->node_weights) {
+        for (uint32_t node = 0; node < writer->node_count; node++) {
+            uint32_t into = merged[node];
+            if (UINT32_MAX != into && into != node && is_writer_node(into)) {
+                writer->node_weights[into] += writer->node_weights[node];
+            }
+        }
+    }
+
+    free(merged);
+    free(table);
+    return status;
+}
+
+/* This gives the node that lookups of IPv4 addresses start at in an IPv6
+ * tree, or UINT32_MAX if there isn't one */
+LOCAL uint32_t ipv4_writer_node(MMDB_writer_s *writer)
+{
+    if (6 != writer->metadata.ip_version) {
+        return UINT32_MAX;
+    }
+    uint32_t node = 0;
+    for (int depth = 0; depth < 96; depth++) {
+        node = writer->nodes[2 * node];
+        if (!is_writer_node(node)) {
+            return UINT32_MAX;
+        }
+    }
+    return node;
+}
+
+/* This gives the record that should point at the node in place of the node
+ * itself, once its children have been merged */
+LOCAL uint32_t merge_writer_node(MMDB_writer_s *writer, uint32_t flags,
+                                 uint32_t node, uint32_t ipv4_node,
+                                 uint32_t *table, size_t mask)
+{
+    /* Lookups and aliases need the root and the IPv4 start node to stay
+     * nodes, even if both of their records are the same */
+    if (0 == node || ipv4_node == node) {
+        return node;
+    }
+    uint32_t left = writer->nodes[2 * node];
+    uint32_t right = writer->nodes[2 * node + 1];
+    if (flags & MMDB_WRITER_COMPACT_MERGE_NETWORKS && left == right
+        && !is_writer_node(left)) {
+        return left;
+    }
+
+    size_t slot = (size_t)mmdb_hash_mix(mmdb_hash_mix(0, left), right) & mask;
+    while (table[slot]) {
+        uint32_t other = table[slot] - 1;
+        if (writer->nodes[2 * other] == left
+            && writer->nodes[2 * other + 1] == right) {
+            return other;
+        }
+        slot = (slot + 1) & mask;
+    }
+    table[slot] = node + 1;
+    return node;
+}
+
+int MMDB_writer_write(MMDB_writer_s *const writer, FILE *const stream)
+{
+    if (NULL == writer->metadata.database_type) {
+        return MMDB_INVALID_METADATA_ERROR;
+    }
+
+    uint32_t *numbers = malloc(writer->node_count * sizeof(uint32_t));
+    uint32_t *order = malloc(writer->node_count * sizeof(uint32_t));
+    if (NULL == numbers || NULL == order) {
+        free(numbers);
+        free(order);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+    uint32_t node_count;
+    int status = number_writer_nodes(writer, numbers, order, &node_count);
+
+    /* The biggest record is the one for the end of the data section */
+    uint16_t record_size = writer->metadata.record_size;
+    if (MMDB_SUCCESS == status
+        && (uint64_t)node_count + MMDB_DATA_SECTION_SEPARATOR
+                   + writer->data_size
+               > (1ULL << record_size)) {
+        status = MMDB_DATABASE_TOO_BIG_ERROR;
+    }
+    if (MMDB_SUCCESS == status) {
+        writer->metadata.node_count = node_count;
+        status = write_writer_tree(writer, numbers, order, stream);
+    }
+    free(numbers);
+    free(order);
+
+    static const uint8_t separator[MMDB_DATA_SECTION_SEPARATOR] = { 0 };
+    if (MMDB_SUCCESS == status
+        && (1 != fwrite(separator, sizeof(separator), 1, stream)
+            || writer->data_size != fwrite(writer->data, 1, writer->data_size,
+                                           stream))) {
+        status = MMDB_IO_ERROR;
+    }
+
+    /* The metadata is put together after the end of the data section, and
+     * is taken off again once it has been written */
+    uint32_t data_size = writer->data_size;
+    if (MMDB_SUCCESS == status) {
+        status = append_writer_data(writer, METADATA_MARKER,
+                                    strlen(METADATA_MARKER));
+    }
+    if (MMDB_SUCCESS == status) {
+        status = write_writer_metadata(writer);
+    }
+    if (MMDB_SUCCESS == status
+        && writer->data_size - data_size
+        != fwrite(writer->data + data_size, 1, writer->data_size - data_size,
+                  stream)) {
+        status = MMDB_IO_ERROR;
+    }
+    writer->data_size = data_size;
+
+    if (MMDB_SUCCESS == status && 0 != fflush(stream)) {
+        status = MMDB_IO_ERROR;
+    }
+    return status;
+}
+
+/* This numbers the nodes that can be reached from the root. Without
+ * weights, they are numbered depth first, left before right, so that each
+ * subtree is in one piece in the file and the nodes near the root are
+ * together at the start. With weights, the nodes that lookups read are
+ * numbered first, taking the heavier child first, so they are together at
+ * the start of the file and the path that is read the most is in one
+ * piece. The rest are numbered after them. A node that two records point
+ * to is only numbered once, and nodes that were cut off when a bigger
+ * network replaced them aren't numbered at all. order gets the nodes in the
+ * order of their numbers, and count gets the number of nodes. */
+LOCAL int number_writer_nodes(MMDB_writer_s *writer, uint32_t *numbers,
+                              uint32_t *order, uint32_t *count)
+{
+    memset(numbers, 0xff, writer->node_count * sizeof(uint32_t));
+    *count = 0;
+    if (NULL != writer->node_weights) {
+        int status = number_writer_pass(writer, true, numbers, order, count);
+        if (MMDB_SUCCESS != status) {
+            return status;
+        }
+    }
+    return number_writer_pass(writer, false, numbers, order, count);
+}
+
+/* The hot pass only goes down to nodes with a weight. The other pass goes
+ * everywhere, but it doesn't go into a node a second time unless the node
+ * has a weight, since then the hot pass numbered it and its children might
+ * not be numbered yet. */
+LOCAL int number_writer_pass(MMDB_writer_s *writer, bool hot,
+                             uint32_t *numbers, uint32_t *order,
+                             uint32_t *count)
+{
+    const uint64_t *weights = writer->node_weights;
+
+    /* The stack holds at most one record for each level above the node we
+     * are at, plus that node's two records */
+    uint32_t stack[130];
+    uint32_t stack_size = 0;
+
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        uint32_t node = stack[--stack_size];
+        if (UINT32_MAX == numbers[node]) {
+            numbers[node] = *count;
+            order[(*count)++] = node;
+        }
+
+        /* The child pushed last is numbered first */
+        uint32_t left = writer->nodes[2 * node];
+        uint32_t right = writer->nodes[2 * node + 1];
+        if (hot && is_writer_node(right) && (!is_writer_node(left)
+                                             || weights[right]
+                                             > weights[left])) {
+            uint32_t swap = left;
+            left = right;
+            right = swap;
+        }
+        uint32_t children[2] = { right, left };
+        for (int i = 0; i < 2; i++) {
+            uint32_t child = children[i];
+            if (!is_writer_node(child)) {
+                continue;
+            }
+            bool has_weight = NULL != weights && weights[child] > 0;
+            if (hot ? has_weight && UINT32_MAX == numbers[child]
+                : has_weight || UINT32_MAX == numbers[child]) {
+                if (sizeof(stack) / sizeof(stack[0]) == stack_size) {
+                    return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+                }
+                stack[stack_size++] = child;
+            }
+        }
+    }
+    return MMDB_SUCCESS;
+}
+
+LOCAL bool is_writer_node(uint32_t record)
+{
+    return 0 != record && !(record & MMDB_WRITER_DATA_RECORD);
+}
+
+LOCAL int write_writer_tree(MMDB_writer_s *writer, const uint32_t *numbers,
+                            const uint32_t *order, FILE *stream)
+{
+    uint32_t node_count = writer->metadata.node_count;
+    uint16_t record_size = writer->metadata.record_size;
+    size_t node_size = record_size / 4;
+
+    uint8_t buffer[4096];
+    size_t used = 0;
+    for (uint32_t i = 0; i < node_count; i++) {
+        uint32_t values[2];
+        for (int j = 0; j < 2; j++) {
+            uint32_t child = writer->nodes[2 * order[i] + j];
+            if (0 == child) {
+                values[j] = node_count;
+            } else if (child & MMDB_WRITER_DATA_RECORD) {
+                values[j] = node_count + MMDB_DATA_SECTION_SEPARATOR
+                            + (child & ~MMDB_WRITER_DATA_RECORD);
+            } else {
+                values[j] = numbers[child];
+            }
+        }
+
+        if (used + node_size > sizeof(buffer)) {
+            if (1 != fwrite(buffer, used, 1, stream)) {
+                return MMDB_IO_ERROR;
+            }
+            used = 0;
+        }
+        encode_writer_node(values[0], values[1], record_size, buffer + used);
+        used += node_size;
+    }
+
+    if (used > 0 && 1 != fwrite(buffer, used, 1, stream)) {
+        return MMDB_IO_ERROR;
+    }
+    return MMDB_SUCCESS;
+}
+
+/* This is the reverse of the record getters in record_info_s. In a 28-bit
+ * node the middle byte has the top four bits of the left record in its high
+ * half and those of the right record in its low half. */
+LOCAL void encode_writer_node(uint32_t left, uint32_t right,
+                              uint16_t record_size, uint8_t *bytes)
+{
+    int record_bytes = 32 == record_size ? 4 : 3;
+    for (int i = record_bytes - 1; i >= 0; i--) {
+        bytes[i] = (uint8_t)left;
+        left >>= 8;
+    }
+    uint8_t *right_bytes = bytes + (24 == record_size ? 3 : 4);
+    for (int i = record_bytes - 1; i >= 0; i--) {
+        right_bytes[i] = (uint8_t)right;
+        right >>= 8;
+    }
+    if (28 == record_size) {
+        bytes[3] = (uint8_t)((left & 0x0f) << 4 | (right & 0x0f));
+    }
+}
+
+LOCAL int write_writer_metadata(MMDB_writer_s *writer)
+{
+    MMDB_metadata_s *metadata = &writer->metadata;
+    uint32_t count = 19 + 2 * (uint32_t)metadata->description.count
+                     + (uint32_t)metadata->languages.count;
+    MMDB_entry_data_s *values = calloc(count, sizeof(MMDB_entry_data_s));
+    uint32_t *ends = malloc(count * sizeof(uint32_t));
+    uint64_t *hashes = malloc(count * sizeof(uint64_t));
+    if (NULL == values || NULL == ends || NULL == hashes) {
+        free(values);
+        free(ends);
+        free(hashes);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    uint32_t i = 0;
+    values[i].type = MMDB_DATA_TYPE_MAP;
+    values[i++].data_size = 9;
+    i = add_metadata_uint(values, i, "binary_format_major_version",
+                          MMDB_DATA_TYPE_UINT16,
+                          metadata->binary_format_major_version);
+    i = add_metadata_uint(values, i, "binary_format_minor_version",
+                          MMDB_DATA_TYPE_UINT16,
+                          metadata->binary_format_minor_version);
+    i = add_metadata_uint(values, i, "build_epoch", MMDB_DATA_TYPE_UINT64,
+                          metadata->build_epoch);
+    i = add_metadata_string(values, i, "database_type");
+    i = add_metadata_string(values, i, metadata->database_type);
+    i = add_metadata_string(values, i, "description");
+    values[i].type = MMDB_DATA_TYPE_MAP;
+    values[i++].data_size = (uint32_t)metadata->description.count;
+    for (size_t j = 0; j < metadata->description.count; j++) {
+        MMDB_description_s *description = metadata->description.descriptions[j];
+        i = add_metadata_string(values, i, description->language);
+        i = add_metadata_string(values, i, description->description);
+    }
+    i = add_metadata_uint(values, i, "ip_version", MMDB_DATA_TYPE_UINT16,
+                          metadata->ip_version);
+    i = add_metadata_string(values, i, "languages");
+    values[i].type = MMDB_DATA_TYPE_ARRAY;
+    values[i++].data_size = (uint32_t)metadata->languages.count;
+    for (size_t j = 0; j < metadata->languages.count; j++) {
+        i = add_metadata_string(values, i, metadata->languages.names[j]);
+    }
+    i = add_metadata_uint(values, i, "node_count", MMDB_DATA_TYPE_UINT32,
+                          metadata->node_count);
+    i = add_metadata_uint(values, i, "record_size", MMDB_DATA_TYPE_UINT16,
+                          metadata->record_size);
+
+    int status = hash_writer_value(values, count, 0, 0, ends, hashes);
+    if (MMDB_SUCCESS == status) {
+        /* The metadata can't have pointers into the data section */
+        status = write_inline_value(writer, values, ends, NULL, 0);
+    }
+
+    free(values);
+    free(ends);
+    free(hashes);
+    return status;
+}
+
+LOCAL uint32_t add_metadata_string(MMDB_entry_data_s *values, uint32_t i,
+                                   const char *string)
+{
+    values[i].type = MMDB_DATA_TYPE_UTF8_STRING;
+    values[i].utf8_string = NULL == string ? "" : string;
+    values[i].data_size = (uint32_t)strlen(values[i].utf8_string);
+    return i + 1;
+}
+
+LOCAL uint32_t add_metadata_uint(MMDB_entry_data_s *values, uint32_t i,
+                                 const char *key, uint32_t type,
+                                 uint64_t value)
+{
+    i = add_metadata_string(values, i, key);
+    values[i].type = type;
+    if (MMDB_DATA_TYPE_UINT16 == type) {
+        values[i].uint16 = (uint16_t)value;
+    } else if (MMDB_DATA_TYPE_UINT32 == type) {
+        values[i].uint32 = (uint32_t)value;
+    } else {
+        values[i].uint64 = value;
+    }
+    return i + 1;
+}
+
+void MMDB_writer_free(MMDB_writer_s *const writer)
+{
+    free(writer->nodes);
+    free(writer->data);
+    free(writer->value_hashes);
+    free(writer->value_offsets);
+    free(writer->value_sizes);
+    free(writer->node_weights);
+    memset(writer, 0, sizeof(MMDB_writer_s));
+}
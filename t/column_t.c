@@ -0,0 +1,258 @@
+#define _GNU_SOURCE
+#include "maxminddb_test_helper.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+/* This checks every row of a column against MMDB_aget_value() */
+void test_column_matches(MMDB_s *mmdb, const char *const *const path,
+                         uint32_t type, const char *mode_desc)
+{
+    MMDB_column_s column;
+    int status = MMDB_export_column(mmdb, path, type, &column);
+    cmp_ok(status, "==", MMDB_SUCCESS, "exported a column for %s - %s",
+           path[0], mode_desc);
+    if (MMDB_SUCCESS != status) {
+        return;
+    }
+    ok(column.record_count > 0, "column for %s has records - %s", path[0],
+       mode_desc);
+    cmp_ok(column.type, "==", type, "column for %s has the right type - %s",
+           path[0], mode_desc);
+
+    int mismatches = 0, with_data = 0;
+    for (uint32_t row = 0; row < column.record_count; row++) {
+        MMDB_entry_s entry = { .mmdb = mmdb, .offset = column.offsets[row] };
+        MMDB_entry_data_s expect;
+        MMDB_aget_value(&entry, &expect, path);
+        if (expect.has_data != column.has_data[row]) {
+            mismatches++;
+            continue;
+        }
+        if (!expect.has_data) {
+            continue;
+        }
+        with_data++;
+
+        bool same = false;
+        switch (type) {
+        case MMDB_DATA_TYPE_UTF8_STRING:
+            same = expect.data_size == column.sizes[row]
+                   && 0 == memcmp(expect.utf8_string,
+                                  column.values.utf8_string[row],
+                                  expect.data_size);
+            break;
+        case MMDB_DATA_TYPE_UINT32:
+            same = expect.uint32 == column.values.uint32[row];
+            break;
+        case MMDB_DATA_TYPE_DOUBLE:
+            same = expect.double_value == column.values.double_value[row];
+            break;
+        }
+        if (!same) {
+            mismatches++;
+        }
+    }
+    ok(with_data > 0, "some records have %s - %s", path[0], mode_desc);
+    cmp_ok(mismatches, "==", 0,
+           "column for %s matches MMDB_aget_value - %s", path[0], mode_desc);
+
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, "81.2.69.160", "GeoIP2-City-Test.mmdb",
+                         mode_desc);
+    uint32_t row;
+    status = MMDB_get_column_row(&column, &result.entry, &row);
+    cmp_ok(status, "==", MMDB_SUCCESS, "found the row for a lookup - %s",
+           mode_desc);
+    cmp_ok(column.offsets[row], "==", result.entry.offset,
+           "row has the record's offset - %s", mode_desc);
+
+    MMDB_free_column(&column);
+    ok(NULL == column.offsets && NULL == column.values.any,
+       "MMDB_free_column clears the column - %s", mode_desc);
+}
+
+void test_city(MMDB_s *mmdb, const char *mode_desc)
+{
+    test_column_matches(mmdb,
+                        (const char *const[]){ "country", "iso_code", NULL },
+                        MMDB_DATA_TYPE_UTF8_STRING, mode_desc);
+    test_column_matches(mmdb,
+                        (const char *const[]){ "city", "geoname_id", NULL },
+                        MMDB_DATA_TYPE_UINT32, mode_desc);
+    test_column_matches(mmdb,
+                        (const char *const[]){ "location", "latitude", NULL },
+                        MMDB_DATA_TYPE_DOUBLE, mode_desc);
+
+    MMDB_column_s column;
+    int status = MMDB_export_column(
+        mmdb, (const char *const[]){ "country", "iso_code", NULL },
+        MMDB_DATA_TYPE_UINT32, &column);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "exported a column of the wrong type - %s", mode_desc);
+    int with_data = 0;
+    for (uint32_t row = 0; row < column.record_count; row++) {
+        with_data += column.has_data[row];
+    }
+    cmp_ok(with_data, "==", 0, "no record has a value of the wrong type - %s",
+           mode_desc);
+    MMDB_free_column(&column);
+
+    status = MMDB_export_column(mmdb,
+                                (const char *const[]){ "country", NULL },
+                                MMDB_DATA_TYPE_MAP, &column);
+    cmp_ok(status, "==", MMDB_TYPE_MISMATCH_ERROR,
+           "a column of maps fails - %s", mode_desc);
+    ok(NULL == column.offsets && NULL == column.has_data,
+       "a failed column has nothing allocated - %s", mode_desc);
+
+    status = MMDB_export_column(mmdb, (const char *const[]){ "missing", NULL },
+                                MMDB_DATA_TYPE_UINT32, &column);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "exported a column for a missing path - %s", mode_desc);
+    with_data = 0;
+    for (uint32_t row = 0; row < column.record_count; row++) {
+        with_data += column.has_data[row];
+    }
+    cmp_ok(with_data, "==", 0, "no record has a missing path - %s",
+           mode_desc);
+    MMDB_free_column(&column);
+}
+
+void test_decoder(MMDB_s *mmdb, const char *mode_desc)
+{
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, "1.1.1.1", "MaxMind-DB-test-decoder.mmdb",
+                         mode_desc);
+
+    struct {
+        const char *key;
+        uint32_t type;
+    } columns[] = {
+        { "bytes", MMDB_DATA_TYPE_BYTES },
+        { "uint16", MMDB_DATA_TYPE_UINT16 },
+        { "int32", MMDB_DATA_TYPE_INT32 },
+        { "uint64", MMDB_DATA_TYPE_UINT64 },
+        { "float", MMDB_DATA_TYPE_FLOAT },
+        { "boolean", MMDB_DATA_TYPE_BOOLEAN },
+    };
+    MMDB_column_s column[6];
+    uint32_t row[6];
+    for (int i = 0; i < 6; i++) {
+        int status = MMDB_export_column(
+            mmdb, (const char *const[]){ columns[i].key, NULL },
+            columns[i].type, &column[i]);
+        cmp_ok(status, "==", MMDB_SUCCESS, "exported a %s column - %s",
+               columns[i].key, mode_desc);
+        status = MMDB_get_column_row(&column[i], &result.entry, &row[i]);
+        cmp_ok(status, "==", MMDB_SUCCESS, "found the row in the %s column - %s",
+               columns[i].key, mode_desc);
+        ok(column[i].has_data[row[i]], "%s column has data for 1.1.1.1 - %s",
+           columns[i].key, mode_desc);
+    }
+
+    ok(4 == column[0].sizes[row[0]]
+       && 0 == memcmp(column[0].values.bytes[row[0]], "\x00\x00\x00\x2a", 4),
+       "bytes is 0x0000002a - %s", mode_desc);
+    cmp_ok(column[1].values.uint16[row[1]], "==", 100, "uint16 is 100 - %s",
+           mode_desc);
+    cmp_ok(column[2].values.int32[row[2]], "==", -(1 << 28),
+           "int32 is -(2**28) - %s", mode_desc);
+    ok(column[3].values.uint64[row[3]] == 1ULL << 60, "uint64 is 2**60 - %s",
+       mode_desc);
+    compare_float(column[4].values.float_value[row[4]], 1.1F);
+    ok(column[5].values.boolean[row[5]], "boolean is true - %s", mode_desc);
+
+    for (int i = 0; i < 6; i++) {
+        MMDB_free_column(&column[i]);
+    }
+}
+
+/* This writes two networks whose records have an "id" of different types,
+ * so the column has a row with data and a row without it. */
+void test_mixed_types(int mode, const char *mode_desc)
+{
+    MMDB_writer_s writer;
+    MMDB_writer_init(&writer, 4, 24);
+    writer.metadata.database_type = "Column-Test";
+
+    uint32_t records[2];
+    MMDB_entry_data_s values[][3] = {
+        { { .type = MMDB_DATA_TYPE_MAP, .data_size = 1 },
+          { .type = MMDB_DATA_TYPE_UTF8_STRING, .utf8_string = "id",
+            .data_size = 2 },
+          { .type = MMDB_DATA_TYPE_UINT32, .uint32 = 42 } },
+        { { .type = MMDB_DATA_TYPE_MAP, .data_size = 1 },
+          { .type = MMDB_DATA_TYPE_UTF8_STRING, .utf8_string = "id",
+            .data_size = 2 },
+          { .type = MMDB_DATA_TYPE_UTF8_STRING, .utf8_string = "42",
+            .data_size = 2 } },
+    };
+    for (int i = 0; i < 2; i++) {
+        MMDB_writer_add_record(&writer, values[i], 3, &records[i]);
+        uint8_t address[4] = { (uint8_t)(i << 7), 0, 0, 0 };
+        MMDB_writer_insert(&writer, address, 1, records[i]);
+    }
+
+    char path[] = "column_t-XXXXXX";
+    int fd = mkstemp(path);
+    if (-1 == fd) {
+        BAIL_OUT("could not create a temporary file");
+    }
+    FILE *stream = fdopen(fd, "wb");
+    int status = MMDB_writer_write(&writer, stream);
+    fclose(stream);
+    MMDB_writer_free(&writer);
+    cmp_ok(status, "==", MMDB_SUCCESS, "wrote the database - %s", mode_desc);
+
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    MMDB_column_s column;
+    status = MMDB_export_column(mmdb, (const char *const[]){ "id", NULL },
+                                MMDB_DATA_TYPE_UINT32, &column);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "exported a column with a value of another type - %s", mode_desc);
+    if (MMDB_SUCCESS == status) {
+        cmp_ok(column.record_count, "==", 2, "column has two rows - %s",
+               mode_desc);
+        int with_data = 0;
+        for (uint32_t row = 0; row < column.record_count; row++) {
+            if (column.has_data[row]) {
+                with_data++;
+                cmp_ok(column.values.uint32[row], "==", 42,
+                       "the uint32 id is 42 - %s", mode_desc);
+            }
+        }
+        cmp_ok(with_data, "==", 1, "only the uint32 id has data - %s",
+               mode_desc);
+        MMDB_free_column(&column);
+    }
+
+    MMDB_close(mmdb);
+    free(mmdb);
+    unlink(path);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    const char *path = test_database_path("GeoIP2-City-Test.mmdb");
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+    test_city(mmdb, mode_desc);
+    MMDB_close(mmdb);
+    free(mmdb);
+
+    path = test_database_path("MaxMind-DB-test-decoder.mmdb");
+    mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+    test_decoder(mmdb, mode_desc);
+    MMDB_close(mmdb);
+    free(mmdb);
+
+    test_mixed_types(mode, mode_desc);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include "maxminddb_test_helper.h"
+
+void test_matches_entry_data_list(MMDB_entry_data_array_s *entry_data_array,
+                                  MMDB_entry_data_list_s *entry_data_list)
+{
+    uint32_t i = 0;
+    for (; entry_data_list && i < entry_data_array->count;
+         entry_data_list = entry_data_list->next, i++) {
+        MMDB_entry_data_s *expect = &entry_data_list->entry_data;
+        MMDB_entry_data_s *got = &entry_data_array->nodes[i].entry_data;
+
+        if (!cmp_ok(got->type, "==", expect->type,
+                    "element %u has the same type as the list entry", i)) {
+            return;
+        }
+        cmp_ok(got->data_size, "==", expect->data_size,
+               "element %u has the same data_size as the list entry", i);
+        cmp_ok(got->offset, "==", expect->offset,
+               "element %u has the same offset as the list entry", i);
+        cmp_ok(got->offset_to_next, "==", expect->offset_to_next,
+               "element %u has the same offset_to_next as the list entry", i);
+    }
+
+    ok(NULL == entry_data_list && i == entry_data_array->count,
+       "array has as many elements as the list");
+}
+
+void test_subtree_links(MMDB_entry_data_array_s *entry_data_array)
+{
+    MMDB_entry_data_node_s *nodes = entry_data_array->nodes;
+
+    cmp_ok(nodes[0].entry_data.type, "==", MMDB_DATA_TYPE_MAP,
+           "first element is a map");
+    cmp_ok(nodes[0].child_count, "==", 24,
+           "top level map has 24 children (12 keys and 12 values)");
+    cmp_ok(nodes[0].subtree_end, "==", entry_data_array->count,
+           "top level map subtree covers the whole array");
+
+    uint32_t keys = 0;
+    uint32_t map_value = 0;
+    for (uint32_t i = 1; i < entry_data_array->count;
+         i = nodes[nodes[i].subtree_end].subtree_end) {
+        MMDB_entry_data_s *key = &nodes[i].entry_data;
+        if (MMDB_DATA_TYPE_UTF8_STRING != key->type) {
+            ok(0, "found a map key at element %u", i);
+            break;
+        }
+        if (3 == key->data_size && !memcmp(key->utf8_string, "map", 3)) {
+            map_value = nodes[i].subtree_end;
+        }
+        keys++;
+    }
+    cmp_ok(keys, "==", 12, "skipped from key to key using subtree_end");
+
+    if (!ok(map_value, "found the value for the 'map' key")) {
+        return;
+    }
+
+    MMDB_entry_data_node_s *map = &nodes[map_value];
+    cmp_ok(map->entry_data.type, "==", MMDB_DATA_TYPE_MAP,
+           "'map' key's value is a map");
+    cmp_ok(map->child_count, "==", 2, "'map' has one key and one value");
+    cmp_ok(map->subtree_end - map_value, "==", 10,
+           "'map' subtree has 10 elements");
+
+    MMDB_entry_data_node_s *array_x = &nodes[map_value + 4];
+    cmp_ok(array_x->entry_data.type, "==", MMDB_DATA_TYPE_ARRAY,
+           "'arrayX' key's value is an array");
+    cmp_ok(array_x->child_count, "==", 3, "'arrayX' has 3 children");
+    cmp_ok(nodes[map_value + 5].subtree_end, "==", map_value + 6,
+           "scalar subtree_end is the next element");
+}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+void test_dump(MMDB_entry_data_array_s *entry_data_array,
+               MMDB_entry_data_list_s *entry_data_list)
+{
+    char *list_output, *array_output;
+    size_t list_size, array_size;
+
+    FILE *stream = open_memstream(&list_output, &list_size);
+    int status = MMDB_dump_entry_data_list(stream, entry_data_list, 2);
+    fclose(stream);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_dump_entry_data_list succeeded");
+
+    stream = open_memstream(&array_output, &array_size);
+    status = MMDB_dump_entry_data_array(stream, entry_data_array, 2);
+    fclose(stream);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_dump_entry_data_array succeeded");
+
+    is(array_output, list_output,
+       "array dump output matches the list dump output");
+
+    free(list_output);
+    free(array_output);
+}
+
+void test_json(MMDB_entry_data_array_s *entry_data_array)
+{
+    char *output;
+    size_t size;
+
+    FILE *stream = open_memstream(&output, &size);
+    int status = MMDB_dump_entry_data_array_as_json(stream, entry_data_array);
+    fclose(stream);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_dump_entry_data_array_as_json succeeded");
+
+    const char *expect =
+        "{\"array\":[1,2,3],\"boolean\":true,\"bytes\":\"0000002A\","
+        "\"double\":42.123456,\"float\":1.1,\"int32\":-268435456,"
+        "\"map\":{\"mapX\":{\"arrayX\":[7,8,9],\"utf8_stringX\":\"hello\"}},"
+        "\"uint128\":\"0x01000000000000000000000000000000\","
+        "\"uint16\":100,\"uint32\":268435456,"
+        "\"uint64\":1152921504606846976,"
+        "\"utf8_string\":\"unicode! \xe2\x98\xaf - \xe2\x99\xab\"}";
+    is(output, expect, "JSON output is correct");
+
+    free(output);
+}
+#endif
+
+void run_tests(int mode, const char *mode_desc)
+{
+    const char *filename = "MaxMind-DB-test-decoder.mmdb";
+    const char *path = test_database_path(filename);
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    const char *ip = "1.1.1.1";
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, ip, filename, mode_desc);
+
+    MMDB_entry_data_array_s *entry_data_array;
+    int status = MMDB_get_entry_data_array(&result.entry, &entry_data_array);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_get_entry_data_array is successful - %s", mode_desc);
+
+    MMDB_entry_data_list_s *entry_data_list;
+    status = MMDB_get_entry_data_list(&result.entry, &entry_data_list);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_get_entry_data_list is successful - %s", mode_desc);
+
+    test_matches_entry_data_list(entry_data_array, entry_data_list);
+    test_subtree_links(entry_data_array);
+#ifdef HAVE_OPEN_MEMSTREAM
+    test_dump(entry_data_array, entry_data_list);
+    test_json(entry_data_array);
+#endif
+
+    MMDB_free_entry_data_list(entry_data_list);
+    MMDB_free_entry_data_array(entry_data_array);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
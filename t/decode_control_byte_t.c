@@ -0,0 +1,243 @@
+#include "maxminddb_test_helper.h"
+
+/* These tests decode hand built data sections so that every way a control
+ * byte can encode a type, a size or a pointer is covered, including the
+ * boundaries between the inline size and the 1, 2 and 3 byte sizes. */
+
+#define DATA_SIZE (600 * 1024)
+
+static uint8_t data[DATA_SIZE];
+
+static MMDB_s fake_mmdb(uint32_t size)
+{
+    MMDB_s mmdb;
+    memset(&mmdb, 0, sizeof(mmdb));
+    mmdb.data_section = data;
+    mmdb.data_section_size = size;
+    return mmdb;
+}
+
+/* This writes a control byte for the given type and size, followed by the
+ * extended type byte and size bytes if needed, and returns the number of
+ * bytes written. */
+static uint32_t write_control(uint8_t *p, int type, uint32_t size)
+{
+    uint32_t length = 0;
+    uint8_t ctrl = type > 7 ? 0 : (uint8_t)(type << 5);
+    uint8_t extended = type > 7 ? (uint8_t)(type - 7) : 0;
+    uint8_t size_bytes[3];
+    int size_length = 0;
+
+    if (size < 29) {
+        ctrl |= size;
+    } else if (size < 285) {
+        ctrl |= 29;
+        size_bytes[size_length++] = (uint8_t)(size - 29);
+    } else if (size < 65821) {
+        ctrl |= 30;
+        size_bytes[size_length++] = (uint8_t)((size - 285) >> 8);
+        size_bytes[size_length++] = (uint8_t)(size - 285);
+    } else {
+        ctrl |= 31;
+        size_bytes[size_length++] = (uint8_t)((size - 65821) >> 16);
+        size_bytes[size_length++] = (uint8_t)((size - 65821) >> 8);
+        size_bytes[size_length++] = (uint8_t)(size - 65821);
+    }
+
+    p[length++] = ctrl;
+    if (type > 7) {
+        p[length++] = extended;
+    }
+    for (int i = 0; i < size_length; i++) {
+        p[length++] = size_bytes[i];
+    }
+    return length;
+}
+
+void test_string_sizes(void)
+{
+    uint32_t sizes[] = { 0, 1, 28, 29, 30, 284, 285, 286, 65820, 65821,
+                         65822, 100000 };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t header = write_control(data, MMDB_DATA_TYPE_UTF8_STRING,
+                                        sizes[i]);
+        memset(data + header, 'x', sizes[i]);
+        MMDB_s mmdb = fake_mmdb(header + sizes[i]);
+        MMDB_entry_s entry = { .mmdb = &mmdb, .offset = 0 };
+
+        MMDB_entry_data_list_s *entry_data_list;
+        int status = MMDB_get_entry_data_list(&entry, &entry_data_list);
+        cmp_ok(status, "==", MMDB_SUCCESS,
+               "decoded a string of size %u", sizes[i]);
+        if (MMDB_SUCCESS != status) {
+            continue;
+        }
+        MMDB_entry_data_s *entry_data = &entry_data_list->entry_data;
+        cmp_ok(entry_data->type, "==", MMDB_DATA_TYPE_UTF8_STRING,
+               "string of size %u has the right type", sizes[i]);
+        cmp_ok(entry_data->data_size, "==", sizes[i],
+               "string of size %u has the right size", sizes[i]);
+        cmp_ok(entry_data->offset_to_next, "==", header + sizes[i],
+               "string of size %u has the right offset_to_next", sizes[i]);
+        MMDB_free_entry_data_list(entry_data_list);
+
+        if (sizes[i] > 0) {
+            mmdb = fake_mmdb(header + sizes[i] - 1);
+            status = MMDB_get_entry_data_list(&entry, &entry_data_list);
+            cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+                   "string of size %u that is cut short is invalid",
+                   sizes[i]);
+        }
+        if (header > 1) {
+            mmdb = fake_mmdb(header - 1);
+            status = MMDB_get_entry_data_list(&entry, &entry_data_list);
+            cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+                   "string of size %u with its size cut short is invalid",
+                   sizes[i]);
+        }
+    }
+}
+
+void test_array_sizes(void)
+{
+    uint32_t sizes[] = { 0, 28, 29, 284, 285, 65820, 65821 };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t header = write_control(data, MMDB_DATA_TYPE_ARRAY, sizes[i]);
+        /* Each element is a one byte true boolean */
+        uint32_t length = header;
+        for (uint32_t j = 0; j < sizes[i]; j++) {
+            length += write_control(data + length, MMDB_DATA_TYPE_BOOLEAN, 1);
+        }
+        MMDB_s mmdb = fake_mmdb(length);
+        MMDB_entry_s entry = { .mmdb = &mmdb, .offset = 0 };
+
+        MMDB_entry_data_array_s *entry_data_array;
+        int status = MMDB_get_entry_data_array(&entry, &entry_data_array);
+        cmp_ok(status, "==", MMDB_SUCCESS,
+               "decoded an array of size %u", sizes[i]);
+        if (MMDB_SUCCESS != status) {
+            continue;
+        }
+        MMDB_entry_data_s *entry_data = &entry_data_array->nodes[0].entry_data;
+        cmp_ok(entry_data->type, "==", MMDB_DATA_TYPE_ARRAY,
+               "array of size %u has the right type", sizes[i]);
+        cmp_ok(entry_data->data_size, "==", sizes[i],
+               "array of size %u has the right size", sizes[i]);
+        cmp_ok(entry_data_array->count, "==", sizes[i] + 1,
+               "array of size %u has all its elements", sizes[i]);
+        MMDB_free_entry_data_array(entry_data_array);
+    }
+}
+
+void test_pointers(void)
+{
+    /* These are pointer sizes with offsets at the edges of what each size
+     * can hold, plus one offset past the end of the data section. */
+    struct {
+        int size;
+        uint32_t target;
+    } pointers[] = {
+        { 1, 0 }, { 1, 2047 }, { 2, 2048 }, { 2, 526335 }, { 3, 526336 },
+        { 3, 600000 }, { 4, 0 }, { 4, 500000 }, { 4, 4000000000U }
+    };
+
+    for (size_t i = 0; i < sizeof(pointers) / sizeof(pointers[0]); i++) {
+        int size = pointers[i].size;
+        uint32_t target = pointers[i].target;
+        uint32_t value = target;
+        if (2 == size) {
+            value -= 2048;
+        } else if (3 == size) {
+            value -= 526336;
+        }
+
+        /* The pointer goes at the end of the data section so that it can't
+         * overlap the string it points to. */
+        uint32_t pointer = DATA_SIZE - 8;
+        uint8_t *p = data + pointer;
+        if (4 == size) {
+            *p++ = (1 << 5) | (3 << 3);
+        } else {
+            *p++ = (uint8_t)((1 << 5) | ((size - 1) << 3)
+                             | (value >> (8 * size)));
+        }
+        for (int j = size - 1; j >= 0; j--) {
+            *p++ = (uint8_t)(value >> (8 * j));
+        }
+
+        MMDB_s mmdb = fake_mmdb(DATA_SIZE);
+        MMDB_entry_s entry = { .mmdb = &mmdb, .offset = pointer };
+        MMDB_entry_data_s entry_data;
+
+        if (target >= pointer) {
+            int status = MMDB_aget_value(&entry, &entry_data,
+                                         (const char *const[]){ NULL });
+            cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+                   "%d byte pointer past the data section is invalid", size);
+            continue;
+        }
+
+        write_control(data + target, MMDB_DATA_TYPE_UTF8_STRING, 1);
+        data[target + 1] = 'p';
+
+        int status = MMDB_aget_value(&entry, &entry_data,
+                                     (const char *const[]){ NULL });
+        cmp_ok(status, "==", MMDB_SUCCESS,
+               "followed a %d byte pointer to %u", size, target);
+        cmp_ok(entry_data.offset, "==", target,
+               "%d byte pointer to %u points to the right place", size,
+               target);
+        cmp_ok(entry_data.type, "==", MMDB_DATA_TYPE_UTF8_STRING,
+               "%d byte pointer to %u found the string", size, target);
+    }
+}
+
+void test_extended_types(void)
+{
+    uint32_t length = write_control(data, MMDB_DATA_TYPE_UINT64, 8);
+    memcpy(data + length, "\x01\x02\x03\x04\x05\x06\x07\x08", 8);
+    MMDB_s mmdb = fake_mmdb(length + 8);
+    MMDB_entry_s entry = { .mmdb = &mmdb, .offset = 0 };
+    MMDB_entry_data_s entry_data;
+    int status = MMDB_aget_value(&entry, &entry_data,
+                                 (const char *const[]){ NULL });
+    cmp_ok(status, "==", MMDB_SUCCESS, "decoded an extended uint64");
+    cmp_ok(entry_data.type, "==", MMDB_DATA_TYPE_UINT64,
+           "extended uint64 has the right type");
+    ok(entry_data.uint64 == 0x0102030405060708ULL,
+       "extended uint64 has the right value");
+
+    mmdb = fake_mmdb(1);
+    status = MMDB_aget_value(&entry, &entry_data,
+                             (const char *const[]){ NULL });
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "extended type byte past the data section is invalid");
+
+    length = write_control(data, MMDB_DATA_TYPE_UINT64, 9);
+    mmdb = fake_mmdb(length + 9);
+    status = MMDB_aget_value(&entry, &entry_data,
+                             (const char *const[]){ NULL });
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "uint64 of size 9 is invalid");
+
+    length = write_control(data, MMDB_DATA_TYPE_BOOLEAN, 1);
+    mmdb = fake_mmdb(length);
+    status = MMDB_aget_value(&entry, &entry_data,
+                             (const char *const[]){ NULL });
+    cmp_ok(status, "==", MMDB_SUCCESS, "decoded an extended boolean");
+    ok(entry_data.boolean, "boolean is true");
+    cmp_ok(entry_data.offset_to_next, "==", 2,
+           "boolean takes no space after its type bytes");
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    test_string_sizes();
+    test_array_sizes();
+    test_pointers();
+    test_extended_types();
+    done_testing();
+}
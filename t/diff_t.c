@@ -0,0 +1,144 @@
+#include "maxminddb_test_helper.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+/* The callback writes each change it is given into changes, separated by
+ * spaces, and asks to stop once it has seen stop_after of them. */
+typedef struct changes_s {
+    MMDB_s *old_mmdb;
+    MMDB_s *new_mmdb;
+    char changes[4096];
+    size_t count;
+    size_t stop_after;
+    int bad_entries;
+} changes_s;
+
+int add_change(void *ctx, const MMDB_diff_s *diff)
+{
+    changes_s *changes = ctx;
+    const char *kind = MMDB_DIFF_ADDED == diff->change ? "+"
+                       : MMDB_DIFF_REMOVED == diff->change ? "-" : "~";
+
+    char address[INET6_ADDRSTRLEN];
+    inet_ntop(4 == changes->old_mmdb->metadata.ip_version ? AF_INET : AF_INET6,
+              diff->address, address, sizeof(address));
+
+    size_t used = strlen(changes->changes);
+    if (used + INET6_ADDRSTRLEN + 8 < sizeof(changes->changes)) {
+        sprintf(changes->changes + used, "%s%s%s/%u", used ? " " : "", kind,
+                address, diff->prefix_length);
+    }
+
+    /* Each entry with data must be a record in its own database */
+    if (MMDB_DIFF_ADDED != diff->change
+        && (changes->old_mmdb != diff->old_entry.mmdb
+            || diff->old_entry.offset >= changes->old_mmdb->data_section_size)) {
+        changes->bad_entries++;
+    }
+    if (MMDB_DIFF_REMOVED != diff->change
+        && (changes->new_mmdb != diff->new_entry.mmdb
+            || diff->new_entry.offset >= changes->new_mmdb->data_section_size)) {
+        changes->bad_entries++;
+    }
+
+    changes->count++;
+    return changes->count == changes->stop_after
+           ? MMDB_VISIT_STOP : MMDB_VISIT_CONTINUE;
+}
+
+MMDB_s *open_database(const char *file, int mode, const char *mode_desc)
+{
+    const char *path = test_database_path(file);
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+    return mmdb;
+}
+
+void test_diff(const char *old_file, const char *new_file, const char *expect,
+               int mode, const char *mode_desc)
+{
+    MMDB_s *old_mmdb = open_database(old_file, mode, mode_desc);
+    MMDB_s *new_mmdb = open_database(new_file, mode, mode_desc);
+
+    changes_s changes = { .old_mmdb = old_mmdb, .new_mmdb = new_mmdb };
+    int status = MMDB_diff(old_mmdb, new_mmdb, 0, add_change, &changes);
+    cmp_ok(status, "==", MMDB_SUCCESS, "diffed %s and %s - %s", old_file,
+           new_file, mode_desc);
+    is(changes.changes, expect, "changes from %s to %s - %s", old_file,
+       new_file, mode_desc);
+    cmp_ok(changes.bad_entries, "==", 0,
+           "the entries point into the right databases - %s", mode_desc);
+
+    MMDB_close(old_mmdb);
+    free(old_mmdb);
+    MMDB_close(new_mmdb);
+    free(new_mmdb);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    const char *files[] = {
+        "MaxMind-DB-test-ipv4-24.mmdb", "MaxMind-DB-test-mixed-28.mmdb",
+        "MaxMind-DB-test-decoder.mmdb", "GeoIP2-City-Test.mmdb"
+    };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        test_diff(files[i], files[i], "", mode, mode_desc);
+    }
+
+    /* The same networks and data with a different record size are the same
+     * even though none of the node numbers or data offsets match */
+    test_diff("MaxMind-DB-test-ipv4-24.mmdb", "MaxMind-DB-test-ipv4-32.mmdb",
+              "", mode, mode_desc);
+    test_diff("MaxMind-DB-test-mixed-24.mmdb", "MaxMind-DB-test-mixed-28.mmdb",
+              "", mode, mode_desc);
+
+    test_diff("MaxMind-DB-test-ipv6-24.mmdb", "MaxMind-DB-test-mixed-24.mmdb",
+              "+::1.1.1.1/128 +::1.1.1.2/127 +::1.1.1.4/126 +::1.1.1.8/125 "
+              "+::1.1.1.16/124 +::1.1.1.32/128", mode, mode_desc);
+    test_diff("MaxMind-DB-test-mixed-24.mmdb", "MaxMind-DB-test-ipv6-24.mmdb",
+              "-::1.1.1.1/128 -::1.1.1.2/127 -::1.1.1.4/126 -::1.1.1.8/125 "
+              "-::1.1.1.16/124 -::1.1.1.32/128", mode, mode_desc);
+
+    /* The decoder database has IPv4 networks that the IPv6 one doesn't, is
+     * missing most of its IPv6 networks and has a different record for
+     * ::1:ffff:ffff */
+    test_diff("MaxMind-DB-test-ipv6-24.mmdb", "MaxMind-DB-test-decoder.mmdb",
+              "+::/128 +::1.1.1.0/120 +::4.5.6.0/120 ~::1:ffff:ffff/128 "
+              "-::2:0:0/122 -::2:0:40/124 -::2:0:50/125 -::2:0:58/127",
+              mode, mode_desc);
+
+    MMDB_s *ipv4 = open_database("MaxMind-DB-test-ipv4-24.mmdb", mode,
+                                 mode_desc);
+    MMDB_s *ipv6 = open_database("MaxMind-DB-test-ipv6-24.mmdb", mode,
+                                 mode_desc);
+    MMDB_s *mixed = open_database("MaxMind-DB-test-mixed-24.mmdb", mode,
+                                  mode_desc);
+
+    changes_s changes = { .old_mmdb = ipv4, .new_mmdb = mixed };
+    int status = MMDB_diff(ipv4, mixed, 0, add_change, &changes);
+    cmp_ok(status, "==", MMDB_IP_VERSION_MISMATCH_ERROR,
+           "an IPv4 and an IPv6 database can't be diffed - %s", mode_desc);
+
+    changes = (changes_s) {
+        .old_mmdb = ipv6, .new_mmdb = mixed, .stop_after = 2
+    };
+    status = MMDB_diff(ipv6, mixed, 0, add_change, &changes);
+    cmp_ok(status, "==", MMDB_SUCCESS, "stopping early is not an error - %s",
+           mode_desc);
+    is(changes.changes, "+::1.1.1.1/128 +::1.1.1.2/127",
+       "the callback can stop the diff - %s", mode_desc);
+
+    MMDB_close(ipv4);
+    free(ipv4);
+    MMDB_close(ipv6);
+    free(ipv6);
+    MMDB_close(mixed);
+    free(mixed);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
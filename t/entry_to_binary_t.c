@@ -0,0 +1,147 @@
+#include "maxminddb_test_helper.h"
+
+/* The expected output was generated independently of this library from the
+ * values in the decoder test database. */
+static const uint8_t decoder_msgpack[] = {
+    0x8c, 0xa5, 0x61, 0x72, 0x72, 0x61, 0x79, 0x93, 0x01, 0x02, 0x03, 0xa7,
+    0x62, 0x6f, 0x6f, 0x6c, 0x65, 0x61, 0x6e, 0xc3, 0xa5, 0x62, 0x79, 0x74,
+    0x65, 0x73, 0xc4, 0x04, 0x00, 0x00, 0x00, 0x2a, 0xa6, 0x64, 0x6f, 0x75,
+    0x62, 0x6c, 0x65, 0xcb, 0x40, 0x45, 0x0f, 0xcd, 0x67, 0xfd, 0x3f, 0x5b,
+    0xa5, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0xca, 0x3f, 0x8c, 0xcc, 0xcd, 0xa5,
+    0x69, 0x6e, 0x74, 0x33, 0x32, 0xd2, 0xf0, 0x00, 0x00, 0x00, 0xa3, 0x6d,
+    0x61, 0x70, 0x81, 0xa4, 0x6d, 0x61, 0x70, 0x58, 0x82, 0xa6, 0x61, 0x72,
+    0x72, 0x61, 0x79, 0x58, 0x93, 0x07, 0x08, 0x09, 0xac, 0x75, 0x74, 0x66,
+    0x38, 0x5f, 0x73, 0x74, 0x72, 0x69, 0x6e, 0x67, 0x58, 0xa5, 0x68, 0x65,
+    0x6c, 0x6c, 0x6f, 0xa7, 0x75, 0x69, 0x6e, 0x74, 0x31, 0x32, 0x38, 0xc4,
+    0x10, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0xa6, 0x75, 0x69, 0x6e, 0x74, 0x31, 0x36,
+    0x64, 0xa6, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0xce, 0x10, 0x00, 0x00,
+    0x00, 0xa6, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0xcf, 0x10, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0xab, 0x75, 0x74, 0x66, 0x38, 0x5f, 0x73,
+    0x74, 0x72, 0x69, 0x6e, 0x67, 0xb2, 0x75, 0x6e, 0x69, 0x63, 0x6f, 0x64,
+    0x65, 0x21, 0x20, 0xe2, 0x98, 0xaf, 0x20, 0x2d, 0x20, 0xe2, 0x99, 0xab,
+};
+
+static const uint8_t decoder_cbor[] = {
+    0xac, 0x65, 0x61, 0x72, 0x72, 0x61, 0x79, 0x83, 0x01, 0x02, 0x03, 0x67,
+    0x62, 0x6f, 0x6f, 0x6c, 0x65, 0x61, 0x6e, 0xf5, 0x65, 0x62, 0x79, 0x74,
+    0x65, 0x73, 0x44, 0x00, 0x00, 0x00, 0x2a, 0x66, 0x64, 0x6f, 0x75, 0x62,
+    0x6c, 0x65, 0xfb, 0x40, 0x45, 0x0f, 0xcd, 0x67, 0xfd, 0x3f, 0x5b, 0x65,
+    0x66, 0x6c, 0x6f, 0x61, 0x74, 0xfa, 0x3f, 0x8c, 0xcc, 0xcd, 0x65, 0x69,
+    0x6e, 0x74, 0x33, 0x32, 0x3a, 0x0f, 0xff, 0xff, 0xff, 0x63, 0x6d, 0x61,
+    0x70, 0xa1, 0x64, 0x6d, 0x61, 0x70, 0x58, 0xa2, 0x66, 0x61, 0x72, 0x72,
+    0x61, 0x79, 0x58, 0x83, 0x07, 0x08, 0x09, 0x6c, 0x75, 0x74, 0x66, 0x38,
+    0x5f, 0x73, 0x74, 0x72, 0x69, 0x6e, 0x67, 0x58, 0x65, 0x68, 0x65, 0x6c,
+    0x6c, 0x6f, 0x67, 0x75, 0x69, 0x6e, 0x74, 0x31, 0x32, 0x38, 0xc2, 0x50,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x66, 0x75, 0x69, 0x6e, 0x74, 0x31, 0x36, 0x18,
+    0x64, 0x66, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x1a, 0x10, 0x00, 0x00,
+    0x00, 0x66, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x1b, 0x10, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x6b, 0x75, 0x74, 0x66, 0x38, 0x5f, 0x73,
+    0x74, 0x72, 0x69, 0x6e, 0x67, 0x72, 0x75, 0x6e, 0x69, 0x63, 0x6f, 0x64,
+    0x65, 0x21, 0x20, 0xe2, 0x98, 0xaf, 0x20, 0x2d, 0x20, 0xe2, 0x99, 0xab,
+};
+
+static const uint8_t zero_msgpack[] = {
+    0x8c, 0xa5, 0x61, 0x72, 0x72, 0x61, 0x79, 0x90, 0xa7, 0x62, 0x6f, 0x6f,
+    0x6c, 0x65, 0x61, 0x6e, 0xc2, 0xa5, 0x62, 0x79, 0x74, 0x65, 0x73, 0xc4,
+    0x00, 0xa6, 0x64, 0x6f, 0x75, 0x62, 0x6c, 0x65, 0xcb, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0xa5, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0xca,
+    0x00, 0x00, 0x00, 0x00, 0xa5, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x00, 0xa3,
+    0x6d, 0x61, 0x70, 0x80, 0xa7, 0x75, 0x69, 0x6e, 0x74, 0x31, 0x32, 0x38,
+    0x00, 0xa6, 0x75, 0x69, 0x6e, 0x74, 0x31, 0x36, 0x00, 0xa6, 0x75, 0x69,
+    0x6e, 0x74, 0x33, 0x32, 0x00, 0xa6, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34,
+    0x00, 0xab, 0x75, 0x74, 0x66, 0x38, 0x5f, 0x73, 0x74, 0x72, 0x69, 0x6e,
+    0x67, 0xa0,
+};
+
+static const uint8_t zero_cbor[] = {
+    0xac, 0x65, 0x61, 0x72, 0x72, 0x61, 0x79, 0x80, 0x67, 0x62, 0x6f, 0x6f,
+    0x6c, 0x65, 0x61, 0x6e, 0xf4, 0x65, 0x62, 0x79, 0x74, 0x65, 0x73, 0x40,
+    0x66, 0x64, 0x6f, 0x75, 0x62, 0x6c, 0x65, 0xfb, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x65, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0xfa, 0x00,
+    0x00, 0x00, 0x00, 0x65, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x00, 0x63, 0x6d,
+    0x61, 0x70, 0xa0, 0x67, 0x75, 0x69, 0x6e, 0x74, 0x31, 0x32, 0x38, 0x00,
+    0x66, 0x75, 0x69, 0x6e, 0x74, 0x31, 0x36, 0x00, 0x66, 0x75, 0x69, 0x6e,
+    0x74, 0x33, 0x32, 0x00, 0x66, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x00,
+    0x6b, 0x75, 0x74, 0x66, 0x38, 0x5f, 0x73, 0x74, 0x72, 0x69, 0x6e, 0x67,
+    0x60,
+};
+
+typedef int (*transcoder_t)(MMDB_entry_s *const entry, uint8_t *buffer,
+                            size_t capacity, size_t *needed);
+
+void test_transcoder(MMDB_entry_s *entry, transcoder_t transcoder,
+                     const uint8_t *expect, size_t expect_size,
+                     const char *description)
+{
+    uint8_t buffer[1024];
+    size_t needed = 0;
+    int status = transcoder(entry, buffer, sizeof(buffer), &needed);
+    cmp_ok(status, "==", MMDB_SUCCESS, "%s succeeded", description);
+    cmp_ok(needed, "==", expect_size, "%s needed is the output size",
+           description);
+    ok(!memcmp(buffer, expect, expect_size), "%s output is correct",
+       description);
+
+    status = transcoder(entry, NULL, 0, &needed);
+    cmp_ok(status, "==", MMDB_BUFFER_TOO_SMALL_ERROR,
+           "%s with a zero capacity returns MMDB_BUFFER_TOO_SMALL_ERROR",
+           description);
+    cmp_ok(needed, "==", expect_size, "%s needed is set with a zero capacity",
+           description);
+
+    memset(buffer, 0xaa, sizeof(buffer));
+    status = transcoder(entry, buffer, expect_size - 1, &needed);
+    cmp_ok(status, "==", MMDB_BUFFER_TOO_SMALL_ERROR,
+           "%s with a short buffer returns MMDB_BUFFER_TOO_SMALL_ERROR",
+           description);
+    ok(!memcmp(buffer, expect, expect_size - 1)
+       && 0xaa == buffer[expect_size - 1],
+       "%s with a short buffer writes a prefix and nothing more",
+       description);
+
+    status = transcoder(entry, buffer, expect_size, NULL);
+    cmp_ok(status, "==", MMDB_SUCCESS, "%s with an exact fit succeeds",
+           description);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    const char *filename = "MaxMind-DB-test-decoder.mmdb";
+    const char *path = test_database_path(filename);
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    char description[100];
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, "1.1.1.1", filename, mode_desc);
+
+    sprintf(description, "MMDB_entry_to_msgpack - %s", mode_desc);
+    test_transcoder(&result.entry, MMDB_entry_to_msgpack, decoder_msgpack,
+                    sizeof(decoder_msgpack), description);
+    sprintf(description, "MMDB_entry_to_cbor - %s", mode_desc);
+    test_transcoder(&result.entry, MMDB_entry_to_cbor, decoder_cbor,
+                    sizeof(decoder_cbor), description);
+
+    result = lookup_string_ok(mmdb, "::", filename, mode_desc);
+
+    sprintf(description, "MMDB_entry_to_msgpack with zero values - %s",
+            mode_desc);
+    test_transcoder(&result.entry, MMDB_entry_to_msgpack, zero_msgpack,
+                    sizeof(zero_msgpack), description);
+    sprintf(description, "MMDB_entry_to_cbor with zero values - %s",
+            mode_desc);
+    test_transcoder(&result.entry, MMDB_entry_to_cbor, zero_cbor,
+                    sizeof(zero_cbor), description);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+#include "maxminddb_test_helper.h"
+
+static const char *decoder_json =
+    "{\"array\":[1,2,3],\"boolean\":true,\"bytes\":\"0000002A\","
+    "\"double\":42.123456,\"float\":1.1,\"int32\":-268435456,"
+    "\"map\":{\"mapX\":{\"arrayX\":[7,8,9],\"utf8_stringX\":\"hello\"}},"
+    "\"uint128\":\"0x01000000000000000000000000000000\","
+    "\"uint16\":100,\"uint32\":268435456,"
+    "\"uint64\":1152921504606846976,"
+    "\"utf8_string\":\"unicode! \xe2\x98\xaf - \xe2\x99\xab\"}";
+
+static const char *zero_json =
+    "{\"array\":[],\"boolean\":false,\"bytes\":\"\",\"double\":0,"
+    "\"float\":0,\"int32\":0,\"map\":{},"
+    "\"uint128\":\"0x00000000000000000000000000000000\","
+    "\"uint16\":0,\"uint32\":0,\"uint64\":0,\"utf8_string\":\"\"}";
+
+void test_decoder(int mode, const char *mode_desc)
+{
+    const char *filename = "MaxMind-DB-test-decoder.mmdb";
+    const char *path = test_database_path(filename);
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, "1.1.1.1", filename, mode_desc);
+
+    char buffer[1024];
+    size_t needed = 0;
+    int status =
+        MMDB_entry_to_json(&result.entry, buffer, sizeof(buffer), &needed);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_entry_to_json succeeded - %s", mode_desc);
+    is(buffer, decoder_json, "JSON output is correct - %s", mode_desc);
+    cmp_ok(needed, "==", strlen(decoder_json) + 1,
+           "needed is the output length plus the NUL - %s", mode_desc);
+
+    status = MMDB_entry_to_json(&result.entry, NULL, 0, &needed);
+    cmp_ok(status, "==", MMDB_BUFFER_TOO_SMALL_ERROR,
+           "a zero capacity returns MMDB_BUFFER_TOO_SMALL_ERROR - %s",
+           mode_desc);
+    cmp_ok(needed, "==", strlen(decoder_json) + 1,
+           "needed is set with a zero capacity - %s", mode_desc);
+
+    memset(buffer, 'x', sizeof(buffer));
+    status = MMDB_entry_to_json(&result.entry, buffer, 20, &needed);
+    cmp_ok(status, "==", MMDB_BUFFER_TOO_SMALL_ERROR,
+           "a short buffer returns MMDB_BUFFER_TOO_SMALL_ERROR - %s",
+           mode_desc);
+    ok(!strncmp(buffer, decoder_json, 19) && '\0' == buffer[19],
+       "a short buffer holds a NUL-terminated prefix - %s", mode_desc);
+    cmp_ok(buffer[20], "==", 'x',
+           "nothing is written past the capacity - %s", mode_desc);
+
+    status = MMDB_entry_to_json(&result.entry, buffer, strlen(decoder_json),
+                                &needed);
+    cmp_ok(status, "==", MMDB_BUFFER_TOO_SMALL_ERROR,
+           "no room for the NUL returns MMDB_BUFFER_TOO_SMALL_ERROR - %s",
+           mode_desc);
+    status = MMDB_entry_to_json(&result.entry, buffer,
+                                strlen(decoder_json) + 1, NULL);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "an exact fit succeeds - %s", mode_desc);
+    is(buffer, decoder_json, "exact fit output is correct - %s", mode_desc);
+
+    result = lookup_string_ok(mmdb, "::", filename, mode_desc);
+    status = MMDB_entry_to_json(&result.entry, buffer, sizeof(buffer), NULL);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_entry_to_json succeeded for zero values - %s", mode_desc);
+    is(buffer, zero_json, "zero value JSON output is correct - %s",
+       mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+void test_matches_dump(int mode, const char *mode_desc)
+{
+    const char *filename = "GeoIP2-City-Test.mmdb";
+    const char *path = test_database_path(filename);
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    const char *ips[] = { "81.2.69.160", "2.125.160.216", "89.160.20.112",
+                          "216.160.83.56", "2001:218::" };
+    for (size_t i = 0; i < sizeof(ips) / sizeof(ips[0]); i++) {
+        MMDB_lookup_result_s result =
+            lookup_string_ok(mmdb, ips[i], filename, mode_desc);
+
+        MMDB_entry_data_array_s *entry_data_array;
+        int status = MMDB_get_entry_data_array(&result.entry,
+                                               &entry_data_array);
+        cmp_ok(status, "==", MMDB_SUCCESS,
+               "MMDB_get_entry_data_array succeeded for %s - %s", ips[i],
+               mode_desc);
+
+        char *expect;
+        size_t size;
+        FILE *stream = open_memstream(&expect, &size);
+        MMDB_dump_entry_data_array_as_json(stream, entry_data_array);
+        fclose(stream);
+        MMDB_free_entry_data_array(entry_data_array);
+
+        char buffer[4096];
+        status = MMDB_entry_to_json(&result.entry, buffer, sizeof(buffer),
+                                    NULL);
+        cmp_ok(status, "==", MMDB_SUCCESS,
+               "MMDB_entry_to_json succeeded for %s - %s", ips[i], mode_desc);
+        is(buffer, expect,
+           "output matches MMDB_dump_entry_data_array_as_json for %s - %s",
+           ips[i], mode_desc);
+        free(expect);
+    }
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+#endif
+
+void run_tests(int mode, const char *mode_desc)
+{
+    test_decoder(mode, mode_desc);
+#ifdef HAVE_OPEN_MEMSTREAM
+    test_matches_dump(mode, mode_desc);
+#endif
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
@@ -0,0 +1,231 @@
+#include "maxminddb_test_helper.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+/* These are the addresses we join, as 16 byte addresses for an IPv6
+ * database or 4 byte ones for an IPv4 database */
+typedef struct addresses_s {
+    uint8_t (*addresses)[16];
+    size_t count;
+    size_t capacity;
+    int size;
+} addresses_s;
+
+void add_address(addresses_s *addresses, const uint8_t *address)
+{
+    if (addresses->count == addresses->capacity) {
+        addresses->capacity = addresses->capacity ? addresses->capacity * 2
+                              : 1024;
+        addresses->addresses = realloc(addresses->addresses,
+                                       addresses->capacity * 16);
+    }
+    memset(addresses->addresses[addresses->count], 0, 16);
+    memcpy(addresses->addresses[addresses->count], address, addresses->size);
+    addresses->count++;
+}
+
+int compare_addresses(const void *a, const void *b)
+{
+    return memcmp(a, b, 16);
+}
+
+/* For every network, including the empty ones and the aliases, we take its
+ * first and last addresses and the address after it. Sorted, these hit every
+ * boundary between networks. */
+void network_boundaries(MMDB_s *mmdb, addresses_s *addresses)
+{
+    memset(addresses, 0, sizeof(addresses_s));
+    addresses->size = mmdb->depth / 8;
+
+    MMDB_network_iterator_s iterator;
+    MMDB_network_iterator_init(mmdb, MMDB_NETWORK_ITERATOR_INCLUDE_EMPTY
+                               | MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES,
+                               &iterator);
+    MMDB_network_s network;
+    bool found_network;
+    while (MMDB_SUCCESS == MMDB_network_iterator_next(&iterator, &network,
+                                                      &found_network)
+           && found_network) {
+        uint8_t last[16];
+        memcpy(last, network.address, 16);
+        for (int bit = network.prefix_length; bit < mmdb->depth; bit++) {
+            last[bit >> 3] |= 0x80 >> (bit & 7);
+        }
+        add_address(addresses, network.address);
+        add_address(addresses, last);
+
+        int i = addresses->size - 1;
+        while (i >= 0 && 0xff == last[i]) {
+            last[i--] = 0;
+        }
+        if (i >= 0) {
+            last[i]++;
+            add_address(addresses, last);
+        }
+    }
+
+    qsort(addresses->addresses, addresses->count, 16, compare_addresses);
+}
+
+void make_sockaddr(const uint8_t *address, int size,
+                   struct sockaddr_storage *sockaddr)
+{
+    memset(sockaddr, 0, sizeof(struct sockaddr_storage));
+    if (4 == size) {
+        struct sockaddr_in *sin = (struct sockaddr_in *)sockaddr;
+        sin->sin_family = AF_INET;
+        memcpy(&sin->sin_addr, address, 4);
+    } else {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)sockaddr;
+        sin6->sin6_family = AF_INET6;
+        memcpy(&sin6->sin6_addr, address, 16);
+    }
+}
+
+/* This joins every step-th address, starting from the end when backwards is
+ * set, and returns how many results were different from a lookup of the same
+ * address. */
+int join_addresses(MMDB_s *mmdb, addresses_s *addresses, int size,
+                   size_t step, bool backwards)
+{
+    MMDB_join_s join;
+    if (MMDB_SUCCESS != MMDB_join_init(mmdb, &join)) {
+        return -1;
+    }
+
+    int differences = 0;
+    for (size_t n = 0; n < addresses->count; n += step) {
+        size_t i = backwards ? addresses->count - 1 - n : n;
+        /* An IPv4 address in an IPv6 database is the last 4 bytes of an
+         * address under ::/96 */
+        const uint8_t *address = addresses->addresses[i];
+        if (4 == size && 16 == addresses->size) {
+            static const uint8_t ipv4_prefix[12] = { 0 };
+            if (0 != memcmp(address, ipv4_prefix, 12)) {
+                continue;
+            }
+            address += 12;
+        }
+
+        struct sockaddr_storage sockaddr;
+        make_sockaddr(address, size, &sockaddr);
+
+        int join_error, lookup_error;
+        MMDB_lookup_result_s joined =
+            MMDB_join_sockaddr(&join, (struct sockaddr *)&sockaddr,
+                               &join_error);
+        MMDB_lookup_result_s looked_up =
+            MMDB_lookup_sockaddr(mmdb, (struct sockaddr *)&sockaddr,
+                                 &lookup_error);
+        if (MMDB_SUCCESS != join_error || MMDB_SUCCESS != lookup_error
+            || joined.found_entry != looked_up.found_entry
+            || joined.netmask != looked_up.netmask
+            || (joined.found_entry
+                && joined.entry.offset != looked_up.entry.offset)) {
+            differences++;
+        }
+    }
+    return differences;
+}
+
+void test_database(const char *file, int mode, const char *mode_desc)
+{
+    const char *path = test_database_path(file);
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    addresses_s addresses;
+    network_boundaries(mmdb, &addresses);
+    int size = addresses.size;
+
+    cmp_ok(join_addresses(mmdb, &addresses, size, 1, false), "==", 0,
+           "joining every boundary in %s matches lookups - %s", file,
+           mode_desc);
+    cmp_ok(join_addresses(mmdb, &addresses, size, 37, false), "==", 0,
+           "joining some boundaries in %s matches lookups - %s", file,
+           mode_desc);
+    cmp_ok(join_addresses(mmdb, &addresses, size, 1, true), "==", 0,
+           "joining in descending order in %s matches lookups - %s", file,
+           mode_desc);
+    if (16 == size) {
+        cmp_ok(join_addresses(mmdb, &addresses, 4, 1, false), "==", 0,
+               "joining IPv4 addresses in %s matches lookups - %s", file,
+               mode_desc);
+    }
+
+    free(addresses.addresses);
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+MMDB_lookup_result_s join_string(MMDB_join_s *join, const char *ip,
+                                 int *mmdb_error)
+{
+    struct sockaddr_storage sockaddr;
+    uint8_t address[16];
+    bool ipv6 = NULL != strchr(ip, ':');
+    inet_pton(ipv6 ? AF_INET6 : AF_INET, ip, address);
+    make_sockaddr(address, ipv6 ? 16 : 4, &sockaddr);
+    return MMDB_join_sockaddr(join, (struct sockaddr *)&sockaddr, mmdb_error);
+}
+
+void test_networks(int mode, const char *mode_desc)
+{
+    const char *path = test_database_path("MaxMind-DB-test-ipv4-24.mmdb");
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    MMDB_join_s join;
+    int status = MMDB_join_init(mmdb, &join);
+    cmp_ok(status, "==", MMDB_SUCCESS, "started a join - %s", mode_desc);
+
+    const char *ips[] = { "0.0.0.0", "1.1.1.1", "1.1.1.3", "1.1.1.3",
+                          "1.1.1.20", "1.1.1.33", "255.255.255.255" };
+    const char *networks[] = { "0.0.0.0/8", "1.1.1.1/32", "1.1.1.2/31",
+                               "1.1.1.2/31", "1.1.1.16/28", "1.1.1.33/32",
+                               "128.0.0.0/1" };
+    const bool found[] = { false, true, true, true, true, false, false };
+    for (size_t i = 0; i < sizeof(ips) / sizeof(ips[0]); i++) {
+        int mmdb_error;
+        MMDB_lookup_result_s result = join_string(&join, ips[i], &mmdb_error);
+        cmp_ok(mmdb_error, "==", MMDB_SUCCESS, "joined %s - %s", ips[i],
+               mode_desc);
+        cmp_ok(result.found_entry, "==", found[i],
+               "%s %s data - %s", ips[i], found[i] ? "has" : "has no",
+               mode_desc);
+
+        char address[INET_ADDRSTRLEN], network[INET_ADDRSTRLEN + 8];
+        inet_ntop(AF_INET, join.network.address, address, sizeof(address));
+        sprintf(network, "%s/%u", address, join.network.prefix_length);
+        is(network, networks[i], "%s is in %s - %s", ips[i], networks[i],
+           mode_desc);
+    }
+
+    int mmdb_error;
+    join_string(&join, "::1.1.1.1", &mmdb_error);
+    cmp_ok(mmdb_error, "==", MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR,
+           "an IPv6 address in an IPv4 database is an error - %s", mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    const char *files[] = {
+        "MaxMind-DB-test-ipv4-24.mmdb", "MaxMind-DB-test-ipv4-28.mmdb",
+        "MaxMind-DB-test-ipv4-32.mmdb", "MaxMind-DB-test-mixed-24.mmdb",
+        "MaxMind-DB-test-decoder.mmdb", "GeoIP2-City-Test.mmdb"
+    };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        test_database(files[i], mode, mode_desc);
+    }
+    test_networks(mode, mode_desc);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
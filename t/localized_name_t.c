@@ -0,0 +1,96 @@
+#include "maxminddb_test_helper.h"
+
+void test_name(MMDB_lookup_result_s *result, const char *const *const path,
+               const char *const *const languages, size_t language_count,
+               const char *expect, const char *description,
+               const char *mode_desc)
+{
+    MMDB_entry_data_s entry_data;
+    int status = MMDB_get_localized_name(&result->entry, path, languages,
+                                         language_count, &entry_data);
+    cmp_ok(status, "==", MMDB_SUCCESS, "%s - %s", description, mode_desc);
+    if (MMDB_SUCCESS != status) {
+        return;
+    }
+    cmp_ok(entry_data.type, "==", MMDB_DATA_TYPE_UTF8_STRING,
+           "%s is a string - %s", description, mode_desc);
+    char *name = strndup(entry_data.utf8_string, entry_data.data_size);
+    is(name, expect, "%s is %s - %s", description, expect, mode_desc);
+    free(name);
+}
+
+void test_no_name(MMDB_lookup_result_s *result,
+                  const char *const *const path,
+                  const char *const *const languages, size_t language_count,
+                  const char *description, const char *mode_desc)
+{
+    MMDB_entry_data_s entry_data;
+    int status = MMDB_get_localized_name(&result->entry, path, languages,
+                                         language_count, &entry_data);
+    cmp_ok(status, "==", MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR,
+           "%s - %s", description, mode_desc);
+    ok(!entry_data.has_data, "%s has no data - %s", description, mode_desc);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    const char *path = test_database_path("GeoIP2-City-Test.mmdb");
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, "81.2.69.160", "GeoIP2-City-Test.mmdb",
+                         mode_desc);
+    const char *const city[] = { "city", NULL };
+    const char *const country[] = { "country", NULL };
+    const char *const subdivision[] = { "subdivisions", "0", NULL };
+
+    test_name(&result, city, (const char *const[]){ "en" }, 1, "London",
+              "city name in en", mode_desc);
+    test_name(&result, city, (const char *const[]){ "fr", "en" }, 2,
+              "London (fr)", "city name in fr before en", mode_desc);
+    test_name(&result, city, (const char *const[]){ "ja", "zh-CN", "en" }, 3,
+              "London (zh)",
+              "city name falls back from ja to zh-CN", mode_desc);
+    test_name(&result, country, (const char *const[]){ "ja", "en" }, 2,
+              "GB jp", "country name in ja", mode_desc);
+    test_name(&result, subdivision, (const char *const[]){ "de", "en" }, 2,
+              "England", "subdivision name falls back to en", mode_desc);
+
+    /* pt-BR isn't in the metadata, so it is skipped even though we don't
+     * look to see if the record has it */
+    test_name(&result, city, (const char *const[]){ "pt-BR", "de" }, 2,
+              "London", "city name skips a language the database lacks",
+              mode_desc);
+    test_no_name(&result, city, (const char *const[]){ "pt-BR" }, 1,
+                 "only languages the database lacks", mode_desc);
+
+    test_no_name(&result, city, (const char *const[]){ "ja" }, 1,
+                 "no city name in ja", mode_desc);
+    test_no_name(&result, city, NULL, 0, "no languages", mode_desc);
+    test_no_name(&result, (const char *const[]){ "postal", NULL },
+                 (const char *const[]){ "en" }, 1, "postal has no names",
+                 mode_desc);
+    test_no_name(&result, (const char *const[]){ "missing", NULL },
+                 (const char *const[]){ "en" }, 1, "missing path", mode_desc);
+    test_no_name(&result, (const char *const[]){ NULL },
+                 (const char *const[]){ "en" }, 1,
+                 "top level map has no names", mode_desc);
+
+    MMDB_entry_data_s entry_data;
+    int status = MMDB_get_localized_name(
+        &result.entry, (const char *const[]){ "location", "latitude", NULL },
+        (const char *const[]){ "en" }, 1, &entry_data);
+    cmp_ok(status, "==", MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR,
+           "path to a double - %s", mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
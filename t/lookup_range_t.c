@@ -0,0 +1,192 @@
+#include "maxminddb_test_helper.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+/* The callback writes each network it is given into networks as CIDR,
+ * separated by spaces, and asks to stop once it has seen stop_after of
+ * them. */
+typedef struct range_s {
+    int ip_version;
+    char networks[4096];
+    size_t count;
+    size_t stop_after;
+    uint32_t offsets[4096];
+} range_s;
+
+int add_network(void *ctx, const MMDB_network_s *network)
+{
+    range_s *range = ctx;
+    char address[INET6_ADDRSTRLEN];
+    inet_ntop(4 == range->ip_version ? AF_INET : AF_INET6, network->address,
+              address, sizeof(address));
+
+    size_t used = strlen(range->networks);
+    if (used + INET6_ADDRSTRLEN + 8 < sizeof(range->networks)) {
+        sprintf(range->networks + used, "%s%s/%u", used ? " " : "", address,
+                network->prefix_length);
+    }
+    if (range->count < sizeof(range->offsets) / sizeof(uint32_t)) {
+        range->offsets[range->count] = network->entry.offset;
+    }
+    range->count++;
+
+    return range->count == range->stop_after
+           ? MMDB_VISIT_STOP : MMDB_VISIT_CONTINUE;
+}
+
+int lookup_range(MMDB_s *mmdb, const char *ip, uint16_t prefix_length,
+                 uint32_t flags, size_t stop_after, range_s *range)
+{
+    memset(range, 0, sizeof(range_s));
+    range->ip_version = mmdb->metadata.ip_version;
+    range->stop_after = stop_after;
+
+    struct sockaddr_storage sockaddr;
+    memset(&sockaddr, 0, sizeof(sockaddr));
+    if (strchr(ip, ':')) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&sockaddr;
+        sin6->sin6_family = AF_INET6;
+        inet_pton(AF_INET6, ip, &sin6->sin6_addr);
+    } else {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&sockaddr;
+        sin->sin_family = AF_INET;
+        inet_pton(AF_INET, ip, &sin->sin_addr);
+    }
+
+    return MMDB_lookup_range(mmdb, (struct sockaddr *)&sockaddr,
+                             prefix_length, flags, add_network, range);
+}
+
+void test_range(MMDB_s *mmdb, const char *ip, uint16_t prefix_length,
+                const char *expect, const char *mode_desc)
+{
+    range_s range;
+    int status = lookup_range(mmdb, ip, prefix_length, 0, 0, &range);
+    cmp_ok(status, "==", MMDB_SUCCESS, "looked up %s/%u - %s", ip,
+           prefix_length, mode_desc);
+    is(range.networks, expect, "networks in %s/%u - %s", ip, prefix_length,
+       mode_desc);
+}
+
+void test_ipv4_database(int mode, const char *mode_desc)
+{
+    const char *path = test_database_path("MaxMind-DB-test-ipv4-24.mmdb");
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    test_range(mmdb, "1.1.1.0", 24,
+               "1.1.1.1/32 1.1.1.2/31 1.1.1.4/30 1.1.1.8/29 1.1.1.16/28 "
+               "1.1.1.32/32", mode_desc);
+    test_range(mmdb, "1.1.1.0", 29, "1.1.1.1/32 1.1.1.2/31 1.1.1.4/30",
+               mode_desc);
+    test_range(mmdb, "1.1.1.1", 32, "1.1.1.1/32", mode_desc);
+    test_range(mmdb, "0.0.0.0", 0,
+               "1.1.1.1/32 1.1.1.2/31 1.1.1.4/30 1.1.1.8/29 1.1.1.16/28 "
+               "1.1.1.32/32", mode_desc);
+    /* A range inside a bigger network gets the bigger network */
+    test_range(mmdb, "1.1.1.20", 30, "1.1.1.16/28", mode_desc);
+    test_range(mmdb, "2.0.0.0", 8, "", mode_desc);
+
+    range_s range;
+    int status = lookup_range(mmdb, "1.1.1.0", 24, 0, 2, &range);
+    cmp_ok(status, "==", MMDB_SUCCESS, "stopping early is not an error - %s",
+           mode_desc);
+    is(range.networks, "1.1.1.1/32 1.1.1.2/31",
+       "the callback can stop the lookup - %s", mode_desc);
+
+    status = lookup_range(mmdb, "1.1.1.0", 33, 0, 0, &range);
+    cmp_ok(status, "==", MMDB_INVALID_NETWORK_ERROR,
+           "a prefix longer than the address is an error - %s", mode_desc);
+    status = lookup_range(mmdb, "::1.1.1.0", 120, 0, 0, &range);
+    cmp_ok(status, "==", MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR,
+           "an IPv6 range in an IPv4 database is an error - %s", mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+void test_ipv6_database(int mode, const char *mode_desc)
+{
+    const char *path = test_database_path("MaxMind-DB-test-mixed-24.mmdb");
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    /* An IPv4 range is under ::/96, just like an IPv4 lookup */
+    const char *expect = "::1.1.1.1/128 ::1.1.1.2/127 ::1.1.1.4/126 "
+                         "::1.1.1.8/125 ::1.1.1.16/124 ::1.1.1.32/128";
+    test_range(mmdb, "1.1.1.0", 24, expect, mode_desc);
+    test_range(mmdb, "::1.1.1.0", 120, expect, mode_desc);
+    test_range(mmdb, "1.1.1.16", 28, "::1.1.1.16/124", mode_desc);
+    test_range(mmdb, "::2:0:0", 122, "::2:0:0/122", mode_desc);
+
+    range_s range;
+    int status = lookup_range(mmdb, "1.1.1.0", 33, 0, 0, &range);
+    cmp_ok(status, "==", MMDB_INVALID_NETWORK_ERROR,
+           "an IPv4 prefix longer than 32 is an error - %s", mode_desc);
+    status = lookup_range(mmdb, "::", 129, 0, 0, &range);
+    cmp_ok(status, "==", MMDB_INVALID_NETWORK_ERROR,
+           "an IPv6 prefix longer than 128 is an error - %s", mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+int compare_offsets(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void test_unique_data(int mode, const char *mode_desc)
+{
+    const char *path = test_database_path("MaxMind-DB-test-decoder.mmdb");
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    range_s *all = calloc(1, sizeof(range_s));
+    range_s *unique = calloc(1, sizeof(range_s));
+    int status = lookup_range(mmdb, "::", 0, 0, 0, all);
+    cmp_ok(status, "==", MMDB_SUCCESS, "looked up every network - %s",
+           mode_desc);
+    status = lookup_range(mmdb, "::", 0, MMDB_LOOKUP_RANGE_UNIQUE_DATA, 0,
+                          unique);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "looked up every network with unique data - %s", mode_desc);
+
+    /* The database has more networks than records */
+    qsort(all->offsets, all->count, sizeof(uint32_t), compare_offsets);
+    size_t distinct = 0;
+    for (size_t i = 0; i < all->count; i++) {
+        distinct += 0 == i || all->offsets[i] != all->offsets[i - 1];
+    }
+    ok(distinct < all->count, "some networks share a record - %s",
+       mode_desc);
+    cmp_ok(unique->count, "==", distinct,
+           "each record is reported once - %s", mode_desc);
+
+    qsort(unique->offsets, unique->count, sizeof(uint32_t), compare_offsets);
+    int repeats = 0;
+    for (size_t i = 1; i < unique->count; i++) {
+        repeats += unique->offsets[i] == unique->offsets[i - 1];
+    }
+    cmp_ok(repeats, "==", 0, "no record is reported twice - %s", mode_desc);
+
+    free(all);
+    free(unique);
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    test_ipv4_database(mode, mode_desc);
+    test_ipv6_database(mode, mode_desc);
+    test_unique_data(mode, mode_desc);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
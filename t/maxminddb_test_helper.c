@@ -2,7 +2,7 @@
 #include <config.h>
 #endif
 
-#define _POSIX_C_SOURCE 200112L
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <stdarg.h>
 #include <sys/types.h>
@@ -13,6 +13,7 @@
 #ifdef _WIN32
 #include <io.h>
 #else
+#include <arpa/inet.h>
 #include <libgen.h>
 #include <unistd.h>
 #endif
@@ -253,3 +254,45 @@ void compare_float(float got, float expect)
              got, expect, diff);
     }
 }
+
+#ifndef _WIN32
+/* This writes the database to a temporary file in the current directory,
+ * opens it and checks that it verifies */
+MMDB_s *write_and_open(MMDB_writer_s *writer, char *path,
+                       const char *description)
+{
+    strcpy(path, "mmdb_test-XXXXXX");
+    int fd = mkstemp(path);
+    if (-1 == fd) {
+        BAIL_OUT("could not create a temporary file");
+    }
+    FILE *stream = fdopen(fd, "wb");
+    int status = MMDB_writer_write(writer, stream);
+    fclose(stream);
+    cmp_ok(status, "==", MMDB_SUCCESS, "wrote the database - %s",
+           description);
+
+    MMDB_s *mmdb = open_ok(path, MMDB_MODE_MMAP, description);
+    status = MMDB_verify(mmdb);
+    cmp_ok(status, "==", MMDB_SUCCESS, "the database verifies - %s",
+           description);
+    return mmdb;
+}
+
+void close_and_remove(MMDB_s *mmdb, const char *path)
+{
+    MMDB_close(mmdb);
+    free(mmdb);
+    unlink(path);
+}
+
+void insert_ok(MMDB_writer_s *writer, const char *ip, uint16_t prefix_length,
+               uint32_t record)
+{
+    uint8_t address[16];
+    int family = strchr(ip, ':') ? AF_INET6 : AF_INET;
+    inet_pton(family, ip, address);
+    int status = MMDB_writer_insert(writer, address, prefix_length, record);
+    cmp_ok(status, "==", MMDB_SUCCESS, "inserted %s/%u", ip, prefix_length);
+}
+#endif
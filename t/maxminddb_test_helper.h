@@ -1,6 +1,6 @@
 /* Some test files may require something newer */
 #ifndef _GNU_SOURCE
-#define _POSIX_C_SOURCE 200112L
+#define _POSIX_C_SOURCE 200809L
 #endif
 
 #if HAVE_CONFIG_H
@@ -63,6 +63,11 @@ extern char *strndup(const char *s, size_t n);
                                      const char *description, ...);
     extern void compare_double(double got, double expect);
     extern void compare_float(float got, float expect);
+    extern MMDB_s *write_and_open(MMDB_writer_s *writer, char *path,
+                                  const char *description);
+    extern void close_and_remove(MMDB_s *mmdb, const char *path);
+    extern void insert_ok(MMDB_writer_s *writer, const char *ip,
+                          uint16_t prefix_length, uint32_t record);
     /* --prototypes end - don't remove this comment-- */
     /* *INDENT-ON* */
 
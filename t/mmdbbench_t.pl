@@ -0,0 +1,195 @@
+#!/usr/bin/env perl
+
+use strict;
+use warnings;
+
+use File::Temp;
+use FindBin qw( $Bin );
+
+eval <<'EOF';
+use Test::More 0.88;
+use IPC::Run3 qw( run3 );
+EOF
+
+if ($@) {
+    print
+        "1..0 # skip all tests skipped - these tests need the Test::More 0.88 and IPC::Run3 modules:\n";
+    print "$@";
+    exit 0;
+}
+
+my $mmdbbench     = "$Bin/../bin/mmdbbench";
+my $test_data_dir = "$Bin/maxmind-db/test-data";
+
+{
+    ok( -x $mmdbbench, 'mmdbbench script is executable' );
+}
+
+for my $arg (qw( -h -? --help )) {
+    _test_stdout(
+        [$arg],
+        qr{mmdbbench --file.+This application accepts the following options:}s,
+        0,
+        "help output from $arg"
+    );
+}
+
+_test_stdout(
+    [qw( --version )],
+    qr/mmdbbench version \d+\.\d+\.\d+/,
+    0,
+    'output for --version'
+);
+
+_test_stderr(
+    [],
+    qr{ERROR: You must provide a filename with --file},
+    1,
+    'error without --file'
+);
+
+my $city = "$test_data_dir/GeoIP2-City-Test.mmdb";
+
+_test_stderr(
+    [ '--file', $city, '--distribution', 'gaussian' ],
+    qr{ERROR: The distribution must be uniform4, uniform6, zipf or replay},
+    1,
+    'error for an unknown distribution'
+);
+
+_test_stderr(
+    [ '--file', $city, '--distribution', 'replay' ],
+    qr{ERROR: You must provide a file to replay with --input},
+    1,
+    'error for replay without --input'
+);
+
+_test_stderr(
+    [ '--file', $city, '--threads', 0 ],
+    qr{ERROR: The number of threads must be from 1 to 256},
+    1,
+    'error for zero threads'
+);
+
+_test_stderr(
+    [ '--file', 'this/path/better/not/exist.mmdb' ],
+    qr{Can't open this/path/better/not/exist.mmdb}s,
+    2,
+    'error for file that does not exist'
+);
+
+_test_stderr(
+    [
+        '--file', "$test_data_dir/MaxMind-DB-test-ipv4-24.mmdb",
+        '--distribution', 'uniform6'
+    ],
+    qr{Can't use IPv6 addresses with an IPv4 database},
+    1,
+    'error for IPv6 addresses with an IPv4 database'
+);
+
+for my $distribution (qw( uniform4 uniform6 zipf )) {
+    _test_stdout(
+        [
+            '--file', $city, '--count', 1000, '--threads', 2,
+            '--distribution', $distribution
+        ],
+        qr{Operations\s+1000\sper\sthread\sfor\seach\sstage,\s2\sthreads.+
+           ^\s+tree\s+[\d.]+\s+[\d.]+\s+\d+\s+\d+\s+\d+.+
+           ^\s+end-to-end\s+[\d.]+\s+[\d.]+\s+\d+\s+\d+\s+\d+}msx,
+        0,
+        "report for $distribution addresses"
+    );
+}
+
+{
+    my $input = File::Temp->new;
+    print {$input} "81.2.69.160\nnot-an-ip-address\n2.125.160.216\n";
+    close $input;
+
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdbbench, '--file', $city, '--count', 100, '--input',
+            $input->filename ],
+        \undef,
+        \$stdout,
+        \$stderr,
+    );
+    is( $? >> 8, 0, 'exit status is 0 when replaying addresses' );
+    like(
+        $stderr,
+        qr{Skipped 1 line of },
+        'lines that are not addresses are skipped'
+    );
+    like(
+        $stdout,
+        qr{Addresses\s+2 from .+, 100\.0% with data},
+        'the replayed addresses are all in the database'
+    );
+    like(
+        $stdout,
+        qr{^\s+decode\s+[\d.]+\s+[\d.]+\s+\d+\s+\d+\s+\d+}m,
+        'the records that were found are decoded'
+    );
+}
+
+done_testing();
+
+sub _test_stdout {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, $expect_stdout, q{}, $expect_status, $desc );
+}
+
+sub _test_stderr {
+    my $args          = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, undef, $expect_stderr, $expect_status, $desc );
+}
+
+sub _test_both {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdbbench, @{$args} ],
+        \undef,
+        \$stdout,
+        \$stderr,
+    );
+
+    my $exit_status = $? >> 8;
+
+    # We don't need to retest that the help output shows up for all errors
+    if ( defined $expect_stdout ) {
+        like(
+            $stdout,
+            $expect_stdout,
+            "stdout for mmdbbench @{$args}"
+        );
+    }
+
+    if ( ref $expect_stderr ) {
+        like( $stderr, $expect_stderr, "stderr for mmdbbench @{$args}" );
+    }
+    else {
+        is( $stderr, $expect_stderr, "stderr for mmdbbench @{$args}" );
+    }
+
+    is(
+        $exit_status, $expect_status,
+        "exit status was $expect_status for mmdbbench @{$args}"
+    );
+}
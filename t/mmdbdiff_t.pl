@@ -0,0 +1,176 @@
+#!/usr/bin/env perl
+
+use strict;
+use warnings;
+
+use FindBin qw( $Bin );
+
+eval <<'EOF';
+use Test::More 0.88;
+use IPC::Run3 qw( run3 );
+EOF
+
+if ($@) {
+    print
+        "1..0 # skip all tests skipped - these tests need the Test::More 0.88 and IPC::Run3 modules:\n";
+    print "$@";
+    exit 0;
+}
+
+my $mmdbdiff      = "$Bin/../bin/mmdbdiff";
+my $test_data_dir = "$Bin/maxmind-db/test-data";
+
+{
+    ok( -x $mmdbdiff, 'mmdbdiff script is executable' );
+}
+
+for my $arg (qw( -h -? --help )) {
+    _test_stdout(
+        [$arg],
+        qr{mmdbdiff --old.+This application accepts the following options:}s,
+        0,
+        "help output from $arg"
+    );
+}
+
+_test_both(
+    [ '--old', "$test_data_dir/MaxMind-DB-test-ipv4-24.mmdb" ],
+    qr{mmdbdiff --old.+This application accepts the following options:}s,
+    qr{ERROR: You must provide both files with --old and --new},
+    2,
+    "help output without --new"
+);
+
+_test_stdout(
+    [qw( --version )],
+    qr/mmdbdiff version \d+\.\d+\.\d+/,
+    0,
+    'output for --version'
+);
+
+_test_stderr(
+    [
+        '--old', 'this/path/better/not/exist.mmdb',
+        '--new', "$test_data_dir/MaxMind-DB-test-ipv4-24.mmdb"
+    ],
+    qr{Can't open this/path/better/not/exist.mmdb}s,
+    2,
+    'error for file that does not exist'
+);
+
+_test_stderr(
+    [
+        '--old', "$test_data_dir/MaxMind-DB-test-ipv4-24.mmdb",
+        '--new', "$test_data_dir/MaxMind-DB-test-mixed-24.mmdb"
+    ],
+    qr{Can't compare .+ - The databases are for different IP versions}s,
+    2,
+    'error for databases with different IP versions'
+);
+
+# The record size is different, so the trees and data sections don't have
+# a byte in common, but the networks and their data are the same.
+_test_stdout(
+    [
+        '--old', "$test_data_dir/MaxMind-DB-test-mixed-24.mmdb",
+        '--new', "$test_data_dir/MaxMind-DB-test-mixed-32.mmdb"
+    ],
+    qr/\A\z/,
+    0,
+    'no differences between record sizes'
+);
+
+{
+    my $expect = join q{}, map {"$_\n"} (
+        qq{added\t0.0.0.0/32\t\{"array":[],},
+        qq{added\t1.1.1.0/24\t\{"array":[1,2,3],},
+        qq{added\t4.5.6.0/24\t\{"array":[1,2,3],},
+        qq{changed\t::1:ffff:ffff/128\t\{"ip":"::1:ffff:ffff"\}\t}
+            . qq{\{"uint128":"0xFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF"\}},
+        qq{removed\t::2:0:0/122\t\{"ip":"::2:0:0"\}},
+        qq{removed\t::2:0:40/124\t\{"ip":"::2:0:40"\}},
+        qq{removed\t::2:0:50/125\t\{"ip":"::2:0:50"\}},
+        qq{removed\t::2:0:58/127\t\{"ip":"::2:0:58"\}},
+    );
+
+    my @args = (
+        '--old', "$test_data_dir/MaxMind-DB-test-ipv6-24.mmdb",
+        '--new', "$test_data_dir/MaxMind-DB-test-decoder.mmdb"
+    );
+
+    my $stdout;
+    my $stderr;
+    run3( [ $mmdbdiff, @args ], \undef, \$stdout, \$stderr );
+    is( $? >> 8, 1, 'exit status is 1 when there are differences' );
+
+    # The added records are long, so we only check how they start
+    $stdout =~ s/^(added\t\S+\t\{"array":\[[^\]]*\],)[^\n]*/$1/mg;
+    is( $stdout, $expect, 'every difference is printed in address order' );
+
+    _test_stdout(
+        [ @args, '--summary' ],
+        qr/\Aadded\t3\nremoved\t4\nchanged\t1\n\z/,
+        1,
+        'summary of the differences'
+    );
+}
+
+done_testing();
+
+sub _test_stdout {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, $expect_stdout, q{}, $expect_status, $desc );
+}
+
+sub _test_stderr {
+    my $args          = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, undef, $expect_stderr, $expect_status, $desc );
+}
+
+sub _test_both {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdbdiff, @{$args} ],
+        \undef,
+        \$stdout,
+        \$stderr,
+    );
+
+    my $exit_status = $? >> 8;
+
+    # We don't need to retest that the help output shows up for all errors
+    if ( defined $expect_stdout ) {
+        like(
+            $stdout,
+            $expect_stdout,
+            "stdout for mmdbdiff @{$args}"
+        );
+    }
+
+    if ( ref $expect_stderr ) {
+        like( $stderr, $expect_stderr, "stderr for mmdbdiff @{$args}" );
+    }
+    else {
+        is( $stderr, $expect_stderr, "stderr for mmdbdiff @{$args}" );
+    }
+
+    is(
+        $exit_status, $expect_status,
+        "exit status was $expect_status for mmdbdiff @{$args}"
+    );
+}
@@ -0,0 +1,184 @@
+#!/usr/bin/env perl
+
+use strict;
+use warnings;
+
+use FindBin qw( $Bin );
+
+eval <<'EOF';
+use Test::More 0.88;
+use IPC::Run3 qw( run3 );
+EOF
+
+if ($@) {
+    print
+        "1..0 # skip all tests skipped - these tests need the Test::More 0.88 and IPC::Run3 modules:\n";
+    print "$@";
+    exit 0;
+}
+
+my $mmdbdump      = "$Bin/../bin/mmdbdump";
+my $test_data_dir = "$Bin/maxmind-db/test-data";
+
+{
+    ok( -x $mmdbdump, 'mmdbdump script is executable' );
+}
+
+for my $arg (qw( -h -? --help )) {
+    _test_stdout(
+        [$arg],
+        qr{mmdbdump --file.+This application accepts the following options:}s,
+        0,
+        "help output from $arg"
+    );
+}
+
+_test_both(
+    [],
+    qr{mmdbdump --file.+This application accepts the following options:}s,
+    qr{ERROR: You must provide a filename with --file},
+    1,
+    "help output with no CLI options"
+);
+
+_test_stdout(
+    [qw( --version )],
+    qr/mmdbdump version \d+\.\d+\.\d+/,
+    0,
+    'output for --version'
+);
+
+_test_stderr(
+    [qw( --file this/path/better/not/exist.mmdb )],
+    qr{Can't open this/path/better/not/exist.mmdb}s,
+    2,
+    'error for file that does not exist'
+);
+
+_test_both(
+    [ '--file', "$test_data_dir/MaxMind-DB-test-ipv4-24.mmdb", '--threads',
+        1000 ],
+    qr{mmdbdump --file}s,
+    qr{ERROR: The number of threads must be from 1 to 256},
+    1,
+    'error for too many threads'
+);
+
+{
+    my @networks = qw(
+        1.1.1.1/32 1.1.1.2/31 1.1.1.4/30 1.1.1.8/29 1.1.1.16/28 1.1.1.32/32
+    );
+    my $ipv4 = join q{}, map { _line( $_, $_ ) } @networks;
+
+    _test_stdout(
+        [ '--file', "$test_data_dir/MaxMind-DB-test-ipv4-24.mmdb" ],
+        qr/\A\Qnetwork,data\E\n\Q$ipv4\E\z/,
+        0,
+        'every network in an IPv4 database'
+    );
+
+    # The IPv4 networks in an IPv6 database are written as IPv4 and come
+    # before all of the IPv6 networks.
+    my $mixed = join q{}, map { _line( $_, "::$_" ) } @networks;
+    _test_stdout(
+        [ '--file', "$test_data_dir/MaxMind-DB-test-mixed-24.mmdb" ],
+        qr/\A\Qnetwork,data\E\n\Q$mixed\E(?:[0-9a-f:]+\/\d+,"[^\n]+"\n)+\z/,
+        0,
+        'every network in an IPv6 database'
+    );
+}
+
+for my $file (
+    qw(
+    GeoIP2-City-Test.mmdb
+    MaxMind-DB-test-decoder.mmdb
+    MaxMind-DB-test-ipv6-32.mmdb
+    MaxMind-DB-test-mixed-32.mmdb
+    )
+    ) {
+    my @outputs = map { _dump( '--file', "$test_data_dir/$file", '--threads', $_ ) }
+        ( 1, 4 );
+    ok(
+        length $outputs[0] > length "network,data\n",
+        "found networks in $file"
+    );
+    is(
+        $outputs[1], $outputs[0],
+        "$file is dumped the same way with 1 and 4 threads"
+    );
+}
+
+done_testing();
+
+sub _line {
+    my $network = shift;
+    my $ip      = shift;
+
+    ( my $address = $ip ) =~ s{/\d+\z}{};
+    return qq{$network,"{""ip"":""$address""}"\n};
+}
+
+sub _dump {
+    my $stdout;
+    my $stderr;
+    run3( [ $mmdbdump, @_ ], \undef, \$stdout, \$stderr );
+    return $stdout;
+}
+
+sub _test_stdout {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, $expect_stdout, q{}, $expect_status, $desc );
+}
+
+sub _test_stderr {
+    my $args          = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, undef, $expect_stderr, $expect_status, $desc );
+}
+
+sub _test_both {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdbdump, @{$args} ],
+        \undef,
+        \$stdout,
+        \$stderr,
+    );
+
+    my $exit_status = $? >> 8;
+
+    # We don't need to retest that the help output shows up for all errors
+    if ( defined $expect_stdout ) {
+        like(
+            $stdout,
+            $expect_stdout,
+            "stdout for mmdbdump @{$args}"
+        );
+    }
+
+    if ( ref $expect_stderr ) {
+        like( $stderr, $expect_stderr, "stderr for mmdbdump @{$args}" );
+    }
+    else {
+        is( $stderr, $expect_stderr, "stderr for mmdbdump @{$args}" );
+    }
+
+    is(
+        $exit_status, $expect_status,
+        "exit status was $expect_status for mmdbdump @{$args}"
+    );
+}
@@ -0,0 +1,199 @@
+#!/usr/bin/env perl
+
+use strict;
+use warnings;
+
+use FindBin qw( $Bin );
+
+eval <<'EOF';
+use Test::More 0.88;
+use File::Compare qw( compare );
+use File::Temp qw( tempdir );
+use IPC::Run3 qw( run3 );
+EOF
+
+if ($@) {
+    print
+        "1..0 # skip all tests skipped - these tests need the Test::More 0.88, File::Temp and IPC::Run3 modules:\n";
+    print "$@";
+    exit 0;
+}
+
+my $mmdbgen    = "$Bin/../bin/mmdbgen";
+my $mmdbverify = "$Bin/../bin/mmdbverify";
+my $dir        = tempdir( CLEANUP => 1 );
+
+{
+    ok( -x $mmdbgen, 'mmdbgen script is executable' );
+}
+
+for my $arg (qw( -h -? --help )) {
+    _test_stdout(
+        [$arg],
+        qr{mmdbgen --output.+This application accepts the following options:}s,
+        0,
+        "help output from $arg"
+    );
+}
+
+_test_both(
+    [],
+    qr{mmdbgen --output.+This application accepts the following options:}s,
+    qr{ERROR: You must provide a filename with --output},
+    1,
+    "help output with no CLI options"
+);
+
+_test_stdout(
+    [qw( --version )],
+    qr/mmdbgen version \d+\.\d+\.\d+/,
+    0,
+    'output for --version'
+);
+
+for my $test (
+    [ [qw( --record-size 30 )], qr{The record size must be 24, 28 or 32} ],
+    [ [qw( --ip-version 5 )],   qr{The IP version must be 4 or 6} ],
+    [ [qw( --nodes 0 )],        qr{The number of nodes must be from 1} ],
+    [ [qw( --depth 9 )],        qr{The depth must be from 1 to 8} ],
+    [
+        [ '--ipv4-prefix-lengths', '24:1,33' ],
+        qr{The IPv4 prefix lengths must be a list of LENGTH:WEIGHT}
+    ],
+    [
+        [qw( --ipv6-prefix-lengths 48:x )],
+        qr{The IPv6 prefix lengths must be a list of LENGTH:WEIGHT}
+    ],
+    [
+        [qw( --keys 256 --depth 8 )],
+        qr{The keys and depth give records with more than 1048576 values}
+    ],
+    ) {
+    my ( $args, $error ) = @{$test};
+    _test_both(
+        [ '--output', "$dir/error.mmdb", @{$args} ],
+        qr{This application accepts the following options:},
+        $error,
+        1,
+        "error for @{$args}"
+    );
+}
+
+{
+    local $ENV{SOURCE_DATE_EPOCH} = 1;
+
+    my @args = qw(
+        --nodes 5000 --ip-version 4 --record-size 24 --records 100
+        --keys 4 --depth 3 --languages 2 --seed 42
+    );
+
+    my $stdout = _generate( [ @args, '--output', "$dir/first.mmdb" ] );
+    like(
+        $stdout,
+        qr/\Anetworks\t\d+\nnodes\t\d+\nrecords\t100\ndata_size\t\d+\n\z/,
+        'summary of the generated database'
+    );
+    my ($nodes) = $stdout =~ /^nodes\t(\d+)$/m;
+    ok(
+        $nodes > 4900 && $nodes < 5100,
+        "tree has about the requested number of nodes ($nodes)"
+    );
+
+    _generate( [ @args, '--output', "$dir/second.mmdb" ] );
+    is(
+        compare( "$dir/first.mmdb", "$dir/second.mmdb" ), 0,
+        'the same seed gives the same database'
+    );
+
+    _generate( [ @args, '--seed', 43, '--output', "$dir/third.mmdb" ] );
+    is(
+        compare( "$dir/first.mmdb", "$dir/third.mmdb" ), 1,
+        'a different seed gives a different database'
+    );
+}
+
+for my $ip_version ( 4, 6 ) {
+    for my $record_size ( 24, 28, 32 ) {
+        my $file = "$dir/verify-$ip_version-$record_size.mmdb";
+        _generate(
+            [
+                '--output',      $file,
+                '--ip-version',  $ip_version,
+                '--record-size', $record_size,
+                qw( --nodes 20000 --records 500 ),
+                '--ipv6-prefix-lengths', '48,64,128',
+            ]
+        );
+
+        my $stdout;
+        my $stderr;
+        run3( [ $mmdbverify, '--file', $file ], \undef, \$stdout, \$stderr );
+        is(
+            $? >> 8, 0,
+            "mmdbverify passes for IPv$ip_version with $record_size-bit records"
+        );
+    }
+}
+
+done_testing();
+
+sub _generate {
+    my $args = shift;
+
+    my $stdout;
+    my $stderr;
+    run3( [ $mmdbgen, @{$args} ], \undef, \$stdout, \$stderr );
+    is( $? >> 8, 0, "exit status was 0 for mmdbgen @{$args}" )
+        or diag($stderr);
+
+    return $stdout;
+}
+
+sub _test_stdout {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, $expect_stdout, q{}, $expect_status, $desc );
+}
+
+sub _test_both {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdbgen, @{$args} ],
+        \undef,
+        \$stdout,
+        \$stderr,
+    );
+
+    my $exit_status = $? >> 8;
+
+    # We don't need to retest that the help output shows up for all errors
+    if ( defined $expect_stdout ) {
+        like(
+            $stdout,
+            $expect_stdout,
+            "stdout for mmdbgen @{$args}"
+        );
+    }
+
+    if ( ref $expect_stderr ) {
+        like( $stderr, $expect_stderr, "stderr for mmdbgen @{$args}" );
+    }
+    else {
+        is( $stderr, $expect_stderr, "stderr for mmdbgen @{$args}" );
+    }
+
+    is(
+        $exit_status, $expect_status,
+        "exit status was $expect_status for mmdbgen @{$args}"
+    );
+}
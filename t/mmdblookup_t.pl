@@ -3,6 +3,7 @@
 use strict;
 use warnings;
 
+use File::Temp;
 use FindBin qw( $Bin );
 
 eval <<'EOF';
@@ -97,8 +98,167 @@ _test_stderr(
     'error for bad PI address'
 );
 
+{
+    my ( $stdout, $stderr, $status ) = _join(
+        "$test_data_dir/MaxMind-DB-test-ipv4-24.mmdb",
+        "1.1.1.1\n 1.1.1.3 \n\n1.1.1.20\nnot-an-ip-address\n2.0.0.1\n",
+    );
+    is(
+        $stdout,
+        <<'EOF',
+{"ip":"1.1.1.1","network":"1.1.1.1/32","data":{"ip":"1.1.1.1"}}
+{"ip":"1.1.1.3","network":"1.1.1.2/31","data":{"ip":"1.1.1.2"}}
+{"ip":"1.1.1.20","network":"1.1.1.16/28","data":{"ip":"1.1.1.16"}}
+{"ip":"2.0.0.1","network":"2.0.0.0/7"}
+EOF
+        'one JSON object for each address from --join'
+    );
+    like(
+        $stderr,
+        qr{not-an-ip-address is not a valid IP address},
+        'an address that is not valid is reported on stderr'
+    );
+    is( $status, 3, 'exit status is 3 when an address is not valid' );
+}
+
+{
+    my ( $stdout, $stderr, $status ) = _join(
+        "$test_data_dir/MaxMind-DB-test-mixed-24.mmdb",
+        "1.1.1.4\n::1.1.1.8\n::2:0:1\n1.1.1.1\n",
+    );
+    is(
+        $stdout,
+        <<'EOF',
+{"ip":"1.1.1.4","network":"1.1.1.4/30","data":{"ip":"::1.1.1.4"}}
+{"ip":"::1.1.1.8","network":"1.1.1.8/29","data":{"ip":"::1.1.1.8"}}
+{"ip":"::2:0:1","network":"::2:0:0/122","data":{"ip":"::2:0:0"}}
+{"ip":"1.1.1.1","network":"1.1.1.1/32","data":{"ip":"::1.1.1.1"}}
+EOF
+        'addresses out of order are still looked up'
+    );
+    is( $status, 0, 'exit status is 0 when every address was looked up' );
+}
+
+{
+    my ( $stdout, $stderr, $status ) = _join(
+        "$test_data_dir/GeoIP2-City-Test.mmdb",
+        "2.125.160.216\n81.2.69.160\n",
+        qw( city names en ),
+    );
+    is(
+        $stdout,
+        <<'EOF',
+{"ip":"2.125.160.216","network":"2.125.160.216/29","data":"Boxford"}
+{"ip":"81.2.69.160","network":"81.2.69.160/27","data":"London"}
+EOF
+        'a lookup path picks the data to print for each address'
+    );
+}
+
+{
+    my $input = File::Temp->new;
+    print {$input} "81.2.69.160\n2.125.160.216\n1.1.1.1\n";
+    close $input;
+
+    my ( $stdout, $stderr, $status ) = _run(
+        q{},
+        '--file', "$test_data_dir/GeoIP2-City-Test.mmdb",
+        '--bulk', $input->filename,
+        '--path', 'city.names.en',
+        '--path', 'country.iso_code',
+    );
+    is(
+        $stdout,
+        <<'EOF',
+{"ip":"81.2.69.160","network":"81.2.69.160/27","data":{"city.names.en":"London","country.iso_code":"GB"}}
+{"ip":"2.125.160.216","network":"2.125.160.216/29","data":{"city.names.en":"Boxford","country.iso_code":"GB"}}
+{"ip":"1.1.1.1","network":"0.0.0.0/7"}
+EOF
+        'each --path is a key in the data printed by --bulk'
+    );
+    is( $status, 0, 'exit status is 0 after reading addresses from a file' );
+}
+
+{
+    # This is more than one block of input, so the lines are looked up by
+    # several threads and have to be put back in order.
+    my @ips = map { ( '2.125.160.216', '81.2.69.160', "1.1.1.$_" ) }
+        map { $_ % 256 } 1 .. 30_000;
+    my ( $stdout, $stderr, $status ) = _run(
+        join( q{}, map {"$_\n"} @ips ),
+        '--file', "$test_data_dir/GeoIP2-City-Test.mmdb",
+        '--bulk', q{-},
+        '--threads', 3,
+        'city', 'names', 'en',
+    );
+    my @lines = split /\n/, $stdout;
+    is( scalar @lines, scalar @ips, 'one line for each address with --threads' );
+    is_deeply(
+        [ map { /"ip":"([^"]+)"/ ? $1 : undef } @lines ],
+        \@ips,
+        'the lines are printed in the order the addresses were read'
+    );
+    is(
+        ( scalar grep {/"data":"(?:Boxford|London)"/} @lines ),
+        60_000,
+        'every address with data was looked up'
+    );
+    is( $status, 0, 'exit status is 0 with several threads' );
+}
+
+{
+    my ( $stdout, $stderr, $status ) = _run(
+        q{},
+        '--file', "$test_data_dir/GeoIP2-City-Test.mmdb",
+        '--bulk', "$Bin/no-such-file",
+    );
+    like(
+        $stderr,
+        qr{\QCan't open $Bin/no-such-file},
+        'error for a --bulk file that does not exist'
+    );
+    is( $status, 2, 'exit status is 2 when the --bulk file cannot be read' );
+}
+
+{
+    my ( $stdout, $stderr, $status ) = _run(
+        q{},
+        '--file', "$test_data_dir/GeoIP2-City-Test.mmdb",
+        '--ip',   '81.2.69.160',
+        '--path', 'city.names.en',
+    );
+    like(
+        $stderr,
+        qr{\Q--path and --threads can only be used with --bulk},
+        'error for --path without --bulk'
+    );
+    is( $status, 1, 'exit status is 1 for --path without --bulk' );
+}
+
 done_testing();
 
+sub _join {
+    my $file  = shift;
+    my $input = shift;
+
+    return _run( $input, '--file', $file, '--join', @_ );
+}
+
+sub _run {
+    my $input = shift;
+
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdblookup, @_ ],
+        \$input,
+        \$stdout,
+        \$stderr,
+    );
+
+    return ( $stdout, $stderr, $? >> 8 );
+}
+
 sub _test_stdout {
     my $args          = shift;
     my $expect_stdout = shift;
@@ -0,0 +1,309 @@
+#!/usr/bin/env perl
+
+use strict;
+use warnings;
+
+use FindBin qw( $Bin );
+
+eval <<'EOF';
+use Test::More 0.88;
+use File::Temp qw( tempdir );
+use IPC::Run3 qw( run3 );
+EOF
+
+if ($@) {
+    print
+        "1..0 # skip all tests skipped - these tests need the Test::More 0.88, File::Temp and IPC::Run3 modules:\n";
+    print "$@";
+    exit 0;
+}
+
+my $mmdboptimize  = "$Bin/../bin/mmdboptimize";
+my $mmdbdiff      = "$Bin/../bin/mmdbdiff";
+my $mmdbgen       = "$Bin/../bin/mmdbgen";
+my $mmdblookup    = "$Bin/../bin/mmdblookup";
+my $mmdbverify    = "$Bin/../bin/mmdbverify";
+my $test_data_dir = "$Bin/maxmind-db/test-data";
+my $dir           = tempdir( CLEANUP => 1 );
+
+my $city = "$test_data_dir/GeoIP2-City-Test.mmdb";
+
+{
+    ok( -x $mmdboptimize, 'mmdboptimize script is executable' );
+}
+
+for my $arg (qw( -h -? --help )) {
+    _test_stdout(
+        [$arg],
+        qr{mmdboptimize --file.+This application accepts the following options:}s,
+        0,
+        "help output from $arg"
+    );
+}
+
+_test_both(
+    [],
+    qr{mmdboptimize --file.+This application accepts the following options:}s,
+    qr{ERROR: You must provide a filename with --file},
+    1,
+    "help output with no CLI options"
+);
+
+_test_stdout(
+    [qw( --version )],
+    qr/mmdboptimize version \d+\.\d+\.\d+/,
+    0,
+    'output for --version'
+);
+
+for my $test (
+    [ [ '--file', $city ], qr{You must provide a filename with --output} ],
+    [
+        [ '--file', $city, '--output', "$dir/error.mmdb", '--record-size', 30 ],
+        qr{The record size must be 24, 28 or 32}
+    ],
+    [
+        [ '--file', $city, '--output', "$dir/error.mmdb", '--hot-path', q{} ],
+        qr{A hot path can't be empty}
+    ],
+    ) {
+    my ( $args, $error ) = @{$test};
+    _test_both(
+        $args,
+        qr{This application accepts the following options:},
+        $error,
+        1,
+        "error for @{$args}"
+    );
+}
+
+_test_both(
+    [ '--file', "$dir/missing.mmdb", '--output', "$dir/error.mmdb" ],
+    q{},
+    qr{Can't open .+missing\.mmdb},
+    2,
+    'error for a database that does not exist'
+);
+
+for my $file (
+    qw(
+    GeoIP2-City-Test.mmdb
+    MaxMind-DB-test-decoder.mmdb
+    MaxMind-DB-test-ipv4-24.mmdb
+    MaxMind-DB-test-mixed-32.mmdb
+    MaxMind-DB-test-nested.mmdb
+    )
+    ) {
+    my $output = "$dir/$file";
+    my $stdout = _optimize(
+        [ '--file', "$test_data_dir/$file", '--output', $output ] );
+    like(
+        $stdout,
+        qr/\Anodes\t(\d+)\t\1\naverage_depth\t([\d.]+)\t\2\n
+           data_size\t\d+\t\d+\nfile_size\t\d+\t\d+\n\z/x,
+        "summary for $file"
+    );
+    ok( -s $output == ( $stdout =~ /^file_size\t\d+\t(\d+)$/m )[0],
+        "file size in the summary for $file" );
+
+    _test_same( "$test_data_dir/$file", $output, $file );
+}
+
+{
+    my $queries = "$dir/queries.txt";
+    open my $fh, '>', $queries or die $!;
+    print {$fh} "216.160.83.56\n  89.160.20.112  \n\n89.160.20.112\n"
+        . "2001:480::1\nnot an address\n";
+    close $fh;
+
+    my $output = "$dir/queries.mmdb";
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdboptimize, '--file', $city, '--output', $output, '--queries',
+            $queries
+        ],
+        \undef,
+        \$stdout,
+        \$stderr
+    );
+    is( $? >> 8, 0, 'exit status was 0 with --queries' );
+    like(
+        $stderr,
+        qr/Skipped 1 line of .+ that can't be looked up/,
+        'lines that are not addresses are skipped'
+    );
+    _test_same( $city, $output, 'the database optimized for queries' );
+
+    open $fh, '>', "$dir/empty.txt" or die $!;
+    close $fh;
+    _test_both(
+        [
+            '--file',    $city, '--output', "$dir/error.mmdb",
+            '--queries', "$dir/empty.txt"
+        ],
+        q{},
+        qr{There are no addresses to use in},
+        2,
+        'error for a query log with no addresses'
+    );
+}
+
+{
+    my $output = "$dir/hot.mmdb";
+    _optimize(
+        [
+            '--file',     $city, '--output', $output,
+            '--hot-path', 'subdivisions.0.names.en',
+            '--hot-path', 'city.names.en', '--hot-path', 'no.such.key',
+        ]
+    );
+
+    my $stdout;
+    my $stderr;
+    run3( [ $mmdbverify, '--file', $output ], \undef, \$stdout, \$stderr );
+    is( $? >> 8, 0, 'mmdbverify passes for the database with hot paths' );
+
+    run3(
+        [ $mmdblookup, '--file', $output, '--ip', '81.2.69.160' ],
+        \undef, \$stdout, \$stderr
+    );
+    like(
+        $stdout,
+        qr/\A\s*\{\s*"subdivisions":\s*\[\s*\{\s*"names":\s*\{\s*"en":/,
+        'the first hot path comes first in the record, through the array'
+    );
+    like(
+        $stdout,
+        qr/\]\s*"city":\s*\{\s*"names":\s*\{\s*"en":\s*"London"/,
+        'the second hot path comes before the other keys'
+    );
+
+    run3(
+        [ $mmdbdiff, '--old', $city, '--new', $output ],
+        \undef, \$stdout, \$stderr
+    );
+    is( $? >> 8, 1, 'mmdbdiff reports records with moved keys as changed' );
+    unlike( $stdout, qr/^(?:added|removed)/m, 'no networks were lost' );
+}
+
+{
+    # With a single record, many of the generated networks have subtrees
+    # with the same shape
+    my $file = "$dir/generated.mmdb";
+    my $stdout;
+    my $stderr;
+    run3(
+        [
+            $mmdbgen, '--output', $file,
+            qw( --nodes 5000 --ip-version 4 --records 1 ),
+            '--ipv4-prefix-lengths', '24,32'
+        ],
+        \undef,
+        \$stdout,
+        \$stderr
+    );
+    is( $? >> 8, 0, 'generated a database to compact' ) or diag($stderr);
+
+    my %nodes;
+    for my $option (qw( --compact --merge-networks )) {
+        my $output = "$dir/compact$option.mmdb";
+        $stdout = _optimize(
+            [ '--file', $file, '--output', $output, $option ] );
+        my ( $old, $new ) = $stdout =~ /^nodes\t(\d+)\t(\d+)$/m;
+        ok( $new < $old, "$option reduces the node count ($old to $new)" );
+        $nodes{$option} = $new;
+
+        _test_same( $file, $output, "the database with $option" );
+    }
+    ok(
+        $nodes{'--merge-networks'} <= $nodes{'--compact'},
+        '--merge-networks removes at least as many nodes as --compact'
+    );
+}
+
+done_testing();
+
+sub _test_same {
+    my $old  = shift;
+    my $new  = shift;
+    my $desc = shift;
+
+    my $stdout;
+    my $stderr;
+    run3( [ $mmdbverify, '--file', $new ], \undef, \$stdout, \$stderr );
+    is( $? >> 8, 0, "mmdbverify passes for $desc" );
+
+    run3(
+        [ $mmdbdiff, '--old', $old, '--new', $new ],
+        \undef, \$stdout, \$stderr
+    );
+    is( $? >> 8, 0, "mmdbdiff finds no differences for $desc" )
+        or diag($stdout);
+}
+
+sub _optimize {
+    my $args = shift;
+
+    my $stdout;
+    my $stderr;
+    run3( [ $mmdboptimize, @{$args} ], \undef, \$stdout, \$stderr );
+    is( $? >> 8, 0, "exit status was 0 for mmdboptimize @{$args}" )
+        or diag($stderr);
+
+    return $stdout;
+}
+
+sub _test_stdout {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, $expect_stdout, q{}, $expect_status, $desc );
+}
+
+sub _test_both {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdboptimize, @{$args} ],
+        \undef,
+        \$stdout,
+        \$stderr,
+    );
+
+    my $exit_status = $? >> 8;
+
+    # We don't need to retest that the help output shows up for all errors
+    if ( defined $expect_stdout ) {
+        if ( ref $expect_stdout ) {
+            like(
+                $stdout,
+                $expect_stdout,
+                "stdout for mmdboptimize @{$args}"
+            );
+        }
+        else {
+            is( $stdout, $expect_stdout, "stdout for mmdboptimize @{$args}" );
+        }
+    }
+
+    if ( ref $expect_stderr ) {
+        like( $stderr, $expect_stderr, "stderr for mmdboptimize @{$args}" );
+    }
+    else {
+        is( $stderr, $expect_stderr, "stderr for mmdboptimize @{$args}" );
+    }
+
+    is(
+        $exit_status, $expect_status,
+        "exit status was $expect_status for mmdboptimize @{$args}"
+    );
+}
@@ -0,0 +1,228 @@
+#!/usr/bin/env perl
+
+use strict;
+use warnings;
+
+use FindBin qw( $Bin );
+
+eval <<'EOF';
+use Test::More 0.88;
+use File::Temp qw( tempdir );
+use IPC::Run3 qw( run3 );
+EOF
+
+if ($@) {
+    print
+        "1..0 # skip all tests skipped - these tests need the Test::More 0.88, File::Temp and IPC::Run3 modules:\n";
+    print "$@";
+    exit 0;
+}
+
+my $mmdbstats     = "$Bin/../bin/mmdbstats";
+my $test_data_dir = "$Bin/maxmind-db/test-data";
+
+{
+    ok( -x $mmdbstats, 'mmdbstats script is executable' );
+}
+
+for my $arg (qw( -h -? --help )) {
+    _test_stdout(
+        [$arg],
+        qr{mmdbstats --file.+This application accepts the following options:}s,
+        0,
+        "help output from $arg"
+    );
+}
+
+_test_both(
+    [],
+    qr{mmdbstats --file.+This application accepts the following options:}s,
+    qr{ERROR: You must provide a filename with --file},
+    1,
+    "help output with no CLI options"
+);
+
+_test_stdout(
+    [qw( --version )],
+    qr/mmdbstats version \d+\.\d+\.\d+/,
+    0,
+    'output for --version'
+);
+
+_test_stderr(
+    [qw( --file this/path/better/not/exist.mmdb )],
+    qr{Can't open this/path/better/not/exist.mmdb}s,
+    2,
+    'error for file that does not exist'
+);
+
+for my $file (
+    qw(
+    GeoIP2-City-Test.mmdb
+    MaxMind-DB-test-decoder.mmdb
+    MaxMind-DB-test-ipv4-24.mmdb
+    MaxMind-DB-test-mixed-32.mmdb
+    )
+    ) {
+    my $stdout = _stats("$test_data_dir/$file");
+
+    like(
+        $stdout,
+        qr/\Anodes\t(\d+)\t\1\nnodes_at_depth\t0\t1\n/,
+        "every node in $file is reachable, and the root is at depth 0"
+    );
+
+    my %lines;
+    for my $line ( split /\n/, $stdout ) {
+        my ( $name, @fields ) = split /\t/, $line;
+        push @{ $lines{$name} }, \@fields;
+    }
+
+    my ( $nodes, $depth_nodes ) = ( $lines{nodes}[0][0], 0 );
+    $depth_nodes += $_->[1] for @{ $lines{nodes_at_depth} };
+    is( $depth_nodes, $nodes, "the nodes at each depth add up in $file" );
+
+    my ( $data, $empty ) = ( 0, 0 );
+    for ( @{ $lines{networks_at_depth} } ) {
+        $data  += $_->[1];
+        $empty += $_->[2];
+    }
+    is( $data, $lines{data_networks}[0][0],
+        "the networks with data add up in $file" );
+    is( $empty, $lines{empty_networks}[0][0],
+        "the networks without data add up in $file" );
+
+    my $records = 0;
+    $records += $_->[1] for @{ $lines{records_of_size} };
+    is( $records, $lines{records}[0][0],
+        "the records of each size add up in $file" );
+
+    my $bytes = 0;
+    $bytes += $_->[2] for @{ $lines{type} };
+    is( $bytes, $lines{used_data_size}[0][0],
+        "the bytes of each type add up in $file" );
+    ok( $lines{used_data_size}[0][0] <= $lines{data_size}[0][0],
+        "the used bytes fit in the data section of $file" );
+    like( $lines{deduplication_ratio}[0][0], qr/\A\d+\.\d\d\z/,
+        "deduplication ratio for $file" );
+
+    my ($pointers) = grep { $_->[0] eq 'pointer' } @{ $lines{type} };
+    is_deeply(
+        $lines{pointers}[0], [ @{$pointers}[ 1, 2 ] ],
+        "the pointers line matches the pointer type in $file"
+    );
+    my ($strings) = grep { $_->[0] eq 'utf8_string' } @{ $lines{type} };
+    is_deeply(
+        $lines{strings}[0], [ @{$strings}[ 1, 2 ] ],
+        "the strings line matches the utf8_string type in $file"
+    );
+}
+
+{
+    my $stdout = _stats("$test_data_dir/MaxMind-DB-test-ipv4-24.mmdb");
+    like(
+        $stdout,
+        qr/^nodes\t37\t37\n.+^data_networks\t6\n.+^records\t6\n/ms,
+        'counts for MaxMind-DB-test-ipv4-24.mmdb'
+    );
+}
+
+{
+    open my $fh, '<:raw', "$test_data_dir/MaxMind-DB-test-decoder.mmdb"
+        or die $!;
+    my $db = do { local $/; <$fh> };
+    close $fh;
+
+    # The right record of the first node points past the end of the file
+    substr( $db, 3, 3 ) = "\xff\xff\xf0";
+
+    my $dir = tempdir( CLEANUP => 1 );
+    my $bad = "$dir/bad.mmdb";
+    open $fh, '>:raw', $bad or die $!;
+    print {$fh} $db;
+    close $fh;
+
+    _test_both(
+        [ '--file', $bad ],
+        q{},
+        qr{Can't get the stats for .+bad\.mmdb - .*search tree}i,
+        3,
+        'error for a broken database'
+    );
+}
+
+done_testing();
+
+sub _stats {
+    my $file = shift;
+
+    my $stdout;
+    my $stderr;
+    run3( [ $mmdbstats, '--file', $file ], \undef, \$stdout, \$stderr );
+    is( $? >> 8, 0, "exit status was 0 for $file" ) or diag($stderr);
+
+    return $stdout;
+}
+
+sub _test_stdout {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, $expect_stdout, q{}, $expect_status, $desc );
+}
+
+sub _test_stderr {
+    my $args          = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, undef, $expect_stderr, $expect_status, $desc );
+}
+
+sub _test_both {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdbstats, @{$args} ],
+        \undef,
+        \$stdout,
+        \$stderr,
+    );
+
+    my $exit_status = $? >> 8;
+
+    # We don't need to retest that the help output shows up for all errors
+    if ( defined $expect_stdout ) {
+        if ( ref $expect_stdout ) {
+            like(
+                $stdout,
+                $expect_stdout,
+                "stdout for mmdbstats @{$args}"
+            );
+        }
+        else {
+            is( $stdout, $expect_stdout, "stdout for mmdbstats @{$args}" );
+        }
+    }
+
+    if ( ref $expect_stderr ) {
+        like( $stderr, $expect_stderr, "stderr for mmdbstats @{$args}" );
+    }
+    else {
+        is( $stderr, $expect_stderr, "stderr for mmdbstats @{$args}" );
+    }
+
+    is(
+        $exit_status, $expect_status,
+        "exit status was $expect_status for mmdbstats @{$args}"
+    );
+}
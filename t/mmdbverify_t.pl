@@ -0,0 +1,208 @@
+#!/usr/bin/env perl
+
+use strict;
+use warnings;
+
+use FindBin qw( $Bin );
+
+eval <<'EOF';
+use Test::More 0.88;
+use File::Temp qw( tempdir );
+use IPC::Run3 qw( run3 );
+EOF
+
+if ($@) {
+    print
+        "1..0 # skip all tests skipped - these tests need the Test::More 0.88, File::Temp and IPC::Run3 modules:\n";
+    print "$@";
+    exit 0;
+}
+
+my $mmdbverify    = "$Bin/../bin/mmdbverify";
+my $test_data_dir = "$Bin/maxmind-db/test-data";
+
+{
+    ok( -x $mmdbverify, 'mmdbverify script is executable' );
+}
+
+for my $arg (qw( -h -? --help )) {
+    _test_stdout(
+        [$arg],
+        qr{mmdbverify --file.+This application accepts the following options:}s,
+        0,
+        "help output from $arg"
+    );
+}
+
+_test_both(
+    [],
+    qr{mmdbverify --file.+This application accepts the following options:}s,
+    qr{ERROR: You must provide a filename with --file},
+    1,
+    "help output with no CLI options"
+);
+
+_test_stdout(
+    [qw( --version )],
+    qr/mmdbverify version \d+\.\d+\.\d+/,
+    0,
+    'output for --version'
+);
+
+_test_stderr(
+    [ qw( --file this/path/better/not/exist.mmdb ) ],
+    qr{Can't open this/path/better/not/exist.mmdb}s,
+    2,
+    'error for file that does not exist'
+);
+
+for my $file (
+    qw(
+    GeoIP2-City-Test.mmdb
+    MaxMind-DB-test-decoder.mmdb
+    MaxMind-DB-test-ipv4-24.mmdb
+    MaxMind-DB-test-mixed-28.mmdb
+    MaxMind-DB-test-mixed-32.mmdb
+    )
+    ) {
+    for my $threads ( 1, 4 ) {
+        _test_stdout(
+            [ '--file', "$test_data_dir/$file", '--threads', $threads ],
+            qr/Checked \d+ search tree nodes and \d+ records .+ Found 0 errors/,
+            0,
+            "$file is valid with $threads threads"
+        );
+    }
+}
+
+{
+    open my $fh, '<:raw', "$test_data_dir/MaxMind-DB-test-decoder.mmdb"
+        or die $!;
+    my $db = do { local $/; <$fh> };
+    close $fh;
+
+    # The right record of the first node points past the end of the file and
+    # the first string in the data section is no longer valid UTF-8.
+    substr( $db, 3, 3 ) = "\xff\xff\xf0";
+    my $string = index( $db, 'unicode! ' );
+    substr( $db, $string + 9, 1 ) = "\xff";
+
+    my $dir = tempdir( CLEANUP => 1 );
+    my $bad = "$dir/bad.mmdb";
+    open $fh, '>:raw', $bad or die $!;
+    print {$fh} $db;
+    close $fh;
+
+    my $expect = qr/
+        \A
+        \s*search\ tree\ node\ 0:\ right\ record\ has\ an\ invalid\ value[^\n]*\n
+        \s*data\ section\ offset\ \d+:\ string\ is\ not\ valid\ UTF-8\n
+        \s*\z
+    /x;
+    for my $threads ( 1, 4 ) {
+        _test_stdout(
+            [ '--file', $bad, '--threads', $threads, '--quiet' ],
+            $expect,
+            1,
+            "errors in a broken database with $threads threads"
+        );
+    }
+}
+
+{
+    open my $fh, '<:raw', "$test_data_dir/GeoIP2-City-Test.mmdb" or die $!;
+    my $db = do { local $/; <$fh> };
+    close $fh;
+
+    # This breaks many keys, strings and control bytes in the data section,
+    # some of which are reached from records that different threads check.
+    my $start    = index( $db, "\0" x 16 ) + 16;
+    my $metadata = rindex( $db, "\xab\xcd\xefMaxMind.com" );
+    my $data     = substr( $db, $start, $metadata - $start );
+    $data =~ s/e/\xff/g;
+    substr( $db, $start, $metadata - $start ) = $data;
+
+    my $dir = tempdir( CLEANUP => 1 );
+    my $bad = "$dir/bad.mmdb";
+    open $fh, '>:raw', $bad or die $!;
+    print {$fh} $db;
+    close $fh;
+
+    my %reports;
+    for my $threads ( 1, 2, 4, 8 ) {
+        my ( $stdout, $stderr );
+        run3(
+            [ $mmdbverify, '--file', $bad, '--threads', $threads, '--quiet' ],
+            \undef,
+            \$stdout,
+            \$stderr,
+        );
+        $reports{$threads} = $stdout;
+    }
+    like(
+        $reports{1}, qr/not valid UTF-8/,
+        'errors in a database with many broken strings'
+    );
+    is( $reports{$_}, $reports{1}, "the same errors with $_ threads" )
+        for 2, 4, 8;
+}
+
+done_testing();
+
+sub _test_stdout {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, $expect_stdout, q{}, $expect_status, $desc );
+}
+
+sub _test_stderr {
+    my $args          = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    _test_both( $args, undef, $expect_stderr, $expect_status, $desc );
+}
+
+sub _test_both {
+    my $args          = shift;
+    my $expect_stdout = shift;
+    my $expect_stderr = shift;
+    my $expect_status = shift;
+    my $desc          = shift;
+
+    my $stdout;
+    my $stderr;
+    run3(
+        [ $mmdbverify, @{$args} ],
+        \undef,
+        \$stdout,
+        \$stderr,
+    );
+
+    my $exit_status = $? >> 8;
+
+    # We don't need to retest that the help output shows up for all errors
+    if ( defined $expect_stdout ) {
+        like(
+            $stdout,
+            $expect_stdout,
+            "stdout for mmdbverify @{$args}"
+        );
+    }
+
+    if ( ref $expect_stderr ) {
+        like( $stderr, $expect_stderr, "stderr for mmdbverify @{$args}" );
+    }
+    else {
+        is( $stderr, $expect_stderr, "stderr for mmdbverify @{$args}" );
+    }
+
+    is(
+        $exit_status, $expect_status,
+        "exit status was $expect_status for mmdbverify @{$args}"
+    );
+}
@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+#include "maxminddb_test_helper.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* This adds one to the address at the last bit of the prefix, which gives
+ * the first address after the network, and returns true if it wrapped
+ * around. */
+bool next_network_address(uint8_t *address, uint16_t prefix_length)
+{
+    int byte = (prefix_length - 1) / 8;
+    unsigned int carry = 0x80 >> ((prefix_length - 1) % 8);
+    for (; byte >= 0 && carry; byte--) {
+        carry += address[byte];
+        address[byte] = carry & 0xff;
+        carry >>= 8;
+    }
+    return carry;
+}
+
+void address_to_string(const uint8_t *address, int ip_version, char *buffer)
+{
+    inet_ntop(4 == ip_version ? AF_INET : AF_INET6, address, buffer,
+              INET6_ADDRSTRLEN);
+}
+
+void test_ipv4_networks(int mode, const char *mode_desc)
+{
+    const char *path = test_database_path("MaxMind-DB-test-ipv4-24.mmdb");
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    const char *expect[] = { "1.1.1.1/32", "1.1.1.2/31", "1.1.1.4/30",
+                             "1.1.1.8/29", "1.1.1.16/28", "1.1.1.32/32" };
+    size_t expect_count = sizeof(expect) / sizeof(expect[0]);
+
+    MMDB_network_iterator_s iterator;
+    int status = MMDB_network_iterator_init(mmdb, 0, &iterator);
+    cmp_ok(status, "==", MMDB_SUCCESS, "started iterating - %s", mode_desc);
+
+    MMDB_network_s network;
+    bool found;
+    size_t count = 0;
+    while (MMDB_SUCCESS ==
+           (status = MMDB_network_iterator_next(&iterator, &network, &found))
+           && found) {
+        char address[INET6_ADDRSTRLEN], cidr[INET6_ADDRSTRLEN + 8];
+        address_to_string(network.address, 4, address);
+        sprintf(cidr, "%s/%u", address, network.prefix_length);
+        if (count < expect_count) {
+            is(cidr, expect[count], "network %zu is %s - %s", count,
+               expect[count], mode_desc);
+        }
+        cmp_ok(network.record_type, "==", MMDB_RECORD_TYPE_DATA,
+               "%s is a data record - %s", cidr, mode_desc);
+
+        MMDB_lookup_result_s result =
+            lookup_string_ok(mmdb, address, "MaxMind-DB-test-ipv4-24.mmdb",
+                             mode_desc);
+        ok(result.found_entry && result.entry.offset == network.entry.offset
+           && result.netmask == network.prefix_length,
+           "looking up %s finds the same record - %s", cidr, mode_desc);
+        count++;
+    }
+    cmp_ok(status, "==", MMDB_SUCCESS, "iterated without errors - %s",
+           mode_desc);
+    cmp_ok(count, "==", expect_count, "found every network - %s", mode_desc);
+
+    status = MMDB_network_iterator_next(&iterator, &network, &found);
+    ok(MMDB_SUCCESS == status && !found,
+       "nothing is found after the last network - %s", mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+/* With empty networks included, the networks should cover the whole address
+ * space in order, each one starting where the one before it ended. */
+void test_networks_cover_tree(MMDB_s *mmdb, uint32_t flags,
+                              const char *db_desc, const char *mode_desc)
+{
+    MMDB_network_iterator_s iterator;
+    int status = MMDB_network_iterator_init(
+        mmdb, flags | MMDB_NETWORK_ITERATOR_INCLUDE_EMPTY, &iterator);
+    cmp_ok(status, "==", MMDB_SUCCESS, "started iterating %s - %s", db_desc,
+           mode_desc);
+
+    uint8_t next_address[16] = { 0 };
+    bool wrapped = false;
+    int gaps = 0, mismatches = 0, data = 0;
+    MMDB_network_s network;
+    bool found;
+    while (MMDB_SUCCESS ==
+           (status = MMDB_network_iterator_next(&iterator, &network, &found))
+           && found) {
+        if (wrapped || 0 != memcmp(network.address, next_address,
+                                   mmdb->depth / 8)) {
+            gaps++;
+        }
+        wrapped = next_network_address(next_address, network.prefix_length);
+        if (MMDB_RECORD_TYPE_DATA != network.record_type) {
+            continue;
+        }
+        data++;
+
+        char address[INET6_ADDRSTRLEN];
+        address_to_string(network.address, mmdb->metadata.ip_version,
+                          address);
+        int gai_error, mmdb_error;
+        MMDB_lookup_result_s result =
+            MMDB_lookup_string(mmdb, address, &gai_error, &mmdb_error);
+        if (!result.found_entry || result.entry.offset != network.entry.offset
+            || result.netmask != network.prefix_length) {
+            diag("%s/%u doesn't match a lookup", address,
+                 network.prefix_length);
+            mismatches++;
+        }
+    }
+    cmp_ok(status, "==", MMDB_SUCCESS, "iterated %s without errors - %s",
+           db_desc, mode_desc);
+    ok(data > 0, "found data networks in %s - %s", db_desc, mode_desc);
+    cmp_ok(gaps, "==", 0, "networks in %s are contiguous - %s", db_desc,
+           mode_desc);
+    ok(wrapped, "networks in %s cover the address space - %s", db_desc,
+       mode_desc);
+    cmp_ok(mismatches, "==", 0, "networks in %s match lookups - %s", db_desc,
+           mode_desc);
+}
+
+/* Walking every subtree at a given depth in order should give the same
+ * networks as walking the whole tree, with no network missing or repeated. */
+void test_subtrees(MMDB_s *mmdb, uint32_t flags, uint16_t split_depth,
+                   const char *db_desc, const char *mode_desc)
+{
+    MMDB_network_iterator_s whole, subtree;
+    MMDB_network_iterator_init(mmdb, flags, &whole);
+
+    uint8_t address[16] = { 0 };
+    int mismatches = 0, status = MMDB_SUCCESS;
+    uint64_t count = 0;
+    bool wrapped = false;
+    while (!wrapped && MMDB_SUCCESS == status) {
+        status = MMDB_network_iterator_init_subtree(mmdb, flags, address,
+                                                    split_depth, &subtree);
+        MMDB_network_s network, expect;
+        bool found, expect_found;
+        while (MMDB_SUCCESS == status
+               && MMDB_SUCCESS == (status = MMDB_network_iterator_next(
+                                       &subtree, &network, &found))
+               && found) {
+            MMDB_network_iterator_next(&whole, &expect, &expect_found);
+            if (!expect_found
+                || 0 != memcmp(network.address, expect.address, 16)
+                || network.prefix_length != expect.prefix_length
+                || network.entry.offset != expect.entry.offset) {
+                mismatches++;
+            }
+            count++;
+        }
+        wrapped = next_network_address(address, split_depth);
+    }
+
+    MMDB_network_s network;
+    bool found;
+    MMDB_network_iterator_next(&whole, &network, &found);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "walked the subtrees of %s at depth %u - %s", db_desc, split_depth,
+           mode_desc);
+    ok(count > 0 && 0 == mismatches && !found,
+       "subtrees of %s at depth %u have the same networks as the whole tree"
+       " - %s", db_desc, split_depth, mode_desc);
+}
+
+void test_bad_subtree(MMDB_s *mmdb, const char *mode_desc)
+{
+    static const uint8_t address[16] = { 0 };
+    MMDB_network_iterator_s iterator;
+    int status = MMDB_network_iterator_init_subtree(
+        mmdb, 0, address, mmdb->depth + 1, &iterator);
+    cmp_ok(status, "==", MMDB_INVALID_NETWORK_ERROR,
+           "a prefix longer than the address is an error - %s", mode_desc);
+}
+
+/* None of the test databases alias the IPv4 subtree, so this makes a copy
+ * of a 24-bit IPv6 database where the empty record on the way to
+ * ::ffff:0:0 points at the IPv4 start node instead. */
+MMDB_s *open_aliased_database(const char *file, char *path, int mode,
+                              const char *mode_desc)
+{
+    const char *source = test_database_path(file);
+    MMDB_s *mmdb = open_ok(source, mode, mode_desc);
+    int gai_error, mmdb_error;
+    MMDB_lookup_string(mmdb, "1.1.1.1", &gai_error, &mmdb_error);
+    uint32_t ipv4_start_node = mmdb->ipv4_start_node.node_value;
+
+    static const uint8_t ipv4_mapped[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                             0xff, 0xff };
+    uint32_t node = 0;
+    long patch_at = -1;
+    for (int bit = 0; bit < 96; bit++) {
+        MMDB_search_node_s search_node;
+        MMDB_read_node(mmdb, node, &search_node);
+        bool right = ipv4_mapped[bit / 8] & (0x80 >> (bit % 8));
+        uint8_t type = right ? search_node.right_record_type
+                       : search_node.left_record_type;
+        if (MMDB_RECORD_TYPE_SEARCH_NODE != type) {
+            if (MMDB_RECORD_TYPE_EMPTY == type) {
+                patch_at = node * 6L + (right ? 3 : 0);
+            }
+            break;
+        }
+        node = right ? search_node.right_record : search_node.left_record;
+    }
+    cmp_ok(mmdb->metadata.record_size, "==", 24,
+           "%s has 24-bit records - %s", file, mode_desc);
+    ok(patch_at >= 0, "found the empty ::ffff:0:0 record in %s - %s", file,
+       mode_desc);
+    MMDB_close(mmdb);
+    free(mmdb);
+
+    FILE *in = fopen(source, "rb");
+    free((void *)source);
+    static uint8_t content[1 << 16];
+    size_t size = fread(content, 1, sizeof(content), in);
+    fclose(in);
+    content[patch_at] = (ipv4_start_node >> 16) & 0xff;
+    content[patch_at + 1] = (ipv4_start_node >> 8) & 0xff;
+    content[patch_at + 2] = ipv4_start_node & 0xff;
+
+    strcpy(path, "/tmp/network_iterator_t-XXXXXX");
+    int fd = mkstemp(path);
+    FILE *out = fdopen(fd, "wb");
+    fwrite(content, 1, size, out);
+    fclose(out);
+
+    return open_ok(path, mode, mode_desc);
+}
+
+int count_data_networks(MMDB_s *mmdb, uint32_t flags, int *ipv4_networks)
+{
+    static const uint8_t ipv4_prefix[12] = { 0 };
+    MMDB_network_iterator_s iterator;
+    MMDB_network_iterator_init(mmdb, flags, &iterator);
+
+    int count = 0;
+    *ipv4_networks = 0;
+    MMDB_network_s network;
+    bool found;
+    while (MMDB_SUCCESS == MMDB_network_iterator_next(&iterator, &network,
+                                                      &found) && found) {
+        count++;
+        if (network.prefix_length >= 96
+            && 0 == memcmp(network.address, ipv4_prefix, 12)) {
+            (*ipv4_networks)++;
+        }
+    }
+    return count;
+}
+
+void test_aliases(int mode, const char *mode_desc)
+{
+    const char *file = "MaxMind-DB-test-mixed-24.mmdb";
+    const char *source = test_database_path(file);
+    MMDB_s *mmdb = open_ok(source, mode, mode_desc);
+    free((void *)source);
+    int ipv4_networks;
+    int count = count_data_networks(mmdb, 0, &ipv4_networks);
+    MMDB_close(mmdb);
+    free(mmdb);
+
+    char path[64];
+    mmdb = open_aliased_database(file, path, mode, mode_desc);
+    int aliased_ipv4_networks;
+    int aliased_count = count_data_networks(mmdb, 0, &aliased_ipv4_networks);
+    cmp_ok(aliased_count, "==", count,
+           "aliased networks are skipped by default - %s", mode_desc);
+    cmp_ok(aliased_ipv4_networks, "==", ipv4_networks,
+           "and the IPv4 networks are still found under ::/96 - %s",
+           mode_desc);
+
+    int all = count_data_networks(mmdb, MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES,
+                                  &aliased_ipv4_networks);
+    cmp_ok(all, "==", count + ipv4_networks,
+           "aliased networks are found with "
+           "MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES - %s", mode_desc);
+
+    MMDB_network_iterator_s iterator;
+    MMDB_network_iterator_init(mmdb, MMDB_NETWORK_ITERATOR_REPORT_ALIASES,
+                               &iterator);
+    MMDB_network_s network;
+    bool found;
+    int reported = 0, aliases = 0;
+    while (MMDB_SUCCESS == MMDB_network_iterator_next(&iterator, &network,
+                                                      &found) && found) {
+        reported++;
+        if (MMDB_RECORD_TYPE_SEARCH_NODE == network.record_type) {
+            aliases++;
+            ok(network.address[10] & 0x80 && network.prefix_length <= 96,
+               "the alias is on the way to ::ffff:0:0 - %s", mode_desc);
+            cmp_ok(network.entry.offset, "==", 0,
+                   "the alias has no entry - %s", mode_desc);
+        }
+    }
+    cmp_ok(aliases, "==", 1,
+           "the alias is found with MMDB_NETWORK_ITERATOR_REPORT_ALIASES - %s",
+           mode_desc);
+    cmp_ok(reported, "==", count + 1,
+           "and the networks in it are not - %s", mode_desc);
+
+    test_networks_cover_tree(mmdb, MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES,
+                             "an aliased database", mode_desc);
+    test_subtrees(mmdb, 0, 12, "an aliased database", mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+    unlink(path);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    test_ipv4_networks(mode, mode_desc);
+
+    const char *files[] = { "MaxMind-DB-test-ipv4-24.mmdb",
+                            "MaxMind-DB-test-ipv6-32.mmdb",
+                            "MaxMind-DB-test-mixed-24.mmdb",
+                            "GeoIP2-City-Test.mmdb" };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        const char *path = test_database_path(files[i]);
+        MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+        free((void *)path);
+
+        test_networks_cover_tree(mmdb, MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES,
+                                 files[i], mode_desc);
+        cmp_ok(MMDB_verify(mmdb), "==", MMDB_SUCCESS, "verified %s - %s",
+               files[i], mode_desc);
+        test_networks_cover_tree(mmdb, MMDB_NETWORK_ITERATOR_INCLUDE_ALIASES,
+                                 files[i], mode_desc);
+        uint16_t split_depths[] = { 1, 5, 12 };
+        for (size_t j = 0; j < 3; j++) {
+            test_subtrees(mmdb, 0, split_depths[j], files[i], mode_desc);
+            test_subtrees(mmdb, MMDB_NETWORK_ITERATOR_INCLUDE_EMPTY,
+                          split_depths[j], files[i], mode_desc);
+        }
+        test_bad_subtree(mmdb, mode_desc);
+
+        MMDB_close(mmdb);
+        free(mmdb);
+    }
+
+    test_aliases(mode, mode_desc);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
@@ -0,0 +1,154 @@
+#include "maxminddb_test_helper.h"
+
+static const char *const city_names_en[] = { "city", "names", "en", NULL };
+static const char *const country_iso_code[] = { "country", "iso_code", NULL };
+static const char *const latitude[] = { "location", "latitude", NULL };
+static const char *const subdivision_0[] = { "subdivisions", "0", NULL };
+static const char *const missing[] = { "missing", NULL };
+
+static const char *const *const paths[] = {
+    city_names_en, country_iso_code, latitude, subdivision_0, missing
+};
+#define PATH_COUNT (sizeof(paths) / sizeof(paths[0]))
+
+void test_projection(MMDB_s *mmdb, const char *mode_desc)
+{
+    MMDB_projection_s projection;
+    int status = MMDB_build_projection(mmdb, paths, PATH_COUNT, &projection);
+    cmp_ok(status, "==", MMDB_SUCCESS, "built a projection - %s", mode_desc);
+    if (MMDB_SUCCESS != status) {
+        return;
+    }
+    ok(projection.record_count > 0, "projection has records - %s",
+       mode_desc);
+    cmp_ok(projection.path_count, "==", PATH_COUNT,
+           "projection has a column for each path - %s", mode_desc);
+    ok(projection.memory_size
+       >= projection.record_count * PATH_COUNT * sizeof(uint32_t),
+       "memory_size covers the columns - %s", mode_desc);
+
+    int unsorted = 0;
+    for (uint32_t row = 1; row < projection.record_count; row++) {
+        if (projection.offsets[row] <= projection.offsets[row - 1]) {
+            unsorted++;
+        }
+    }
+    cmp_ok(unsorted, "==", 0,
+           "record offsets are unique and in ascending order - %s",
+           mode_desc);
+
+    const char *ips[] = { "81.2.69.160", "2.125.160.216", "89.160.20.112",
+                          "216.160.83.56", "2001:218::", "::81.2.69.160" };
+    for (size_t i = 0; i < sizeof(ips) / sizeof(ips[0]); i++) {
+        MMDB_lookup_result_s result =
+            lookup_string_ok(mmdb, ips[i], "GeoIP2-City-Test.mmdb",
+                             mode_desc);
+        if (!result.found_entry) {
+            continue;
+        }
+
+        uint32_t row;
+        status = MMDB_get_projection_row(&projection, &result.entry, &row);
+        cmp_ok(status, "==", MMDB_SUCCESS, "found the row for %s - %s",
+               ips[i], mode_desc);
+        if (MMDB_SUCCESS != status) {
+            continue;
+        }
+        cmp_ok(projection.offsets[row], "==", result.entry.offset,
+               "row for %s has the record's offset - %s", ips[i], mode_desc);
+
+        int mismatches = 0;
+        MMDB_entry_data_s got;
+        for (uint32_t j = 0; j < PATH_COUNT; j++) {
+            MMDB_entry_data_s expect;
+            MMDB_aget_value(&result.entry, &expect, paths[j]);
+            status = MMDB_get_projection_value(&projection, row, j, &got);
+            if (MMDB_SUCCESS != status
+                || 0 != memcmp(&expect, &got, sizeof(MMDB_entry_data_s))) {
+                diag("%s differs for %s", paths[j][0], ips[i]);
+                mismatches++;
+            }
+        }
+        cmp_ok(mismatches, "==", 0,
+               "projection matches MMDB_aget_value for %s - %s", ips[i],
+               mode_desc);
+        MMDB_get_projection_value(&projection, row, PATH_COUNT - 1, &got);
+        ok(!got.has_data,
+           "a path the record doesn't have has no data - %s", mode_desc);
+
+        status = MMDB_get_projection_value(&projection, row, PATH_COUNT,
+                                           &got);
+        cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+               "no value for a path that isn't in the projection - %s",
+               mode_desc);
+    }
+
+    MMDB_entry_s entry = { .mmdb = mmdb, .offset = 1 };
+    uint32_t row;
+    status = MMDB_get_projection_row(&projection, &entry, &row);
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "no row for an offset that isn't a record - %s", mode_desc);
+
+    MMDB_s other;
+    entry.mmdb = &other;
+    entry.offset = projection.offsets[0];
+    status = MMDB_get_projection_row(&projection, &entry, &row);
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "no row for an entry from another database - %s", mode_desc);
+
+    MMDB_free_projection(&projection);
+    ok(NULL == projection.value_offsets && 0 == projection.record_count,
+       "MMDB_free_projection clears the projection - %s", mode_desc);
+}
+
+void test_bad_path(MMDB_s *mmdb, const char *mode_desc)
+{
+    static const char *const negative_index[] = { "subdivisions", "-1",
+                                                  NULL };
+    static const char *const *const bad_paths[] = { city_names_en,
+                                                    negative_index };
+    MMDB_projection_s projection;
+    int status = MMDB_build_projection(mmdb, bad_paths, 2, &projection);
+    cmp_ok(status, "==", MMDB_INVALID_LOOKUP_PATH_ERROR,
+           "a projection with an invalid path fails - %s", mode_desc);
+    ok(NULL == projection.value_offsets && NULL == projection.offsets,
+       "a failed projection has nothing allocated - %s", mode_desc);
+}
+
+void test_no_paths(MMDB_s *mmdb, const char *mode_desc)
+{
+    MMDB_projection_s projection;
+    int status = MMDB_build_projection(mmdb, NULL, 0, &projection);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "built a projection with no paths - %s", mode_desc);
+
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, "81.2.69.160", "GeoIP2-City-Test.mmdb",
+                         mode_desc);
+    uint32_t row;
+    status = MMDB_get_projection_row(&projection, &result.entry, &row);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "found a row in a projection with no paths - %s", mode_desc);
+    MMDB_free_projection(&projection);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    const char *path = test_database_path("GeoIP2-City-Test.mmdb");
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    test_projection(mmdb, mode_desc);
+    test_bad_path(mmdb, mode_desc);
+    test_no_paths(mmdb, mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
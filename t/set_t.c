@@ -0,0 +1,111 @@
+#include "maxminddb_test_helper.h"
+
+static const char *const files[] = {
+    "MaxMind-DB-test-ipv4-24.mmdb", "MaxMind-DB-test-ipv6-32.mmdb",
+    "MaxMind-DB-test-mixed-32.mmdb", "GeoIP2-City-Test.mmdb",
+    "MaxMind-DB-test-decoder.mmdb"
+};
+#define FILE_COUNT (sizeof(files) / sizeof(files[0]))
+
+/* There are more handles than MMDB_set_lookup_sockaddr() walks at once, so
+ * this covers a set that is looked up in several batches. */
+#define HANDLE_COUNT (3 * FILE_COUNT)
+
+static const char *const ips[] = {
+    "1.1.1.1", "1.1.1.3", "81.2.69.160", "2.125.160.216", "255.255.255.255",
+    "::1.1.1.1", "::1:ffff:ffff", "2001:218::", "::2:0:0", "ffff::"
+};
+#define IP_COUNT (sizeof(ips) / sizeof(ips[0]))
+
+/* This checks each result from the set against MMDB_lookup_string() on the
+ * same handle. */
+void test_set_lookup(MMDB_set_s *set, const char *mode_desc)
+{
+    MMDB_lookup_result_s results[HANDLE_COUNT];
+    int mmdb_errors[HANDLE_COUNT];
+
+    for (size_t i = 0; i < IP_COUNT; i++) {
+        int gai_error;
+        MMDB_set_lookup_string(set, ips[i], &gai_error, results, mmdb_errors);
+        cmp_ok(gai_error, "==", 0, "no getaddrinfo error for %s - %s", ips[i],
+               mode_desc);
+
+        int mismatches = 0;
+        for (size_t j = 0; j < set->count; j++) {
+            int expect_gai_error, expect_mmdb_error;
+            MMDB_lookup_result_s expect =
+                MMDB_lookup_string(set->mmdbs[j], ips[i], &expect_gai_error,
+                                   &expect_mmdb_error);
+            if (expect_mmdb_error != mmdb_errors[j]
+                || expect.found_entry != results[j].found_entry
+                || expect.netmask != results[j].netmask
+                || expect.entry.offset != results[j].entry.offset
+                || set->mmdbs[j] != results[j].entry.mmdb) {
+                diag("%s differs in %s", ips[i], files[j % FILE_COUNT]);
+                mismatches++;
+            }
+        }
+        cmp_ok(mismatches, "==", 0,
+               "set lookup of %s matches MMDB_lookup_string - %s", ips[i],
+               mode_desc);
+    }
+
+    int gai_error;
+    MMDB_set_lookup_string(set, "::1.1.1.1", &gai_error, results,
+                           mmdb_errors);
+    cmp_ok(mmdb_errors[0], "==", MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR,
+           "IPv6 lookup in an IPv4 database fails - %s", mode_desc);
+    cmp_ok(mmdb_errors[1], "==", MMDB_SUCCESS,
+           "while the other databases are still searched - %s", mode_desc);
+
+    MMDB_set_lookup_string(set, "not an ip", &gai_error, results,
+                           mmdb_errors);
+    ok(0 != gai_error, "getaddrinfo error for a bad address - %s",
+       mode_desc);
+    int found = 0;
+    for (size_t j = 0; j < set->count; j++) {
+        found += results[j].found_entry || MMDB_SUCCESS != mmdb_errors[j];
+    }
+    cmp_ok(found, "==", 0, "nothing is found for a bad address - %s",
+           mode_desc);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    MMDB_s *mmdbs[HANDLE_COUNT];
+    for (size_t i = 0; i < HANDLE_COUNT; i++) {
+        const char *path = test_database_path(files[i % FILE_COUNT]);
+        mmdbs[i] = open_ok(path, mode, mode_desc);
+        free((void *)path);
+    }
+
+    MMDB_set_s set = { .mmdbs = mmdbs, .count = FILE_COUNT };
+    test_set_lookup(&set, mode_desc);
+
+    /* The second copy of each database is verified, so it is searched
+     * without bounds checks. */
+    for (size_t i = FILE_COUNT; i < 2 * FILE_COUNT; i++) {
+        cmp_ok(MMDB_verify(mmdbs[i]), "==", MMDB_SUCCESS, "verified %s - %s",
+               files[i % FILE_COUNT], mode_desc);
+    }
+    set.count = HANDLE_COUNT;
+    test_set_lookup(&set, mode_desc);
+
+    set.count = 0;
+    int gai_error;
+    MMDB_set_lookup_string(&set, "1.1.1.1", &gai_error, NULL, NULL);
+    cmp_ok(gai_error, "==", 0, "an empty set can be looked up - %s",
+           mode_desc);
+
+    for (size_t i = 0; i < HANDLE_COUNT; i++) {
+        MMDB_close(mmdbs[i]);
+        free(mmdbs[i]);
+    }
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include "maxminddb_test_helper.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#define STRING(s) { .type = MMDB_DATA_TYPE_UTF8_STRING, .utf8_string = (s), \
+                    .data_size = sizeof(s) - 1 }
+#define COUNT(values) ((uint32_t)(sizeof(values) / sizeof(values[0])))
+
+int compare_offsets(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* The network iterator skips the IPv4 aliases too, so it has to find the
+ * same networks at the same depths, and the same records */
+void test_against_iterator(const char *filename, int mode,
+                           const char *mode_desc)
+{
+    const char *path = test_database_path(filename);
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    MMDB_stats_s stats;
+    int status = MMDB_get_stats(mmdb, &stats);
+    cmp_ok(status, "==", MMDB_SUCCESS, "got the stats for %s - %s", filename,
+           mode_desc);
+
+    static uint64_t data_networks[MMDB_STATS_MAX_DEPTH + 1];
+    static uint64_t empty_networks[MMDB_STATS_MAX_DEPTH + 1];
+    static uint32_t offsets[1024];
+    memset(data_networks, 0, sizeof(data_networks));
+    memset(empty_networks, 0, sizeof(empty_networks));
+    size_t offset_count = 0;
+
+    MMDB_network_iterator_s iterator;
+    MMDB_network_iterator_init(mmdb, MMDB_NETWORK_ITERATOR_INCLUDE_EMPTY,
+                               &iterator);
+    MMDB_network_s network;
+    bool found_network;
+    while (MMDB_SUCCESS == MMDB_network_iterator_next(&iterator, &network,
+                                                      &found_network)
+           && found_network) {
+        if (MMDB_RECORD_TYPE_DATA == network.record_type) {
+            data_networks[network.prefix_length]++;
+            if (offset_count < COUNT(offsets)) {
+                offsets[offset_count++] = network.entry.offset;
+            }
+        } else {
+            empty_networks[network.prefix_length]++;
+        }
+    }
+
+    qsort(offsets, offset_count, sizeof(uint32_t), compare_offsets);
+    uint32_t record_count = 0;
+    for (size_t i = 0; i < offset_count; i++) {
+        record_count += 0 == i || offsets[i] != offsets[i - 1];
+    }
+
+    ok(!memcmp(data_networks, stats.data_networks_by_depth,
+               sizeof(data_networks)),
+       "networks with data at each depth for %s - %s", filename, mode_desc);
+    ok(!memcmp(empty_networks, stats.empty_networks_by_depth,
+               sizeof(empty_networks)),
+       "networks without data at each depth for %s - %s", filename,
+       mode_desc);
+    cmp_ok(stats.record_count, "==", record_count,
+           "distinct records for %s - %s", filename, mode_desc);
+
+    uint32_t nodes = 0;
+    for (int i = 0; i <= MMDB_STATS_MAX_DEPTH; i++) {
+        nodes += stats.nodes_by_depth[i];
+    }
+    cmp_ok(nodes, "==", stats.node_count,
+           "every node is at one depth for %s - %s", filename, mode_desc);
+    cmp_ok(stats.node_count, "==", mmdb->metadata.node_count,
+           "every node is reachable in %s - %s", filename, mode_desc);
+    cmp_ok(stats.nodes_by_depth[0], "==", 1, "the root is at depth 0 - %s",
+           mode_desc);
+
+    uint32_t sized_records = 0;
+    for (int i = 0; i < MMDB_STATS_SIZE_BUCKETS; i++) {
+        sized_records += stats.record_sizes[i];
+    }
+    cmp_ok(sized_records, "==", stats.record_count,
+           "every record has a size for %s - %s", filename, mode_desc);
+
+    uint64_t bytes = 0;
+    for (int i = 0; i < MMDB_STATS_DATA_TYPES; i++) {
+        bytes += stats.type_bytes[i];
+    }
+    cmp_ok(bytes, "==", stats.used_data_size,
+           "the bytes of each type add up to the used bytes for %s - %s",
+           filename, mode_desc);
+    ok(stats.used_data_size <= stats.data_size,
+       "the used bytes fit in the data section for %s - %s", filename,
+       mode_desc);
+    ok(stats.pointer_target_count
+       <= stats.type_counts[MMDB_DATA_TYPE_POINTER],
+       "no more pointer targets than pointers for %s - %s", filename,
+       mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    test_against_iterator("GeoIP2-City-Test.mmdb", mode, mode_desc);
+    test_against_iterator("MaxMind-DB-test-decoder.mmdb", mode, mode_desc);
+    test_against_iterator("MaxMind-DB-test-ipv4-24.mmdb", mode, mode_desc);
+    test_against_iterator("MaxMind-DB-test-mixed-32.mmdb", mode, mode_desc);
+}
+
+void test_counts(void)
+{
+    MMDB_writer_s writer;
+    MMDB_writer_init(&writer, 4, 24);
+    writer.metadata.database_type = "Stats-Test";
+
+    /* {"a":"a string of 20 bytes","b":<pointer>,"c":"a"} is 32 bytes and
+     * {"d":<pointer>} is 5. With the pointers followed, they are 51 and 24
+     * bytes. */
+    MMDB_entry_data_s twice[] = {
+        { .type = MMDB_DATA_TYPE_MAP, .data_size = 3 },
+        STRING("a"), STRING("a string of 20 bytes"),
+        STRING("b"), STRING("a string of 20 bytes"),
+        STRING("c"), STRING("a")
+    };
+    MMDB_entry_data_s other[] = {
+        { .type = MMDB_DATA_TYPE_MAP, .data_size = 1 },
+        STRING("d"), STRING("a string of 20 bytes")
+    };
+    uint32_t a, b;
+    MMDB_writer_add_record(&writer, twice, COUNT(twice), &a);
+    MMDB_writer_add_record(&writer, other, COUNT(other), &b);
+    insert_ok(&writer, "10.0.0.0", 8, a);
+    insert_ok(&writer, "11.0.0.0", 8, b);
+    insert_ok(&writer, "10.1.0.0", 16, b);
+
+    char path[32];
+    MMDB_s *mmdb = write_and_open(&writer, path, "counts");
+    MMDB_stats_s stats;
+    int status = MMDB_get_stats(mmdb, &stats);
+    cmp_ok(status, "==", MMDB_SUCCESS, "got the stats");
+
+    /* 10 and 11 share the first 7 bits, and 10.1 needs 8 more nodes */
+    cmp_ok(stats.node_count, "==", 16, "node count");
+    for (int depth = 0; depth < 16; depth++) {
+        cmp_ok(stats.nodes_by_depth[depth], "==", 1, "nodes at depth %d",
+               depth);
+    }
+    cmp_ok(stats.nodes_by_depth[16], "==", 0, "no nodes at depth 16");
+    cmp_ok(stats.data_networks_by_depth[8], "==", 1,
+           "networks with data at depth 8");
+    cmp_ok(stats.data_networks_by_depth[9], "==", 1,
+           "networks with data at depth 9");
+    cmp_ok(stats.data_networks_by_depth[16], "==", 2,
+           "networks with data at depth 16");
+    cmp_ok(stats.empty_networks_by_depth[1], "==", 1,
+           "networks without data at depth 1");
+    cmp_ok(stats.empty_networks_by_depth[8], "==", 0,
+           "no networks without data at depth 8");
+
+    cmp_ok(stats.record_count, "==", 2, "record count");
+    cmp_ok(stats.record_sizes[4], "==", 1, "one record of 16 to 31 bytes");
+    cmp_ok(stats.record_sizes[5], "==", 1, "one record of 32 to 63 bytes");
+    cmp_ok(stats.data_size, "==", 37, "data size");
+    cmp_ok(stats.used_data_size, "==", 37, "used data size");
+    cmp_ok(stats.expanded_data_size, "==", 51 + 24, "expanded data size");
+    cmp_ok(stats.type_counts[MMDB_DATA_TYPE_POINTER], "==", 2, "pointers");
+    cmp_ok(stats.type_bytes[MMDB_DATA_TYPE_POINTER], "==", 4,
+           "pointer bytes");
+    cmp_ok(stats.pointer_target_count, "==", 1, "pointer targets");
+    cmp_ok(stats.type_counts[MMDB_DATA_TYPE_UTF8_STRING], "==", 6, "strings");
+    cmp_ok(stats.type_bytes[MMDB_DATA_TYPE_UTF8_STRING], "==",
+           2 + 21 + 2 + 2 + 2 + 2, "string bytes");
+    cmp_ok(stats.type_counts[MMDB_DATA_TYPE_MAP], "==", 2, "maps");
+    cmp_ok(stats.type_bytes[MMDB_DATA_TYPE_MAP], "==", 2, "map bytes");
+
+    close_and_remove(mmdb, path);
+    MMDB_writer_free(&writer);
+}
+
+void test_aliases(void)
+{
+    MMDB_writer_s writer;
+    MMDB_writer_init(&writer, 6, 24);
+    writer.metadata.database_type = "Stats-Test";
+
+    MMDB_entry_data_s values[] = {
+        { .type = MMDB_DATA_TYPE_MAP, .data_size = 1 },
+        STRING("a"), STRING("b")
+    };
+    uint32_t record;
+    MMDB_writer_add_record(&writer, values, COUNT(values), &record);
+    insert_ok(&writer, "::1.2.3.0", 120, record);
+
+    uint8_t alias[16], target[16] = { 0 };
+    inet_pton(AF_INET6, "::ffff:0:0", alias);
+    MMDB_writer_alias(&writer, alias, 96, target, 96);
+    inet_pton(AF_INET6, "2002::", alias);
+    MMDB_writer_alias(&writer, alias, 16, target, 96);
+
+    char path[32];
+    MMDB_s *mmdb = write_and_open(&writer, path, "aliases");
+    MMDB_stats_s stats;
+    int status = MMDB_get_stats(mmdb, &stats);
+    cmp_ok(status, "==", MMDB_SUCCESS, "got the stats with aliases");
+
+    cmp_ok(stats.node_count, "==", mmdb->metadata.node_count,
+           "every node is counted once");
+    cmp_ok(stats.nodes_by_depth[96], "==", 1,
+           "the IPv4 start node is at depth 96, not the depth of an alias");
+    cmp_ok(stats.nodes_by_depth[16], "==", 1,
+           "only the node on the way to ::/96 is at depth 16");
+    uint64_t data_networks = 0;
+    for (int i = 0; i <= MMDB_STATS_MAX_DEPTH; i++) {
+        data_networks += stats.data_networks_by_depth[i];
+    }
+    cmp_ok(data_networks, "==", 1, "the aliases' networks aren't counted");
+    cmp_ok(stats.data_networks_by_depth[120], "==", 1,
+           "the network is at depth 120");
+
+    close_and_remove(mmdb, path);
+    MMDB_writer_free(&writer);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    test_counts();
+    test_aliases();
+    done_testing();
+}
@@ -0,0 +1,287 @@
+#include "maxminddb_test_helper.h"
+
+void test_decoder_types(MMDB_lookup_result_s *result, const char *mode_desc)
+{
+    MMDB_entry_s *entry = &result->entry;
+
+    const char *string;
+    uint32_t size;
+    int status = MMDB_get_utf8(entry, (const char *const[]){ "utf8_string",
+                                                              NULL },
+                               &string, &size);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_utf8 - %s", mode_desc);
+    ok(18 == size && 0 == memcmp(string, "unicode! \xe2\x98\xaf - \xe2\x99\xab",
+                                 size),
+       "utf8_string is 'unicode! ☯ - ♫' - %s", mode_desc);
+
+    const uint8_t *bytes;
+    status = MMDB_get_bytes(entry, (const char *const[]){ "bytes", NULL },
+                            &bytes, &size);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_bytes - %s", mode_desc);
+    ok(4 == size && 0 == memcmp(bytes, "\x00\x00\x00\x2a", 4),
+       "bytes is 0x0000002a - %s", mode_desc);
+
+    uint16_t uint16;
+    status = MMDB_get_uint16(entry, (const char *const[]){ "uint16", NULL },
+                             &uint16);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_uint16 - %s", mode_desc);
+    cmp_ok(uint16, "==", 100, "uint16 is 100 - %s", mode_desc);
+
+    uint32_t uint32;
+    status = MMDB_get_uint32(entry, (const char *const[]){ "uint32", NULL },
+                             &uint32);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_uint32 - %s", mode_desc);
+    cmp_ok(uint32, "==", 1 << 28, "uint32 is 2**28 - %s", mode_desc);
+
+    int32_t int32;
+    status = MMDB_get_int32(entry, (const char *const[]){ "int32", NULL },
+                            &int32);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_int32 - %s", mode_desc);
+    cmp_ok(int32, "==", -(1 << 28), "int32 is -(2**28) - %s", mode_desc);
+
+    uint64_t uint64;
+    status = MMDB_get_uint64(entry, (const char *const[]){ "uint64", NULL },
+                             &uint64);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_uint64 - %s", mode_desc);
+    ok(uint64 == 1ULL << 60, "uint64 is 2**60 - %s", mode_desc);
+
+    double double_value;
+    status = MMDB_get_double(entry, (const char *const[]){ "double", NULL },
+                             &double_value);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_double - %s", mode_desc);
+    compare_double(double_value, 42.123456);
+
+    float float_value;
+    status = MMDB_get_float(entry, (const char *const[]){ "float", NULL },
+                            &float_value);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_float - %s", mode_desc);
+    compare_float(float_value, 1.1F);
+
+    bool boolean;
+    status = MMDB_get_boolean(entry, (const char *const[]){ "boolean", NULL },
+                              &boolean);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_boolean - %s", mode_desc);
+    ok(boolean, "boolean is true - %s", mode_desc);
+
+    status = MMDB_get_utf8(entry,
+                           (const char *const[]){ "map", "mapX",
+                                                  "utf8_stringX", NULL },
+                           &string, &size);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_utf8 in a nested map - %s",
+           mode_desc);
+    ok(5 == size && 0 == memcmp(string, "hello", 5),
+       "map{mapX}{utf8_stringX} is 'hello' - %s", mode_desc);
+
+    status = MMDB_get_uint32(entry, (const char *const[]){ "map", "mapX",
+                                                            "arrayX", "2",
+                                                            NULL },
+                             &uint32);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_get_uint32 in an array in a nested map - %s", mode_desc);
+    cmp_ok(uint32, "==", 9, "map{mapX}{arrayX}[2] is 9 - %s", mode_desc);
+
+    status = MMDB_get_uint32(entry, (const char *const[]){ "array", "0",
+                                                            NULL },
+                             &uint32);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_uint32 in an array - %s",
+           mode_desc);
+    cmp_ok(uint32, "==", 1, "array[0] is 1 - %s", mode_desc);
+}
+
+void test_errors(MMDB_lookup_result_s *result, const char *mode_desc)
+{
+    MMDB_entry_s *entry = &result->entry;
+
+    uint32_t uint32 = 42;
+    int status = MMDB_get_uint32(entry, (const char *const[]){ "uint16",
+                                                                NULL },
+                                 &uint32);
+    cmp_ok(status, "==", MMDB_TYPE_MISMATCH_ERROR,
+           "MMDB_get_uint32 on a uint16 is a type mismatch - %s", mode_desc);
+    cmp_ok(uint32, "==", 42,
+           "value isn't changed on a type mismatch - %s", mode_desc);
+
+    const char *string;
+    uint32_t size;
+    status = MMDB_get_utf8(entry, (const char *const[]){ "map", NULL },
+                           &string, &size);
+    cmp_ok(status, "==", MMDB_TYPE_MISMATCH_ERROR,
+           "MMDB_get_utf8 on a map is a type mismatch - %s", mode_desc);
+    ok(!strcmp(MMDB_strerror(status),
+               "The value at the lookup path is not of the requested type"),
+       "MMDB_strerror for MMDB_TYPE_MISMATCH_ERROR - %s", mode_desc);
+
+    status = MMDB_get_uint32(entry, (const char *const[]){ "missing", NULL },
+                             &uint32);
+    cmp_ok(status, "==", MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR,
+           "MMDB_get_uint32 on a missing key - %s", mode_desc);
+
+    status = MMDB_get_uint32(entry, (const char *const[]){ "array", "3",
+                                                            NULL },
+                             &uint32);
+    cmp_ok(status, "==", MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR,
+           "MMDB_get_uint32 past the end of an array - %s", mode_desc);
+
+    status = MMDB_get_uint32(entry, (const char *const[]){ "uint32", "x",
+                                                            NULL },
+                             &uint32);
+    cmp_ok(status, "==", MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR,
+           "MMDB_get_uint32 with a path through a scalar - %s", mode_desc);
+}
+
+void test_empty_string(MMDB_s *mmdb, const char *mode_desc)
+{
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, "::0", "MaxMind-DB-test-decoder.mmdb",
+                         mode_desc);
+    const char *string = NULL;
+    uint32_t size = 42;
+    int status = MMDB_get_utf8(&result.entry,
+                               (const char *const[]){ "utf8_string", NULL },
+                               &string, &size);
+    cmp_ok(status, "==", MMDB_SUCCESS, "MMDB_get_utf8 on an empty string - %s",
+           mode_desc);
+    cmp_ok(size, "==", 0, "empty string has a size of 0 - %s", mode_desc);
+    is(string, "", "empty string is '' - %s", mode_desc);
+}
+
+/* This checks that the typed getters and MMDB_aget_value() find the same
+ * values in a realistic record. */
+void test_matches_aget_value(MMDB_s *mmdb, const char *mode_desc)
+{
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, "81.2.69.160", "GeoIP2-City-Test.mmdb",
+                         mode_desc);
+    MMDB_entry_data_s entry_data;
+
+    const char *const names[][5] = {
+        { "city", "names", "en", NULL },
+        { "country", "iso_code", NULL },
+        { "subdivisions", "0", "names", "en", NULL },
+        { "location", "time_zone", NULL },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        const char *string;
+        uint32_t size;
+        int status = MMDB_get_utf8(&result.entry, names[i], &string, &size);
+        int aget_status = MMDB_aget_value(&result.entry, &entry_data,
+                                          names[i]);
+        cmp_ok(status, "==", aget_status, "%s - same status - %s",
+               names[i][0], mode_desc);
+        ok(MMDB_SUCCESS == status && size == entry_data.data_size
+           && string == entry_data.utf8_string,
+           "%s - same string - %s", names[i][0], mode_desc);
+    }
+
+    uint32_t geoname_id;
+    int status = MMDB_get_uint32(&result.entry,
+                                 (const char *const[]){ "city", "geoname_id",
+                                                        NULL },
+                                 &geoname_id);
+    MMDB_aget_value(&result.entry, &entry_data,
+                    (const char *const[]){ "city", "geoname_id", NULL });
+    ok(MMDB_SUCCESS == status && geoname_id == entry_data.uint32,
+       "city geoname_id matches - %s", mode_desc);
+
+    double latitude;
+    status = MMDB_get_double(&result.entry,
+                             (const char *const[]){ "location", "latitude",
+                                                    NULL },
+                             &latitude);
+    MMDB_aget_value(&result.entry, &entry_data,
+                    (const char *const[]){ "location", "latitude", NULL });
+    ok(MMDB_SUCCESS == status && latitude == entry_data.double_value,
+       "location latitude matches - %s", mode_desc);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    const char *path = test_database_path("MaxMind-DB-test-decoder.mmdb");
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    /* Everything should be the same once MMDB_verify() has turned off the
+     * bounds checks. */
+    for (int verified = 0; verified < 2; verified++) {
+        char description[500];
+        snprintf(description, 500, "%s%s", mode_desc,
+                 verified ? " (verified)" : "");
+        if (verified) {
+            cmp_ok(MMDB_verify(mmdb), "==", MMDB_SUCCESS,
+                   "verified the decoder database - %s", mode_desc);
+        }
+
+        MMDB_lookup_result_s result =
+            lookup_string_ok(mmdb, "1.1.1.1", "MaxMind-DB-test-decoder.mmdb",
+                             description);
+        test_decoder_types(&result, description);
+        test_errors(&result, description);
+        test_empty_string(mmdb, description);
+    }
+    MMDB_close(mmdb);
+    free(mmdb);
+
+    path = test_database_path("GeoIP2-City-Test.mmdb");
+    mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+    test_matches_aget_value(mmdb, mode_desc);
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+/* These use a hand built data section so that they can cover data that is
+ * cut short or that the decoder database doesn't have. */
+void test_bad_data(void)
+{
+    uint8_t data[16];
+    MMDB_s mmdb;
+    memset(&mmdb, 0, sizeof(mmdb));
+    mmdb.data_section = data;
+    MMDB_entry_s entry = { .mmdb = &mmdb, .offset = 0 };
+    const char *const no_path[] = { NULL };
+    uint32_t uint32;
+
+    /* a uint32 of size 5 */
+    memcpy(data, "\xc5\x01\x02\x03\x04\x05", 6);
+    mmdb.data_section_size = 6;
+    cmp_ok(MMDB_get_uint32(&entry, no_path, &uint32), "==",
+           MMDB_INVALID_DATA_ERROR, "a uint32 of size 5 is invalid");
+
+    /* a uint32 of size 4 with only 3 bytes of data */
+    memcpy(data, "\xc4\x01\x02\x03", 4);
+    mmdb.data_section_size = 4;
+    cmp_ok(MMDB_get_uint32(&entry, no_path, &uint32), "==",
+           MMDB_INVALID_DATA_ERROR, "a uint32 that is cut short is invalid");
+
+    /* a pointer to 2, then a uint32 at 2 */
+    memcpy(data, "\x20\x02\xc1\x07", 4);
+    mmdb.data_section_size = 4;
+    cmp_ok(MMDB_get_uint32(&entry, no_path, &uint32), "==", MMDB_SUCCESS,
+           "followed a pointer to a uint32");
+    cmp_ok(uint32, "==", 7, "uint32 behind a pointer is 7");
+
+    /* a pointer to 2, then a pointer to 0 at 2 */
+    memcpy(data, "\x20\x02\x20\x00", 4);
+    cmp_ok(MMDB_get_uint32(&entry, no_path, &uint32), "==",
+           MMDB_INVALID_DATA_ERROR, "a pointer to a pointer is invalid");
+
+    /* a pointer past the data section */
+    memcpy(data, "\x20\x09", 2);
+    mmdb.data_section_size = 2;
+    cmp_ok(MMDB_get_uint32(&entry, no_path, &uint32), "==",
+           MMDB_INVALID_DATA_ERROR,
+           "a pointer past the data section is invalid");
+
+    entry.offset = 2;
+    cmp_ok(MMDB_get_uint32(&entry, no_path, &uint32), "==",
+           MMDB_INVALID_DATA_ERROR,
+           "a start offset past the data section is invalid");
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    test_bad_data();
+    done_testing();
+}
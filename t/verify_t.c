@@ -0,0 +1,243 @@
+#include "maxminddb_test_helper.h"
+#include <arpa/inet.h>
+
+/* A database with a single search tree node, 24 bit records and whatever
+ * data section a test needs */
+#define FAKE_TREE_SIZE (6)
+#define FAKE_DATA_START (FAKE_TREE_SIZE + 16)
+
+static uint8_t file[4096];
+
+static MMDB_s fake_mmdb(uint32_t left, uint32_t right, const uint8_t *data,
+                        uint32_t data_size)
+{
+    memset(file, 0, sizeof(file));
+    file[0] = (uint8_t)(left >> 16);
+    file[1] = (uint8_t)(left >> 8);
+    file[2] = (uint8_t)left;
+    file[3] = (uint8_t)(right >> 16);
+    file[4] = (uint8_t)(right >> 8);
+    file[5] = (uint8_t)right;
+    memcpy(file + FAKE_DATA_START, data, data_size);
+
+    MMDB_s mmdb;
+    memset(&mmdb, 0, sizeof(mmdb));
+    mmdb.flags = MMDB_MODE_MMAP;
+    mmdb.file_content = file;
+    mmdb.file_size = FAKE_DATA_START + data_size;
+    mmdb.data_section = file + FAKE_DATA_START;
+    mmdb.data_section_size = data_size;
+    mmdb.metadata.node_count = 1;
+    mmdb.metadata.record_size = 24;
+    mmdb.metadata.ip_version = 4;
+    mmdb.full_record_byte_size = 6;
+    mmdb.depth = 32;
+    return mmdb;
+}
+
+/* This is the record that points to the start of the data section */
+#define DATA_RECORD (1 + 16)
+
+static MMDB_lookup_result_s lookup_ipv4(MMDB_s *mmdb, uint32_t ip,
+                                        int *mmdb_error)
+{
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(ip);
+    return MMDB_lookup_sockaddr(mmdb, (struct sockaddr *)&sin, mmdb_error);
+}
+
+void test_fake_database(void)
+{
+    /* {"a":"b"} */
+    const uint8_t data[] = { 0xe1, 0x41, 'a', 0x41, 'b' };
+    MMDB_s mmdb = fake_mmdb(DATA_RECORD, 1, data, sizeof(data));
+
+    int status = MMDB_verify(&mmdb);
+    cmp_ok(status, "==", MMDB_SUCCESS, "verified a valid database");
+    ok(mmdb.flags & MMDB_VERIFIED, "MMDB_VERIFIED is set");
+
+    int mmdb_error;
+    MMDB_lookup_result_s result = lookup_ipv4(&mmdb, 0x01020304, &mmdb_error);
+    cmp_ok(mmdb_error, "==", MMDB_SUCCESS, "looked up 1.2.3.4");
+    ok(result.found_entry, "found an entry for 1.2.3.4");
+    cmp_ok(result.netmask, "==", 1, "netmask for 1.2.3.4 is 1");
+
+    MMDB_entry_data_s entry_data;
+    status = MMDB_get_value(&result.entry, &entry_data, "a", NULL);
+    cmp_ok(status, "==", MMDB_SUCCESS, "got the value for a");
+    ok(MMDB_DATA_TYPE_UTF8_STRING == entry_data.type
+       && 1 == entry_data.data_size && 'b' == entry_data.utf8_string[0],
+       "value for a is b");
+
+    result = lookup_ipv4(&mmdb, 0x80000000, &mmdb_error);
+    cmp_ok(mmdb_error, "==", MMDB_SUCCESS, "looked up 128.0.0.0");
+    ok(!result.found_entry, "no entry for 128.0.0.0");
+    cmp_ok(result.netmask, "==", 1, "netmask for 128.0.0.0 is 1");
+
+    status = MMDB_get_value(&result.entry, &entry_data, "a", NULL);
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "MMDB_get_value on an entry that wasn't found is an error");
+    MMDB_entry_data_list_s *entry_data_list;
+    status = MMDB_get_entry_data_list(&result.entry, &entry_data_list);
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "MMDB_get_entry_data_list on an entry that wasn't found is an "
+           "error");
+    MMDB_free_entry_data_list(entry_data_list);
+}
+
+void test_bad_database(const char *description, uint32_t left,
+                       const uint8_t *data, uint32_t data_size,
+                       int expect)
+{
+    MMDB_s mmdb = fake_mmdb(left, 1, data, data_size);
+    int status = MMDB_verify(&mmdb);
+    cmp_ok(status, "==", expect, "MMDB_verify fails for %s", description);
+    ok(!(mmdb.flags & MMDB_VERIFIED), "MMDB_VERIFIED is not set for %s",
+       description);
+}
+
+void test_bad_databases(void)
+{
+    const uint8_t map[] = { 0xe1, 0x41, 'a', 0x41, 'b' };
+    test_bad_database("a record of 0", 0, map, sizeof(map),
+                      MMDB_CORRUPT_SEARCH_TREE_ERROR);
+    test_bad_database("a record in the separator", 2, map, sizeof(map),
+                      MMDB_CORRUPT_SEARCH_TREE_ERROR);
+    test_bad_database("a record past the data section", DATA_RECORD + 5, map,
+                      sizeof(map), MMDB_CORRUPT_SEARCH_TREE_ERROR);
+
+    /* {"a": pointer to 500} */
+    const uint8_t pointer_past_end[] = { 0xe1, 0x41, 'a', 0x21, 0xf4 };
+    test_bad_database("a pointer past the data section", DATA_RECORD,
+                      pointer_past_end, sizeof(pointer_past_end),
+                      MMDB_INVALID_DATA_ERROR);
+
+    /* {"a": pointer to 5}, then a pointer to 0 at 5 */
+    const uint8_t pointer_to_pointer[] =
+    { 0xe1, 0x41, 'a', 0x20, 0x05, 0x20, 0x00 };
+    test_bad_database("a pointer to a pointer", DATA_RECORD,
+                      pointer_to_pointer, sizeof(pointer_to_pointer),
+                      MMDB_INVALID_DATA_ERROR);
+
+    /* {1: "b"} */
+    const uint8_t uint16_key[] = { 0xe1, 0xa1, 0x01, 0x41, 'b' };
+    test_bad_database("a map key that isn't a string", DATA_RECORD,
+                      uint16_key, sizeof(uint16_key),
+                      MMDB_INVALID_DATA_ERROR);
+
+    /* {"a": a string of size 5 with 1 byte of data} */
+    const uint8_t truncated_string[] = { 0xe1, 0x41, 'a', 0x45, 'b' };
+    test_bad_database("a truncated string", DATA_RECORD, truncated_string,
+                      sizeof(truncated_string), MMDB_INVALID_DATA_ERROR);
+
+    /* [extended type 16] */
+    const uint8_t unknown_type[] = { 0x01, 0x04, 0x01, 0x09 };
+    test_bad_database("an unknown type", DATA_RECORD, unknown_type,
+                      sizeof(unknown_type), MMDB_INVALID_DATA_ERROR);
+
+    /* Arrays nested deeper than the decoder allows, around an empty map */
+    uint8_t deep[2048];
+    for (int i = 0; i < 1023; i++) {
+        deep[i * 2] = 0x01;
+        deep[i * 2 + 1] = 0x04;
+    }
+    deep[2046] = 0xe0;
+    test_bad_database("deeply nested arrays", DATA_RECORD, deep, 2047,
+                      MMDB_INVALID_DATA_ERROR);
+
+    MMDB_s mmdb = fake_mmdb(DATA_RECORD, 1, map, sizeof(map));
+    file[FAKE_TREE_SIZE + 3] = 1;
+    cmp_ok(MMDB_verify(&mmdb), "==", MMDB_INVALID_DATA_ERROR,
+           "MMDB_verify fails when the separator isn't all zeros");
+
+    mmdb = fake_mmdb(DATA_RECORD, 1, map, sizeof(map));
+    mmdb.metadata.node_count = 1000;
+    cmp_ok(MMDB_verify(&mmdb), "==", MMDB_INVALID_METADATA_ERROR,
+           "MMDB_verify fails when the search tree is bigger than the file");
+}
+
+/* This looks up the same addresses in a verified and an unverified handle
+ * for the same file and checks that they agree. */
+void test_matches_unverified(const char *filename, int mode,
+                             const char *mode_desc)
+{
+    const char *path = test_database_path(filename);
+    MMDB_s *checked = open_ok(path, mode, mode_desc);
+    MMDB_s *verified = open_ok(path, mode | MMDB_VERIFIED, mode_desc);
+    free((void *)path);
+
+    ok(!(verified->flags & MMDB_VERIFIED),
+       "MMDB_open ignores MMDB_VERIFIED - %s - %s", filename, mode_desc);
+    int status = MMDB_verify(verified);
+    cmp_ok(status, "==", MMDB_SUCCESS, "verified %s - %s", filename,
+           mode_desc);
+    ok(verified->flags & MMDB_VERIFIED, "MMDB_VERIFIED is set - %s - %s",
+       filename, mode_desc);
+
+    const char *ips[] = { "1.1.1.1", "1.1.1.3", "1.1.1.32", "2.125.160.216",
+                          "81.2.69.160", "89.160.20.112", "216.160.83.56",
+                          "255.255.255.255", "::", "::1:ffff:ffff",
+                          "::2:0:40", "2001:218::", "ffff::" };
+    int mismatches = 0;
+    for (size_t i = 0; i < sizeof(ips) / sizeof(ips[0]); i++) {
+        int gai_error, checked_error, verified_error;
+        MMDB_lookup_result_s expect =
+            MMDB_lookup_string(checked, ips[i], &gai_error, &checked_error);
+        MMDB_lookup_result_s got =
+            MMDB_lookup_string(verified, ips[i], &gai_error, &verified_error);
+        if (checked_error != verified_error
+            || expect.found_entry != got.found_entry
+            || expect.netmask != got.netmask) {
+            diag("lookup of %s differs", ips[i]);
+            mismatches++;
+            continue;
+        }
+        if (!expect.found_entry) {
+            continue;
+        }
+
+        char expect_json[8192], got_json[8192];
+        int expect_status = MMDB_entry_to_json(&expect.entry, expect_json,
+                                               sizeof(expect_json), NULL);
+        int got_status = MMDB_entry_to_json(&got.entry, got_json,
+                                            sizeof(got_json), NULL);
+        if (expect_status != got_status
+            || (MMDB_SUCCESS == expect_status
+                && strcmp(expect_json, got_json))) {
+            diag("record for %s differs", ips[i]);
+            mismatches++;
+        }
+    }
+    cmp_ok(mismatches, "==", 0,
+           "verified lookups match unverified lookups - %s - %s", filename,
+           mode_desc);
+
+    MMDB_close(checked);
+    free(checked);
+    MMDB_close(verified);
+    free(verified);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    const char *filenames[] = { "MaxMind-DB-test-decoder.mmdb",
+                                "GeoIP2-City-Test.mmdb",
+                                "MaxMind-DB-test-ipv4-24.mmdb",
+                                "MaxMind-DB-test-mixed-24.mmdb",
+                                "MaxMind-DB-test-mixed-28.mmdb",
+                                "MaxMind-DB-test-mixed-32.mmdb" };
+    for (size_t i = 0; i < sizeof(filenames) / sizeof(filenames[0]); i++) {
+        test_matches_unverified(filenames[i], mode, mode_desc);
+    }
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    test_fake_database();
+    test_bad_databases();
+    for_all_modes(&run_tests);
+    done_testing();
+}
@@ -0,0 +1,237 @@
+#include "maxminddb_test_helper.h"
+
+/* The recording visitor appends one token per event to a string so that the
+ * tests can compare the whole event sequence at once. */
+typedef struct record_s {
+    char events[4096];
+    size_t used;
+    const char *skip_key;
+    const char *stop_key;
+    int skip_maps;
+    uint32_t scalars;
+    uint32_t scalar_offsets[1024];
+} record_s;
+
+static void append(record_s *record, const char *event)
+{
+    size_t length = strlen(event);
+    if (record->used + length + 1 < sizeof(record->events)) {
+        memcpy(record->events + record->used, event, length);
+        record->used += length;
+        record->events[record->used++] = ' ';
+        record->events[record->used] = '\0';
+    }
+}
+
+static int begin_map(void *ctx, uint32_t size)
+{
+    record_s *record = ctx;
+    char event[32];
+    sprintf(event, "{%u", size);
+    append(record, event);
+    if (record->skip_maps && record->used > 4) {
+        return MMDB_VISIT_SKIP;
+    }
+    return MMDB_VISIT_CONTINUE;
+}
+
+static int end_map(void *ctx)
+{
+    append(ctx, "}");
+    return MMDB_VISIT_CONTINUE;
+}
+
+static int begin_array(void *ctx, uint32_t size)
+{
+    char event[32];
+    sprintf(event, "[%u", size);
+    append(ctx, event);
+    return MMDB_VISIT_CONTINUE;
+}
+
+static int end_array(void *ctx)
+{
+    append(ctx, "]");
+    return MMDB_VISIT_CONTINUE;
+}
+
+static int key(void *ctx, const char *key, uint32_t key_size)
+{
+    record_s *record = ctx;
+    char event[64];
+    if (key_size > sizeof(event) - 2) {
+        key_size = sizeof(event) - 2;
+    }
+    memcpy(event, key, key_size);
+    event[key_size] = ':';
+    event[key_size + 1] = '\0';
+    append(record, event);
+
+    if (record->stop_key && !strcmp(event, record->stop_key)) {
+        return MMDB_VISIT_STOP;
+    }
+    if (record->skip_key && !strcmp(event, record->skip_key)) {
+        return MMDB_VISIT_SKIP;
+    }
+    return MMDB_VISIT_CONTINUE;
+}
+
+static int scalar(void *ctx, const MMDB_entry_data_s *entry_data)
+{
+    record_s *record = ctx;
+    char event[32];
+    sprintf(event, "t%u", entry_data->type);
+    append(record, event);
+    if (record->scalars < sizeof(record->scalar_offsets) /
+        sizeof(record->scalar_offsets[0])) {
+        record->scalar_offsets[record->scalars] = entry_data->offset;
+    }
+    record->scalars++;
+    return MMDB_VISIT_CONTINUE;
+}
+
+static const MMDB_visitor_s visitor = {
+    .begin_map   = begin_map,
+    .end_map     = end_map,
+    .begin_array = begin_array,
+    .end_array   = end_array,
+    .key         = key,
+    .scalar      = scalar,
+};
+
+static MMDB_entry_s lookup_entry(MMDB_s *mmdb, const char *ip,
+                                const char *filename, const char *mode_desc)
+{
+    MMDB_lookup_result_s result =
+        lookup_string_ok(mmdb, ip, filename, mode_desc);
+    ok(result.found_entry, "found an entry for %s - %s", ip, mode_desc);
+    return result.entry;
+}
+
+void test_decoder_events(const char *mode_desc, int mode)
+{
+    const char *filename = "MaxMind-DB-test-decoder.mmdb";
+    const char *path = test_database_path(filename);
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    MMDB_entry_s entry = lookup_entry(mmdb, "1.1.1.1", filename, mode_desc);
+
+    record_s record = { .used = 0 };
+    int status = MMDB_walk_entry(&entry, &visitor, &record);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_walk_entry succeeded - %s", mode_desc);
+    is(record.events,
+       "{12 array: [3 t6 t6 t6 ] boolean: t14 bytes: t4 double: t3 float: t15 "
+       "int32: t8 map: {1 mapX: {2 arrayX: [3 t6 t6 t6 ] utf8_stringX: t2 } } "
+       "uint128: t10 uint16: t5 uint32: t6 uint64: t9 utf8_string: t2 } ",
+       "got the expected events - %s", mode_desc);
+
+    record = (record_s){ .skip_key = "map:" };
+    status = MMDB_walk_entry(&entry, &visitor, &record);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_walk_entry with a skipped key succeeded - %s", mode_desc);
+    is(record.events,
+       "{12 array: [3 t6 t6 t6 ] boolean: t14 bytes: t4 double: t3 float: t15 "
+       "int32: t8 map: uint128: t10 uint16: t5 uint32: t6 uint64: t9 "
+       "utf8_string: t2 } ",
+       "skipping a key skips its value - %s", mode_desc);
+
+    record = (record_s){ .skip_maps = 1 };
+    status = MMDB_walk_entry(&entry, &visitor, &record);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_walk_entry with a skipped map succeeded - %s", mode_desc);
+    is(record.events,
+       "{12 array: [3 t6 t6 t6 ] boolean: t14 bytes: t4 double: t3 float: t15 "
+       "int32: t8 map: {1 uint128: t10 uint16: t5 uint32: t6 uint64: t9 "
+       "utf8_string: t2 } ",
+       "skipping a map skips its contents and end_map - %s", mode_desc);
+
+    record = (record_s){ .stop_key = "float:" };
+    status = MMDB_walk_entry(&entry, &visitor, &record);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_walk_entry returns success when stopped - %s", mode_desc);
+    is(record.events,
+       "{12 array: [3 t6 t6 t6 ] boolean: t14 bytes: t4 double: t3 float: ",
+       "stopping ends the walk immediately - %s", mode_desc);
+
+    MMDB_visitor_s only_scalars = { .scalar = scalar };
+    record = (record_s){ .used = 0 };
+    status = MMDB_walk_entry(&entry, &only_scalars, &record);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_walk_entry with NULL callbacks succeeded - %s", mode_desc);
+    cmp_ok(record.scalars, "==", 17, "saw all 17 scalars - %s", mode_desc);
+
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+static void collect_scalars(MMDB_entry_data_node_s *nodes, uint32_t i,
+                            uint32_t *scalars, record_s *record, int *matches)
+{
+    uint32_t type = nodes[i].entry_data.type;
+    if (MMDB_DATA_TYPE_MAP != type && MMDB_DATA_TYPE_ARRAY != type) {
+        if (*scalars >= record->scalars
+            || record->scalar_offsets[*scalars] != nodes[i].entry_data.offset) {
+            *matches = 0;
+        }
+        (*scalars)++;
+        return;
+    }
+
+    uint32_t child = i + 1;
+    for (uint32_t n = 0; n < nodes[i].child_count; n++) {
+        /* Even children of a map are its keys */
+        if (MMDB_DATA_TYPE_ARRAY == type || n % 2) {
+            collect_scalars(nodes, child, scalars, record, matches);
+        }
+        child = nodes[child].subtree_end;
+    }
+}
+
+void test_matches_entry_data_array(const char *mode_desc, int mode)
+{
+    const char *filename = "GeoIP2-City-Test.mmdb";
+    const char *path = test_database_path(filename);
+    MMDB_s *mmdb = open_ok(path, mode, mode_desc);
+    free((void *)path);
+
+    MMDB_entry_s entry =
+        lookup_entry(mmdb, "81.2.69.160", filename, mode_desc);
+
+    MMDB_visitor_s only_scalars = { .scalar = scalar };
+    record_s record = { .used = 0 };
+    int status = MMDB_walk_entry(&entry, &only_scalars, &record);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_walk_entry succeeded - %s", mode_desc);
+
+    MMDB_entry_data_array_s *entry_data_array;
+    status = MMDB_get_entry_data_array(&entry, &entry_data_array);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "MMDB_get_entry_data_array succeeded - %s", mode_desc);
+
+    /* The array contains map keys as well as values, but the walker reports
+     * keys through a separate callback so we only compare the values. */
+    uint32_t scalars = 0;
+    int matches = 1;
+    collect_scalars(entry_data_array->nodes, 0, &scalars, &record, &matches);
+    ok(matches && scalars == record.scalars,
+       "walker saw the same scalars as the entry data array - %s", mode_desc);
+
+    MMDB_free_entry_data_array(entry_data_array);
+    MMDB_close(mmdb);
+    free(mmdb);
+}
+
+void run_tests(int mode, const char *mode_desc)
+{
+    test_decoder_events(mode_desc, mode);
+    test_matches_entry_data_array(mode_desc, mode);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    for_all_modes(&run_tests);
+    done_testing();
+}
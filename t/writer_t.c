@@ -0,0 +1,600 @@
+#define _GNU_SOURCE
+#include "maxminddb_test_helper.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#define STRING(s) { .type = MMDB_DATA_TYPE_UTF8_STRING, .utf8_string = (s), \
+                    .data_size = sizeof(s) - 1 }
+
+/* {"name":"network one","id":1,"tags":["x","y"]} */
+static const MMDB_entry_data_s small_record[] = {
+    { .type = MMDB_DATA_TYPE_MAP, .data_size = 3 },
+    STRING("name"), STRING("network one"),
+    STRING("id"), { .type = MMDB_DATA_TYPE_UINT32, .uint32 = 1 },
+    STRING("tags"), { .type = MMDB_DATA_TYPE_ARRAY, .data_size = 2 },
+    STRING("x"), STRING("y")
+};
+
+#define COUNT(values) ((uint32_t)(sizeof(values) / sizeof(values[0])))
+
+void all_types_record(MMDB_entry_data_s *values)
+{
+    uint32_t i = 0;
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_MAP, .data_size = 11
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("utf8_string");
+    values[i++] = (MMDB_entry_data_s)STRING("unicode! \xe2\x98\xaf");
+    values[i++] = (MMDB_entry_data_s)STRING("double");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_DOUBLE, .double_value = 42.123456
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("bytes");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_BYTES, .bytes = (const uint8_t *)"\0\0\0*",
+        .data_size = 4
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("uint16");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_UINT16, .uint16 = 100
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("uint32");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_UINT32, .uint32 = 268435456
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("int32");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_INT32, .int32 = -268435456
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("uint64");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_UINT64, .uint64 = 1152921504606846976ULL
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("uint128");
+    values[i].type = MMDB_DATA_TYPE_UINT128;
+#if MMDB_UINT128_IS_BYTE_ARRAY
+    memset(values[i].uint128, 0, 16);
+    values[i].uint128[0] = 1;
+#else
+    values[i].uint128 = (mmdb_uint128_t)1 << 120;
+#endif
+    i++;
+    values[i++] = (MMDB_entry_data_s)STRING("boolean");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_BOOLEAN, .boolean = true
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("float");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_FLOAT, .float_value = 1.1f
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("map");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_MAP, .data_size = 1
+    };
+    values[i++] = (MMDB_entry_data_s)STRING("empty");
+    values[i++] = (MMDB_entry_data_s) {
+        .type = MMDB_DATA_TYPE_ARRAY, .data_size = 0
+    };
+}
+#define ALL_TYPES_COUNT (25)
+
+void test_lookup(MMDB_s *mmdb, const char *ip, uint32_t expect_offset,
+                 uint16_t expect_netmask, const char *description)
+{
+    int gai_error, mmdb_error;
+    MMDB_lookup_result_s result =
+        MMDB_lookup_string(mmdb, ip, &gai_error, &mmdb_error);
+    cmp_ok(mmdb_error, "==", MMDB_SUCCESS, "looked up %s - %s", ip,
+           description);
+    if (UINT32_MAX == expect_offset) {
+        ok(!result.found_entry, "no data for %s - %s", ip, description);
+    } else {
+        ok(result.found_entry, "found data for %s - %s", ip, description);
+        cmp_ok(result.entry.offset, "==", expect_offset,
+               "%s has the expected record - %s", ip, description);
+    }
+    cmp_ok(result.netmask, "==", expect_netmask, "netmask for %s is %u - %s",
+           ip, expect_netmask, description);
+}
+
+/* The decoded record must have the same types and values as the ones it was
+ * written from */
+void test_round_trip(MMDB_s *mmdb, uint32_t offset,
+                     const MMDB_entry_data_s *values, uint32_t count,
+                     const char *description)
+{
+    MMDB_entry_s entry = { .mmdb = mmdb, .offset = offset };
+    MMDB_entry_data_list_s *list = NULL;
+    int status = MMDB_get_entry_data_list(&entry, &list);
+    cmp_ok(status, "==", MMDB_SUCCESS, "decoded the record - %s",
+           description);
+
+    uint32_t i = 0;
+    MMDB_entry_data_list_s *next = list;
+    for (; next && i < count; next = next->next, i++) {
+        MMDB_entry_data_s *got = &next->entry_data;
+        const MMDB_entry_data_s *expect = &values[i];
+        if (got->type != expect->type) {
+            break;
+        }
+        bool same = true;
+        switch (expect->type) {
+        case MMDB_DATA_TYPE_MAP:
+        case MMDB_DATA_TYPE_ARRAY:
+            same = got->data_size == expect->data_size;
+            break;
+        case MMDB_DATA_TYPE_UTF8_STRING:
+        case MMDB_DATA_TYPE_BYTES:
+            same = got->data_size == expect->data_size
+                   && !memcmp(got->bytes, expect->bytes, got->data_size);
+            break;
+        case MMDB_DATA_TYPE_DOUBLE:
+            same = got->double_value == expect->double_value;
+            break;
+        case MMDB_DATA_TYPE_FLOAT:
+            same = got->float_value == expect->float_value;
+            break;
+        case MMDB_DATA_TYPE_UINT16:
+            same = got->uint16 == expect->uint16;
+            break;
+        case MMDB_DATA_TYPE_UINT32:
+            same = got->uint32 == expect->uint32;
+            break;
+        case MMDB_DATA_TYPE_INT32:
+            same = got->int32 == expect->int32;
+            break;
+        case MMDB_DATA_TYPE_UINT64:
+            same = got->uint64 == expect->uint64;
+            break;
+        case MMDB_DATA_TYPE_UINT128:
+            same = !memcmp(&got->uint128, &expect->uint128,
+                           sizeof(got->uint128));
+            break;
+        case MMDB_DATA_TYPE_BOOLEAN:
+            same = got->boolean == expect->boolean;
+            break;
+        }
+        if (!same) {
+            break;
+        }
+    }
+    ok(NULL == next && i == count,
+       "the record decodes to the values it was written from - %s",
+       description);
+
+    MMDB_free_entry_data_list(list);
+}
+
+void test_ipv4(uint16_t record_size)
+{
+    char description[64];
+    snprintf(description, sizeof(description), "IPv4, %u bit records",
+             record_size);
+
+    MMDB_writer_s writer;
+    int status = MMDB_writer_init(&writer, 4, record_size);
+    cmp_ok(status, "==", MMDB_SUCCESS, "initialized the writer - %s",
+           description);
+    writer.metadata.database_type = "Writer-Test";
+    const char *languages[] = { "en", "zh" };
+    writer.metadata.languages.count = 2;
+    writer.metadata.languages.names = languages;
+    MMDB_description_s en = { "en", "A test database" };
+    MMDB_description_s *descriptions[] = { &en };
+    writer.metadata.description.count = 1;
+    writer.metadata.description.descriptions = descriptions;
+    writer.metadata.build_epoch = 1500000000;
+
+    uint32_t small, all_types, again;
+    status = MMDB_writer_add_record(&writer, small_record,
+                                    COUNT(small_record), &small);
+    cmp_ok(status, "==", MMDB_SUCCESS, "added a small record - %s",
+           description);
+    MMDB_entry_data_s values[ALL_TYPES_COUNT];
+    all_types_record(values);
+    status = MMDB_writer_add_record(&writer, values, ALL_TYPES_COUNT,
+                                    &all_types);
+    cmp_ok(status, "==", MMDB_SUCCESS, "added a record of every type - %s",
+           description);
+    uint32_t data_size = writer.data_size;
+    status = MMDB_writer_add_record(&writer, small_record,
+                                    COUNT(small_record), &again);
+    cmp_ok(status, "==", MMDB_SUCCESS, "added the small record again - %s",
+           description);
+    cmp_ok(again, "==", small, "the same record has the same offset - %s",
+           description);
+    cmp_ok(writer.data_size, "==", data_size,
+           "adding the same record again wrote nothing - %s", description);
+
+    insert_ok(&writer, "1.2.3.0", 24, small);
+    insert_ok(&writer, "1.2.3.128", 25, all_types);
+    insert_ok(&writer, "10.0.0.0", 8, small);
+    insert_ok(&writer, "192.168.0.0", 16, all_types);
+    /* This replaces the /16 */
+    insert_ok(&writer, "192.0.0.0", 8, small);
+
+    char path[32];
+    MMDB_s *mmdb = write_and_open(&writer, path, description);
+    cmp_ok(mmdb->metadata.record_size, "==", record_size,
+           "record_size in the metadata - %s", description);
+    cmp_ok(mmdb->metadata.node_count, "==", 35,
+           "the nodes replaced by 192.0.0.0/8 aren't written - %s",
+           description);
+    is(mmdb->metadata.database_type, "Writer-Test",
+       "database_type in the metadata - %s", description);
+    ok(2 == mmdb->metadata.languages.count
+       && !strcmp(mmdb->metadata.languages.names[1], "zh"),
+       "languages in the metadata - %s", description);
+    ok(1 == mmdb->metadata.description.count
+       && !strcmp(mmdb->metadata.description.descriptions[0]->description,
+                  "A test database"),
+       "description in the metadata - %s", description);
+    ok(1500000000 == mmdb->metadata.build_epoch,
+       "build_epoch in the metadata - %s", description);
+
+    test_lookup(mmdb, "1.2.3.4", small, 25, description);
+    test_lookup(mmdb, "1.2.3.200", all_types, 25, description);
+    test_lookup(mmdb, "10.20.30.40", small, 8, description);
+    test_lookup(mmdb, "11.0.0.1", UINT32_MAX, 8, description);
+    test_lookup(mmdb, "192.168.1.1", small, 8, description);
+
+    test_round_trip(mmdb, small, small_record, COUNT(small_record),
+                    description);
+    test_round_trip(mmdb, all_types, values, ALL_TYPES_COUNT, description);
+
+    close_and_remove(mmdb, path);
+    MMDB_writer_free(&writer);
+}
+
+void test_ipv6(void)
+{
+    MMDB_writer_s writer;
+    MMDB_writer_init(&writer, 6, 28);
+    writer.metadata.database_type = "Writer-Test";
+
+    uint32_t record;
+    MMDB_writer_add_record(&writer, small_record, COUNT(small_record),
+                           &record);
+    insert_ok(&writer, "::1.2.3.0", 120, record);
+    insert_ok(&writer, "2001:db8::", 32, record);
+
+    char path[32];
+    MMDB_s *mmdb = write_and_open(&writer, path, "IPv6");
+    test_lookup(mmdb, "1.2.3.4", record, 120, "IPv6");
+    test_lookup(mmdb, "2001:db8::1", record, 32, "IPv6");
+    test_lookup(mmdb, "2001:db9::1", UINT32_MAX, 32, "IPv6");
+
+    close_and_remove(mmdb, path);
+    MMDB_writer_free(&writer);
+}
+
+/* ::ffff:0:0/96 shares the IPv4 subtree, so a network inserted through
+ * either one is in both, and the shared nodes are only written once */
+void test_aliases(void)
+{
+    MMDB_writer_s writer;
+    MMDB_writer_init(&writer, 6, 24);
+    writer.metadata.database_type = "Writer-Test";
+
+    uint32_t record;
+    MMDB_writer_add_record(&writer, small_record, COUNT(small_record),
+                           &record);
+    insert_ok(&writer, "::1.2.3.0", 120, record);
+
+    uint8_t alias[16], target[16] = { 0 };
+    inet_pton(AF_INET6, "::ffff:0:0", alias);
+    int status = MMDB_writer_alias(&writer, alias, 96, target, 96);
+    cmp_ok(status, "==", MMDB_SUCCESS, "aliased ::ffff:0:0/96 to ::/96");
+    insert_ok(&writer, "::ffff:5.6.7.0", 120, record);
+
+    char path[32];
+    MMDB_s *mmdb = write_and_open(&writer, path, "aliases");
+    /* 96 nodes down to ::/96, 24 for 1.2.3.0/24, 18 more for 5.6.7.0/24,
+     * which shares the first 5 bits, and the 15 nodes of ::ffff:0:0/96 that
+     * aren't on the way to ::/96 */
+    cmp_ok(mmdb->metadata.node_count, "==", 96 + 24 + 18 + 15,
+           "the IPv4 subtree is written once");
+    test_lookup(mmdb, "::ffff:1.2.3.4", record, 120, "aliases");
+    test_lookup(mmdb, "1.2.3.4", record, 120, "aliases");
+    test_lookup(mmdb, "5.6.7.8", record, 120, "aliases");
+    test_lookup(mmdb, "::ffff:5.6.7.8", record, 120, "aliases");
+    test_lookup(mmdb, "::ffff:9.9.9.9", UINT32_MAX, 101, "aliases");
+    close_and_remove(mmdb, path);
+
+    inet_pton(AF_INET6, "::1.0.0.0", alias);
+    status = MMDB_writer_alias(&writer, alias, 104, target, 96);
+    cmp_ok(status, "==", MMDB_INVALID_NETWORK_ERROR,
+           "an alias inside its target is an error");
+    status = MMDB_writer_alias(&writer, alias, 104, target, 0);
+    cmp_ok(status, "==", MMDB_INVALID_NETWORK_ERROR,
+           "an alias of the whole tree is an error");
+
+    MMDB_writer_free(&writer);
+}
+
+/* With weights, the nodes on the way to the weighted address are written
+ * first, so the root's right record is node 1 */
+void test_weights(void)
+{
+    MMDB_writer_s writer;
+    MMDB_writer_init(&writer, 4, 24);
+    writer.metadata.database_type = "Writer-Test";
+
+    uint32_t record;
+    MMDB_writer_add_record(&writer, small_record, COUNT(small_record),
+                           &record);
+    insert_ok(&writer, "1.0.0.0", 16, record);
+    insert_ok(&writer, "200.1.0.0", 16, record);
+
+    char path[32];
+    MMDB_s *mmdb = write_and_open(&writer, path, "no weights");
+    MMDB_search_node_s node;
+    MMDB_read_node(mmdb, 0, &node);
+    cmp_ok(node.left_record, "==", 1,
+           "without weights the left child is next to the root");
+    close_and_remove(mmdb, path);
+
+    uint8_t address[4] = { 200, 1, 2, 3 };
+    int status = MMDB_writer_add_weight(&writer, address, 10);
+    cmp_ok(status, "==", MMDB_SUCCESS, "added a weight");
+    cmp_ok(writer.node_weights[0], "==", 10, "the root has the weight");
+
+    mmdb = write_and_open(&writer, path, "weights");
+    cmp_ok(mmdb->metadata.node_count, "==", 31,
+           "weights don't change the number of nodes");
+    MMDB_read_node(mmdb, 0, &node);
+    cmp_ok(node.right_record, "==", 1,
+           "with weights the heavier right child is next to the root");
+    MMDB_read_node(mmdb, 15, &node);
+    ok(MMDB_RECORD_TYPE_DATA == node.right_record_type
+       || MMDB_RECORD_TYPE_DATA == node.left_record_type,
+       "the weighted path is the first 16 nodes");
+    test_lookup(mmdb, "200.1.2.3", record, 16, "weights");
+    test_lookup(mmdb, "1.0.2.3", record, 16, "weights");
+    test_lookup(mmdb, "2.0.2.3", UINT32_MAX, 7, "weights");
+    close_and_remove(mmdb, path);
+
+    MMDB_writer_free(&writer);
+}
+
+/* A value that was already written is replaced by a pointer, but only when
+ * the pointer is smaller */
+void test_compact(void)
+{
+    MMDB_writer_s writer;
+    MMDB_writer_init(&writer, 4, 24);
+    writer.metadata.database_type = "Writer-Test";
+
+    uint32_t a, b;
+    MMDB_writer_add_record(&writer, small_record, COUNT(small_record), &a);
+    MMDB_entry_data_s other = { .type = MMDB_DATA_TYPE_UINT32, .uint32 = 2 };
+    MMDB_writer_add_record(&writer, &other, 1, &b);
+
+    insert_ok(&writer, "10.1.0.0", 24, a);
+    insert_ok(&writer, "10.1.1.0", 24, b);
+    insert_ok(&writer, "10.2.0.0", 24, a);
+    insert_ok(&writer, "10.2.1.0", 24, b);
+    insert_ok(&writer, "10.3.0.0", 24, a);
+    insert_ok(&writer, "10.3.1.0", 24, a);
+
+    char path[32];
+    MMDB_s *mmdb = write_and_open(&writer, path, "before compacting");
+    /* 15 nodes down to 10.0.0.0/15, 2 for the three /16s and 8 under each
+     * of them */
+    cmp_ok(mmdb->metadata.node_count, "==", 15 + 2 + 3 * 8,
+           "node count before compacting");
+    close_and_remove(mmdb, path);
+
+    int status = MMDB_writer_compact(&writer, 0);
+    cmp_ok(status, "==", MMDB_SUCCESS, "compacted the tree");
+    mmdb = write_and_open(&writer, path, "compacted");
+    cmp_ok(mmdb->metadata.node_count, "==", 15 + 2 + 2 * 8,
+           "10.1.0.0/16 and 10.2.0.0/16 share their nodes");
+    test_lookup(mmdb, "10.1.0.1", a, 24, "compacted");
+    test_lookup(mmdb, "10.1.1.1", b, 24, "compacted");
+    test_lookup(mmdb, "10.2.0.1", a, 24, "compacted");
+    test_lookup(mmdb, "10.2.1.1", b, 24, "compacted");
+    test_lookup(mmdb, "10.3.1.1", a, 24, "compacted");
+    test_lookup(mmdb, "10.2.2.1", UINT32_MAX, 23, "compacted");
+    close_and_remove(mmdb, path);
+
+    status = MMDB_writer_compact(&writer, MMDB_WRITER_COMPACT_MERGE_NETWORKS);
+    cmp_ok(status, "==", MMDB_SUCCESS, "compacted the tree merging networks");
+    mmdb = write_and_open(&writer, path, "merged");
+    cmp_ok(mmdb->metadata.node_count, "==", 15 + 2 + 2 * 8 - 1,
+           "10.3.0.0/24 and 10.3.1.0/24 are one network");
+    test_lookup(mmdb, "10.3.0.1", a, 23, "merged");
+    test_lookup(mmdb, "10.3.1.1", a, 23, "merged");
+    test_lookup(mmdb, "10.1.1.1", b, 24, "merged");
+    close_and_remove(mmdb, path);
+
+    MMDB_writer_free(&writer);
+
+    /* A copy of the IPv4 subtree, rather than an alias of it, must still
+     * be iterated over */
+    MMDB_writer_init(&writer, 6, 24);
+    writer.metadata.database_type = "Writer-Test";
+    MMDB_writer_add_record(&writer, small_record, COUNT(small_record), &a);
+    insert_ok(&writer, "::1.2.3.0", 120, a);
+    insert_ok(&writer, "::ffff:1.2.3.0", 120, a);
+
+    status = MMDB_writer_compact(&writer, 0);
+    cmp_ok(status, "==", MMDB_SUCCESS, "compacted an IPv6 tree");
+    mmdb = write_and_open(&writer, path, "IPv4 copy");
+    /* 120 nodes down to ::1.2.3.0/120 and 16 from where ::ffff:0:0/96
+     * branches off down to ::ffff:0:0/96 itself. Everything under that is
+     * shared with ::/96. */
+    cmp_ok(mmdb->metadata.node_count, "==", 120 + 16,
+           "the copy shares every node below ::ffff:0:0/96");
+    test_lookup(mmdb, "::ffff:1.2.3.4", a, 120, "IPv4 copy");
+
+    MMDB_network_iterator_s iterator;
+    MMDB_network_iterator_init(mmdb, 0, &iterator);
+    MMDB_network_s network;
+    bool found_network;
+    int count = 0;
+    while (MMDB_SUCCESS == MMDB_network_iterator_next(&iterator, &network,
+                                                      &found_network)
+           && found_network) {
+        count++;
+    }
+    cmp_ok(count, "==", 2, "the copy is not mistaken for an alias");
+    close_and_remove(mmdb, path);
+
+    MMDB_writer_free(&writer);
+
+    /* Both halves of the IPv4 subtree have the same record, but ::/96 is
+     * where IPv4 lookups and the alias start, so it isn't merged away */
+    MMDB_writer_init(&writer, 6, 24);
+    writer.metadata.database_type = "Writer-Test";
+    MMDB_writer_add_record(&writer, small_record, COUNT(small_record), &a);
+    insert_ok(&writer, "::0.0.0.0", 97, a);
+    insert_ok(&writer, "::128.0.0.0", 97, a);
+    uint8_t alias[16], target[16] = { 0 };
+    inet_pton(AF_INET6, "::ffff:0:0", alias);
+    MMDB_writer_alias(&writer, alias, 96, target, 96);
+
+    status = MMDB_writer_compact(&writer, MMDB_WRITER_COMPACT_MERGE_NETWORKS);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "compacted an IPv6 tree merging networks");
+    mmdb = write_and_open(&writer, path, "merged IPv4 subtree");
+    cmp_ok(mmdb->metadata.node_count, "==", 97 + 15,
+           "the IPv4 start node is kept");
+    test_lookup(mmdb, "1.2.3.4", a, 97, "merged IPv4 subtree");
+    test_lookup(mmdb, "::ffff:200.0.0.1", a, 97, "merged IPv4 subtree");
+    test_lookup(mmdb, "::1:0:0", UINT32_MAX, 96, "merged IPv4 subtree");
+    close_and_remove(mmdb, path);
+
+    MMDB_writer_free(&writer);
+}
+
+void test_deduplication(void)
+{
+    MMDB_writer_s writer;
+    MMDB_writer_init(&writer, 4, 24);
+
+    MMDB_entry_data_s twice[] = {
+        { .type = MMDB_DATA_TYPE_MAP, .data_size = 3 },
+        STRING("a"), STRING("a string of 20 bytes"),
+        STRING("b"), STRING("a string of 20 bytes"),
+        STRING("c"), STRING("a")
+    };
+    uint32_t record;
+    int status = MMDB_writer_add_record(&writer, twice, COUNT(twice),
+                                        &record);
+    cmp_ok(status, "==", MMDB_SUCCESS, "added a record with a string twice");
+    /* The map, "a" and the string, "b" and a pointer, and "c" and "a" */
+    cmp_ok(writer.data_size, "==", 1 + 2 + 21 + 2 + 2 + 2 + 2,
+           "the second copy of the string is a pointer");
+
+    MMDB_entry_data_s other[] = {
+        { .type = MMDB_DATA_TYPE_MAP, .data_size = 1 },
+        STRING("d"), STRING("a string of 20 bytes")
+    };
+    uint32_t data_size = writer.data_size;
+    MMDB_writer_add_record(&writer, other, COUNT(other), &record);
+    cmp_ok(writer.data_size - data_size, "==", 1 + 2 + 2,
+           "a string from another record is a pointer");
+
+    MMDB_writer_free(&writer);
+}
+
+void test_errors(void)
+{
+    MMDB_writer_s writer;
+    int status = MMDB_writer_init(&writer, 5, 24);
+    cmp_ok(status, "==", MMDB_INVALID_METADATA_ERROR,
+           "an ip_version of 5 is an error");
+    status = MMDB_writer_init(&writer, 4, 26);
+    cmp_ok(status, "==", MMDB_UNKNOWN_DATABASE_FORMAT_ERROR,
+           "a record size of 26 is an error");
+
+    MMDB_writer_init(&writer, 4, 24);
+    MMDB_entry_data_s number_key[] = {
+        { .type = MMDB_DATA_TYPE_MAP, .data_size = 1 },
+        { .type = MMDB_DATA_TYPE_UINT32, .uint32 = 1 }, STRING("a")
+    };
+    uint32_t record;
+    status = MMDB_writer_add_record(&writer, number_key, COUNT(number_key),
+                                    &record);
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "a map key must be a string");
+    status = MMDB_writer_add_record(&writer, small_record,
+                                    COUNT(small_record) - 1, &record);
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "a map that is missing a value is an error");
+    status = MMDB_writer_add_record(&writer, &small_record[1], 2, &record);
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "two values that aren't in a map or array are an error");
+    MMDB_entry_data_s pointer[] = {
+        { .type = MMDB_DATA_TYPE_POINTER, .pointer = 0 }
+    };
+    status = MMDB_writer_add_record(&writer, pointer, 1, &record);
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR, "a pointer is an error");
+    cmp_ok(writer.data_size, "==", 0, "nothing was written for the errors");
+
+    uint8_t address[16] = { 0 };
+    MMDB_writer_add_record(&writer, small_record, COUNT(small_record),
+                           &record);
+    status = MMDB_writer_insert(&writer, address, 33, record);
+    cmp_ok(status, "==", MMDB_INVALID_NETWORK_ERROR,
+           "a /33 in an IPv4 database is an error");
+    status = MMDB_writer_insert(&writer, address, 8, writer.data_size);
+    cmp_ok(status, "==", MMDB_INVALID_DATA_ERROR,
+           "a record past the end of the data section is an error");
+
+    FILE *stream = tmpfile();
+    status = MMDB_writer_write(&writer, stream);
+    cmp_ok(status, "==", MMDB_INVALID_METADATA_ERROR,
+           "the database_type has to be set");
+
+    /* 24-bit records can't point at data past 16MB */
+    MMDB_entry_data_s bytes = {
+        .type = MMDB_DATA_TYPE_BYTES, .data_size = 1 << 24,
+        .bytes = calloc(1 << 24, 1)
+    };
+    MMDB_writer_add_record(&writer, &bytes, 1, &record);
+    writer.metadata.database_type = "Writer-Test";
+    status = MMDB_writer_write(&writer, stream);
+    cmp_ok(status, "==", MMDB_DATABASE_TOO_BIG_ERROR,
+           "too much data for 24-bit records is an error");
+    is(MMDB_strerror(status),
+       "The database has too many nodes or too much data for its record size",
+       "MMDB_strerror for MMDB_DATABASE_TOO_BIG_ERROR");
+    fclose(stream);
+    free((void *)bytes.bytes);
+
+    MMDB_writer_free(&writer);
+
+    /* A longer alias would put the target's networks past bit 128 */
+    MMDB_writer_init(&writer, 6, 24);
+    writer.metadata.database_type = "Writer-Test";
+    MMDB_writer_add_record(&writer, small_record, COUNT(small_record),
+                           &record);
+    insert_ok(&writer, "a000::", 64, record);
+    uint8_t alias[16] = { 0 }, target[16] = { 0xa0 };
+    status = MMDB_writer_alias(&writer, alias, 120, target, 8);
+    cmp_ok(status, "==", MMDB_INVALID_NETWORK_ERROR,
+           "an alias longer than its target is an error");
+    stream = tmpfile();
+    status = MMDB_writer_write(&writer, stream);
+    cmp_ok(status, "==", MMDB_SUCCESS,
+           "the database is written without the alias");
+    fclose(stream);
+    MMDB_writer_free(&writer);
+}
+
+int main(void)
+{
+    plan(NO_PLAN);
+    test_ipv4(24);
+    test_ipv4(28);
+    test_ipv4(32);
+    test_ipv6();
+    test_aliases();
+    test_weights();
+    test_compact();
+    test_deduplication();
+    test_errors();
+    done_testing();
+}